@@ -81,7 +81,6 @@ extern "C" void app_main(void) {
             held_since = std::nullopt;
         }
 
-        using namespace std::chrono_literals;
-        std::this_thread::sleep_for(100ms);
+        charger->waitForNextStep();
     }
 }
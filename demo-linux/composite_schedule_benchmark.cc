@@ -0,0 +1,139 @@
+#include "openocpp/implementation/platform_posix.h"
+#include "openocpp/implementation/loopback_csms.h"
+#include "openocpp/implementation/station_posix.h"
+#include "openocpp/implementation/station_simulator.h"
+#include "openocpp/module/power_management_module1_6.h"
+#include "openocpp/common/logging.h"
+
+#include <chrono>
+#include <string>
+#include <iostream>
+#include <filesystem>
+
+namespace {
+    constexpr int kConnectors = 20;
+    constexpr int kProfiles = 10;
+    constexpr int kPeriods = 48;
+    constexpr int kPeriodSeconds = 30*60;
+    constexpr int kCompositeDurationSeconds = 24*60*60;
+    constexpr int kIterations = 50;
+    constexpr int kMillisPerMinute = 60*1000;
+
+    template <typename Callable>
+    double timeMicros(int iterations, Callable&& callable) {
+        auto const start = std::chrono::steady_clock::now();
+        for (int i=0; i < iterations; i++)
+            callable();
+
+        auto const elapsed = std::chrono::steady_clock::now() - start;
+        return (double)std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() / iterations;
+    }
+
+    chargelab::ocpp1_6::SetChargingProfileReq makeProfile(int index, chargelab::SystemTimeMillis midnight) {
+        using namespace chargelab;
+
+        // Two ChargePointMaxProfiles, then TxDefaultProfiles spread over the station and individual connectors
+        auto const purpose = index < 2 ?
+                ocpp1_6::ChargingProfilePurposeType::kChargePointMaxProfile :
+                ocpp1_6::ChargingProfilePurposeType::kTxDefaultProfile;
+        auto const connector_id = (index < 2 || index % 3 == 0) ? 0 : index;
+
+        std::vector<ocpp1_6::ChargingSchedulePeriod> periods;
+        for (int i=0; i < kPeriods; i++)
+            periods.push_back(ocpp1_6::ChargingSchedulePeriod {i*kPeriodSeconds, (double)(6 + (index*7 + i*5) % 40)});
+
+        return ocpp1_6::SetChargingProfileReq {
+                connector_id,
+                ocpp1_6::ChargingProfile {
+                        100 + index,
+                        std::nullopt,
+                        index,
+                        purpose,
+                        ocpp1_6::ChargingProfileKindType::kRecurring,
+                        ocpp1_6::RecurrencyKindType::kDaily,
+                        std::nullopt,
+                        std::nullopt,
+                        ocpp1_6::ChargingSchedule {
+                                std::nullopt,
+                                ocpp1_6::DateTime(midnight),
+                                ocpp1_6::ChargingRateUnitType::kA,
+                                std::move(periods),
+                                std::nullopt
+                        }
+                }
+        };
+    }
+}
+
+// Measures the OCPP 1.6 composite schedule calculation on a station with kConnectors connectors and kProfiles
+// recurring profiles of kPeriods periods each.
+int main(int argc, char** argv) {
+    using namespace chargelab;
+
+    std::string const storage_directory = argc > 1 ? argv[1] : "openocpp-benchmark-data";
+    std::filesystem::remove_all(storage_directory);
+    std::filesystem::create_directories(storage_directory);
+    logging::SetLogLevel(logging::LogLevel::warning);
+
+    auto platform = std::make_shared<PlatformPOSIX>(storage_directory, 0);
+    auto settings = platform->getSettings();
+    settings->MaxChargingProfilesInstalled.setValue(kProfiles);
+    settings->ChargeProfileMaxStackLevel.setValue(kProfiles);
+
+    auto csms = std::make_shared<LoopbackCsms>(platform, "ocpp1.6");
+    platform->setCsms(csms);
+
+    auto station = std::make_shared<StationSimulator<StationPOSIX>>(platform, storage_directory);
+    station->updateState([&](detail::SimulatorState& state) {
+        for (int i=1; i <= kConnectors; i++) {
+            state.evse_metadata[ocpp2_0::EVSEType {i}] = charger::EvseMetadata {1, 10560.0};
+            state.connector_metadata[ocpp2_0::EVSEType {i, 1}] = charger::ConnectorMetadata {i, "cType1", 1, 10560.0, 48};
+        }
+    });
+
+    PowerManagementModule1_6 module {settings, platform, station, platform->getPartition("pmjournal")};
+    auto const implementations = module.getImplementations();
+    auto& handler = *implementations.ocpp1_6.request_handler;
+    auto& service = *implementations.ocpp1_6.service;
+    ocpp1_6::OcppRemote remote {*csms->connection(), []() {return true;}, [](auto const&, auto const&) {return true;}};
+
+    auto const now = platform->systemClockNow();
+    auto const midnight = (SystemTimeMillis)(now - now % (24*60*kMillisPerMinute));
+    for (int i=0; i < kProfiles; i++) {
+        // Note: letting the simulated clock run so the flash write rate limit doesn't reject the profile
+        platform->waitForWakeup(60*kMillisPerMinute);
+
+        auto const response = handler.onSetChargingProfileReq(makeProfile(i, midnight));
+        if (!response.has_value() || !std::holds_alternative<ocpp1_6::SetChargingProfileRsp>(response.value()) ||
+            std::get<ocpp1_6::SetChargingProfileRsp>(response.value()).status != ocpp1_6::ChargingProfileStatus::kAccepted)
+        {
+            std::cerr << "Charging profile " << i << " was not accepted\n";
+            return 1;
+        }
+    }
+
+    auto const compositeForAllConnectors = [&]() {
+        for (int connector=0; connector <= kConnectors; connector++)
+            handler.onGetCompositeScheduleReq(ocpp1_6::GetCompositeScheduleReq {connector, kCompositeDurationSeconds});
+    };
+
+    // Moving the clock by a day forces the schedules to be calculated again
+    auto const cold = timeMicros(kIterations, [&]() {
+        platform->waitForWakeup(kCompositeDurationSeconds*1000);
+        compositeForAllConnectors();
+    });
+    auto const warm = timeMicros(kIterations, compositeForAllConnectors);
+
+    // Station updates over a day, one step per simulated minute
+    auto const steps = timeMicros(24*60, [&]() {
+        platform->waitForWakeup(kMillisPerMinute);
+        service.runStep(remote);
+    });
+
+    std::cout << kConnectors << " connectors x " << kProfiles << " profiles x " << kPeriods << " periods\n"
+              << "  GetCompositeSchedule for all connectors after clock change: " << cold << "us\n"
+              << "  GetCompositeSchedule for all connectors, unchanged profiles: " << warm << "us\n"
+              << "  runStep, one per simulated minute: " << steps << "us\n";
+
+    return 0;
+}
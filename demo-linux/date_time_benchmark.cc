@@ -0,0 +1,487 @@
+#include "openocpp/protocol/common/date_time.h"
+#include "openocpp/helpers/binary.h"
+#include "openocpp/common/logging.h"
+
+#include <new>
+#include <ctime>
+#include <chrono>
+#include <random>
+#include <regex>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <iostream>
+
+namespace {
+    constexpr int kTexts = 1000;
+    constexpr int kIterations = 200;
+    constexpr int kRounds = 5;
+    constexpr int kFuzzCases = 200000;
+    constexpr std::int64_t kMinTimestamp = -62135596800000; // 0001-01-01T00:00:00Z
+    constexpr std::int64_t kMaxTimestamp = 253402300799999; // 9999-12-31T23:59:59.999Z
+
+    std::size_t gAllocations = 0;
+}
+
+void* operator new(std::size_t size) {
+    gAllocations++;
+    if (auto result = std::malloc(size == 0 ? 1 : size))
+        return result;
+
+    throw std::bad_alloc {};
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+
+namespace {
+    using namespace chargelab;
+
+    // The gmtime/sprintf and sscanf based codec DateTime used before, kept as the reference for the equivalence check
+    class PreviousDateTime {
+        static constexpr int kMilliSecondSize = 3;
+
+    public:
+        PreviousDateTime() = default;
+        explicit PreviousDateTime(std::string text) : text_(text), timestamp_(textToTimestamp(text)) {
+        }
+
+        [[nodiscard]] std::optional<std::string> getText() const {
+            return text_;
+        }
+
+        [[nodiscard]] std::optional<SystemTimeMillis> getTimestamp() const {
+            return timestamp_;
+        }
+
+        static void write_json(json::JsonWriter& writer, PreviousDateTime const& value) {
+            if (value.text_.has_value()) {
+                writer.String(value.text_.value());
+            } else {
+                writer.Null();
+            }
+        }
+
+        static bool read_json(json::JsonReader& reader, PreviousDateTime& value) {
+            auto const token = reader.nextToken();
+            if (!token.has_value())
+                return false;
+            if (!std::holds_alternative<json::StringType>(token.value()))
+                return false;
+
+            auto const& text = std::get<json::StringType>(token.value());
+            value.text_ = std::string{text.str, text.length};
+            value.timestamp_ = textToTimestamp(value.text_.value());
+            return true;
+        }
+
+        static std::optional<std::string> timestampToText(SystemTimeMillis const& timestamp) {
+            time_t time = timestamp/1000;
+            int millisecond = timestamp%1000;
+            if (millisecond < 0) {  // adjust the minus value to be positive, borrow 1 second
+                time -= 1;
+                millisecond += 1000;
+            }
+
+            auto tm = gmtime(&time);
+            char buf[100]{};
+            sprintf(buf, "%04d-%02d-%02dT%02d:%02d:%02dZ", tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday,
+                    tm->tm_hour, tm->tm_min, tm->tm_sec);
+            return std::string(buf);
+        }
+
+        static std::optional<SystemTimeMillis> textToTimestamp(std::string const& text) {
+            auto text2 = removeExcessiveFractionDigits(text);
+            auto timezone_minutes = retrieveTimezoneMinutes(text2);
+            if (!timezone_minutes.has_value()) {
+                CHARGELAB_LOG_MESSAGE(error) << "wrong time zone format:" << text;
+                return std::nullopt;
+            }
+            // "2022-12-17T14:37:09.894Z"
+            auto tm = parseTm(text2);
+            if (tm) {
+                std::int64_t ret = timegm2(&tm.value());  // timegm() is not supported by ESP32
+                ret -= timezone_minutes.value() * 60;
+                return static_cast<SystemTimeMillis>(ret * 1000 + retrieveMillisecond(text2));
+            }
+            CHARGELAB_LOG_MESSAGE(error) << "wrong date time format:" << text;
+            return std::nullopt;
+        }
+    private:
+        static std::string removeExcessiveFractionDigits(std::string const& time_text) {
+            int pos = time_text.find('.');
+            if (pos == -1) return time_text;
+            int decimal_digit_count = 0;
+            unsigned int i = pos + 1;
+            while (i < time_text.length() && decimal_digit_count < kMilliSecondSize) {
+                if (!std::isdigit(time_text[i])) break;
+                ++decimal_digit_count;
+                ++i;
+            }
+            if (decimal_digit_count == kMilliSecondSize) {
+                auto start = i;
+                while (i < time_text.length()) {
+                    if (!std::isdigit(time_text[i])) break;
+                    ++i;
+                }
+                if (start != i) {
+                    return time_text.substr(0, start) + time_text.substr(i);
+                }
+            }
+            return time_text;
+        }
+
+        static int retrieveMillisecond(std::string const& timestamp) {
+            auto find = timestamp.find('.');
+            if (find == std::string::npos) {
+                return 0;
+            }
+
+            int milliseconds = 0;
+            unsigned int multiplier = 100;
+            for (unsigned int i = find+1; i < timestamp.length(); ++i) {
+                if (!std::isdigit(timestamp[i])) break;
+                milliseconds += (timestamp[i] - '0') * multiplier;
+                multiplier /= 10;
+            }
+
+            return milliseconds;
+        }
+
+        // timestamp: e.g. "2022-10-17T14:37:09.894+03:00" https://www.w3.org/TR/NOTE-datetime
+        static std::optional<int> retrieveTimezoneMinutes(std::string & timestamp) {
+            auto find = timestamp.find('Z');
+            if (find != std::string::npos) {
+                timestamp = timestamp.substr(0, find); // ignore anything after 'Z'
+                return 0;
+            }
+
+            bool negative = false;
+            find = timestamp.find('+');
+            if (find == std::string::npos) {
+                find = timestamp.rfind('-');
+                negative = true;
+            }
+            if (find == std::string::npos) return std::nullopt;
+
+            int hour = 0;
+            int minute = 0;
+
+            auto find2 = timestamp.find(':', find);
+            if (find2 == std::string::npos) {   // only have hours
+                if (sscanf(timestamp.c_str() + find + 1, "%2d", &hour) != 1) return std::nullopt;
+            } else {
+                if (sscanf(timestamp.c_str() + find + 1, "%2d:%2d", &hour, &minute) != 2) return std::nullopt;
+            }
+
+            timestamp = timestamp.substr(0, find);  // remove timezone from the timestamp for future process
+            return (hour*60 + minute)*(negative ? -1 : 1);
+        }
+
+        static std::optional<std::tm> parseTm(std::string const& timestamp) {
+            int year, month, day, hour, minute, second;
+
+            if (sscanf(timestamp.c_str(), "%4d-%2d-%2dT%2d:%2d:%2d", &year, &month, &day, &hour, &minute, &second) != 6) {
+                return std::nullopt;
+            }
+            //
+            if (month < 1 || month > 12 || day < 1 || day > getDaysOfMonth(year, month) || hour < 0 || hour >= 24 ||
+                minute < 0 || minute >= 60 || second < 0 || second >= 60) { // no leap seconds supported
+                return std::nullopt;
+            }
+
+            std::tm tm{};
+
+            tm.tm_sec = second;
+            tm.tm_min = minute;
+            tm.tm_hour = hour;
+            tm.tm_mday = day;
+            tm.tm_mon = month-1;
+            tm.tm_year = year-1900;
+
+            return tm;
+        };
+
+        static std::time_t timegm2(std::tm const *tm) {
+            if (tm == nullptr) return -1;
+            if (tm->tm_mon >= 12 || tm->tm_hour >= 24 || tm->tm_min >= 60 || tm->tm_sec >= 61) {
+                return -1;
+            }
+            if (getDaysOfMonth(tm->tm_year + 1900, tm->tm_mon + 1) == -1) {
+                return -1;
+            }
+
+            // get the day to the tm date since 1900-01-01 00:00:00 +0000, UTC instead of the Epoch (1970-01-01 00:00:00 +0000, UTC)
+            std::int64_t total_days = 0; //
+            int year = tm->tm_year + 1900;
+
+            auto const year_since_epch = year - 1970;
+
+            int leap_years = totalLeapYears(year - 1) - totalLeapYears(1970);
+
+            total_days = year_since_epch*365 + leap_years;
+
+            for (int i = 0; i < tm->tm_mon; ++i) {
+                total_days += getDaysOfMonth(year, i+1);
+            }
+            total_days += tm->tm_mday - 1;  // tm_mday is 1-31
+            std::int64_t total_hours = total_days*24 + tm->tm_hour;
+            std::time_t total_seconds = (total_hours*60 + tm->tm_min)*60 + tm->tm_sec;
+
+            return total_seconds /*+ kSecondsFrom1990*/;
+        }
+
+        static bool isLeapYear(unsigned int year) {
+            return (year%4 == 0) && (!(year%100 == 0) || (year%400 == 0));
+        }
+        // month: 1-based
+        static int getDaysOfMonth(unsigned int year, int month) {
+            switch (month) {
+                case 1:
+                case 3:
+                case 5:
+                case 7:
+                case 8:
+                case 10:
+                case 12:
+                    return 31;
+                case 4:
+                case 6:
+                case 9:
+                case 11:
+                    return 30;
+                case 2:
+                    return isLeapYear(year) ? 29 : 28;
+                default:
+                    return -1;
+            }
+        }
+
+        static int totalLeapYears(int year) {
+            return year/4 - year/100 + year/400;
+        }
+
+    private:
+        std::optional<std::string> text_ = std::nullopt;
+        std::optional<SystemTimeMillis> timestamp_ = std::nullopt;
+    };
+
+    // RFC 3339 date-time, as an oracle for the inputs the two parsers are expected to disagree on
+    std::regex const kRfc3339 {R"(^\d{4}-\d{2}-\d{2}[Tt]\d{2}:\d{2}:\d{2}(\.\d+)?([Zz]|[+-]([01]\d|2[0-3]):[0-5]\d)$)"};
+
+    // Note: digits past milliseconds are random when sub_millisecond_digits is set, and otherwise zero
+    std::string makeText(std::mt19937_64& random, std::int64_t timestamp, bool sub_millisecond_digits) {
+        auto const offset_minutes = (int)(random()%3) == 0 ? 0 : (int)(random()%(2*14*60 + 1)) - 14*60;
+        auto text = common::DateTime::timestampToText((SystemTimeMillis)(timestamp + offset_minutes*60*1000)).value();
+        text.pop_back();
+
+        auto const fraction_digits = random()%10;
+        if (fraction_digits > 0) {
+            text += ".";
+            auto const milliseconds = (unsigned)(((timestamp%1000) + 1000)%1000);
+            char millis[4];
+            std::snprintf(millis, sizeof(millis), "%03u", milliseconds);
+            for (unsigned i=0; i < fraction_digits; i++)
+                text += i < 3 ? millis[i] : (sub_millisecond_digits && random()%4 == 0 ? (char)('0' + random()%10) : '0');
+        }
+
+        if (offset_minutes == 0 && random()%2 == 0) {
+            text += "Z";
+        } else {
+            char zone[8];
+            std::snprintf(zone, sizeof(zone), "%c%02d:%02d", offset_minutes < 0 ? '-' : '+',
+                          std::abs(offset_minutes)/60, std::abs(offset_minutes)%60);
+            text += zone;
+        }
+
+        return text;
+    }
+
+    std::string mutate(std::mt19937_64& random, std::string text) {
+        static char const kCharacters[] = "0123456789-:.+TtZz x";
+        auto const edits = 1 + random()%3;
+        for (unsigned i=0; i < edits && !text.empty(); i++) {
+            auto const position = random()%text.size();
+            auto const character = kCharacters[random()%(sizeof(kCharacters) - 1)];
+            switch (random()%4) {
+                case 0: text[position] = character; break;
+                case 1: text.erase(position, 1); break;
+                case 2: text.insert(text.begin() + (long)position, character); break;
+                default: text.resize(position); break;
+            }
+        }
+
+        return text;
+    }
+
+    // Compares formatting and parsing against the previous codec; returns the number of unexpected differences
+    int checkEquivalence() {
+        std::mt19937_64 random {1709287200};
+        std::uniform_int_distribution<std::int64_t> timestamps {kMinTimestamp, kMaxTimestamp};
+        std::uniform_int_distribution<std::int64_t> recent {946684800000, 4102444800000}; // 2000 to 2100
+
+        int mismatches = 0;
+        int formatted = 0, parsed = 0, agreed = 0, lenient = 0, lowercase = 0;
+        auto const report = [&](char const* what, std::string const& text) {
+            if (mismatches++ < 10)
+                std::cout << "  mismatch (" << what << "): " << text << "\n";
+        };
+
+        for (int i=0; i < kFuzzCases; i++) {
+            auto const timestamp = i%2 == 0 ? timestamps(random) : recent(random);
+            auto const expected = PreviousDateTime::timestampToText((SystemTimeMillis)timestamp);
+            if (common::DateTime::timestampToText((SystemTimeMillis)timestamp) != expected ||
+                common::DateTime {(SystemTimeMillis)timestamp}.getText() != expected)
+            {
+                report("format", expected.value_or(""));
+            }
+            formatted++;
+
+            auto const text = makeText(random, timestamp, true);
+            PreviousDateTime const previous {text};
+            common::DateTime const current {text};
+            if (current.getTimestamp() != previous.getTimestamp() || current.getText() != text)
+                report("parse", text);
+            parsed++;
+
+            // Binary round trip, as used by the offline message queue
+            std::string binary;
+            binary::Writer writer {binary};
+            common::DateTime::write_binary(writer, current);
+            binary::Reader reader {binary};
+            common::DateTime decoded;
+            if (!common::DateTime::read_binary(reader, decoded) || decoded.getText() != current.getText() ||
+                decoded.getTimestamp() != current.getTimestamp())
+            {
+                report("binary", text);
+            }
+
+            // Damaged text: the parsers only differ where the old one accepted text that isn't RFC 3339 (one digit
+            // fields, trailing characters after Z, offsets without minutes) or the new one accepts lowercase t/z
+            auto const damaged = mutate(random, text);
+            PreviousDateTime const previous_damaged {damaged};
+            common::DateTime const current_damaged {damaged};
+            auto const rfc3339 = std::regex_match(damaged, kRfc3339);
+            if (current_damaged.getText() != damaged) {
+                report("verbatim", damaged);
+            } else if (current_damaged.getTimestamp() == previous_damaged.getTimestamp()) {
+                agreed++;
+            } else if (!current_damaged.getTimestamp().has_value() && !rfc3339) {
+                lenient++;
+            } else if (!previous_damaged.getTimestamp().has_value() && rfc3339 &&
+                       damaged.find_first_of("tz") != std::string::npos)
+            {
+                lowercase++;
+            } else {
+                report("damaged", damaged);
+            }
+        }
+
+        std::cout << "Equivalence with the previous codec:\n"
+                  << "  " << formatted << " timestamps formatted, " << parsed << " texts parsed and round tripped\n"
+                  << "  " << kFuzzCases << " damaged texts: " << agreed << " agreed, " << lenient
+                  << " non-RFC 3339 texts accepted only by the previous parser, " << lowercase
+                  << " lowercase texts accepted only by the new one\n"
+                  << "  unexpected differences: " << mismatches << "\n";
+        return mismatches;
+    }
+
+    struct Result {
+        double nanoseconds = 0;
+        double allocations = 0;
+    };
+
+    // Best time per operation over kRounds rounds of kIterations passes over the kTexts inputs
+    template <typename Callable>
+    Result measure(Callable&& callable) {
+        Result result {1e300, 0};
+        for (int round=0; round < kRounds; round++) {
+            auto const allocations = gAllocations;
+            auto const start = std::chrono::steady_clock::now();
+            for (int i=0; i < kIterations; i++)
+                callable();
+
+            auto const elapsed = std::chrono::steady_clock::now() - start;
+            auto const nanoseconds = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+            result.nanoseconds = std::min(result.nanoseconds, nanoseconds/(kIterations*kTexts));
+            result.allocations = (double)(gAllocations - allocations)/(kIterations*kTexts);
+        }
+
+        return result;
+    }
+
+    // Reads each time from a JSON string and calculates the size of writing it back
+    template <typename T>
+    std::size_t readAndWrite(std::vector<std::string> const& json, std::string& scratch) {
+        std::size_t result = 0;
+        for (auto const& x : json) {
+            T value;
+            json::JsonReader reader {x, scratch};
+            T::read_json(reader, value);
+            result += calculate_size(value);
+        }
+
+        return result;
+    }
+
+    void print(char const* name, Result const& previous, Result const& current) {
+        std::cout << "  " << name << ": " << previous.nanoseconds << " ns and " << previous.allocations
+                  << " allocations before, " << current.nanoseconds << " ns and " << current.allocations
+                  << " allocations now\n";
+    }
+}
+
+// Checks the RFC 3339 codec in DateTime against the gmtime/sscanf based one it replaced, then compares the cost of
+// formatting and parsing times and of reading them from and writing them to JSON.
+int main() {
+    logging::SetLogLevel(logging::LogLevel::fatal);
+    auto const mismatches = checkEquivalence();
+
+    std::mt19937_64 random {42};
+    std::uniform_int_distribution<std::int64_t> recent {946684800000, 4102444800000};
+    std::vector<SystemTimeMillis> timestamps;
+    std::vector<std::string> texts;
+    std::vector<std::string> json;
+    for (int i=0; i < kTexts; i++) {
+        timestamps.push_back((SystemTimeMillis)recent(random));
+        texts.push_back(makeText(random, (std::int64_t)timestamps.back(), false));
+        json.push_back("\"" + texts.back() + "\"");
+    }
+
+    std::size_t checksum = 0;
+    std::cout << kTexts << " times, best of " << kRounds << " rounds of " << kIterations << " passes\n";
+    print("format", measure([&]() {
+        for (auto const& x : timestamps)
+            checksum += PreviousDateTime::timestampToText(x)->size();
+    }), measure([&]() {
+        common::DateTime::Text text;
+        for (auto const& x : timestamps)
+            checksum += common::DateTime::timestampToText(x, text);
+    }));
+
+    print("parse", measure([&]() {
+        for (auto const& x : texts)
+            checksum += (std::size_t)PreviousDateTime::textToTimestamp(x).value_or((SystemTimeMillis)0);
+    }), measure([&]() {
+        for (auto const& x : texts)
+            checksum += (std::size_t)common::DateTime::textToTimestamp(x).value_or((SystemTimeMillis)0);
+    }));
+
+    std::string scratch;
+    print("read and write JSON", measure([&]() {
+        checksum += readAndWrite<PreviousDateTime>(json, scratch);
+    }), measure([&]() {
+        checksum += readAndWrite<common::DateTime>(json, scratch);
+    }));
+
+    std::cout << "  size: " << sizeof(PreviousDateTime) << " bytes before, " << sizeof(common::DateTime)
+              << " bytes now\n";
+    return mismatches == 0 && checksum > 0 ? 0 : 1;
+}
@@ -0,0 +1,219 @@
+#include "openocpp/protocol/ocpp1_6/handlers/ocpp_remote.h"
+#include "openocpp/protocol/ocpp2_0/handlers/ocpp_remote.h"
+#include "openocpp/common/logging.h"
+
+#include <new>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <algorithm>
+#include <iostream>
+
+namespace {
+    constexpr int kFrames = 500;
+    constexpr int kIterations = 20;
+    constexpr int kRounds = 5;
+
+    std::size_t gAllocations = 0;
+}
+
+void* operator new(std::size_t size) {
+    gAllocations++;
+    if (auto result = std::malloc(size == 0 ? 1 : size))
+        return result;
+
+    throw std::bad_alloc {};
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+
+namespace {
+    using namespace chargelab;
+
+    std::string uniqueId(int index) {
+        char result[40];
+        std::snprintf(result, sizeof(result), "%08x-7a41-4b8e-9f0d-%012x", 0x5d3f0e2u + index, 0x2b6e1a3cu*(index + 1));
+        return result;
+    }
+
+    // Daily TxDefaultProfile with an hourly schedule, as sent by a load management system
+    std::string makeSetChargingProfile(int index) {
+        std::string periods;
+        for (int i=0; i < 24; i++) {
+            if (i > 0)
+                periods += ",";
+            periods += "{\"startPeriod\":" + std::to_string(i*3600) + ",\"limit\":" + std::to_string(16 + (index + i)%16) +
+                       ".0,\"numberPhases\":3}";
+        }
+
+        return "[2,\"" + uniqueId(index) + "\",\"SetChargingProfile\",{\"connectorId\":1,\"csChargingProfiles\":{"
+               "\"chargingProfileId\":" + std::to_string(100 + index) + ",\"stackLevel\":1,"
+               "\"chargingProfilePurpose\":\"TxDefaultProfile\",\"chargingProfileKind\":\"Recurring\","
+               "\"recurrencyKind\":\"Daily\",\"chargingSchedule\":{\"duration\":86400,"
+               "\"startSchedule\":\"2024-03-01T00:00:00.000Z\",\"chargingRateUnit\":\"A\","
+               "\"chargingSchedulePeriod\":[" + periods + "],\"minChargingRate\":6.0}}}]";
+    }
+
+    // Configuration read-back of standard controller variables, several for each EVSE
+    std::string makeGetVariables(int index) {
+        static char const* const kVariables[][2] = {
+                {"SampledDataCtrlr", "TxUpdatedMeasurands"},
+                {"SampledDataCtrlr", "TxUpdatedInterval"},
+                {"AlignedDataCtrlr", "Measurands"},
+                {"AlignedDataCtrlr", "Interval"},
+                {"TxCtrlr", "EVConnectionTimeOut"},
+                {"TxCtrlr", "StopTxOnInvalidId"},
+                {"OCPPCommCtrlr", "HeartbeatInterval"},
+                {"AuthCtrlr", "LocalPreAuthorize"},
+        };
+
+        std::string data;
+        for (int i=0; i < 12; i++) {
+            auto const& x = kVariables[(index + i)%8];
+            if (i > 0)
+                data += ",";
+            data += "{\"component\":{\"name\":\"" + std::string{x[0]} + "\"";
+            if (i%3 == 0)
+                data += ",\"evse\":{\"id\":" + std::to_string(1 + i%2) + "}";
+            data += "},\"variable\":{\"name\":\"" + std::string{x[1]} + "\"}";
+            if (i%4 == 1)
+                data += ",\"attributeType\":\"Target\"";
+            data += "}";
+        }
+
+        return "[2,\"" + uniqueId(index) + "\",\"GetVariables\",{\"getVariableData\":[" + data + "]}]";
+    }
+
+    // Reads a call frame the way the message handlers do, copying the unique ID unless the reader can lend it
+    template <typename MessageType, typename ActionId, typename Payload>
+    bool readCall(json::JsonReader& reader, Payload& payload) {
+        MessageType message_type;
+        ActionId action_id;
+        if (!json::expect_type<json::StartArrayType>(reader) ||
+            !json::ReadValue<MessageType>::read_json(reader, message_type))
+        {
+            return false;
+        }
+
+        if (reader.isInsitu()) {
+            std::string_view unique_id;
+            if (!json::ReadValue<std::string_view>::read_json(reader, unique_id))
+                return false;
+        } else {
+            std::string unique_id;
+            if (!json::ReadValue<std::string>::read_json(reader, unique_id))
+                return false;
+        }
+
+        return json::ReadValue<ActionId>::read_json(reader, action_id) &&
+               json::ReadValue<Payload>::read_json(reader, payload) &&
+               json::expect_type<json::EndArrayType>(reader);
+    }
+
+    struct Result {
+        double frames_per_second = 0;
+        double allocations_per_frame = 0;
+        bool consistent = true;
+    };
+
+    // Best frame rate over kRounds rounds of kIterations passes over the corpus
+    template <typename Callable>
+    Result measureFrames(std::size_t frames, Callable&& callable) {
+        Result result;
+        for (int round=0; round < kRounds; round++) {
+            auto const allocations = gAllocations;
+            auto const start = std::chrono::steady_clock::now();
+            for (int i=0; i < kIterations; i++)
+                result.consistent &= callable();
+
+            auto const elapsed = std::chrono::steady_clock::now() - start;
+            auto const seconds = (double)std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()/1e6;
+            result.frames_per_second = std::max(result.frames_per_second, (double)(frames*kIterations)/seconds);
+            result.allocations_per_frame = (double)(gAllocations - allocations)/(double)(frames*kIterations);
+        }
+
+        return result;
+    }
+
+    template <typename MessageType, typename ActionId, typename Payload, typename Factory>
+    bool measure(char const* name, Factory&& factory) {
+        std::vector<std::string> frames;
+        std::vector<std::string> expected;
+        std::size_t bytes = 0;
+        for (int i=0; i < kFrames; i++) {
+            frames.push_back(factory(i));
+            bytes += frames.back().size();
+
+            Payload payload {};
+            stream::StringReader stream {frames.back()};
+            json::JsonReader reader {stream};
+            if (!readCall<MessageType, ActionId>(reader, payload)) {
+                std::cerr << "Failed reading " << name << " frame: " << frames.back() << "\n";
+                return false;
+            }
+            expected.push_back(write_json_to_string(payload));
+        }
+
+        auto const copied = measureFrames(frames.size(), [&]() {
+            bool consistent = true;
+            for (std::size_t i=0; i < frames.size(); i++) {
+                Payload payload {};
+                stream::StringReader stream {frames[i]};
+                json::JsonReader reader {stream};
+                consistent &= readCall<MessageType, ActionId>(reader, payload);
+            }
+
+            return consistent;
+        });
+
+        std::string scratch;
+        auto const in_place = measureFrames(frames.size(), [&]() {
+            bool consistent = true;
+            for (std::size_t i=0; i < frames.size(); i++) {
+                Payload payload {};
+                json::JsonReader reader {frames[i], scratch};
+                consistent &= readCall<MessageType, ActionId>(reader, payload);
+            }
+
+            return consistent;
+        });
+
+        bool consistent = copied.consistent && in_place.consistent;
+        for (std::size_t i=0; i < frames.size(); i++) {
+            Payload payload {};
+            json::JsonReader reader {frames[i], scratch};
+            consistent &= readCall<MessageType, ActionId>(reader, payload) && write_json_to_string(payload) == expected[i];
+        }
+
+        std::cout << "  " << name << " (" << bytes/frames.size() << " bytes per frame):\n"
+                  << "    through a stream:  " << (long)copied.frames_per_second << " frames/s, "
+                  << copied.allocations_per_frame << " allocations per frame\n"
+                  << "    parsed in place:   " << (long)in_place.frames_per_second << " frames/s, "
+                  << in_place.allocations_per_frame << " allocations per frame\n";
+        return consistent;
+    }
+}
+
+// Compares reading inbound call frames through the buffered stream reader, which copies every string token, against
+// parsing a reused copy of the frame in place, where string tokens point into the buffer and the unique ID is borrowed.
+int main() {
+    logging::SetLogLevel(logging::LogLevel::warning);
+
+    std::cout << kFrames << " frames of each type, best of " << kRounds << " rounds of " << kIterations << " passes\n";
+    auto consistent = measure<ocpp1_6::MessageType, ocpp1_6::ActionId, ocpp1_6::SetChargingProfileReq>(
+            "SetChargingProfile (OCPP 1.6)", makeSetChargingProfile
+    );
+    consistent &= measure<ocpp2_0::MessageType, ocpp2_0::ActionId, ocpp2_0::GetVariablesRequest>(
+            "GetVariables (OCPP 2.0.1)", makeGetVariables
+    );
+    std::cout << "  payloads consistent: " << (consistent ? "yes" : "no") << "\n";
+
+    return consistent ? 0 : 1;
+}
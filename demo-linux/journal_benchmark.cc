@@ -0,0 +1,181 @@
+#include "openocpp/implementation/platform_posix.h"
+#include "openocpp/protocol/ocpp1_6/messages/set_charging_profile.h"
+#include "openocpp/common/compressed_journal.h"
+#include "openocpp/common/logging.h"
+
+#include <map>
+#include <string>
+#include <iostream>
+#include <filesystem>
+
+namespace {
+    constexpr int kUpdates = 1000;
+    constexpr int kProfileSlots = 5;
+    constexpr int kPeriods = 24;
+    constexpr std::size_t kPartitionSize = 0x2000;
+    // Every kPowerCutInterval updates, the update is repeated on a copy of the flash with power lost part way through
+    constexpr int kPowerCutInterval = 7;
+
+    using Journal = chargelab::CompressedJournalJson<chargelab::ocpp1_6::SetChargingProfileReq>;
+    using State = std::map<int, chargelab::ocpp1_6::SetChargingProfileReq>;
+
+    /**
+     * Flash that stops programming after a number of bytes, to simulate losing power in the middle of an update.
+     */
+    class PowerCutFlash : public chargelab::detail::SimulatedFlash {
+    public:
+        PowerCutFlash(std::shared_ptr<chargelab::detail::SimulatedFlashState> state, std::size_t budget)
+                : SimulatedFlash(std::move(state)),
+                  budget_(budget)
+        {
+        }
+
+        bool write(std::size_t dst_offset, void *src, std::size_t size) override {
+            auto const allowed = std::min(size, budget_);
+            budget_ -= allowed;
+            if (allowed > 0)
+                SimulatedFlash::write(dst_offset, src, allowed);
+
+            return allowed == size;
+        }
+
+        bool erase() override {
+            return budget_ > 0 && SimulatedFlash::erase();
+        }
+
+        bool eraseSector(std::size_t offset) override {
+            return budget_ > 0 && SimulatedFlash::eraseSector(offset);
+        }
+
+    private:
+        std::size_t budget_;
+    };
+
+    chargelab::ocpp1_6::SetChargingProfileReq makeProfile(int slot, int update) {
+        using namespace chargelab;
+
+        std::vector<ocpp1_6::ChargingSchedulePeriod> periods;
+        for (int i=0; i < kPeriods; i++)
+            periods.push_back(ocpp1_6::ChargingSchedulePeriod {i*3600, (double)(6 + (update*7 + i*5) % 40)});
+
+        return ocpp1_6::SetChargingProfileReq {
+                0,
+                ocpp1_6::ChargingProfile {
+                        100 + slot,
+                        std::nullopt,
+                        slot,
+                        ocpp1_6::ChargingProfilePurposeType::kTxDefaultProfile,
+                        ocpp1_6::ChargingProfileKindType::kRecurring,
+                        ocpp1_6::RecurrencyKindType::kDaily,
+                        std::nullopt,
+                        std::nullopt,
+                        ocpp1_6::ChargingSchedule {
+                                std::nullopt,
+                                ocpp1_6::DateTime(chargelab::SystemTimeMillis {0}),
+                                ocpp1_6::ChargingRateUnitType::kA,
+                                std::move(periods),
+                                std::nullopt
+                        }
+                }
+        };
+    }
+
+    std::shared_ptr<chargelab::detail::SimulatedFlashState> copyFlash(
+            chargelab::detail::SimulatedFlashState const& state,
+            std::string const& path
+    ) {
+        auto result = std::make_shared<chargelab::detail::SimulatedFlashState>();
+        result->path = path;
+        result->data = state.data;
+        return result;
+    }
+
+    std::string toString(State const& state) {
+        std::string result;
+        for (auto const& entry : state)
+            result += chargelab::write_json_to_string(entry.second) + "\n";
+
+        return result;
+    }
+
+    State recover(std::shared_ptr<chargelab::detail::SimulatedFlashState> const& flash) {
+        State result;
+        Journal journal {std::make_unique<chargelab::detail::SimulatedFlash>(flash), "benchmark-1"};
+        journal.visit([&](std::string_view const&, chargelab::ocpp1_6::SetChargingProfileReq const& update) {
+            result[update.csChargingProfiles.chargingProfileId] = update;
+        });
+
+        return result;
+    }
+
+    bool addUpdate(Journal& journal, State& state, chargelab::ocpp1_6::SetChargingProfileReq const& update) {
+        state[update.csChargingProfiles.chargingProfileId] = update;
+
+        std::vector<chargelab::ocpp1_6::SetChargingProfileReq> final_state;
+        for (auto const& entry : state)
+            final_state.push_back(entry.second);
+
+        return journal.addUpdate(final_state, update);
+    }
+}
+
+// Writes kUpdates charging profile updates to a journal on a simulated NOR flash partition, reporting the bytes
+// programmed and sectors erased, and checks that the final state is recovered - including after losing power part way
+// through an update.
+int main(int argc, char** argv) {
+    using namespace chargelab;
+
+    std::string const storage_directory = argc > 1 ? argv[1] : "openocpp-benchmark-data";
+    std::filesystem::remove_all(storage_directory);
+    std::filesystem::create_directories(storage_directory);
+    logging::SetLogLevel(logging::LogLevel::error);
+
+    auto flash = std::make_shared<detail::SimulatedFlashState>();
+    flash->path = storage_directory + "/journal.flash";
+    flash->data.resize(kPartitionSize, 0xFF);
+
+    Journal journal {std::make_unique<detail::SimulatedFlash>(flash), "benchmark-1"};
+    journal.visit([](auto const&, auto const&) {});
+
+    State state;
+    int failed_updates = 0;
+    int power_cuts = 0;
+    int failed_recoveries = 0;
+    for (int update=0; update < kUpdates; update++) {
+        auto const profile = makeProfile(update % kProfileSlots, update);
+        if (update % kPowerCutInterval == 0) {
+            auto const before = toString(state);
+            auto after_state = state;
+            after_state[profile.csChargingProfiles.chargingProfileId] = profile;
+            auto const after = toString(after_state);
+
+            auto copy = copyFlash(*flash, storage_directory + "/power_cut.flash");
+            {
+                auto copy_state = state;
+                Journal interrupted {std::make_unique<PowerCutFlash>(copy, (update*37) % 400), "benchmark-1"};
+                interrupted.visit([](auto const&, auto const&) {});
+                addUpdate(interrupted, copy_state, profile);
+            }
+
+            auto const recovered = toString(recover(copy));
+            power_cuts++;
+            if (recovered != before && recovered != after)
+                failed_recoveries++;
+        }
+
+        if (!addUpdate(journal, state, profile))
+            failed_updates++;
+    }
+
+    auto const recovered = toString(recover(flash));
+    std::cout << kUpdates << " updates of " << kProfileSlots << " profiles x " << kPeriods << " periods on a "
+              << kPartitionSize << " byte partition\n"
+              << "  bytes programmed: " << flash->bytes_written << "\n"
+              << "  write operations: " << flash->write_count << "\n"
+              << "  sector erases: " << flash->erase_count << "\n"
+              << "  failed updates: " << failed_updates << "\n"
+              << "  recovered final state: " << (recovered == toString(state) ? "yes" : "no") << "\n"
+              << "  power cuts recovered: " << (power_cuts - failed_recoveries) << "/" << power_cuts << "\n";
+
+    return failed_updates == 0 && recovered == toString(state) && failed_recoveries == 0 ? 0 : 1;
+}
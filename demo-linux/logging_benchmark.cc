@@ -0,0 +1,195 @@
+#include "openocpp/common/logging.h"
+
+#include <new>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+#include <iostream>
+#include <streambuf>
+
+namespace {
+    constexpr int kCalls = 100000;
+    // Note: calls between flushes, small enough that a burst from every thread fits in the backend's ring
+    constexpr int kBurst = 128;
+    constexpr int kThreads = 4;
+
+    thread_local std::size_t gAllocations = 0;
+}
+
+void* operator new(std::size_t size) {
+    gAllocations++;
+    if (auto result = std::malloc(size == 0 ? 1 : size))
+        return result;
+
+    throw std::bad_alloc {};
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+
+namespace {
+    using namespace chargelab;
+
+    class NullBuffer : public std::streambuf {
+    protected:
+        int overflow(int ch) override {
+            return ch;
+        }
+
+        std::streamsize xsputn(char const*, std::streamsize count) override {
+            return count;
+        }
+    };
+
+    /**
+     * The previous call site path: the message is built in a std::string with std::to_string, then printed and passed
+     * to the listeners before the call returns.
+     */
+    class SynchronousAccumulator {
+    public:
+        explicit SynchronousAccumulator(logging::LogLevel level, std::string_view function)
+            : metadata_ {level, function}
+        {
+        }
+
+        ~SynchronousAccumulator() {
+            logging::PrintLogMessage(metadata_, text_);
+        }
+
+        template <typename T>
+        SynchronousAccumulator& operator<<(T const& value) {
+            if constexpr (std::is_arithmetic<T>::value) {
+                text_ += std::to_string(value);
+            } else {
+                text_ += value;
+            }
+
+            return *this;
+        }
+
+    private:
+        logging::LogMetadata metadata_;
+        std::string text_;
+    };
+
+    // Log statements from the hot paths: a received frame logged by the message handler, and a few numbers
+    std::string const kFrame = "[2,\"8f1e33c2-4b7a-4d0e-a1c5-93b2d7e0f6a4\",\"MeterValues\",{\"connectorId\":1,"
+            "\"transactionId\":1042,\"meterValue\":[{\"timestamp\":\"2024-03-01T10:15:00Z\",\"sampledValue\":["
+            "{\"value\":\"18234\",\"measurand\":\"Energy.Active.Import.Register\",\"unit\":\"Wh\"},"
+            "{\"value\":\"11004\",\"measurand\":\"Power.Active.Import\",\"unit\":\"W\"}]}]}]";
+
+    void logDeferred(int i) {
+        if (i % 2 == 0) {
+            CHARGELAB_LOG_MESSAGE(debug) << "Received OCPP message: " << kFrame;
+        } else {
+            CHARGELAB_LOG_MESSAGE(info) << "Dropping pending message: " << i << ", priority=" << (i % 7)
+                                        << ", elapsed=" << 1.5*i;
+        }
+    }
+
+    void logSynchronous(int i) {
+        if (i % 2 == 0) {
+            SynchronousAccumulator {logging::LogLevel::debug, __func__} << "Received OCPP message: " << kFrame;
+        } else {
+            SynchronousAccumulator {logging::LogLevel::info, __func__} << "Dropping pending message: " << i
+                                                                       << ", priority=" << (i % 7)
+                                                                       << ", elapsed=" << 1.5*i;
+        }
+    }
+
+    struct Result {
+        double nanos_per_call = 0;
+        double allocations_per_call = 0;
+    };
+
+    // Times kCalls calls split over threads, in bursts followed by a flush that isn't timed
+    template <typename Callable>
+    Result measure(int threads, Callable&& log) {
+        std::atomic<std::int64_t> total_nanos {0};
+        std::atomic<std::size_t> total_allocations {0};
+
+        std::vector<std::thread> workers;
+        for (int t=0; t < threads; t++) {
+            workers.emplace_back([&, t]() {
+                std::int64_t nanos = 0;
+                std::size_t allocations = 0;
+                for (int i=t; i < kCalls; i += threads*kBurst) {
+                    auto const before = gAllocations;
+                    auto const start = std::chrono::steady_clock::now();
+                    for (int j=0; j < kBurst*threads && i + j < kCalls; j += threads)
+                        log(i + j);
+
+                    nanos += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+                    allocations += gAllocations - before;
+                    logging::FlushLogMessages();
+                }
+
+                total_nanos += nanos;
+                total_allocations += allocations;
+            });
+        }
+
+        for (auto& x : workers)
+            x.join();
+
+        return Result {(double)total_nanos/kCalls, (double)total_allocations/kCalls};
+    }
+
+    void print(char const* name, Result const& result) {
+        std::cout << "  " << name << ": " << result.nanos_per_call << "ns per call, "
+                  << result.allocations_per_call << " allocations per call\n";
+    }
+}
+
+// Measures the cost of a log statement to the calling thread, comparing the previous path (formatting on the calling
+// thread and delivering to listeners synchronously) with the backend that captures the arguments and formats them on
+// its own thread. Output goes to a null stream; a listener stands in for the log streaming and GetLog modules.
+int main() {
+    logging::SetLogLevel(logging::LogLevel::debug);
+
+    std::mutex mutex;
+    std::size_t lines = 0;
+    std::size_t bytes = 0;
+    auto listener = std::make_shared<logging::LoggingListenerFunction>([&](logging::LogMetadata const&, std::string_view const& message) {
+        std::lock_guard lock {mutex};
+        lines++;
+        bytes += message.size();
+    });
+    logging::RegisterLoggingListener(listener);
+
+    NullBuffer null_buffer;
+    auto const original_buffer = std::cout.rdbuf(&null_buffer);
+
+    auto const synchronous = measure(1, logSynchronous);
+    auto const synchronous_threads = measure(kThreads, logSynchronous);
+    auto const synchronous_bytes = bytes;
+
+    bytes = 0;
+    auto const deferred = measure(1, logDeferred);
+    auto const deferred_threads = measure(kThreads, logDeferred);
+    logging::FlushLogMessages();
+
+    std::cout.rdbuf(original_buffer);
+    logging::UnregisterLoggingListener(listener);
+
+    auto const delivered = lines == 4*(std::size_t)kCalls && bytes == synchronous_bytes;
+    std::cout << kCalls << " log statements (a received frame or a few numbers), in bursts of " << kBurst << "\n"
+              << " synchronous formatting and delivery\n";
+    print("1 thread", synchronous);
+    print(std::to_string(kThreads).append(" threads").c_str(), synchronous_threads);
+    std::cout << " deferred formatting\n";
+    print("1 thread", deferred);
+    print(std::to_string(kThreads).append(" threads").c_str(), deferred_threads);
+    std::cout << "  all messages delivered: " << (delivered ? "yes" : "no") << "\n";
+
+    return delivered ? 0 : 1;
+}
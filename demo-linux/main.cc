@@ -0,0 +1,166 @@
+#include "openocpp/implementation/platform_posix.h"
+#include "openocpp/implementation/loopback_csms.h"
+#include "openocpp/implementation/station_posix.h"
+#include "openocpp/implementation/station_simulator.h"
+#include "openocpp/implementation/standard_charger.h"
+#include "openocpp/common/logging.h"
+
+#include <map>
+#include <chrono>
+#include <string>
+#include <iostream>
+#include <filesystem>
+
+namespace {
+    constexpr std::int64_t kMillisPerMinute = 60*1000;
+
+    // Simulated driver behaviour: a session starts every kSessionIntervalMinutes and the vehicle stays plugged in for
+    // kSessionLengthMinutes
+    constexpr std::int64_t kSessionIntervalMinutes = 120;
+    constexpr std::int64_t kSessionLengthMinutes = 60;
+
+    struct Options {
+        std::string protocol = "ocpp1.6";
+        std::string storage_directory = "openocpp-data";
+        double hours = 24;
+        double clock_rate = 0;
+        int latency_millis = 50;
+        chargelab::logging::LogLevel log_level = chargelab::logging::LogLevel::warning;
+    };
+
+    void printUsage(char const* name) {
+        std::cerr << "Usage: " << name << " [options]\n"
+                  << "  --protocol <ocpp1.6|ocpp2.0.1>  OCPP version to run (default: ocpp1.6)\n"
+                  << "  --storage <directory>           directory for settings and flash files (default: openocpp-data)\n"
+                  << "  --hours <hours>                 charger time to run for (default: 24)\n"
+                  << "  --clock-rate <rate>             multiple of real time, or 0 to run as fast as possible (default: 0)\n"
+                  << "  --latency <millis>              central system response latency (default: 50)\n"
+                  << "  --verbose                       log at debug level\n";
+    }
+
+    std::optional<Options> parseOptions(int argc, char** argv) {
+        Options result;
+        for (int i=1; i < argc; i++) {
+            std::string const arg = argv[i];
+            if (arg == "--help")
+                return std::nullopt;
+
+            if (arg == "--verbose") {
+                result.log_level = chargelab::logging::LogLevel::debug;
+                continue;
+            }
+
+            if (i+1 >= argc)
+                return std::nullopt;
+
+            std::string const value = argv[++i];
+            if (arg == "--protocol") {
+                result.protocol = value;
+            } else if (arg == "--storage") {
+                result.storage_directory = value;
+            } else if (arg == "--hours") {
+                result.hours = std::stod(value);
+            } else if (arg == "--clock-rate") {
+                result.clock_rate = std::stod(value);
+            } else if (arg == "--latency") {
+                result.latency_millis = std::stoi(value);
+            } else {
+                return std::nullopt;
+            }
+        }
+
+        return result;
+    }
+}
+
+int main(int argc, char** argv) {
+    using namespace chargelab;
+
+    auto const options = parseOptions(argc, argv);
+    if (!options.has_value()) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    logging::SetLogLevel(options->log_level);
+    std::filesystem::create_directories(options->storage_directory);
+
+    auto const wall_start = std::chrono::steady_clock::now();
+    auto const run_millis = (std::int64_t)(options->hours*60*kMillisPerMinute);
+    std::int64_t elapsed_millis = 0;
+    std::optional<SystemTimeMillis> system_time;
+    std::map<std::string, std::size_t> received_calls;
+    std::size_t steps = 0;
+    std::size_t restarts = 0;
+    std::size_t sessions = 0;
+
+    // Each iteration simulates one boot of the charger
+    while (elapsed_millis < run_millis) {
+        auto platform = std::make_shared<PlatformPOSIX>(options->storage_directory, options->clock_rate);
+        if (system_time.has_value())
+            platform->setSystemClock(system_time.value());
+
+        auto csms = std::make_shared<LoopbackCsms>(platform, options->protocol);
+        csms->setLatency(options->latency_millis);
+        platform->setCsms(csms);
+
+        auto station = std::make_shared<StationSimulator<StationPOSIX>>(platform, options->storage_directory);
+        auto charger = std::make_unique<StandardCharger>(platform, station);
+
+        auto const boot_steady = platform->steadyClockNow();
+        auto const boot_elapsed = elapsed_millis;
+        bool plugged_in = false;
+        while (elapsed_millis < run_millis && !platform->resetRequested()) {
+            station->updateMeasurements();
+            charger->runStep();
+            steps++;
+
+            elapsed_millis = boot_elapsed + (platform->steadyClockNow() - boot_steady);
+            auto const session_minute = (elapsed_millis/kMillisPerMinute) % kSessionIntervalMinutes;
+            auto const should_plug_in = session_minute < kSessionLengthMinutes;
+            if (should_plug_in != plugged_in) {
+                plugged_in = should_plug_in;
+                station->updateState([&](detail::SimulatorState& state) {
+                    for (auto const& entry : state.connector_metadata)
+                        state.connector_state[entry.first].vehicle_connected = plugged_in;
+                });
+
+                if (plugged_in) {
+                    sessions++;
+                    station->simulateTap(
+                            ocpp1_6::IdToken {"LOOPBACK"},
+                            ocpp2_0::IdTokenType {"LOOPBACK", ocpp2_0::IdTokenEnumType::kISO14443},
+                            1000
+                    );
+                }
+            }
+
+            charger->waitForNextStep();
+        }
+
+        system_time = platform->systemClockNow();
+        for (auto const& entry : csms->receivedCalls())
+            received_calls[entry.first] += entry.second;
+
+        for (auto const& entry : platform->flashPartitions()) {
+            std::cout << "Flash partition " << entry.first << ": erases=" << entry.second->erase_count
+                      << " writes=" << entry.second->write_count
+                      << " bytes_written=" << entry.second->bytes_written
+                      << " bits_set_violations=" << entry.second->bits_set_violations << "\n";
+        }
+
+        if (platform->resetRequested())
+            restarts++;
+    }
+
+    auto const wall_millis = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - wall_start
+    ).count();
+
+    std::cout << "Simulated " << elapsed_millis/1000 << "s of charger time in " << wall_millis << "ms"
+              << " (steps=" << steps << ", sessions=" << sessions << ", restarts=" << restarts << ")\n";
+    for (auto const& entry : received_calls)
+        std::cout << "  " << entry.first << ": " << entry.second << "\n";
+
+    return 0;
+}
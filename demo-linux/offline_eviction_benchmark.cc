@@ -0,0 +1,177 @@
+#include "openocpp/module/pending_messages_module.h"
+#include "openocpp/common/compressed_queue.h"
+#include "openocpp/common/logging.h"
+
+#include <map>
+#include <chrono>
+#include <random>
+#include <string>
+#include <iostream>
+
+namespace {
+    constexpr int kRecords = 10000;
+    constexpr int kTransactions = 20;
+    constexpr int kPasses = 50;
+    constexpr int kTargetDeleteRecordCount = 10;
+    constexpr int kPriorityTransaction = 0;
+    constexpr int kPriorityMeterValue = 5;
+
+    using Wrapper = chargelab::detail::PendingMessageWrapper;
+    using Queue = chargelab::detail::PendingMessageQueue;
+
+    template <typename Callable>
+    double timeMicros(int iterations, Callable&& callable) {
+        auto const start = std::chrono::steady_clock::now();
+        for (int i=0; i < iterations; i++)
+            callable();
+
+        auto const elapsed = std::chrono::steady_clock::now() - start;
+        return (double)std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() / iterations;
+    }
+
+    // Transactions recorded while offline: a start and stop for each, with periodic meter values in between
+    void fill(Queue& queue) {
+        constexpr int kRecordsPerTransaction = kRecords/kTransactions;
+        for (int i=0; i < kRecords; i++) {
+            auto const transaction = i/kRecordsPerTransaction;
+            auto const index = i%kRecordsPerTransaction;
+            auto const boundary = index == 0 || index == kRecordsPerTransaction-1;
+
+            chargelab::PendingMessagePolicy policy {};
+            policy.message_type = chargelab::PendingMessageType::kTransactionEvent;
+            policy.group_id = 1000 + transaction;
+            policy.priority = boundary ? kPriorityTransaction : kPriorityMeterValue;
+
+            Wrapper wrapper {i, {}, policy, chargelab::ocpp1_6::ActionId::kMeterValues, std::nullopt};
+            wrapper.payload = "{\"connectorId\":1,\"transactionId\":" + std::to_string(transaction) + ","
+                    "\"meterValue\":[{\"timestamp\":\"2024-03-01T10:" + std::to_string(10 + index%50) + ":00Z\","
+                    "\"sampledValue\":[{\"value\":\"" + std::to_string(1000 + index*183) + "\","
+                    "\"measurand\":\"Energy.Active.Import.Register\",\"unit\":\"Wh\"},"
+                    "{\"value\":\"" + std::to_string(11000 + index%7) + "\",\"measurand\":\"Power.Active.Import\","
+                    "\"unit\":\"W\"}]}]}";
+            queue.pushBack(wrapper);
+        }
+    }
+
+    // Eviction as done before block summaries: gathering stats and removing records by rewriting the whole queue
+    std::size_t evictByRewriting(Queue& queue, std::default_random_engine& random_engine) {
+        std::map<std::pair<int, std::optional<uint64_t>>, int> stats;
+        queue.visit([&] (std::string_view const&, Wrapper const& wrapper) {
+            stats[std::make_pair(wrapper.policy.priority, wrapper.policy.group_id)] += 1;
+        });
+
+        int max_priority = std::numeric_limits<int>::min();
+        for (auto const& x : stats)
+            max_priority = std::max(x.first.first, max_priority);
+
+        int delete_count = 0;
+        for (auto const& x : stats) {
+            if (x.first.first == max_priority)
+                delete_count += std::max(x.second - 2, 0);
+        }
+
+        std::size_t deleted = 0;
+        std::uniform_int_distribution<int64_t> distribution(0, delete_count-1);
+        std::map<uint64_t, int> counter;
+        queue.removeIf([&] (std::string_view const&, Wrapper const& wrapper) {
+            if (wrapper.policy.priority != max_priority)
+                return false;
+
+            auto const index = counter[wrapper.policy.group_id.value()]++;
+            auto const total = stats[std::make_pair(wrapper.policy.priority, wrapper.policy.group_id)];
+            if (index == 0 || index == total-1 || distribution(random_engine) >= kTargetDeleteRecordCount)
+                return false;
+
+            deleted++;
+            return true;
+        });
+
+        return deleted;
+    }
+
+    // Checks the summaries kept by the queue against the records it holds
+    bool summariesMatch(Queue& queue) {
+        chargelab::detail::PendingMessageSummary expected;
+        queue.visit([&](std::string_view const& text, Wrapper const&) {
+            expected.add(text);
+        });
+
+        int records = 0;
+        int bytes = 0;
+        std::map<std::pair<int, std::optional<uint64_t>>, int> groups;
+        queue.visitSummaries([&](chargelab::detail::PendingMessageSummary const& summary) {
+            records += summary.records;
+            bytes += summary.bytes;
+            for (auto const& x : summary.groups)
+                groups[std::make_pair(x.priority, x.group_id)] += x.records;
+        });
+
+        for (auto const& x : expected.groups) {
+            if (groups[std::make_pair(x.priority, x.group_id)] != x.records)
+                return false;
+        }
+
+        return records == expected.records && bytes == expected.bytes && groups.size() == expected.groups.size();
+    }
+}
+
+// Measures dropping records from an offline queue of kRecords records that's over its size limit, comparing the pass
+// that decompresses and rewrites the whole queue with the one driven by the block summaries.
+int main() {
+    using namespace chargelab;
+    logging::SetLogLevel(logging::LogLevel::error);
+
+    Queue rewritten;
+    Queue summarized;
+    fill(rewritten);
+    fill(summarized);
+
+    // Sending a few records from the front, as happens between eviction passes
+    for (int i=0; i < 5; i++) {
+        rewritten.popFront();
+        summarized.popFront();
+    }
+
+    std::default_random_engine random_engine {1};
+    std::size_t rewritten_deleted = 0;
+    std::size_t summarized_deleted = 0;
+    auto const rewritten_micros = timeMicros(kPasses, [&]() {
+        rewritten_deleted += evictByRewriting(rewritten, random_engine);
+    });
+    auto const summarized_micros = timeMicros(kPasses, [&]() {
+        summarized_deleted += detail::evictPendingMessages(
+                summarized,
+                random_engine,
+                kTargetDeleteRecordCount,
+                [](Wrapper const&) {}
+        ).records;
+    });
+
+    // Offline stats: visiting the records against reading the summaries
+    std::size_t sink = 0;
+    auto const stats_visit_micros = timeMicros(kPasses, [&]() {
+        summarized.visit([&](std::string_view const& text, Wrapper const&) {
+            sink += text.size();
+        });
+    });
+    auto const stats_summary_micros = timeMicros(kPasses, [&]() {
+        summarized.visitSummaries([&](detail::PendingMessageSummary const& summary) {
+            sink += summary.bytes;
+        });
+    });
+
+    auto const consistent = summariesMatch(summarized);
+    std::cout << kRecords << " queued records in " << kTransactions << " transactions, " << kPasses << " eviction passes\n"
+              << "  rewriting the queue: " << rewritten_micros << "us per pass, "
+              << rewritten_deleted << " records dropped\n"
+              << "  using block summaries: " << summarized_micros << "us per pass, "
+              << summarized_deleted << " records dropped\n"
+              << "  offline stats: visiting records " << stats_visit_micros << "us, summaries "
+              << stats_summary_micros << "us\n"
+              << "  summaries consistent: " << (consistent ? "yes" : "no") << "\n";
+
+    if (sink == 0)
+        std::cerr << "Unexpected empty output\n";
+
+    return consistent ? 0 : 1;
+}
@@ -0,0 +1,191 @@
+#include "openocpp/module/pending_messages_module.h"
+#include "openocpp/common/compressed_queue.h"
+#include "openocpp/common/logging.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <iostream>
+
+namespace {
+    constexpr int kMessages = 2000;
+    constexpr int kIterations = 5;
+    constexpr std::int64_t kStartTimestamp = 1709287200000; // 2024-03-01T10:00:00Z
+    constexpr std::int64_t kMeterValueIntervalMillis = 60*1000;
+
+    using Wrapper = chargelab::detail::PendingMessageWrapper;
+    using Codec = chargelab::detail::PendingPayloadCodec;
+
+    template <typename Callable>
+    double timeMicros(Callable&& callable) {
+        auto const start = std::chrono::steady_clock::now();
+        for (int i=0; i < kIterations; i++)
+            callable();
+
+        auto const elapsed = std::chrono::steady_clock::now() - start;
+        return (double)std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() / (kIterations*kMessages);
+    }
+
+    std::string timestamp(int index) {
+        auto const text = chargelab::common::DateTime::timestampToText(
+                (chargelab::SystemTimeMillis)(kStartTimestamp + index*kMeterValueIntervalMillis)
+        );
+        return "\"" + text.value() + "\"";
+    }
+
+    // Periodic meter values during a three phase session, as sent while the charger is offline
+    chargelab::ocpp2_0::TransactionEventRequest makeTransactionEvent(int index) {
+        auto const energy = 1000.0 + index*183.5;
+        std::string sampled = "{\"value\":" + std::to_string(energy) + ",\"context\":\"Sample.Periodic\","
+                "\"measurand\":\"Energy.Active.Import.Register\",\"location\":\"Outlet\",\"unitOfMeasure\":{\"unit\":\"Wh\"}},"
+                "{\"value\":" + std::to_string(11000 + index%7) + ",\"context\":\"Sample.Periodic\","
+                "\"measurand\":\"Power.Active.Import\",\"location\":\"Outlet\",\"unitOfMeasure\":{\"unit\":\"W\"}}";
+        for (auto const& phase : {"L1", "L2", "L3"}) {
+            sampled += ",{\"value\":" + std::to_string(16 + index%3) + ".2,\"context\":\"Sample.Periodic\","
+                    "\"measurand\":\"Current.Import\",\"phase\":\"" + phase + "\",\"location\":\"Outlet\","
+                    "\"unitOfMeasure\":{\"unit\":\"A\"}}";
+        }
+
+        auto const json = "{\"eventType\":\"Updated\",\"timestamp\":" + timestamp(index) + ","
+                "\"triggerReason\":\"MeterValuePeriodic\",\"seqNo\":" + std::to_string(index) + ",\"offline\":true,"
+                "\"transactionInfo\":{\"transactionId\":\"c5d3f0e2-7a41-4b8e-9f0d-2b6e1a3c4d5e\",\"chargingState\":\"Charging\"},"
+                "\"evse\":{\"id\":1,\"connectorId\":1},"
+                "\"meterValue\":[{\"timestamp\":" + timestamp(index) + ",\"sampledValue\":[" + sampled + "]}]}";
+
+        return chargelab::read_json_from_string<chargelab::ocpp2_0::TransactionEventRequest>(json).value();
+    }
+
+    chargelab::ocpp1_6::MeterValuesReq makeMeterValues(int index) {
+        auto const energy = 1000.0 + index*183.5;
+        std::string sampled = "{\"value\":\"" + std::to_string(energy) + "\",\"context\":\"Sample.Periodic\","
+                "\"format\":\"Raw\",\"measurand\":\"Energy.Active.Import.Register\",\"location\":\"Outlet\",\"unit\":\"Wh\"},"
+                "{\"value\":\"" + std::to_string(11000 + index%7) + "\",\"context\":\"Sample.Periodic\","
+                "\"format\":\"Raw\",\"measurand\":\"Power.Active.Import\",\"location\":\"Outlet\",\"unit\":\"W\"}";
+        for (auto const& phase : {"L1", "L2", "L3"}) {
+            sampled += ",{\"value\":\"" + std::to_string(16 + index%3) + ".2\",\"context\":\"Sample.Periodic\","
+                    "\"format\":\"Raw\",\"measurand\":\"Current.Import\",\"phase\":\"" + phase + "\","
+                    "\"location\":\"Outlet\",\"unit\":\"A\"}";
+        }
+
+        auto const json = "{\"connectorId\":1,\"meterValue\":[{\"timestamp\":" + timestamp(index) + ","
+                "\"sampledValue\":[" + sampled + "]}]}";
+
+        return chargelab::read_json_from_string<chargelab::ocpp1_6::MeterValuesReq>(json).value();
+    }
+
+    struct Result {
+        std::size_t json_bytes = 0;
+        std::size_t binary_bytes = 0;
+        std::size_t json_queue_bytes = 0;
+        std::size_t binary_queue_bytes = 0;
+        double json_encode_micros = 0;
+        double binary_encode_micros = 0;
+        double json_send_micros = 0;
+        double binary_send_micros = 0;
+    };
+
+    template <typename T, typename ActionIds>
+    Result measure(std::vector<T> const& corpus, ActionIds const& action_ids, char const* patch_field) {
+        using namespace chargelab;
+        Result result;
+
+        std::vector<Wrapper> json_wrappers;
+        std::vector<Wrapper> binary_wrappers;
+        CompressedQueueCustom<Wrapper, detail::PendingMessageSerializer> json_queue;
+        CompressedQueueCustom<Wrapper, detail::PendingMessageSerializer> binary_queue;
+        for (std::size_t i=0; i < corpus.size(); i++) {
+            Wrapper wrapper {(int64_t)i, {}, PendingMessagePolicy {}, action_ids.first, action_ids.second};
+            wrapper.payload = write_json_to_string(corpus[i]);
+            json_wrappers.push_back(wrapper);
+            json_queue.pushBack(wrapper);
+
+            Codec::write(wrapper, corpus[i]);
+            binary_wrappers.push_back(wrapper);
+            binary_queue.pushBack(wrapper);
+
+            result.json_bytes += json_wrappers.back().payload.size();
+            result.binary_bytes += binary_wrappers.back().payload.size();
+        }
+
+        result.json_queue_bytes = json_queue.totalBytes();
+        result.binary_queue_bytes = binary_queue.totalBytes();
+
+        std::size_t sink = 0;
+        result.json_encode_micros = timeMicros([&]() {
+            for (auto const& x : corpus)
+                sink += write_json_to_string(x).size();
+        });
+        result.binary_encode_micros = timeMicros([&]() {
+            Wrapper wrapper {};
+            for (auto const& x : corpus) {
+                Codec::write(wrapper, x);
+                sink += wrapper.payload.size();
+            }
+        });
+
+        // Sending a queued record: reading the field to patch and writing the patched payload
+        result.json_send_micros = timeMicros([&]() {
+            for (auto const& x : json_wrappers) {
+                auto const value = read_field_from_object<int>(x.payload, patch_field).value_or(0);
+                sink += insert_into_object(x.payload, patch_field, value + 1).size();
+            }
+        });
+        result.binary_send_micros = timeMicros([&]() {
+            for (auto const& x : binary_wrappers) {
+                auto const payload = Codec::toJson(x, [&](auto& request) {
+                    using type = std::decay_t<decltype(request)>;
+                    if constexpr (detail::HasSeqNo<type>::value)
+                        request.seqNo = request.seqNo + 1;
+                    if constexpr (detail::HasTransactionId<type>::value)
+                        request.transactionId = 1;
+                });
+                sink += payload.value().size();
+            }
+        });
+
+        if (sink == 0)
+            std::cerr << "Unexpected empty output\n";
+
+        return result;
+    }
+
+    void print(char const* name, Result const& result) {
+        std::cout << name << " x " << kMessages << "\n"
+                  << "  payload bytes: json=" << result.json_bytes << " binary=" << result.binary_bytes
+                  << " (" << (100*result.binary_bytes/result.json_bytes) << "%)\n"
+                  << "  offline queue bytes: json=" << result.json_queue_bytes << " binary=" << result.binary_queue_bytes
+                  << " (" << (100*result.binary_queue_bytes/result.json_queue_bytes) << "%)\n"
+                  << "  encode per message: json=" << result.json_encode_micros << "us binary="
+                  << result.binary_encode_micros << "us\n"
+                  << "  send per message: json=" << result.json_send_micros << "us binary="
+                  << result.binary_send_micros << "us\n";
+    }
+}
+
+// Compares queued OCPP payloads stored as JSON text against the binary encoding used by the offline queue in
+// PendingMessagesModule: bytes stored (before and after the queue's compression), the cost of encoding a request, and
+// the cost of preparing a queued record to send.
+int main() {
+    using namespace chargelab;
+    logging::SetLogLevel(logging::LogLevel::error);
+
+    std::vector<ocpp2_0::TransactionEventRequest> transaction_events;
+    std::vector<ocpp1_6::MeterValuesReq> meter_values;
+    for (int i=0; i < kMessages; i++) {
+        transaction_events.push_back(makeTransactionEvent(i));
+        meter_values.push_back(makeMeterValues(i));
+    }
+
+    print("TransactionEvent (OCPP 2.0.1)", measure(
+            transaction_events,
+            std::make_pair(std::optional<ocpp1_6::ActionId> {}, std::optional<ocpp2_0::ActionId> {ocpp2_0::ActionId::kTransactionEvent}),
+            "seqNo"
+    ));
+    print("MeterValues (OCPP 1.6)", measure(
+            meter_values,
+            std::make_pair(std::optional<ocpp1_6::ActionId> {ocpp1_6::ActionId::kMeterValues}, std::optional<ocpp2_0::ActionId> {}),
+            "transactionId"
+    ));
+
+    return 0;
+}
@@ -0,0 +1,235 @@
+#include "openocpp/implementation/platform_posix.h"
+#include "openocpp/protocol/ocpp1_6/handlers/ocpp_message_handler.h"
+#include "openocpp/module/common_templates.h"
+#include "openocpp/common/logging.h"
+
+#include <new>
+#include <deque>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <iostream>
+#include <filesystem>
+
+namespace {
+    constexpr int kModules = 15;
+    constexpr int kResponses = 20000;
+
+    std::size_t gAllocations = 0;
+}
+
+void* operator new(std::size_t size) {
+    gAllocations++;
+    if (auto result = std::malloc(size == 0 ? 1 : size))
+        return result;
+
+    throw std::bad_alloc {};
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+
+namespace {
+    using namespace chargelab;
+
+    // Answers every call with a Heartbeat response on the next poll
+    class ReplyingWebsocket : public WebsocketInterface {
+    public:
+        bool isConnected() override {
+            return true;
+        }
+
+        std::optional<std::string> getSubprotocol() override {
+            return "ocpp1.6";
+        }
+
+        std::size_t pendingMessages() override {
+            return inbox_.size();
+        }
+
+        std::optional<std::string> pollMessages() override {
+            if (inbox_.empty())
+                return std::nullopt;
+
+            auto result = std::move(inbox_.front());
+            inbox_.pop_front();
+            return result;
+        }
+
+        void sendCustom(std::function<void(ByteWriterInterface&)> payload) override {
+            stream::SizeCalculator calculator;
+            payload(calculator);
+        }
+
+        void reply(std::string const& unique_id) {
+            inbox_.push_back("[3,\"" + unique_id + "\",{\"currentTime\":\"2024-03-01T10:15:00.000Z\"}]");
+        }
+
+    private:
+        std::deque<std::string> inbox_;
+    };
+
+    struct Counters {
+        int sender = 0;
+        std::size_t typed = 0;
+        std::size_t raw = 0;
+    };
+
+    class BenchmarkModule : public ServiceStateful1_6 {
+    public:
+        BenchmarkModule(int index, bool observe, ReplyingWebsocket& websocket, Counters& counters)
+            : index_(index), observe_(observe), websocket_(websocket), counters_(counters)
+        {
+        }
+
+        void runStep(ocpp1_6::OcppRemote& remote) override {
+            if (counters_.sender != index_)
+                return;
+
+            auto const unique_id = remote.sendHeartbeatReq({});
+            if (unique_id.has_value()) {
+                websocket_.reply(unique_id.value());
+                counters_.sender = (counters_.sender + 1) % kModules;
+            }
+        }
+
+        void onHeartbeatRsp(std::string const&, ocpp1_6::ResponseMessage<ocpp1_6::HeartbeatRsp> const&) override {
+            counters_.typed++;
+        }
+
+        void onCallRsp(std::string const&, ocpp1_6::ResponseMessage<common::RawJson> const&) override {
+            counters_.raw++;
+        }
+
+        bool observesResponses(ocpp1_6::ActionId const&) const override {
+            return observe_;
+        }
+
+    private:
+        int index_;
+        bool observe_;
+        ReplyingWebsocket& websocket_;
+        Counters& counters_;
+    };
+
+    struct Result {
+        double nanos_per_response = 0;
+        double allocations_per_response = 0;
+        double deliveries_per_response = 0;
+    };
+
+    template <typename Callable>
+    Result measure(Counters const& counters, Callable&& step) {
+        auto const before = gAllocations;
+        auto const start = std::chrono::steady_clock::now();
+        for (int i=0; i < kResponses; i++)
+            step();
+
+        auto const elapsed = std::chrono::steady_clock::now() - start;
+        return Result {
+                (double)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()/kResponses,
+                (double)(gAllocations - before)/kResponses,
+                (double)(counters.typed + counters.raw)/(2*kResponses)
+        };
+    }
+
+    // A step of the message handler: one response received and dispatched, then the next module sends a call
+    Result measureHandler(std::shared_ptr<PlatformPOSIX> const& platform, bool observe) {
+        ReplyingWebsocket websocket;
+        auto websocket_pointer = std::shared_ptr<WebsocketInterface> {&websocket, [](auto*) {}};
+
+        Counters counters;
+        std::vector<std::shared_ptr<AbstractModuleInterface>> modules;
+        for (int i=0; i < kModules; i++)
+            modules.push_back(std::make_shared<BenchmarkModule>(i, observe, websocket, counters));
+
+        ocpp1_6::OcppMessageHandler handler {platform->getSettings(), platform, modules, []() {return true;}};
+        handler.runStep(websocket_pointer);
+        counters = Counters {counters.sender};
+
+        return measure(counters, [&]() {
+            handler.runStep(websocket_pointer);
+        });
+    }
+
+    /**
+     * The previous dispatch: every response handler received the typed response and a RawJson built for it.
+     */
+    Result measureBroadcastLoop(std::vector<ocpp1_6::AbstractResponseHandler*> const& handlers, Counters& counters) {
+        ocpp1_6::HeartbeatRsp const parsed {};
+        return measure(counters, [&]() {
+            for (auto& ptr : handlers) {
+                ptr->onHeartbeatRsp("1", parsed);
+                ptr->onCallRsp("1", common::RawJson::from_value_lazy(parsed));
+            }
+        });
+    }
+
+    // Dispatch to the sending module only, as done by the message handler
+    Result measureRoutedLoop(std::vector<ocpp1_6::AbstractResponseHandler*> const& handlers, Counters& counters) {
+        ocpp1_6::HeartbeatRsp const parsed {};
+        int owner = 0;
+        return measure(counters, [&]() {
+            auto const ptr = handlers[owner];
+            ocpp1_6::ResponseMessage<common::RawJson> const payload {common::RawJson::from_value_lazy(parsed)};
+            ocpp1_6::ResponseMessage<ocpp1_6::HeartbeatRsp> const response {parsed};
+            ptr->onHeartbeatRsp("1", response);
+            ptr->onCallRsp("1", payload);
+            owner = (owner + 1) % kModules;
+        });
+    }
+
+    void print(char const* name, Result const& result) {
+        std::cout << "  " << name << ": " << result.nanos_per_response << "ns per response, "
+                  << result.allocations_per_response << " allocations, "
+                  << result.deliveries_per_response << " modules notified\n";
+    }
+}
+
+// Measures the cost of delivering a CallResult with kModules modules registered on the OCPP 1.6 message handler,
+// comparing delivery to the module that sent the call with every module opting in to observe all responses, and the
+// dispatch loop on its own against the previous broadcast to every response handler.
+int main(int argc, char** argv) {
+    std::string const storage_directory = argc > 1 ? argv[1] : "openocpp-benchmark-data";
+    std::filesystem::remove_all(storage_directory);
+    std::filesystem::create_directories(storage_directory);
+    logging::SetLogLevel(logging::LogLevel::warning);
+
+    auto platform = std::make_shared<PlatformPOSIX>(storage_directory, 0);
+    auto const routed = measureHandler(platform, false);
+    auto const observed = measureHandler(platform, true);
+
+    ReplyingWebsocket websocket;
+    Counters counters;
+    std::vector<std::shared_ptr<BenchmarkModule>> modules;
+    std::vector<ocpp1_6::AbstractResponseHandler*> handlers;
+    for (int i=0; i < kModules; i++) {
+        modules.push_back(std::make_shared<BenchmarkModule>(i, false, websocket, counters));
+        handlers.push_back(modules.back()->getImplementations().ocpp1_6.response_handler);
+    }
+
+    counters = Counters {};
+    auto const broadcast_loop = measureBroadcastLoop(handlers, counters);
+    counters = Counters {};
+    auto const routed_loop = measureRoutedLoop(handlers, counters);
+
+    std::cout << kResponses << " Heartbeat responses with " << kModules << " modules registered\n"
+              << " message handler step (parse, dispatch and send the next call)\n";
+    print("routed to the sender", routed);
+    print("observed by every module", observed);
+    std::cout << " dispatch only\n";
+    print("broadcast to every handler", broadcast_loop);
+    print("routed to the sender", routed_loop);
+
+    auto const delivered = routed.deliveries_per_response == 1 && observed.deliveries_per_response == kModules;
+    std::cout << "  responses delivered as expected: " << (delivered ? "yes" : "no") << "\n";
+
+    std::filesystem::remove_all(storage_directory);
+    return delivered ? 0 : 1;
+}
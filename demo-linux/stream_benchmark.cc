@@ -0,0 +1,163 @@
+#include "openocpp/protocol/ocpp1_6/handlers/ocpp_remote.h"
+#include "openocpp/protocol/ocpp2_0/handlers/ocpp_remote.h"
+#include "openocpp/helpers/file.h"
+#include "openocpp/common/logging.h"
+
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <iostream>
+
+namespace {
+    constexpr int kMessages = 500;
+    constexpr int kIterations = 20;
+    constexpr int kRounds = 5;
+    constexpr std::int64_t kStartTimestamp = 1709287200000; // 2024-03-01T10:00:00Z
+    constexpr std::int64_t kMeterValueIntervalMillis = 60*1000;
+
+    std::string timestamp(int index) {
+        auto const text = chargelab::common::DateTime::timestampToText(
+                (chargelab::SystemTimeMillis)(kStartTimestamp + index*kMeterValueIntervalMillis)
+        );
+        return "\"" + text.value() + "\"";
+    }
+
+    // Periodic meter values during a three phase session, in both protocol versions
+    std::string makeTransactionEvent(int index) {
+        std::string sampled = "{\"value\":" + std::to_string(1000.0 + index*183.5) + ",\"context\":\"Sample.Periodic\","
+                "\"measurand\":\"Energy.Active.Import.Register\",\"location\":\"Outlet\",\"unitOfMeasure\":{\"unit\":\"Wh\"}}";
+        for (auto const& phase : {"L1", "L2", "L3"}) {
+            sampled += ",{\"value\":" + std::to_string(16 + index%3) + ".2,\"context\":\"Sample.Periodic\","
+                    "\"measurand\":\"Current.Import\",\"phase\":\"" + phase + "\",\"location\":\"Outlet\","
+                    "\"unitOfMeasure\":{\"unit\":\"A\"}}";
+        }
+
+        return "{\"eventType\":\"Updated\",\"timestamp\":" + timestamp(index) + ","
+                "\"triggerReason\":\"MeterValuePeriodic\",\"seqNo\":" + std::to_string(index) + ",\"offline\":false,"
+                "\"transactionInfo\":{\"transactionId\":\"c5d3f0e2-7a41-4b8e-9f0d-2b6e1a3c4d5e\",\"chargingState\":\"Charging\"},"
+                "\"evse\":{\"id\":1,\"connectorId\":1},"
+                "\"meterValue\":[{\"timestamp\":" + timestamp(index) + ",\"sampledValue\":[" + sampled + "]}]}";
+    }
+
+    std::string makeMeterValues(int index) {
+        std::string sampled = "{\"value\":\"" + std::to_string(1000.0 + index*183.5) + "\",\"context\":\"Sample.Periodic\","
+                "\"format\":\"Raw\",\"measurand\":\"Energy.Active.Import.Register\",\"location\":\"Outlet\",\"unit\":\"Wh\"}";
+        for (auto const& phase : {"L1", "L2", "L3"}) {
+            sampled += ",{\"value\":\"" + std::to_string(16 + index%3) + ".2\",\"context\":\"Sample.Periodic\","
+                    "\"format\":\"Raw\",\"measurand\":\"Current.Import\",\"phase\":\"" + phase + "\","
+                    "\"location\":\"Outlet\",\"unit\":\"A\"}";
+        }
+
+        return "{\"connectorId\":1,\"transactionId\":1042,\"meterValue\":[{\"timestamp\":" + timestamp(index) + ","
+                "\"sampledValue\":[" + sampled + "]}]}";
+    }
+
+    // Vendor specific payload, such as a diagnostics snapshot, carried as base64 text
+    std::string makeDataTransfer(int index) {
+        static char const kAlphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        std::string data;
+        for (int i=0; i < 2048; i++)
+            data += kAlphabet[(index*31 + i*7) % 64];
+
+        return "{\"vendorId\":\"com.chargelab\",\"messageId\":\"Diagnostics\",\"data\":\"" + data + "\"}";
+    }
+
+    template <typename T>
+    struct Messages {
+        std::vector<T> values;
+        std::vector<std::string> text;
+        std::size_t bytes = 0;
+    };
+
+    template <typename T, typename Factory>
+    Messages<T> makeMessages(Factory&& factory) {
+        Messages<T> result;
+        for (int i=0; i < kMessages; i++) {
+            result.values.push_back(chargelab::read_json_from_string<T>(factory(i)).value());
+            result.text.push_back(chargelab::write_json_to_string(result.values.back()));
+            result.bytes += result.text.back().size();
+        }
+
+        return result;
+    }
+
+    // Best throughput in MB/s over kRounds rounds of kIterations passes, each handling every message once
+    template <typename Callable>
+    double timeMegabytesPerSecond(std::size_t bytes, Callable&& callable) {
+        double result = 0;
+        for (int round=0; round < kRounds; round++) {
+            auto const start = std::chrono::steady_clock::now();
+            for (int i=0; i < kIterations; i++)
+                callable();
+
+            auto const elapsed = std::chrono::steady_clock::now() - start;
+            auto const seconds = (double)std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()/1e6;
+            result = std::max(result, (double)(bytes*kIterations)/1e6/seconds);
+        }
+
+        return result;
+    }
+
+    template <typename T>
+    bool measure(char const* name, Messages<T> const& messages, std::FILE* file) {
+        bool consistent = true;
+        auto const to_string = timeMegabytesPerSecond(messages.bytes, [&]() {
+            for (std::size_t i=0; i < messages.values.size(); i++)
+                consistent &= chargelab::write_json_to_string(messages.values[i]) == messages.text[i];
+        });
+
+        auto const to_file = timeMegabytesPerSecond(messages.bytes, [&]() {
+            std::rewind(file);
+            for (auto const& x : messages.values)
+                chargelab::file::json_write_object_to_file(file, x);
+        });
+        std::fflush(file);
+        consistent &= std::ftell(file) == (long)(messages.bytes + messages.values.size());
+
+        std::size_t calculated = 0;
+        auto const size = timeMegabytesPerSecond(messages.bytes, [&]() {
+            for (auto const& x : messages.values)
+                calculated += chargelab::calculate_size(x);
+        });
+        consistent &= calculated == messages.bytes*kIterations*kRounds;
+
+        auto const parse = timeMegabytesPerSecond(messages.bytes, [&]() {
+            for (auto const& x : messages.text)
+                consistent &= chargelab::read_json_from_string<T>(x).has_value();
+        });
+
+        std::cout << "  " << name << " (" << messages.bytes/messages.values.size() << " bytes per message): "
+                  << to_string << " MB/s to string, " << to_file << " MB/s to file, "
+                  << size << " MB/s size calculation, " << parse << " MB/s parsing\n";
+        return consistent;
+    }
+}
+
+// Measures JSON serialization throughput through the buffered stream writers (to a string, to a file and into the
+// size calculator), and parsing throughput through the buffered reader, for typical meter value messages and a data
+// transfer carrying a long string.
+int main() {
+    using namespace chargelab;
+    logging::SetLogLevel(logging::LogLevel::warning);
+
+    auto const meter_values = makeMessages<ocpp1_6::MeterValuesReq>(makeMeterValues);
+    auto const transaction_events = makeMessages<ocpp2_0::TransactionEventRequest>(makeTransactionEvent);
+    auto const data_transfers = makeMessages<ocpp1_6::DataTransferReq>(makeDataTransfer);
+
+    auto file = std::tmpfile();
+    if (file == nullptr) {
+        std::cerr << "Failed creating temporary file\n";
+        return 1;
+    }
+
+    std::cout << kMessages << " messages of each type, best of " << kRounds << " rounds of " << kIterations << " passes\n";
+    auto consistent = measure("MeterValues", meter_values, file);
+    consistent &= measure("TransactionEvent", transaction_events, file);
+    consistent &= measure("DataTransfer", data_transfers, file);
+    std::cout << "  output consistent: " << (consistent ? "yes" : "no") << "\n";
+
+    std::fclose(file);
+    return consistent ? 0 : 1;
+}
@@ -4,51 +4,120 @@
 #include "openocpp/common/compressed_queue.h"
 #include "openocpp/interface/element/flash_block_interface.h"
 
+#include <atomic>
+#include <limits>
+#include <cstddef>
+
 namespace chargelab {
+    namespace detail {
+        class CompressedJournalConstants {
+        public:
+            static constexpr std::uint32_t kSectorMagic = 0x4A4C4243;
+            // Sectors smaller than this are ignored and the whole partition is used as a single sector
+            static constexpr std::size_t kMinimumSectorSize = 256;
+
+            static constexpr std::uint8_t kFrameCheckpointBegin = 1;
+            static constexpr std::uint8_t kFrameCheckpointRecord = 2;
+            static constexpr std::uint8_t kFrameCheckpointEnd = 3;
+            static constexpr std::uint8_t kFrameDelta = 4;
+
+            static constexpr std::uint8_t kFlagCompressed = 0x01;
+            static constexpr std::uint8_t kFlagDictionary = 0x02;
+
+            // Preset dictionary for compressing frames, limited to the deflate window
+            static constexpr std::size_t kDictionarySize = 1 << CompressedStreamZlibConstants::kZlibWindowBits;
+        };
+
+        struct JournalSectorHeader {
+            std::uint32_t magic;
+            std::uint32_t sequence;
+            std::uint32_t version_crc;
+            std::uint32_t crc;
+        };
+        static_assert(sizeof(JournalSectorHeader) == 16);
+
+        struct JournalFrameHeader {
+            std::uint16_t length;
+            std::uint8_t type;
+            std::uint8_t flags;
+            std::uint32_t crc;
+        };
+        static_assert(sizeof(JournalFrameHeader) == 8);
+    }
+
+    /**
+     * Journal of updates stored in a flash partition, replayed on start-up to recover the final state.
+     *
+     * The partition is used as a ring of erase sectors. Each sector starts with a header holding a sequence number,
+     * followed by frames with a length, type and CRC. Frame payloads are deflated on their own, with the records of the
+     * live checkpoint as a preset dictionary, and stored as-is if that doesn't make them smaller. An update is appended as a single delta frame, so it only programs the bytes of that frame. Once the
+     * current sector is full a checkpoint of the final state is written to the oldest sector that doesn't hold any
+     * live frames, and only that sector is erased. On recovery the frames are replayed from the last complete
+     * checkpoint, and a torn frame at the tail is ignored.
+     *
+     * Note: partitions written in the previous format (a single deflate stream after the protocol version) are still
+     * read, and are replaced by a checkpoint on the first update.
+     */
     template <typename T, typename Serializer>
     class CompressedJournalCustom {
+    private:
+        using constants = detail::CompressedJournalConstants;
+
     public:
         explicit CompressedJournalCustom(std::unique_ptr<FlashBlockInterface> storage, std::string protocol_version)
             : storage_(std::move(storage)),
               protocol_version_(std::move(protocol_version))
         {
+            auto const size = storage_->size();
+            auto const sector_size = storage_->sectorSize();
+            if (sector_size >= constants::kMinimumSectorSize && sector_size <= size && size % sector_size == 0) {
+                sector_size_ = sector_size;
+            } else {
+                sector_size_ = size;
+            }
+
+            sector_count_ = sector_size_ > 0 ? size/sector_size_ : 0;
+            version_crc_ = crc32(0, (Bytef const*)protocol_version_.data(), protocol_version_.size());
         }
 
         bool addUpdate(std::vector<T> const& final_state, T const& delta) {
-            // First try to add the delta to the stream
-            if (addToStream(std::vector<T>{delta}))
-                return true;
+            recover();
+
+            // First try to append the delta to the current sector
+            if (write_sector_.has_value()) {
+                auto const frame = encodeFrame(constants::kFrameDelta, Serializer::write(delta), dictionary_);
+                if (write_offset_ + frame.size() <= sector_size_) {
+                    if (!writeFrame(write_sector_.value(), write_offset_, frame)) {
+                        write_sector_ = std::nullopt;
+                        return false;
+                    }
+
+                    write_offset_ += frame.size();
+                    live_last_sequence_ = sector_sequences_[write_sector_.value()].value();
+                    return true;
+                }
+            }
 
-            // Otherwise erase flash storage and write the final state
-            CHARGELAB_LOG_MESSAGE(info) << "Available journal storage exhausted - clearing";
-            storage_->erase();
-            writeHeader();
-            return addToStream(final_state);
+            // Otherwise start a new sector with a checkpoint of the final state
+            return writeCheckpoint(final_state);
         }
 
         template <typename Visitor>
         void visit(Visitor&& visitor) {
-            if (!checkHeader())
+            recover();
+            if (legacy_format_) {
+                visitLegacy(visitor);
                 return;
+            }
 
-            std::vector<uint8_t> raw_data;
-            raw_data.resize(storage_->size() - protocol_version_.size());
-            storage_->read(protocol_version_.size(), raw_data.data(), raw_data.size());
-
-            std::vector<uint8_t> input_buffer;
-            CompressedInputStreamZLib input(input_buffer, raw_data.data(), raw_data.size(), true);
-            while (true) {
-                auto record = input.nextRecord();
-                if (!record.has_value())
-                    break;
-
-                auto result = Serializer::read(record.value());
+            replayLive([&](std::string_view const& text) {
+                auto result = Serializer::read(text);
                 if (result.has_value()) {
-                    visitor(record.value(), result.value());
+                    visitor(text, result.value());
                 } else {
-                    CHARGELAB_LOG_MESSAGE(warning) << "Failed deserializing payload: " << record.value();
+                    CHARGELAB_LOG_MESSAGE(warning) << "Failed deserializing payload: " << text;
                 }
-            }
+            });
         }
 
         [[nodiscard]] std::size_t totalBytesWritten() const {
@@ -60,84 +129,443 @@ namespace chargelab {
         }
 
     private:
-        bool checkHeader() {
-            std::string test;
-            test.resize(protocol_version_.size());
-            storage_->read(0, test.data(), test.size());
-            return test == protocol_version_;
+        struct ScanResult {
+            std::size_t end_offset;
+            // False if the scan stopped at a frame that failed validation rather than at erased flash
+            bool clean;
+        };
+
+        void recover() {
+            if (recovered_)
+                return;
+
+            recovered_ = true;
+            sector_sequences_.assign(sector_count_, std::nullopt);
+            for (std::size_t i=0; i < sector_count_; i++) {
+                detail::JournalSectorHeader header {};
+                if (!storage_->read(i*sector_size_, &header, sizeof(header)))
+                    continue;
+
+                auto const crc = crc32(0, (Bytef const*)&header, offsetof(detail::JournalSectorHeader, crc));
+                if (header.magic == constants::kSectorMagic && header.version_crc == version_crc_ && header.crc == crc)
+                    sector_sequences_[i] = header.sequence;
+            }
+
+            std::optional<std::uint32_t> last_sequence;
+            for (auto const& x : sector_sequences_) {
+                if (x.has_value() && (!last_sequence.has_value() || x.value() > last_sequence.value()))
+                    last_sequence = x;
+            }
+
+            if (!last_sequence.has_value()) {
+                legacy_format_ = checkLegacyHeader();
+                if (legacy_format_)
+                    CHARGELAB_LOG_MESSAGE(info) << "Found journal in the previous format - it will be replaced on the next update";
+
+                return;
+            }
+
+            // The log is the run of consecutive sequence numbers ending at the most recent sector
+            auto first_sequence = last_sequence.value();
+            while (first_sequence > 0 && findSector(first_sequence - 1).has_value())
+                first_sequence--;
+
+            next_sequence_ = last_sequence.value() + 1;
+
+            std::optional<std::uint32_t> pending_sequence;
+            std::size_t pending_offset = 0;
+            ScanResult tail {0, false};
+            for (auto sequence = first_sequence; sequence <= last_sequence.value(); sequence++) {
+                tail = scanSector(findSector(sequence).value(), [&](std::size_t offset, detail::JournalFrameHeader const& header, std::uint8_t const*) {
+                    switch (header.type) {
+                        default:
+                            break;
+
+                        case constants::kFrameCheckpointBegin:
+                            pending_sequence = sequence;
+                            pending_offset = offset;
+                            break;
+
+                        case constants::kFrameCheckpointEnd:
+                            if (pending_sequence.has_value()) {
+                                live_first_sequence_ = pending_sequence;
+                                live_begin_offset_ = pending_offset;
+                                live_last_sequence_ = sequence;
+                                pending_sequence = std::nullopt;
+                            }
+                            break;
+
+                        case constants::kFrameDelta:
+                            if (live_first_sequence_.has_value() && !pending_sequence.has_value())
+                                live_last_sequence_ = sequence;
+                            break;
+                    }
+                });
+            }
+
+            if (!live_first_sequence_.has_value()) {
+                CHARGELAB_LOG_MESSAGE(warning) << "No complete checkpoint found in journal";
+                return;
+            }
+
+            // Keep appending to the most recent sector unless it ends with a torn frame or an incomplete checkpoint
+            if (tail.clean && !pending_sequence.has_value() && live_last_sequence_ == last_sequence.value()) {
+                write_sector_ = findSector(last_sequence.value());
+                write_offset_ = tail.end_offset;
+                replayLive([](std::string_view const&) {});
+            }
         }
 
-        bool writeHeader() {
-            return storage_->write(0, protocol_version_.data(), protocol_version_.size());
+        /**
+         * Decodes the records of the live checkpoint and the deltas after it, leaving the dictionary built from the
+         * checkpoint records in dictionary_.
+         */
+        template <typename Visitor>
+        void replayLive(Visitor&& visitor) {
+            dictionary_.clear();
+            if (!live_first_sequence_.has_value())
+                return;
+
+            std::string text;
+            for (auto sequence = live_first_sequence_.value(); sequence <= live_last_sequence_; sequence++) {
+                auto const sector = findSector(sequence);
+                if (!sector.has_value())
+                    break;
+
+                auto const first_offset = sequence == live_first_sequence_ ?
+                        live_begin_offset_ :
+                        sizeof(detail::JournalSectorHeader);
+
+                scanSector(sector.value(), [&](std::size_t offset, detail::JournalFrameHeader const& header, std::uint8_t const* payload) {
+                    if (offset < first_offset)
+                        return;
+                    if (header.type != constants::kFrameCheckpointRecord && header.type != constants::kFrameDelta)
+                        return;
+
+                    if (!decodePayload(header, payload, dictionary_, text)) {
+                        CHARGELAB_LOG_MESSAGE(warning) << "Failed decoding journal frame at offset: " << offset;
+                        return;
+                    }
+
+                    if (header.type == constants::kFrameCheckpointRecord)
+                        appendDictionary(dictionary_, text);
+
+                    visitor(std::string_view {text});
+                });
+            }
         }
 
-        bool addToStream(std::vector<T> const& records) {
-            if (!checkHeader())
-                return false;
+        template <typename Visitor>
+        ScanResult scanSector(std::size_t sector, Visitor&& visitor) {
+            std::vector<std::uint8_t> data;
+            data.resize(sector_size_);
+            if (!storage_->read(sector*sector_size_, data.data(), data.size()))
+                return ScanResult {sizeof(detail::JournalSectorHeader), false};
 
-            std::vector<uint8_t> raw_data;
-            raw_data.resize(storage_->size() - protocol_version_.size());
-            storage_->read(protocol_version_.size(), raw_data.data(), raw_data.size());
+            auto offset = sizeof(detail::JournalSectorHeader);
+            while (offset + sizeof(detail::JournalFrameHeader) <= data.size()) {
+                detail::JournalFrameHeader header {};
+                std::memcpy(&header, &data[offset], sizeof(header));
+                if (header.length == std::numeric_limits<std::uint16_t>::max() && header.type == 0xFF)
+                    return ScanResult {offset, true};
 
-            std::vector<uint8_t> input_buffer;
-            std::vector<uint8_t> output_buffer;
-            CompressedInputStreamZLib input(input_buffer, raw_data.data(), raw_data.size(), true);
-            CompressedOutputStreamZLib output(output_buffer, Z_SYNC_FLUSH);
-            while (true) {
-                auto record = input.nextRecord();
-                if (!record.has_value())
-                    break;
+                auto const end = offset + sizeof(header) + header.length;
+                if (end > data.size() || header.crc != frameCrc(header, data.data() + offset + sizeof(header))) {
+                    CHARGELAB_LOG_MESSAGE(warning) << "Invalid journal frame in sector " << sector << " at offset: " << offset;
+                    return ScanResult {offset, false};
+                }
 
-                output.addRecord(record.value());
+                visitor(offset, header, data.data() + offset + sizeof(header));
+                offset = end;
             }
 
-            for (auto const& x : records)
-                output.addRecord(Serializer::write(x));
+            return ScanResult {offset, true};
+        }
 
-            if (!output.close(false) || output_buffer.size() > raw_data.size())
-                return false;
+        bool writeCheckpoint(std::vector<T> const& final_state) {
+            write_sector_ = std::nullopt;
+            dictionary_.clear();
 
-            total_bytes_ = output_buffer.size();
+            std::optional<std::uint32_t> checkpoint_sequence;
+            std::optional<std::size_t> sector;
+            std::size_t offset = 0;
+            auto const append = [&](std::uint8_t type, std::string_view const& record) {
+                auto const frame = encodeFrame(type, record, dictionary_);
+                if (!sector.has_value() || offset + frame.size() > sector_size_) {
+                    if (sizeof(detail::JournalSectorHeader) + frame.size() > sector_size_) {
+                        CHARGELAB_LOG_MESSAGE(warning) << "Journal record doesn't fit in a sector: " << frame.size() << " bytes";
+                        return false;
+                    }
 
-            std::size_t first_index = 0;
-            while (first_index < output_buffer.size()) {
-                auto const old_byte = raw_data[first_index];
-                auto const new_byte = output_buffer[first_index];
+                    sector = startSector(checkpoint_sequence);
+                    if (!sector.has_value())
+                        return false;
 
-                // Note: assuming write operations can only set bits to zero in between erase operations
-                if ((old_byte & new_byte) != new_byte)
+                    if (!checkpoint_sequence.has_value())
+                        checkpoint_sequence = sector_sequences_[sector.value()];
+
+                    offset = sizeof(detail::JournalSectorHeader);
+                }
+
+                if (!writeFrame(sector.value(), offset, frame))
+                    return false;
+
+                offset += frame.size();
+                return true;
+            };
+
+            if (!append(constants::kFrameCheckpointBegin, {}))
+                return false;
+            for (auto const& x : final_state) {
+                auto const record = Serializer::write(x);
+                if (!append(constants::kFrameCheckpointRecord, record))
                     return false;
 
-                if (old_byte != new_byte)
+                appendDictionary(dictionary_, record);
+            }
+            if (!append(constants::kFrameCheckpointEnd, {}))
+                return false;
+
+            legacy_format_ = false;
+            live_first_sequence_ = checkpoint_sequence;
+            live_begin_offset_ = sizeof(detail::JournalSectorHeader);
+            live_last_sequence_ = sector_sequences_[sector.value()].value();
+            write_sector_ = sector;
+            write_offset_ = offset;
+            return true;
+        }
+
+        /**
+         * Erases a sector for the checkpoint that started at checkpoint_sequence (if any) and writes its header,
+         * preferring sectors that don't hold any frames of the live state.
+         */
+        std::optional<std::size_t> startSector(std::optional<std::uint32_t> const& checkpoint_sequence) {
+            std::optional<std::size_t> result;
+            std::optional<std::size_t> fallback;
+            for (std::size_t i=0; i < sector_count_; i++) {
+                auto const& sequence = sector_sequences_[i];
+                if (!sequence.has_value()) {
+                    result = i;
                     break;
+                }
+
+                if (checkpoint_sequence.has_value() && sequence.value() >= checkpoint_sequence.value())
+                    continue;
+
+                auto const older = [&](std::optional<std::size_t> const& other) {
+                    return !other.has_value() || sequence.value() < sector_sequences_[other.value()].value();
+                };
 
-                first_index++;
+                auto const live = live_first_sequence_.has_value() &&
+                        sequence.value() >= live_first_sequence_.value() &&
+                        sequence.value() <= live_last_sequence_;
+                if (!live && older(result))
+                    result = i;
+                if (older(fallback))
+                    fallback = i;
             }
 
-            if (first_index >= output_buffer.size())
-                return true;
+            if (!result.has_value()) {
+                if (!fallback.has_value()) {
+                    CHARGELAB_LOG_MESSAGE(warning) << "Available journal storage exhausted";
+                    return std::nullopt;
+                }
 
-            auto last_index = first_index;
-            for (auto i = first_index; i < output_buffer.size(); i++) {
-                auto const old_byte = raw_data[i];
-                auto const new_byte = output_buffer[i];
+                CHARGELAB_LOG_MESSAGE(info) << "Journal checkpoint doesn't fit in free sectors - clearing live sector";
+                live_first_sequence_ = std::nullopt;
+                result = fallback;
+            }
 
-                // Note: assuming write operations can only set bits to zero in between erase operations
-                if ((old_byte & new_byte) != new_byte)
-                    return false;
-                if (old_byte != new_byte)
-                    last_index = i;
+            auto const sector = result.value();
+            sector_sequences_[sector] = std::nullopt;
+            auto const erased = sector_count_ > 1 ? storage_->eraseSector(sector*sector_size_) : storage_->erase();
+            if (!erased) {
+                CHARGELAB_LOG_MESSAGE(warning) << "Failed erasing journal sector: " << sector;
+                return std::nullopt;
+            }
+
+            detail::JournalSectorHeader header {constants::kSectorMagic, next_sequence_, version_crc_, 0};
+            header.crc = crc32(0, (Bytef const*)&header, offsetof(detail::JournalSectorHeader, crc));
+            if (!storage_->write(sector*sector_size_, &header, sizeof(header)))
+                return std::nullopt;
+
+            bytes_written_ += sizeof(header);
+            sector_sequences_[sector] = next_sequence_++;
+            return sector;
+        }
+
+        bool writeFrame(std::size_t sector, std::size_t offset, std::vector<std::uint8_t> const& frame) {
+            bytes_written_ += frame.size();
+            return storage_->write(sector*sector_size_ + offset, (void*)frame.data(), frame.size());
+        }
+
+        std::optional<std::size_t> findSector(std::uint32_t sequence) const {
+            for (std::size_t i=0; i < sector_sequences_.size(); i++) {
+                if (sector_sequences_[i] == sequence)
+                    return i;
+            }
+
+            return std::nullopt;
+        }
+
+        static std::uint32_t frameCrc(detail::JournalFrameHeader const& header, std::uint8_t const* payload) {
+            auto const result = crc32(0, (Bytef const*)&header, offsetof(detail::JournalFrameHeader, crc));
+            return crc32(result, payload, header.length);
+        }
+
+        /**
+         * Frames the record, deflating it first if that makes it smaller. Compressed payloads are prefixed with the
+         * size of the original record.
+         */
+        static std::vector<std::uint8_t> encodeFrame(std::uint8_t type, std::string_view const& record, std::string const& dictionary) {
+            std::vector<std::uint8_t> result;
+            result.resize(sizeof(detail::JournalFrameHeader));
+
+            detail::JournalFrameHeader header {0, type, 0, 0};
+            if (record.size() > sizeof(std::uint16_t) && record.size() <= std::numeric_limits<std::uint16_t>::max()) {
+                auto const original_size = (std::uint16_t)record.size();
+                result.resize(result.size() + sizeof(original_size));
+                std::memcpy(result.data() + sizeof(header), &original_size, sizeof(original_size));
+                if (deflateRecord(record, dictionary, result) && result.size() - sizeof(header) < record.size()) {
+                    header.flags |= constants::kFlagCompressed;
+                    if (!dictionary.empty())
+                        header.flags |= constants::kFlagDictionary;
+                }
+            }
+
+            if ((header.flags & constants::kFlagCompressed) == 0) {
+                result.resize(sizeof(header));
+                result.insert(result.end(), record.begin(), record.end());
+            }
+
+            header.length = (std::uint16_t)(result.size() - sizeof(header));
+            header.crc = frameCrc(header, result.data() + sizeof(header));
+            std::memcpy(result.data(), &header, sizeof(header));
+            return result;
+        }
+
+        static bool deflateRecord(std::string_view const& record, std::string const& dictionary, std::vector<std::uint8_t>& output) {
+            z_stream stream {};
+            auto ret = deflateInit2(
+                    &stream,
+                    detail::CompressedStreamZlibConstants::kZlibLevel,
+                    Z_DEFLATED,
+                    -detail::CompressedStreamZlibConstants::kZlibWindowBits,
+                    detail::CompressedStreamZlibConstants::kZlibMemLevel,
+                    Z_DEFAULT_STRATEGY
+            );
+            if (ret != Z_OK) {
+                CHARGELAB_LOG_MESSAGE(warning) << "deflateInit failed with error code: " << ret;
+                return false;
+            }
+
+            if (!dictionary.empty())
+                deflateSetDictionary(&stream, (Bytef const*)dictionary.data(), dictionary.size());
+
+            auto const index = output.size();
+            output.resize(index + deflateBound(&stream, record.size()));
+            stream.next_in = (Bytef*)record.data();
+            stream.avail_in = record.size();
+            stream.next_out = output.data() + index;
+            stream.avail_out = output.size() - index;
+            ret = deflate(&stream, Z_FINISH);
+            output.resize(output.size() - stream.avail_out);
+            deflateEnd(&stream);
+            return ret == Z_STREAM_END;
+        }
+
+        static bool decodePayload(
+                detail::JournalFrameHeader const& header,
+                std::uint8_t const* payload,
+                std::string const& dictionary,
+                std::string& text
+        ) {
+            if ((header.flags & constants::kFlagCompressed) == 0) {
+                text.assign((char const*)payload, header.length);
+                return true;
             }
 
-            auto const size = last_index - first_index + 1;
-            bytes_written_ += size;
-            return storage_->write(protocol_version_.size() + first_index, &output_buffer[first_index], size);
+            std::uint16_t original_size;
+            if (header.length < sizeof(original_size))
+                return false;
+
+            std::memcpy(&original_size, payload, sizeof(original_size));
+            text.resize(original_size);
+
+            z_stream stream {};
+            if (inflateInit2(&stream, -detail::CompressedStreamZlibConstants::kZlibWindowBits) != Z_OK)
+                return false;
+
+            // Note: raw deflate streams don't record the dictionary, so it has to be set before inflating
+            if ((header.flags & constants::kFlagDictionary) != 0)
+                inflateSetDictionary(&stream, (Bytef const*)dictionary.data(), dictionary.size());
+
+            stream.next_in = (Bytef*)payload + sizeof(original_size);
+            stream.avail_in = header.length - sizeof(original_size);
+            stream.next_out = (Bytef*)text.data();
+            stream.avail_out = text.size();
+            auto const ret = inflate(&stream, Z_FINISH);
+            inflateEnd(&stream);
+            return ret == Z_STREAM_END && stream.avail_out == 0;
+        }
+
+        static void appendDictionary(std::string& dictionary, std::string_view const& record) {
+            dictionary.append(record.data(), record.size());
+            if (dictionary.size() > constants::kDictionarySize)
+                dictionary.erase(0, dictionary.size() - constants::kDictionarySize);
+        }
+
+        bool checkLegacyHeader() {
+            std::string test;
+            test.resize(protocol_version_.size());
+            storage_->read(0, test.data(), test.size());
+            return test == protocol_version_;
+        }
+
+        template <typename Visitor>
+        void visitLegacy(Visitor&& visitor) {
+            std::vector<uint8_t> raw_data;
+            raw_data.resize(storage_->size() - protocol_version_.size());
+            storage_->read(protocol_version_.size(), raw_data.data(), raw_data.size());
+
+            std::vector<uint8_t> input_buffer;
+            CompressedInputStreamZLib input(input_buffer, raw_data.data(), raw_data.size(), true);
+            while (true) {
+                auto record = input.nextRecord();
+                if (!record.has_value())
+                    break;
+
+                auto result = Serializer::read(record.value());
+                if (result.has_value()) {
+                    visitor(record.value(), result.value());
+                } else {
+                    CHARGELAB_LOG_MESSAGE(warning) << "Failed deserializing payload: " << record.value();
+                }
+            }
         }
 
     private:
         std::unique_ptr<FlashBlockInterface> storage_;
         std::string protocol_version_;
-        std::optional<std::size_t> total_bytes_;
+        std::size_t sector_size_;
+        std::size_t sector_count_;
+        std::uint32_t version_crc_;
+
+        bool recovered_ = false;
+        bool legacy_format_ = false;
+        std::vector<std::optional<std::uint32_t>> sector_sequences_;
+        std::uint32_t next_sequence_ = 0;
+
+        // The live state starts with the checkpoint at live_begin_offset_ in the sector with live_first_sequence_,
+        // and continues up to the sector with live_last_sequence_
+        std::optional<std::uint32_t> live_first_sequence_;
+        std::size_t live_begin_offset_ = 0;
+        std::uint32_t live_last_sequence_ = 0;
+
+        // Sector receiving delta frames; unset when the next update has to write a checkpoint
+        std::optional<std::size_t> write_sector_;
+        std::size_t write_offset_ = 0;
+        std::string dictionary_;
 
         std::atomic<std::size_t> bytes_written_ = 0;
     };
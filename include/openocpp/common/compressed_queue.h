@@ -5,10 +5,13 @@
 
 #include <optional>
 #include <vector>
+#include <memory>
+#include <algorithm>
 #include <cstdint>
 #include <cstring>
 #include <variant>
 #include <string>
+#include <type_traits>
 
 #include "zlib.h"
 
@@ -29,6 +32,14 @@ namespace chargelab {
             static constexpr std::size_t kInflateBufferInitialSize = 256;
             static constexpr std::size_t kDeflateBufferStepSize = 256;
         };
+
+        /**
+         * Block summary for queues that don't keep one.
+         */
+        struct NoBlockSummary {
+            void add(std::string_view const&) {}
+            void remove(std::string_view const&) {}
+        };
     }
 
     class CompressedOutputStreamZLib {
@@ -49,13 +60,15 @@ namespace chargelab {
         CompressedOutputStreamZLib& operator=(CompressedOutputStreamZLib const&) = delete;
         CompressedOutputStreamZLib& operator=(CompressedOutputStreamZLib&&) = delete;
 
-        void addRecord(std::string_view const& record) {
+        bool addRecord(std::string_view const& record) {
             if (!initialized_)
-                return;
+                return false;
 
             int size_prefix = (int)record.size();
-            writeBlock(&size_prefix, sizeof(size_prefix), Z_NO_FLUSH);
-            writeBlock(record.data(), record.size(), record_flush_);
+            if (!writeBlock(&size_prefix, sizeof(size_prefix), Z_NO_FLUSH))
+                return false;
+
+            return writeBlock(record.data(), record.size(), record_flush_);
         }
 
         void reset() {
@@ -100,7 +113,7 @@ namespace chargelab {
         }
 
     private:
-        void writeBlock(void const* data, std::size_t size, int flush) {
+        bool writeBlock(void const* data, std::size_t size, int flush) {
             stream_.next_in = (uint8_t*)data;
             stream_.avail_in = size;
 
@@ -115,12 +128,13 @@ namespace chargelab {
                 auto const ret = deflate(&stream_, flush);
                 if (ret != Z_OK) {
                     CHARGELAB_LOG_MESSAGE(warning) << "deflate failed with error code: " << ret;
-                    return;
+                    return false;
                 }
             } while(stream_.avail_out == 0);
 
             stream_.next_in = Z_NULL;
             stream_.avail_in = 0;
+            return true;
         }
 
         void resetInternal() {
@@ -220,6 +234,28 @@ namespace chargelab {
             return true;
         }
 
+        /**
+         * Points the stream at a (possibly relocated or extended) copy of the compressed data it was created with.
+         * Bytes that were already consumed are skipped, which allows records appended to a sync-flushed stream to be
+         * read incrementally.
+         */
+        void rebase(uint8_t* data, std::size_t size) {
+            auto const consumed = consumedBytes();
+            if (consumed > size) {
+                CHARGELAB_LOG_MESSAGE(warning) << "Compressed data truncated while reading: " << consumed << " > " << size;
+                stream_.next_in = data + size;
+                stream_.avail_in = 0;
+                return;
+            }
+
+            stream_.next_in = data + consumed;
+            stream_.avail_in = size - consumed;
+        }
+
+        [[nodiscard]] std::size_t consumedBytes() const {
+            return stream_.total_in;
+        }
+
     private:
         void const* readBlock(std::size_t size) {
             auto bytes_present = buffer_.size() - stream_.avail_out - index_;
@@ -238,8 +274,13 @@ namespace chargelab {
 
             while (true) {
                 auto const avail_begin = stream_.avail_in;
+                auto const avail_out_begin = stream_.avail_out;
                 auto const ret = inflate(&stream_, Z_BLOCK);
                 auto const avail_end = stream_.avail_in;
+
+                // Note: a sync-flushed stream that hasn't been finished yet simply runs out of input
+                if (ret == Z_BUF_ERROR && avail_end == 0)
+                    return nullptr;
                 if (ret != Z_OK && ret != Z_STREAM_END) {
                     if (!ignore_read_errors_) {
                         CHARGELAB_LOG_MESSAGE(warning) << "inflate failed with error code " << ret << ": "
@@ -252,7 +293,9 @@ namespace chargelab {
                 bytes_present = buffer_.size() - stream_.avail_out - index_;
                 if (bytes_present >= size)
                     break;
-                if (avail_begin == avail_end)
+                // Note: inflate may still produce output from buffered input at a block boundary without consuming
+                // any further input
+                if (avail_begin == avail_end && avail_out_begin == stream_.avail_out)
                     return nullptr;
             }
 
@@ -269,183 +312,251 @@ namespace chargelab {
         std::size_t index_ = 0;
     };
 
-    class CompressedQueueRawZLib {
+    /**
+     * Queue of records stored as a sequence of compressed blocks.
+     *
+     * The final block is kept open as a deflate stream that is sync-flushed after every record, so appending a record
+     * only compresses that record. Once the block exceeds kCompressedBlockThreshold its records are recompressed as a
+     * single finished stream and a new block is started. The front of the queue is read through a persistent inflate stream with a cursor past any records that
+     * were already popped, so popping or updating the front record doesn't recompress the block either; the consumed
+     * records are only dropped from the front block when it's written out or fully consumed.
+     *
+     * Each block also has a Summary of the records it holds, which is updated as records are added and removed so
+     * that callers can decide which blocks to look at without decompressing them. Summary must provide add() and
+     * remove() taking the record text.
+     *
+     * Note: the open deflate stream for the final block is retained between calls (~10KiB with the window and memory
+     * levels used here).
+     */
+    template <typename Summary>
+    class BasicCompressedQueueZLib {
+    public:
+        using summary_type = Summary;
+
     public:
-        CompressedQueueRawZLib() {
+        BasicCompressedQueueZLib() {
         }
 
+        BasicCompressedQueueZLib(BasicCompressedQueueZLib const&) = delete;
+        BasicCompressedQueueZLib(BasicCompressedQueueZLib&&) = delete;
+        BasicCompressedQueueZLib& operator=(BasicCompressedQueueZLib const&) = delete;
+        BasicCompressedQueueZLib& operator=(BasicCompressedQueueZLib&&) = delete;
+
         // Use poll first and pop first instead, and just remove when the attempts time-out
         std::optional<std::string> pollFront() {
-            if (blocks_.empty())
+            if (!loadFront())
                 return std::nullopt;
 
-            CompressedInputStreamZLib input {inflate_buffer_, blocks_.front().data(), blocks_.front().size()};
-            auto const record = input.nextRecord();
-            if (!record.has_value()) {
-                CHARGELAB_LOG_MESSAGE(warning) << "Unexpected state - no records present in chunk";
-                blocks_.erase(blocks_.begin());
-                return std::nullopt;
-            }
-
-            return std::string {record.value()};
+            return front_record_;
         }
 
         std::optional<std::string> popFront() {
-            if (blocks_.empty())
-                return std::nullopt;
-
-            CompressedInputStreamZLib input {inflate_buffer_, blocks_.front().data(), blocks_.front().size()};
-            auto const record = input.nextRecord();
-            if (!record.has_value()) {
-                CHARGELAB_LOG_MESSAGE(warning) << "Unexpected state - no records present in chunk";
-                blocks_.erase(blocks_.begin());
+            if (!loadFront())
                 return std::nullopt;
-            }
-            auto result = std::string {record.value()};
 
-            bool empty = true;
-            CompressedOutputStreamZLib output {deflate_buffer_};
-            while (true) {
-                auto const& x = input.nextRecord();
-                if (!x.has_value())
-                    break;
-
-                output.addRecord(x.value());
-                empty = false;
-            }
-
-            output.close();
-            if (empty) {
-                blocks_.erase(blocks_.begin());
-            } else {
-                blocks_.front() = deflate_buffer_;
-            }
+            auto result = std::move(front_record_);
+            frontSummary().remove(result.value());
+            front_record_ = std::nullopt;
+            front_modified_ = false;
+            front_consumed_records_++;
 
+            // Note: reading ahead here so that empty() reflects the state of the queue after removing the record
+            loadFront();
             return result;
         }
 
         void updateFront(std::string const& update) {
-            if (blocks_.empty())
+            if (!loadFront())
                 return;
 
-            CompressedInputStreamZLib input {inflate_buffer_, blocks_.front().data(), blocks_.front().size()};
-            auto const record = input.nextRecord();
-            if (!record.has_value()) {
-                CHARGELAB_LOG_MESSAGE(warning) << "Unexpected state - no records present in chunk";
-                blocks_.erase(blocks_.begin());
-                return;
-            }
+            frontSummary().remove(front_record_.value());
+            frontSummary().add(update);
+            front_record_ = update;
+            front_modified_ = true;
+        }
 
-            CompressedOutputStreamZLib output {deflate_buffer_};
-            output.addRecord(update);
+        void pushBack(std::string const& value) {
+            if (tail_writer_.has_value() && tailBytes() >= detail::CompressedStreamZlibConstants::kCompressedBlockThreshold)
+                sealTail();
 
-            while (true) {
-                auto const& x = input.nextRecord();
-                if (!x.has_value())
-                    break;
+            if (!tail_writer_.has_value())
+                tail_writer_.emplace(tail_buffer_, Z_SYNC_FLUSH);
 
-                output.addRecord(x.value());
+            if (!tail_writer_->addRecord(value)) {
+                CHARGELAB_LOG_MESSAGE(error) << "Failed writing compressed stream - dropping record";
+                clear();
+                return;
             }
 
-            if (!output.close()) {
-                CHARGELAB_LOG_MESSAGE(warning) << "Failed closing output stream - offline messages were dropped";
-                blocks_.erase(blocks_.begin());
-            } else {
-                blocks_.front() = deflate_buffer_;
-            }
+            tail_summary_.add(value);
         }
 
-        void pushBack(std::string const& value) {
-            if (!blocks_.empty() && blocks_.back().size() < detail::CompressedStreamZlibConstants::kCompressedBlockThreshold) {
-                // Try to add the record to the final block
+        template <typename Visitor>
+        void visit(Visitor&& visitor) {
+            visitBlocks([&](uint8_t* data, std::size_t size, bool front) {
+                visitBlockRecords(data, size, front, visitor);
+            });
+        }
+
+        /**
+         * Visits records in order from the front of the queue until the visitor returns false; only the blocks that
+         * are reached are decompressed.
+         */
+        template <typename Visitor>
+        void visitWhile(Visitor&& visitor) {
+            bool proceed = true;
+            visitBlocks([&](uint8_t* data, std::size_t size, bool front) {
+                if (proceed)
+                    proceed = visitBlockRecords(data, size, front, visitor);
+            });
+        }
+
+        /**
+         * Resumable read position in the queue; see visitFrom(). The cursor keeps its own inflate stream (~8KiB) open
+         * while it's positioned inside a block, so it should be discarded once it's no longer needed.
+         */
+        class Cursor {
+        private:
+            friend class BasicCompressedQueueZLib;
+
+            struct Reader {
+                explicit Reader(uint8_t* data, std::size_t size, bool tail)
+                    : stream(buffer, data, size),
+                      tail(tail)
                 {
-                    CompressedOutputStreamZLib writer{deflate_buffer_};
-                    CompressedInputStreamZLib reader{inflate_buffer_, blocks_.back().data(), blocks_.back().size()};
-                    while (true) {
-                        auto record = reader.nextRecord();
-                        if (!record.has_value())
-                            break;
+                }
 
-                        writer.addRecord(record.value());
-                    }
+                std::vector<uint8_t> buffer;
+                CompressedInputStreamZLib stream;
+                bool tail;
+            };
 
-                    if (!reader.close()) {
-                        CHARGELAB_LOG_MESSAGE(error) << "Failed reading historic data - dropping record";
-                        clear();
-                        return;
-                    }
+            std::size_t generation_ = 0;
+            std::size_t block_serial_ = 0;
+            std::size_t record_ = 0;
+            std::unique_ptr<Reader> reader_ = nullptr;
+        };
 
-                    writer.addRecord(value);
-                    if (!writer.close()) {
-                        CHARGELAB_LOG_MESSAGE(error) << "Failed closing compressed stream - dropping record" ;
-                        clear();
-                        return;
-                    }
+        /**
+         * Visits records starting from the cursor position until the visitor returns false or the end of the queue is
+         * reached, advancing the cursor past every record that was visited (including the one the visitor returned
+         * false for). Resuming only decompresses data that wasn't visited before, and remains valid across pushBack()
+         * and popFront(); records that were popped in the meantime are skipped. If the queue was rewritten (removeIf,
+         * clear, read, or sealing a final block that was also the front block) the cursor restarts from the front, so
+         * callers must tolerate records being visited again.
+         */
+        template <typename Visitor>
+        void visitFrom(Cursor& cursor, Visitor&& visitor) {
+            // Note: the block the cursor was in may also have been fully consumed, in which case the cursor
+            // continues from the current front block
+            if (cursor.generation_ != generation_ || cursor.block_serial_ < front_block_serial_) {
+                cursor.generation_ = generation_;
+                cursor.block_serial_ = front_block_serial_;
+                cursor.record_ = 0;
+                cursor.reader_ = nullptr;
+            }
+
+            while (true) {
+                auto const index = cursor.block_serial_ - front_block_serial_;
+                bool const tail = index == blocks_.size();
+                uint8_t* data;
+                std::size_t size;
+                if (index < blocks_.size()) {
+                    data = blocks_[index].data();
+                    size = blocks_[index].size();
+                } else if (tail && tail_writer_.has_value()) {
+                    data = tail_buffer_.data();
+                    size = tailBytes();
+                } else {
+                    return;
                 }
 
-                // Note: freeing the reader and writer before resizing buffer
-                blocks_.back() = deflate_buffer_;
-            } else {
-                // Otherwise add a new block
-                {
-                    CompressedOutputStreamZLib writer{deflate_buffer_};
-                    writer.addRecord(value);
-                    if (!writer.close()) {
-                        CHARGELAB_LOG_MESSAGE(error) << "Failed closing compressed stream - dropping record";
-                        clear();
-                        return;
+                if (cursor.reader_ != nullptr && cursor.reader_->tail == tail) {
+                    cursor.reader_->stream.rebase(data, size);
+                } else {
+                    // Note: a final block that was sealed since the last call keeps the same records in the same
+                    // order, so the records before the cursor are skipped in the recompressed block
+                    cursor.reader_ = std::make_unique<typename Cursor::Reader>(data, size, tail);
+                    for (std::size_t i=0; i < cursor.record_; i++) {
+                        if (!cursor.reader_->stream.nextRecord().has_value())
+                            break;
                     }
                 }
 
-                // Note: freeing the writer before adding new buffer
-                blocks_.push_back(deflate_buffer_);
-            }
-        }
-
-        template <typename Visitor>
-        void visit(Visitor&& visitor) {
-            for (auto& block : blocks_) {
-                CompressedInputStreamZLib reader{inflate_buffer_, block.data(), block.size()};
+                bool const front = index == 0;
                 while (true) {
-                    auto const& record = reader.nextRecord();
+                    auto const record = cursor.reader_->stream.nextRecord();
                     if (!record.has_value())
                         break;
 
-                    visitor(record.value());
+                    auto const position = cursor.record_++;
+                    if (front && position < front_consumed_records_)
+                        continue;
+
+                    std::string_view value = record.value();
+                    if (front && position == front_consumed_records_ && front_modified_ && front_record_.has_value())
+                        value = front_record_.value();
+                    if (!visitor(value))
+                        return;
                 }
+
+                // Note: the final block may still have records appended to it, so the stream is kept open
+                if (tail)
+                    return;
+
+                cursor.block_serial_++;
+                cursor.record_ = 0;
+                cursor.reader_ = nullptr;
             }
         }
 
         template <typename Predicate>
         void removeIf(Predicate&& predicate) {
+            generation_++;
             bool empty = true;
             CompressedOutputStreamZLib writer{deflate_buffer_};
 
             std::vector<std::vector<uint8_t>> original_blocks;
             std::swap(blocks_, original_blocks);
+            summaries_.clear();
+            block_ids_.clear();
+            Summary summary {};
+
+            // Note: the final block is rewritten along with the others
+            if (tail_writer_.has_value()) {
+                tail_buffer_.resize(tailBytes());
+                tail_writer_.reset();
+                original_blocks.push_back(std::move(tail_buffer_));
+                tail_buffer_.clear();
+                tail_summary_ = Summary {};
+            }
 
+            bool front = true;
             for (auto& block : original_blocks) {
-                CompressedInputStreamZLib reader{inflate_buffer_, block.data(), block.size()};
-                while (true) {
-                    auto const& record = reader.nextRecord();
-                    if (!record.has_value())
-                        break;
-                    if (predicate(record.value()))
-                        continue;
+                visitBlockRecords(block.data(), block.size(), front, [&](std::string_view const& record) {
+                    if (predicate(record))
+                        return;
 
                     empty = false;
-                    writer.addRecord(record.value());
+                    writer.addRecord(record);
+                    summary.add(record);
 
                     if (writer.approximateTotalBytes() > detail::CompressedStreamZlibConstants::kCompressedBlockThreshold) {
                         if (!writer.close()) {
                             CHARGELAB_LOG_MESSAGE(error) << "Failed closing compressed stream - blocks were dropped";
                         } else {
-                            blocks_.push_back(deflate_buffer_);
+                            pushBlock(deflate_buffer_, std::move(summary));
                         }
 
                         empty = true;
+                        summary = Summary {};
                         writer.reset();
                     }
+                });
+
+                if (front) {
+                    resetFront();
+                    front = false;
                 }
 
                 std::vector<uint8_t> empty_buffer{};
@@ -461,54 +572,461 @@ namespace chargelab {
                 if (!writer.close()) {
                     CHARGELAB_LOG_MESSAGE(error) << "Failed closing compressed stream - blocks were dropped";
                 } else {
-                    blocks_.push_back(deflate_buffer_);
+                    pushBlock(deflate_buffer_, std::move(summary));
                 }
             }
         }
 
+        /**
+         * Removes the records matching the predicate from a single block (numbered from the front of the queue, with
+         * the final block last), leaving the other blocks untouched. If any records were removed the block is replaced
+         * with a new one and cursors restart from the front.
+         */
+        template <typename Predicate>
+        void removeIfInBlock(std::size_t index, Predicate&& predicate) {
+            bool const tail = index == blocks_.size();
+            if (index > blocks_.size() || (tail && !tail_writer_.has_value()))
+                return;
+
+            bool const front = index == 0;
+            bool empty = true;
+            bool removed = false;
+            Summary summary {};
+            {
+                CompressedOutputStreamZLib writer{deflate_buffer_};
+                auto const data = tail ? tail_buffer_.data() : blocks_[index].data();
+                auto const size = tail ? tailBytes() : blocks_[index].size();
+                visitBlockRecords(data, size, front, [&](std::string_view const& record) {
+                    if (predicate(record)) {
+                        removed = true;
+                        return;
+                    }
+
+                    empty = false;
+                    writer.addRecord(record);
+                    summary.add(record);
+                });
+
+                if (!removed)
+                    return;
+
+                if (!writer.close()) {
+                    CHARGELAB_LOG_MESSAGE(error) << "Failed closing compressed stream - keeping block as is";
+                    return;
+                }
+            }
+
+            generation_++;
+
+            // Note: records already consumed from the front block were dropped along with the removed records
+            if (front)
+                resetFront();
+
+            if (tail) {
+                tail_writer_.reset();
+                tail_buffer_.clear();
+                tail_summary_ = Summary {};
+                if (!empty)
+                    pushBlock(deflate_buffer_, std::move(summary));
+            } else if (empty) {
+                eraseBlock(index);
+            } else {
+                blocks_[index] = deflate_buffer_;
+                summaries_[index] = std::move(summary);
+                block_ids_[index] = next_block_id_++;
+            }
+        }
+
+        /**
+         * Number of blocks, including the final block.
+         */
+        [[nodiscard]] std::size_t blockCount() const {
+            return blocks_.size() + (tail_writer_.has_value() ? 1 : 0);
+        }
+
+        /**
+         * Visits the summary of each block in order from the front of the queue, with the final block last.
+         */
+        template <typename Visitor>
+        void visitSummaries(Visitor&& visitor) const {
+            for (auto const& summary : summaries_)
+                visitor(summary);
+
+            if (tail_writer_.has_value())
+                visitor(tail_summary_);
+        }
+
         void clear() {
+            generation_++;
+            resetFront();
             blocks_.clear();
+            summaries_.clear();
+            block_ids_.clear();
+            tail_writer_.reset();
+            tail_buffer_.clear();
+            tail_summary_ = Summary {};
         }
 
         [[nodiscard]] std::size_t totalBytes() const {
-            std::size_t result = 0;
+            std::size_t result = tailBytes();
             for (auto const& block : blocks_)
                 result += block.size();
 
-            return result;
+            // Note: this is approximate; the compressed bytes of records popped from the front block are only released
+            // once that block is fully consumed.
+            return result - std::min(result, front_consumed_bytes_);
         }
 
         [[nodiscard]] bool empty() const {
-            return blocks_.empty();
+            return blocks_.empty() && !tail_writer_.has_value();
         }
 
+        /**
+         * Writes out each block, optionally along with its summary if the visitor also takes one.
+         */
         template<typename Visitor>
         void write(Visitor&& visitor) {
-            for (auto const& block : blocks_)
-                visitor((void*)block.data(), block.size());
+            std::size_t index = 0;
+            visitBlocks([&](uint8_t* data, std::size_t size, bool front) {
+                auto const& summary = index < summaries_.size() ? summaries_[index] : tail_summary_;
+                index++;
+
+                writeBlock(data, size, front, summary, visitor);
+            });
+        }
+
+        /**
+         * Writes out the final block only, in the same way as write. For saving the queue incrementally along with
+         * visitSealedBlocks, sealedFrontState and restoreFront.
+         */
+        template<typename Visitor>
+        void writeTail(Visitor&& visitor) {
+            if (tail_writer_.has_value())
+                writeBlock(tail_buffer_.data(), tailBytes(), blocks_.empty(), tail_summary_, visitor);
+        }
+
+        /**
+         * Visits the blocks before the final block as they're stored, along with an ID that's unique to the content
+         * of the block within the lifetime of the queue. Records consumed from the front block aren't dropped here;
+         * see sealedFrontState.
+         */
+        template<typename Visitor>
+        void visitSealedBlocks(Visitor&& visitor) const {
+            for (std::size_t i=0; i < blocks_.size(); i++)
+                visitor(block_ids_[i], (void const*)blocks_[i].data(), blocks_[i].size(), summaries_[i]);
+        }
+
+        struct FrontState {
+            std::size_t consumed_records = 0;
+            std::optional<std::string> modified_record = std::nullopt;
+        };
+
+        /**
+         * Records consumed from the first of the blocks visited by visitSealedBlocks, and the updated front record
+         * if it was changed with updateFront.
+         */
+        [[nodiscard]] FrontState sealedFrontState() const {
+            if (blocks_.empty())
+                return FrontState {};
+
+            return FrontState {
+                    front_consumed_records_,
+                    front_modified_ ? front_record_ : std::nullopt
+            };
         }
 
+        /**
+         * Restores the position saved with sealedFrontState once the blocks were read back. The summary saved with the
+         * front block already reflects it, so it's left as is.
+         */
+        void restoreFront(FrontState const& state) {
+            for (std::size_t i=0; i < state.consumed_records; i++) {
+                if (!loadFront())
+                    return;
+
+                front_record_ = std::nullopt;
+                front_consumed_records_++;
+            }
+
+            if (state.modified_record.has_value() && loadFront()) {
+                front_record_ = state.modified_record;
+                front_modified_ = true;
+            }
+        }
+
+        /**
+         * Reads blocks from the supplier until it returns nullopt. Suppliers that take a std::optional<Summary>& may
+         * restore the summary that was written with the block; otherwise it's rebuilt from the block's records.
+         */
         template<typename Supplier>
         void read(Supplier&& supplier) {
-            blocks_.clear();
+            clear();
             while (true) {
-                auto const next = supplier();
+                std::optional<Summary> summary = std::nullopt;
+                std::optional<std::vector<uint8_t>> next;
+                if constexpr (std::is_invocable_v<Supplier&, std::optional<Summary>&>) {
+                    next = supplier(summary);
+                } else {
+                    next = supplier();
+                }
+
                 if (!next.has_value())
                     break;
 
-                blocks_.push_back(next.value());
+                if (!summary.has_value()) {
+                    summary = Summary {};
+                    visitBlockRecords(next->data(), next->size(), false, [&](std::string_view const& record) {
+                        summary->add(record);
+                    });
+                }
+
+                pushBlock(std::move(next.value()), std::move(summary.value()));
+            }
+        }
+
+    private:
+        [[nodiscard]] std::size_t tailBytes() const {
+            if (!tail_writer_.has_value())
+                return 0;
+
+            return tail_writer_->approximateTotalBytes();
+        }
+
+        void sealTail() {
+            // Note: the final block is sync-flushed after every record, which roughly doubles its size for small
+            // records, so once it's complete the remaining records are recompressed as a single stream.
+            bool const front = blocks_.empty();
+            bool empty = true;
+            {
+                CompressedOutputStreamZLib writer{deflate_buffer_};
+                visitBlockRecords(tail_buffer_.data(), tailBytes(), front, [&](std::string_view const& record) {
+                    writer.addRecord(record);
+                    empty = false;
+                });
+
+                if (!writer.close()) {
+                    CHARGELAB_LOG_MESSAGE(warning) << "Failed closing compressed stream - keeping block as is";
+                    tail_buffer_.resize(tailBytes());
+                    tail_writer_.reset();
+                    pushBlock(std::move(tail_buffer_), std::move(tail_summary_));
+                    tail_buffer_.clear();
+                    tail_summary_ = Summary {};
+                    return;
+                }
+            }
+
+            // Note: records already consumed from the front block were dropped, so cursors are invalidated
+            if (front) {
+                resetFront();
+                generation_++;
+            }
+
+            tail_writer_.reset();
+            tail_buffer_.clear();
+            if (!empty)
+                pushBlock(deflate_buffer_, std::move(tail_summary_));
+
+            tail_summary_ = Summary {};
+        }
+
+        void pushBlock(std::vector<uint8_t> data, Summary summary) {
+            blocks_.push_back(std::move(data));
+            summaries_.push_back(std::move(summary));
+            block_ids_.push_back(next_block_id_++);
+        }
+
+        void eraseBlock(std::size_t index) {
+            blocks_.erase(blocks_.begin() + index);
+            summaries_.erase(summaries_.begin() + index);
+            block_ids_.erase(block_ids_.begin() + index);
+        }
+
+        template <typename Visitor>
+        void writeBlock(uint8_t* data, std::size_t size, bool front, Summary const& summary, Visitor& visitor) {
+            auto const output = [&](void* output_data, std::size_t output_size) {
+                if constexpr (std::is_invocable_v<Visitor&, void*, std::size_t, Summary const&>) {
+                    visitor(output_data, output_size, summary);
+                } else {
+                    visitor(output_data, output_size);
+                }
+            };
+
+            if (!front || (front_consumed_records_ == 0 && !front_modified_)) {
+                output((void*)data, size);
+                return;
+            }
+
+            // Drop records that were already consumed from the front block before writing it out
+            bool empty = true;
+            {
+                CompressedOutputStreamZLib writer{deflate_buffer_};
+                visitBlockRecords(data, size, true, [&](std::string_view const& record) {
+                    writer.addRecord(record);
+                    empty = false;
+                });
+
+                if (!writer.close()) {
+                    CHARGELAB_LOG_MESSAGE(error) << "Failed closing compressed stream - block was dropped";
+                    return;
+                }
+            }
+
+            if (!empty)
+                output((void*)deflate_buffer_.data(), deflate_buffer_.size());
+        }
+
+        Summary& frontSummary() {
+            return summaries_.empty() ? tail_summary_ : summaries_.front();
+        }
+
+        void resetFront() {
+            front_reader_.reset();
+            front_record_ = std::nullopt;
+            front_modified_ = false;
+            front_consumed_records_ = 0;
+            front_consumed_bytes_ = 0;
+        }
+
+        template <typename Visitor>
+        void visitBlocks(Visitor&& visitor) {
+            bool front = true;
+            for (auto& block : blocks_) {
+                visitor(block.data(), block.size(), front);
+                front = false;
+            }
+
+            if (tail_writer_.has_value())
+                visitor(tail_buffer_.data(), tailBytes(), front);
+        }
+
+        // Note: the visitor may optionally return false to stop early, in which case this returns false as well
+        template <typename Visitor>
+        bool visitBlockRecords(uint8_t* data, std::size_t size, bool front, Visitor&& visitor) {
+            std::size_t skip_records = front ? front_consumed_records_ : 0;
+            bool replace_record = front && front_modified_ && front_record_.has_value();
+
+            auto visit = [&](std::string_view const& record) {
+                if constexpr (std::is_same_v<std::invoke_result_t<Visitor&, std::string_view const&>, bool>) {
+                    return visitor(record);
+                } else {
+                    visitor(record);
+                    return true;
+                }
+            };
+
+            CompressedInputStreamZLib reader{inflate_buffer_, data, size};
+            while (true) {
+                auto const& record = reader.nextRecord();
+                if (!record.has_value())
+                    break;
+
+                if (skip_records > 0) {
+                    skip_records--;
+                } else if (replace_record) {
+                    replace_record = false;
+                    if (!visit(std::string_view {front_record_.value()}))
+                        return false;
+                } else {
+                    if (!visit(record.value()))
+                        return false;
+                }
+            }
+
+            return true;
+        }
+
+        bool loadFront() {
+            while (!front_record_.has_value()) {
+                uint8_t* data;
+                std::size_t size;
+                if (!blocks_.empty()) {
+                    data = blocks_.front().data();
+                    size = blocks_.front().size();
+                } else if (tail_writer_.has_value()) {
+                    data = tail_buffer_.data();
+                    size = tailBytes();
+                } else {
+                    return false;
+                }
+
+                if (!front_reader_.has_value()) {
+                    front_reader_.emplace(front_buffer_, data, size);
+                } else {
+                    front_reader_->rebase(data, size);
+                }
+
+                front_consumed_bytes_ = front_reader_->consumedBytes();
+                auto const record = front_reader_->nextRecord();
+                if (record.has_value()) {
+                    front_record_ = std::string {record.value()};
+                    break;
+                }
+
+                if (front_consumed_records_ == 0)
+                    CHARGELAB_LOG_MESSAGE(warning) << "Unexpected state - no records present in chunk";
+
+                // The front block was fully consumed; if that was the final block the queue is now empty
+                resetFront();
+                front_block_serial_++;
+                if (!blocks_.empty()) {
+                    eraseBlock(0);
+                } else {
+                    tail_writer_.reset();
+                    tail_buffer_.clear();
+                    tail_summary_ = Summary {};
+                }
             }
+
+            return true;
         }
 
     private:
         // Note: using a shared deflate and inflate buffer here to reduce memory fragmentation
         std::vector<std::vector<uint8_t>> blocks_;
+        std::vector<Summary> summaries_;
+        std::vector<std::uint64_t> block_ids_;
+        std::uint64_t next_block_id_ = 0;
         std::vector<uint8_t> deflate_buffer_;
         std::vector<uint8_t> inflate_buffer_;
+
+        // Final block, which is kept open for appending records
+        std::vector<uint8_t> tail_buffer_;
+        std::optional<CompressedOutputStreamZLib> tail_writer_;
+        Summary tail_summary_ {};
+
+        // Cursor into the front block
+        std::vector<uint8_t> front_buffer_;
+        std::optional<CompressedInputStreamZLib> front_reader_;
+        std::optional<std::string> front_record_;
+        bool front_modified_ = false;
+        std::size_t front_consumed_records_ = 0;
+        std::size_t front_consumed_bytes_ = 0;
+
+        // Used to resume cursors; blocks are numbered in order with front_block_serial_ being the current front
+        std::size_t generation_ = 0;
+        std::size_t front_block_serial_ = 0;
     };
 
+    using CompressedQueueRawZLib = BasicCompressedQueueZLib<detail::NoBlockSummary>;
+
+    namespace detail {
+        template <typename Serializer, typename = void>
+        struct BlockSummaryOf {
+            using type = NoBlockSummary;
+        };
+
+        // Note: serializers may define a summary_type to keep a summary of the records in each block
+        template <typename Serializer>
+        struct BlockSummaryOf<Serializer, std::void_t<typename Serializer::summary_type>> {
+            using type = typename Serializer::summary_type;
+        };
+    }
+
     template <typename T, typename Serializer>
     class CompressedQueueCustom {
+    public:
+        using summary_type = typename detail::BlockSummaryOf<Serializer>::type;
+
     public:
         std::optional<T> pollFront() {
             auto text = queue_.pollFront();
@@ -546,6 +1064,35 @@ namespace chargelab {
             });
         }
 
+        template<typename Visitor>
+        void visitWhile(Visitor&& visitor) {
+            queue_.visitWhile([&](auto const& text) {
+                auto result = Serializer::read(text);
+                if (result.has_value()) {
+                    return (bool)visitor(text, result.value());
+                } else {
+                    CHARGELAB_LOG_MESSAGE(warning) << "Failed deserializing payload: " << text;
+                    return true;
+                }
+            });
+        }
+
+        using Cursor = typename BasicCompressedQueueZLib<summary_type>::Cursor;
+        using FrontState = typename BasicCompressedQueueZLib<summary_type>::FrontState;
+
+        template<typename Visitor>
+        void visitFrom(Cursor& cursor, Visitor&& visitor) {
+            queue_.visitFrom(cursor, [&](auto const& text) {
+                auto result = Serializer::read(text);
+                if (result.has_value()) {
+                    return (bool)visitor(text, result.value());
+                } else {
+                    CHARGELAB_LOG_MESSAGE(warning) << "Failed deserializing payload: " << text;
+                    return true;
+                }
+            });
+        }
+
         template <typename Predicate>
         void removeIf(Predicate&& predicate) {
             queue_.template removeIf([&](auto const& text) {
@@ -559,6 +1106,28 @@ namespace chargelab {
             });
         }
 
+        template <typename Predicate>
+        void removeIfInBlock(std::size_t index, Predicate&& predicate) {
+            queue_.template removeIfInBlock(index, [&](auto const& text) {
+                auto result = Serializer::read(text);
+                if (result.has_value()) {
+                    return predicate(text, result.value());
+                } else {
+                    CHARGELAB_LOG_MESSAGE(warning) << "Failed deserializing payload";
+                    return true;
+                }
+            });
+        }
+
+        template <typename Visitor>
+        void visitSummaries(Visitor&& visitor) const {
+            queue_.visitSummaries(std::forward<Visitor>(visitor));
+        }
+
+        [[nodiscard]] std::size_t blockCount() const {
+            return queue_.blockCount();
+        }
+
         void clear() {
             queue_.clear();
         }
@@ -581,8 +1150,26 @@ namespace chargelab {
             queue_.template read(std::forward<Supplier>(supplier));
         }
 
+        template<typename Visitor>
+        void writeTail(Visitor&& visitor) {
+            queue_.template writeTail(std::forward<Visitor>(visitor));
+        }
+
+        template<typename Visitor>
+        void visitSealedBlocks(Visitor&& visitor) const {
+            queue_.visitSealedBlocks(std::forward<Visitor>(visitor));
+        }
+
+        [[nodiscard]] FrontState sealedFrontState() const {
+            return queue_.sealedFrontState();
+        }
+
+        void restoreFront(FrontState const& state) {
+            queue_.restoreFront(state);
+        }
+
     private:
-        CompressedQueueRawZLib queue_;
+        BasicCompressedQueueZLib<summary_type> queue_;
     };
 
     namespace detail {
@@ -0,0 +1,181 @@
+#ifndef CHARGELAB_OPEN_FIRMWARE_FRAME_QUEUE_H
+#define CHARGELAB_OPEN_FIRMWARE_FRAME_QUEUE_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <optional>
+#include <algorithm>
+
+namespace chargelab {
+    /**
+     * Bounded single-producer single-consumer queue of variable length frames. The frames are stored back to back in
+     * one byte arena that's allocated up front, so receiving a message doesn't allocate. The producer assembles a
+     * frame with beginFrame()/append()/commitFrame(), which allows a message to be built from several websocket
+     * fragments. A frame that doesn't fit, either because it's larger than the maximum frame size or because the
+     * consumer hasn't freed enough space yet, is rejected as a whole rather than overwriting queued frames.
+     *
+     * Note: beginFrame(), append() and commitFrame() may only be called from one thread and pop() from one other
+     * thread; size() and the counters may be read from any thread.
+     */
+    class FrameQueue {
+    private:
+        using header_type = std::uint32_t;
+
+    public:
+        enum class PushResult {
+            kQueued,
+            kQueueFull,
+            kFrameTooLarge
+        };
+
+        FrameQueue(std::size_t capacity_bytes, std::size_t max_frame_bytes)
+            : capacity_(std::max(capacity_bytes, max_frame_bytes + sizeof(header_type))),
+              max_frame_bytes_(max_frame_bytes),
+              arena_(new char[capacity_])
+        {
+        }
+
+        FrameQueue(FrameQueue const&) = delete;
+        FrameQueue& operator=(FrameQueue const&) = delete;
+
+        /**
+         * Starts a new frame, discarding any part of a previous frame that wasn't committed.
+         */
+        void beginFrame() {
+            frame_bytes_ = 0;
+            frame_result_ = PushResult::kQueued;
+        }
+
+        void append(char const* data, std::size_t length) {
+            if (frame_result_ != PushResult::kQueued || length == 0)
+                return;
+
+            if (frame_bytes_ + length > max_frame_bytes_) {
+                frame_result_ = PushResult::kFrameTooLarge;
+                return;
+            }
+
+            auto const tail = tail_.load(std::memory_order_relaxed);
+            auto const head = head_.load(std::memory_order_acquire);
+            auto const end = tail + sizeof(header_type) + frame_bytes_ + length;
+            if (end - head > capacity_) {
+                frame_result_ = PushResult::kQueueFull;
+                return;
+            }
+
+            copyIn(tail + sizeof(header_type) + frame_bytes_, data, length);
+            frame_bytes_ += length;
+        }
+
+        /**
+         * Publishes the frame assembled since beginFrame() to the consumer.
+         * @return kQueued if the frame was queued, otherwise the reason it was dropped
+         */
+        PushResult commitFrame() {
+            auto const result = frame_result_;
+            if (result != PushResult::kQueued) {
+                dropped_frames_.fetch_add(1, std::memory_order_relaxed);
+                beginFrame();
+                return result;
+            }
+
+            // Note: checking the header space separately for empty frames, which never called append()
+            auto const tail = tail_.load(std::memory_order_relaxed);
+            auto const end = tail + sizeof(header_type) + frame_bytes_;
+            if (end - head_.load(std::memory_order_acquire) > capacity_) {
+                dropped_frames_.fetch_add(1, std::memory_order_relaxed);
+                beginFrame();
+                return PushResult::kQueueFull;
+            }
+
+            auto const header = (header_type)frame_bytes_;
+            copyIn(tail, (char const*)&header, sizeof(header));
+            tail_.store(end, std::memory_order_release);
+            auto const frames = pushed_frames_.fetch_add(1, std::memory_order_release) + 1;
+
+            auto const used_bytes = end - head_.load(std::memory_order_relaxed);
+            if (used_bytes > high_water_bytes_.load(std::memory_order_relaxed))
+                high_water_bytes_.store(used_bytes, std::memory_order_relaxed);
+            auto const used_frames = frames - popped_frames_.load(std::memory_order_relaxed);
+            if (used_frames > high_water_frames_.load(std::memory_order_relaxed))
+                high_water_frames_.store(used_frames, std::memory_order_relaxed);
+
+            beginFrame();
+            return PushResult::kQueued;
+        }
+
+        std::optional<std::string> pop() {
+            auto const popped = popped_frames_.load(std::memory_order_relaxed);
+            if (popped == pushed_frames_.load(std::memory_order_acquire))
+                return std::nullopt;
+
+            auto const head = head_.load(std::memory_order_relaxed);
+            header_type length;
+            copyOut(head, (char*)&length, sizeof(length));
+
+            std::string result;
+            result.resize(length);
+            copyOut(head + sizeof(header_type), result.data(), length);
+
+            head_.store(head + sizeof(header_type) + length, std::memory_order_release);
+            popped_frames_.store(popped + 1, std::memory_order_release);
+            return result;
+        }
+
+        [[nodiscard]] std::size_t size() const {
+            auto const popped = popped_frames_.load(std::memory_order_acquire);
+            return pushed_frames_.load(std::memory_order_acquire) - popped;
+        }
+
+        [[nodiscard]] std::size_t droppedFrames() const {
+            return dropped_frames_.load(std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] std::size_t highWaterBytes() const {
+            return high_water_bytes_.load(std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] std::size_t highWaterFrames() const {
+            return high_water_frames_.load(std::memory_order_relaxed);
+        }
+
+    private:
+        void copyIn(std::size_t position, char const* data, std::size_t length) {
+            auto const offset = position % capacity_;
+            auto const first = std::min(length, capacity_ - offset);
+            std::memcpy(arena_.get() + offset, data, first);
+            std::memcpy(arena_.get(), data + first, length - first);
+        }
+
+        void copyOut(std::size_t position, char* data, std::size_t length) const {
+            auto const offset = position % capacity_;
+            auto const first = std::min(length, capacity_ - offset);
+            std::memcpy(data, arena_.get() + offset, first);
+            std::memcpy(data + first, arena_.get(), length - first);
+        }
+
+    private:
+        std::size_t const capacity_;
+        std::size_t const max_frame_bytes_;
+        std::unique_ptr<char[]> arena_;
+
+        // Note: positions only increase; they're reduced modulo capacity_ when accessing the arena
+        std::atomic<std::size_t> head_ = 0;
+        std::atomic<std::size_t> tail_ = 0;
+        std::atomic<std::size_t> pushed_frames_ = 0;
+        std::atomic<std::size_t> popped_frames_ = 0;
+
+        // Producer state for the frame being assembled
+        std::size_t frame_bytes_ = 0;
+        PushResult frame_result_ = PushResult::kQueued;
+
+        std::atomic<std::size_t> dropped_frames_ = 0;
+        std::atomic<std::size_t> high_water_bytes_ = 0;
+        std::atomic<std::size_t> high_water_frames_ = 0;
+    };
+}
+
+#endif //CHARGELAB_OPEN_FIRMWARE_FRAME_QUEUE_H
@@ -3,7 +3,12 @@
 
 #include "openocpp/model/system_types.h"
 
+#include <array>
 #include <atomic>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <variant>
 #include <optional>
 #include <thread>
@@ -12,6 +17,11 @@
 #include <string_view>
 #include <string>
 
+#ifndef CHARGELAB_LOG_RECORD_INLINE_BYTES
+// Note: the arguments of a log message are captured on the stack up to this size, and in a per-thread buffer beyond it
+#define CHARGELAB_LOG_RECORD_INLINE_BYTES 256
+#endif
+
 namespace chargelab::logging {
     enum class LogLevel {
         trace,
@@ -36,74 +46,275 @@ namespace chargelab::logging {
     void PrintLogMessage(LogMetadata const& metadata, std::string_view const& message);
     void PrintLogMessage(LogMetadata const& metadata, std::string const& message);
 
+    /**
+     * Hands a message captured by LogAccumulator to the logging backend, which formats it with FormatLogRecord and
+     * passes the text to the registered listeners - possibly later and on another thread. The metadata only refers
+     * to static storage (string literals and __func__), so it identifies the call site and can be copied as is.
+     */
+    void SubmitLogRecord(LogMetadata const& metadata, std::string_view const& arguments);
+
+    /**
+     * Waits until the messages submitted so far have been printed and passed to the listeners.
+     */
+    void FlushLogMessages();
+
     using LoggingListenerFunction = std::function<void(LogMetadata const& metadata, std::string_view const& message)>;
     void RegisterLoggingListener(std::shared_ptr<LoggingListenerFunction> const& callback);
     void UnregisterLoggingListener(std::shared_ptr<LoggingListenerFunction> const& callback);
 
+    namespace detail {
+        // Note: reused by the messages logged on a thread that don't fit in the inline buffer, so that they don't
+        // allocate once it has grown to the longest message
+        struct LogOverflowBuffer {
+            std::string data;
+            bool in_use = false;
+        };
+
+        inline thread_local LogOverflowBuffer gLogOverflowBuffer {};
+    }
+
+    /**
+     * Raw arguments of a log message, as captured at the call site: each argument is a type tag followed by the bytes
+     * of a string or the binary value of a number. Converting them to text is left to the backend (FormatLogRecord).
+     */
+    class LogRecordWriter {
+    public:
+        enum class Type : std::uint8_t {
+            kText,
+            kSigned,
+            kUnsigned,
+            kFloating
+        };
+
+        void writeText(std::string_view const& value) {
+            auto const size = (std::uint32_t)value.size();
+            char header[1 + sizeof(size)];
+            header[0] = (char)Type::kText;
+            std::memcpy(header + 1, &size, sizeof(size));
+
+            append(header, sizeof(header));
+            append(value.data(), value.size());
+        }
+
+        void writeSigned(std::int64_t value) {
+            writeValue(Type::kSigned, value);
+        }
+
+        void writeUnsigned(std::uint64_t value) {
+            writeValue(Type::kUnsigned, value);
+        }
+
+        void writeFloating(double value) {
+            writeValue(Type::kFloating, value);
+        }
+
+        LogRecordWriter() = default;
+        LogRecordWriter(LogRecordWriter const&) = delete;
+        LogRecordWriter& operator=(LogRecordWriter const&) = delete;
+
+        ~LogRecordWriter() {
+            if (overflow_ == &detail::gLogOverflowBuffer.data)
+                detail::gLogOverflowBuffer.in_use = false;
+        }
+
+        [[nodiscard]] std::string_view view() const {
+            if (overflow_ != nullptr)
+                return *overflow_;
+
+            return std::string_view {inline_.data(), size_};
+        }
+
+    private:
+        template <typename T>
+        void writeValue(Type type, T value) {
+            char buffer[1 + sizeof(T)];
+            buffer[0] = (char)type;
+            std::memcpy(buffer + 1, &value, sizeof(T));
+            append(buffer, sizeof(buffer));
+        }
+
+        void append(char const* data, std::size_t size) {
+            if (overflow_ == nullptr && size_ + size <= inline_.size()) {
+                std::memcpy(inline_.data() + size_, data, size);
+                size_ += size;
+                return;
+            }
+
+            if (overflow_ == nullptr) {
+                // Note: a message logged while formatting an argument of another one gets a buffer of its own
+                if (!detail::gLogOverflowBuffer.in_use) {
+                    detail::gLogOverflowBuffer.in_use = true;
+                    overflow_ = &detail::gLogOverflowBuffer.data;
+                } else {
+                    overflow_ = &owned_;
+                }
+
+                overflow_->assign(inline_.data(), size_);
+            }
+
+            overflow_->append(data, size);
+        }
+
+    private:
+        std::array<char, CHARGELAB_LOG_RECORD_INLINE_BYTES> inline_;
+        std::size_t size_ = 0;
+        std::string* overflow_ = nullptr;
+        std::string owned_;
+    };
+
+    namespace detail {
+        template <typename T>
+        bool ReadLogValue(std::string_view const& record, std::size_t& index, T& value) {
+            if (record.size() - index < sizeof(T))
+                return false;
+
+            std::memcpy(&value, record.data() + index, sizeof(T));
+            index += sizeof(T);
+            return true;
+        }
+
+        template <typename T>
+        void AppendInteger(std::string& output, T value) {
+            char buffer[24];
+            auto const result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+            output.append(buffer, result.ptr);
+        }
+    }
+
+    /**
+     * Appends the text of a message captured with LogRecordWriter, formatted as std::to_string would; returns false if
+     * the record is malformed.
+     */
+    inline bool FormatLogRecord(std::string& output, std::string_view const& record) {
+        std::size_t index = 0;
+        while (index < record.size()) {
+            auto const type = (LogRecordWriter::Type)record[index++];
+            switch (type) {
+                default:
+                    return false;
+
+                case LogRecordWriter::Type::kText:
+                    {
+                        std::uint32_t size;
+                        if (!detail::ReadLogValue(record, index, size) || record.size() - index < size)
+                            return false;
+
+                        output.append(record.data() + index, size);
+                        index += size;
+                        break;
+                    }
+
+                case LogRecordWriter::Type::kSigned:
+                    {
+                        std::int64_t value;
+                        if (!detail::ReadLogValue(record, index, value))
+                            return false;
+
+                        detail::AppendInteger(output, value);
+                        break;
+                    }
+
+                case LogRecordWriter::Type::kUnsigned:
+                    {
+                        std::uint64_t value;
+                        if (!detail::ReadLogValue(record, index, value))
+                            return false;
+
+                        detail::AppendInteger(output, value);
+                        break;
+                    }
+
+                case LogRecordWriter::Type::kFloating:
+                    {
+                        double value;
+                        if (!detail::ReadLogValue(record, index, value))
+                            return false;
+
+                        char buffer[32];
+                        auto const size = std::snprintf(buffer, sizeof(buffer), "%f", value);
+                        if (size > 0 && size < (int)sizeof(buffer)) {
+                            output.append(buffer, size);
+                        } else {
+                            output += std::to_string(value);
+                        }
+                        break;
+                    }
+            }
+        }
+
+        return true;
+    }
+
     template <typename T, typename U=void>
     struct LogWriter;
 
     template <>
     struct LogWriter<std::string, void> {
-        static void write(std::string& accumulator, std::string const& value) {
-            accumulator += value;
+        static void write(LogRecordWriter& writer, std::string const& value) {
+            writer.writeText(value);
         }
     };
 
     template <>
     struct LogWriter<std::string_view, void> {
-        static void write(std::string& accumulator, std::string_view const& value) {
-            accumulator += value;
+        static void write(LogRecordWriter& writer, std::string_view const& value) {
+            writer.writeText(value);
         }
     };
 
     template <>
     struct LogWriter<char const*, void> {
-        static void write(std::string& accumulator, char const* value) {
-            accumulator += value;
+        static void write(LogRecordWriter& writer, char const* value) {
+            writer.writeText(value);
         }
     };
 
     template <int N>
     struct LogWriter<char const[N], void> {
-        static void write(std::string& accumulator, char const* value) {
-            accumulator += value;
+        static void write(LogRecordWriter& writer, char const* value) {
+            writer.writeText(value);
         }
     };
 
     template <int N>
     struct LogWriter<char[N], void> {
-        static void write(std::string& accumulator, char const* value) {
-            accumulator += value;
+        static void write(LogRecordWriter& writer, char const* value) {
+            writer.writeText(value);
         }
     };
 
     template <typename T>
     struct LogWriter<T, typename std::enable_if<std::is_arithmetic<T>::value>::type> {
-        static void write(std::string& accumulator, T const& value) {
-            accumulator += std::to_string(value);
+        static void write(LogRecordWriter& writer, T const& value) {
+            if constexpr (std::is_floating_point<T>::value) {
+                writer.writeFloating((double)value);
+            } else if constexpr (std::is_signed<T>::value) {
+                writer.writeSigned(value);
+            } else {
+                writer.writeUnsigned(value);
+            }
         }
     };
 
     template <>
     struct LogWriter<SystemTimeMillis, void> {
-        static void write(std::string& accumulator, SystemTimeMillis value) {
-            accumulator += std::to_string(static_cast<int64_t>(value));
+        static void write(LogRecordWriter& writer, SystemTimeMillis value) {
+            writer.writeSigned(static_cast<int64_t>(value));
         }
     };
 
     template <>
     struct LogWriter<SteadyPointMillis, void> {
-        static void write(std::string& accumulator, SteadyPointMillis value) {
-            accumulator += std::to_string(static_cast<int64_t>(value));
+        static void write(LogRecordWriter& writer, SteadyPointMillis value) {
+            writer.writeSigned(static_cast<int64_t>(value));
         }
     };
 
     template <typename T>
     struct LogWriter<T, typename std::enable_if_t<std::is_enum<T>::value>> {
-        static void write(std::string& accumulator, T const& value) {
+        static void write(LogRecordWriter& writer, T const& value) {
             using IntType = typename std::underlying_type<T>::type;
-            accumulator += std::to_string(static_cast<IntType>(value));
+            LogWriter<IntType>::write(writer, static_cast<IntType>(value));
         }
     };
 
@@ -124,7 +335,8 @@ namespace chargelab::logging {
         }
 
         ~LogAccumulator() {
-            PrintLogMessage(metadata_, accumulator_);
+            if (enabled_)
+                SubmitLogRecord(metadata_, record_.view());
         }
 
         [[nodiscard]] bool getDone() const {
@@ -137,7 +349,7 @@ namespace chargelab::logging {
 
         template <typename T>
         friend LogAccumulator& operator<<(LogAccumulator& os, T const& value) {
-            LogWriter<T>::write(os.accumulator_, value);
+            LogWriter<T>::write(os.record_, value);
             return os;
         }
 
@@ -146,7 +358,7 @@ namespace chargelab::logging {
         bool enabled_;
 
         bool done_ = false;
-        std::string accumulator_;
+        LogRecordWriter record_;
     };
 
     namespace detail {
@@ -99,6 +99,18 @@ namespace chargelab {
             return !operationInProgress() && getIdleDurationSeconds() >= seconds;
         }
 
+        /**
+         * @return the time at which wasIdleFor(seconds) becomes true
+         */
+        [[nodiscard]] SteadyPointMillis idleDeadline(int seconds) const {
+            if (state_.has_value())
+                return (SteadyPointMillis)(state_->second + ((std::int64_t)timeout_seconds_ + seconds)*1000);
+            if (idle_since_.has_value())
+                return (SteadyPointMillis)(idle_since_.value() + (std::int64_t)seconds*1000);
+
+            return system_->steadyClockNow();
+        }
+
         void setWithTimeout(int timeout_seconds, std::optional<T> const& id) {
             timeout_seconds_ = timeout_seconds;
 
@@ -0,0 +1,173 @@
+#ifndef CHARGELAB_OPEN_FIRMWARE_RECORD_RING_H
+#define CHARGELAB_OPEN_FIRMWARE_RECORD_RING_H
+
+#include <array>
+#include <atomic>
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstring>
+
+namespace chargelab {
+    /**
+     * Bounded lock-free queue of variable length records, written by any number of threads and read by a single
+     * consumer. A record occupies one or more consecutive fixed size slots; each slot carries a sequence number that
+     * tells the consumer when the slot has been written and producers when it's free again (as in Vyukov's bounded
+     * queue). Producers never block: tryPush fails when there isn't room, and the caller decides what to do with the
+     * record.
+     */
+    template <std::size_t N, std::size_t SlotSize=64>
+    class RecordRing {
+        static_assert((N & (N-1)) == 0, "Slot count must be a power of two");
+
+        using LengthType = std::uint32_t;
+
+        struct alignas(SlotSize) Slot {
+            std::atomic<std::size_t> sequence;
+            char data[SlotSize - sizeof(std::atomic<std::size_t>)];
+        };
+
+    public:
+        static constexpr std::size_t kSlotPayload = sizeof(Slot::data);
+
+        RecordRing() {
+            for (std::size_t i=0; i < N; i++)
+                slots_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+
+        RecordRing(RecordRing const&) = delete;
+        RecordRing& operator=(RecordRing const&) = delete;
+
+        /**
+         * Writes the concatenation of header and body as a single record. Returns false if the ring is full or the
+         * record is larger than the ring.
+         */
+        bool tryPush(std::string_view const& header, std::string_view const& body) {
+            auto const size = header.size() + body.size();
+            auto const count = slotsFor(size);
+            if (count > N)
+                return false;
+
+            // Note: slots are released in order, so the last slot of the range being free means the whole range is
+            auto position = enqueue_.load(std::memory_order_relaxed);
+            while (true) {
+                auto const last = position + count - 1;
+                auto const sequence = slots_[last % N].sequence.load(std::memory_order_acquire);
+                auto const difference = (std::intptr_t)(sequence - last);
+                if (difference == 0) {
+                    if (enqueue_.compare_exchange_weak(position, position + count, std::memory_order_relaxed))
+                        break;
+                } else if (difference < 0) {
+                    return false;
+                } else {
+                    position = enqueue_.load(std::memory_order_relaxed);
+                }
+            }
+
+            auto const length = (LengthType)size;
+            put(position, 0, &length, sizeof(length));
+            put(position, sizeof(length), header.data(), header.size());
+            put(position, sizeof(length) + header.size(), body.data(), body.size());
+
+            for (std::size_t i=0; i < count; i++)
+                slots_[(position + i) % N].sequence.store(position + i + 1, std::memory_order_release);
+
+            return true;
+        }
+
+        /**
+         * Consumer side: passes the record at the front to visitor as a std::string_view and removes it. Returns false
+         * if there's no record, or the one at the front hasn't been completely written yet.
+         *
+         * Note: the view refers to a buffer owned by the ring, valid until the next call.
+         */
+        template <typename Visitor>
+        bool tryPop(Visitor&& visitor) {
+            if (!readable())
+                return false;
+
+            LengthType length;
+            std::memcpy(&length, slots_[dequeue_ % N].data, sizeof(length));
+
+            auto const count = slotsFor(length);
+            for (std::size_t i=1; i < count; i++) {
+                auto const& slot = slots_[(dequeue_ + i) % N];
+                if (slot.sequence.load(std::memory_order_acquire) != dequeue_ + i + 1)
+                    return false;
+            }
+
+            buffer_.resize(length);
+            get(dequeue_, sizeof(length), buffer_.data(), length);
+
+            for (std::size_t i=0; i < count; i++)
+                slots_[(dequeue_ + i) % N].sequence.store(dequeue_ + i + N, std::memory_order_release);
+
+            dequeue_ += count;
+            read_position_.store(dequeue_, std::memory_order_release);
+            visitor(std::string_view {buffer_.data(), buffer_.size()});
+            return true;
+        }
+
+        /**
+         * Consumer side: true if a record has at least started being written at the front of the ring.
+         */
+        [[nodiscard]] bool readable() const {
+            return slots_[dequeue_ % N].sequence.load(std::memory_order_acquire) == dequeue_ + 1;
+        }
+
+        /**
+         * Position after the last slot claimed by a producer; records pushed so far have been consumed once
+         * readPosition reaches it.
+         */
+        [[nodiscard]] std::size_t writePosition() const {
+            return enqueue_.load(std::memory_order_acquire);
+        }
+
+        [[nodiscard]] std::size_t readPosition() const {
+            return read_position_.load(std::memory_order_acquire);
+        }
+
+    private:
+        static constexpr std::size_t slotsFor(std::size_t size) {
+            return (size + sizeof(LengthType) + kSlotPayload - 1)/kSlotPayload;
+        }
+
+        void put(std::size_t position, std::size_t offset, void const* data, std::size_t size) {
+            auto input = (char const*)data;
+            while (size > 0) {
+                auto& slot = slots_[(position + offset/kSlotPayload) % N];
+                auto const slot_offset = offset % kSlotPayload;
+                auto const chunk = std::min(size, kSlotPayload - slot_offset);
+                std::memcpy(slot.data + slot_offset, input, chunk);
+
+                input += chunk;
+                offset += chunk;
+                size -= chunk;
+            }
+        }
+
+        void get(std::size_t position, std::size_t offset, void* data, std::size_t size) const {
+            auto output = (char*)data;
+            while (size > 0) {
+                auto const& slot = slots_[(position + offset/kSlotPayload) % N];
+                auto const slot_offset = offset % kSlotPayload;
+                auto const chunk = std::min(size, kSlotPayload - slot_offset);
+                std::memcpy(output, slot.data + slot_offset, chunk);
+
+                output += chunk;
+                offset += chunk;
+                size -= chunk;
+            }
+        }
+
+    private:
+        std::array<Slot, N> slots_;
+        alignas(SlotSize) std::atomic<std::size_t> enqueue_ {0};
+        alignas(SlotSize) std::size_t dequeue_ = 0;
+        std::atomic<std::size_t> read_position_ {0};
+        std::string buffer_;
+    };
+}
+
+#endif //CHARGELAB_OPEN_FIRMWARE_RECORD_RING_H
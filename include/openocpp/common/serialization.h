@@ -58,7 +58,7 @@ namespace chargelab {
             return std::nullopt;
 
         if (present) {
-            T value;
+            T value {};
             auto result = readPrimitive(text, index, value);
             out = std::move(value);
             return result;
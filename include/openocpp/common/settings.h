@@ -13,6 +13,9 @@
 #include <optional>
 #include <utility>
 #include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "openocpp/protocol/ocpp2_0/types/component_type.h"
 #include "openocpp/protocol/ocpp2_0/types/variable_type.h"
@@ -185,27 +188,23 @@ namespace chargelab {
     public:
         virtual ~SettingBase() = default;
         explicit SettingBase(metadata_container_type metadata)
-                : metadata_(std::move(metadata))
+                : metadata_(std::move(metadata)),
+                  identity_(generateIdentity(metadata_))
         {
-            if (std::holds_alternative<metadata_pointer_type>(metadata_)) {
-                assert(std::get<metadata_pointer_type>(metadata_) != nullptr);
-            }
         }
 
+        // Note: the full metadata is regenerated on each call to avoid holding the device model for every setting in
+        // memory; prefer getId and getConfig, which are cached, where possible.
         [[nodiscard]] SettingMetadata getMetadata() const {
-            if (std::holds_alternative<metadata_generator_type>(metadata_)) {
-                return std::get<metadata_generator_type>(metadata_)();
-            } else {
-                return *std::get<metadata_pointer_type>(metadata_);
-            }
+            return generateMetadata(metadata_);
         }
 
-        [[nodiscard]] std::string getId() const {
-            return getMetadata().id;
+        [[nodiscard]] std::string const& getId() const {
+            return identity_.id;
         }
 
         [[nodiscard]] SettingConfig getConfig() const {
-            return getMetadata().config;
+            return identity_.config;
         }
 
         [[nodiscard]] std::optional<DeviceModel1_6> getModel16() const {
@@ -277,8 +276,32 @@ namespace chargelab {
             modified_ = modified;
         }
 
+    private:
+        struct Identity {
+            std::string id;
+            SettingConfig config;
+        };
+
+        static SettingMetadata generateMetadata(metadata_container_type const& metadata) {
+            if (std::holds_alternative<metadata_generator_type>(metadata)) {
+                return std::get<metadata_generator_type>(metadata)();
+            } else {
+                return *std::get<metadata_pointer_type>(metadata);
+            }
+        }
+
+        static Identity generateIdentity(metadata_container_type const& metadata) {
+            if (std::holds_alternative<metadata_pointer_type>(metadata)) {
+                assert(std::get<metadata_pointer_type>(metadata) != nullptr);
+            }
+
+            auto generated = generateMetadata(metadata);
+            return Identity {std::move(generated.id), generated.config};
+        }
+
     private:
         metadata_container_type metadata_;
+        Identity identity_;
 
         // Note: default modified state is true. If this setting is read from a file or written to a file the flag is
         // cleared.
@@ -588,19 +611,15 @@ namespace chargelab {
         SettingBool& operator=(SettingBool const&) = delete;
 
         [[nodiscard]] value_type getValue() const {
-            std::lock_guard lock{detail::SharedSettingLock::mutex_};
-            return current_value_;
+            return current_value_.load();
         }
 
         bool setValue(value_type value) {
             if (!validator_(value))
                 return false;
 
-            std::lock_guard lock{detail::SharedSettingLock::mutex_};
-            if (current_value_ != value) {
-                current_value_ = value;
+            if (current_value_.exchange(value) != value)
                 setModified(true);
-            }
             return true;
         }
 
@@ -624,7 +643,6 @@ namespace chargelab {
         }
 
         bool load(const std::string &value) override {
-            std::lock_guard lock{detail::SharedSettingLock::mutex_};
             if (string::EqualsIgnoreCaseAscii(value, kTextTrue)) {
                 current_value_ = true;
                 return true;
@@ -645,7 +663,7 @@ namespace chargelab {
     private:
         validator_type validator_;
 
-        value_type current_value_;
+        std::atomic<value_type> current_value_;
     };
 
     class SettingInt : public SettingBase {
@@ -670,19 +688,15 @@ namespace chargelab {
         SettingInt& operator=(SettingInt const&) = delete;
 
         [[nodiscard]] value_type getValue() const {
-            std::lock_guard lock{detail::SharedSettingLock::mutex_};
-            return current_value_;
+            return current_value_.load();
         }
 
         bool setValue(value_type value) {
             if (!validator_(value))
                 return false;
 
-            std::lock_guard lock{detail::SharedSettingLock::mutex_};
-            if (current_value_ != value) {
-                current_value_ = value;
+            if (current_value_.exchange(value) != value)
                 setModified(true);
-            }
             return true;
         }
 
@@ -711,7 +725,6 @@ namespace chargelab {
                 return false;
             }
 
-            std::lock_guard lock{detail::SharedSettingLock::mutex_};
             current_value_ = parsed.value();
             return true;
         }
@@ -749,19 +762,15 @@ namespace chargelab {
         SettingDouble& operator=(SettingDouble const&) = delete;
 
         [[nodiscard]] value_type getValue() const {
-            std::lock_guard lock{detail::SharedSettingLock::mutex_};
-            return current_value_;
+            return current_value_.load();
         }
 
         bool setValue(value_type value) {
             if (!validator_(value))
                 return false;
 
-            std::lock_guard lock{detail::SharedSettingLock::mutex_};
-            if (current_value_ != value) {
-                current_value_ = value;
+            if (current_value_.exchange(value) != value)
                 setModified(true);
-            }
             return true;
         }
 
@@ -790,7 +799,6 @@ namespace chargelab {
                 return false;
             }
 
-            std::lock_guard lock{detail::SharedSettingLock::mutex_};
             current_value_ = parsed.value();
             return true;
         }
@@ -803,7 +811,7 @@ namespace chargelab {
     private:
         validator_type validator_;
 
-        value_type current_value_;
+        std::atomic<value_type> current_value_;
     };
 
     template <typename ValueType>
@@ -1422,6 +1430,39 @@ namespace chargelab {
             std::string value;
             CHARGELAB_JSON_INTRUSIVE(SettingKeyValue, key, value)
         };
+
+        // Lookup keys for the settings index; identifiers are case-insensitive so they are folded to lower case, and
+        // each part is terminated so that adjacent fields can't run together.
+        inline void appendSettingKey(std::string& key, std::string const& text) {
+            for (auto ch : text)
+                key.push_back((ch >= 'A' && ch <= 'Z') ? (char)(ch - 'A' + 'a') : ch);
+            key.push_back('\x1f');
+        }
+
+        inline std::string settingIdKey(std::string const& id) {
+            std::string result;
+            appendSettingKey(result, id);
+            return result;
+        }
+
+        inline std::string settingComponentKey(ocpp2_0::ComponentType const& component) {
+            std::string result;
+            appendSettingKey(result, component.name.value());
+            appendSettingKey(result, component.instance.has_value() ? "+" + component.instance->value() : "-");
+            if (component.evse.has_value()) {
+                appendSettingKey(result, std::to_string(component.evse->id));
+                appendSettingKey(result, component.evse->connectorId.has_value() ? std::to_string(component.evse->connectorId.value()) : "-");
+            } else {
+                appendSettingKey(result, "-");
+            }
+            return result;
+        }
+
+        inline std::string settingVariableKey(std::string key, ocpp2_0::VariableType const& variable) {
+            appendSettingKey(key, variable.name.value());
+            appendSettingKey(key, variable.instance.has_value() ? "+" + variable.instance->value() : "-");
+            return key;
+        }
     };
 
     class Settings {
@@ -1854,19 +1895,33 @@ namespace chargelab {
                 }
         };
 
+        // Note: the limits below apply to meter values that are merged into one request while the station is offline
         SettingInt MeterValuesMaxPointsPerRequest {
                 []() {
                     return SettingMetadata {
                             "MeterValuesMaxPointsPerRequest",
                             SettingConfig::rwPolicy(),
                             DeviceModel1_6 {"MeterValuesMaxPointsPerRequest"},
-                            std::nullopt,
+                            DeviceModel2_0 {{"CustomizationCtrlr"}, {"MeterValuesMaxPointsPerRequest"}, {std::nullopt, ocpp2_0::DataEnumType::kinteger}},
                             std::to_string(10)
                     };
                 },
                 [](auto const& value) {return value > 0;}
         };
 
+        SettingInt MeterValuesMaxBytesPerRequest {
+                []() {
+                    return SettingMetadata {
+                            "MeterValuesMaxBytesPerRequest",
+                            SettingConfig::rwPolicy(),
+                            DeviceModel1_6 {"MeterValuesMaxBytesPerRequest"},
+                            DeviceModel2_0 {{"CustomizationCtrlr"}, {"MeterValuesMaxBytesPerRequest"}, {std::nullopt, ocpp2_0::DataEnumType::kinteger}},
+                            std::to_string(4*1024)
+                    };
+                },
+                [](auto const& value) {return value >= 512 && value <= 64*1024;}
+        };
+
         SettingTransitionString WifiSSID {
                 []() {
                     return SettingMetadata {
@@ -2077,6 +2132,33 @@ namespace chargelab {
                 [](auto const&) {return true;}
         };
 
+        // Inbound websocket queue statistics for the current connection
+        SettingInt DiagnosticInboundMessagesDropped {
+                []() {
+                    return SettingMetadata {
+                            "DiagnosticInboundMessagesDropped",
+                            SettingConfig::roNotSavedPolicy(),
+                            DeviceModel1_6 {"DiagnosticInboundMessagesDropped"},
+                            DeviceModel2_0 {{"CustomizationCtrlr"}, {"DiagnosticInboundMessagesDropped"}, {std::nullopt, ocpp2_0::DataEnumType::kinteger}},
+                            std::to_string(0)
+                    };
+                },
+                [](auto const&) {return true;}
+        };
+
+        SettingInt DiagnosticInboundQueueHighWaterBytes {
+                []() {
+                    return SettingMetadata {
+                            "DiagnosticInboundQueueHighWaterBytes",
+                            SettingConfig::roNotSavedPolicy(),
+                            DeviceModel1_6 {"DiagnosticInboundQueueHighWaterBytes"},
+                            DeviceModel2_0 {{"CustomizationCtrlr"}, {"DiagnosticInboundQueueHighWaterBytes"}, {std::nullopt, ocpp2_0::DataEnumType::kinteger}},
+                            std::to_string(0)
+                    };
+                },
+                [](auto const&) {return true;}
+        };
+
         SettingInt RestartProtectionGracePeriodSeconds {
                 []() {
                     return SettingMetadata {
@@ -2246,6 +2328,66 @@ namespace chargelab {
                 [](auto const&) {return true;}
         };
 
+        // Note: values above 1 allow multiple outstanding CALL messages, which is outside of the strict OCPP 1.6 and
+        // 2.0.1 message flow and should only be enabled for central systems known to support it.
+        SettingInt MaxInFlightMessages {
+                []() {
+                    return SettingMetadata {
+                            "MaxInFlightMessages",
+                            SettingConfig::rwPolicy(),
+                            DeviceModel1_6 {"MaxInFlightMessages"},
+                            DeviceModel2_0 {{"CustomizationCtrlr"}, {"MaxInFlightMessages"}, {std::nullopt, ocpp2_0::DataEnumType::kinteger}},
+                            std::to_string(1)
+                    };
+                },
+                [](auto const& value) {return value >= 1 && value <= 16;}
+        };
+
+        // Upper bound on the size of each NotifyReport frame sent in response to GetBaseReport; larger reports are split
+        // across several frames.
+        SettingInt NotifyReportMaxBytes {
+                []() {
+                    return SettingMetadata {
+                            "NotifyReportMaxBytes",
+                            SettingConfig::rwPolicy(),
+                            DeviceModel1_6 {"NotifyReportMaxBytes"},
+                            DeviceModel2_0 {{"CustomizationCtrlr"}, {"NotifyReportMaxBytes"}, {std::nullopt, ocpp2_0::DataEnumType::kinteger}},
+                            std::to_string(4*1024)
+                    };
+                },
+                [](auto const& value) {return value >= 512 && value <= 64*1024;}
+        };
+
+        // Largest inbound websocket message accepted; larger CALLs are rejected with a CallError. Applied on the next
+        // connection.
+        SettingInt WebsocketMaxMessageBytes {
+                []() {
+                    return SettingMetadata {
+                            "WebsocketMaxMessageBytes",
+                            SettingConfig::rwPolicy(),
+                            DeviceModel1_6 {"WebsocketMaxMessageBytes"},
+                            DeviceModel2_0 {{"CustomizationCtrlr"}, {"WebsocketMaxMessageBytes"}, {std::nullopt, ocpp2_0::DataEnumType::kinteger}},
+                            std::to_string(8*1024)
+                    };
+                },
+                [](auto const& value) {return value >= 1024 && value <= 64*1024;}
+        };
+
+        // Size of the buffer holding inbound websocket messages that haven't been processed yet. Applied on the next
+        // connection.
+        SettingInt WebsocketInboundQueueBytes {
+                []() {
+                    return SettingMetadata {
+                            "WebsocketInboundQueueBytes",
+                            SettingConfig::rwPolicy(),
+                            DeviceModel1_6 {"WebsocketInboundQueueBytes"},
+                            DeviceModel2_0 {{"CustomizationCtrlr"}, {"WebsocketInboundQueueBytes"}, {std::nullopt, ocpp2_0::DataEnumType::kinteger}},
+                            std::to_string(16*1024)
+                    };
+                },
+                [](auto const& value) {return value >= 4*1024 && value <= 128*1024;}
+        };
+
         // Internal settings
         SettingString ChargerVendor {
                 []() {
@@ -3274,6 +3416,8 @@ namespace chargelab {
                     &DefaultMessageTimeout,
                     &DiagnosticFreeHeap,
                     &DiagnosticFreeHeapMinimum,
+                    &DiagnosticInboundMessagesDropped,
+                    &DiagnosticInboundQueueHighWaterBytes,
                     &DiagnosticLastPingRoundTripTime,
                     &DiagnosticWiFiSignalStrength,
                     &DisplayMessageSupportedFormats,
@@ -3299,9 +3443,11 @@ namespace chargelab {
                     &LocalPreAuthorize,
                     &LogStreamingEnabled,
                     &MaxChargingProfilesInstalled,
+                    &MaxInFlightMessages,
                     &MeterValuesAlignedData,
                     &MeterValueSampleInterval,
                     &MeterValuesMaxPointsPerRequest,
+                    &MeterValuesMaxBytesPerRequest,
                     &MeterValuesSampledData,
                     &MinimumStatusDuration,
                     &NumberOfConnectors,
@@ -3313,6 +3459,7 @@ namespace chargelab {
                     &NetworkProfileConnectionAttempts,
                     &NotificationMessageDefaultRetries,
                     &NotificationMessageDefaultRetryInterval,
+                    &NotifyReportMaxBytes,
                     &NumberOfDisplayMessages,
                     &OcppProtocol,
                     &OfflinePlugAndChargeToggle,
@@ -3344,6 +3491,8 @@ namespace chargelab {
                     &TxStopPoint,
                     &UnlockConnectorOnEVSideDisconnect,
                     &WebSocketPingInterval,
+                    &WebsocketInboundQueueBytes,
+                    &WebsocketMaxMessageBytes,
                     &WifiHideStationAccessPointAfterSetup,
                     &WifiPassword,
                     &WifiReconnectInterval,
@@ -3353,6 +3502,9 @@ namespace chargelab {
                     &ChargingStationSupplyPhases,
                     &MessageFlushCounter
             };
+
+            for (auto p : combined_setting_list_)
+                indexSetting(p);
         }
 
         virtual ~Settings() {
@@ -3366,25 +3518,54 @@ namespace chargelab {
         virtual void saveIfModified() {
             std::lock_guard lock(mutex_);
 
-            bool modified = false;
+            std::size_t saved_count = 0;
+            std::vector<SettingBase*> modified;
             for (auto const& p : combined_setting_list_) {
                 if (p == nullptr)
                     continue;
                 if (!p->getConfig().isIncludeInSave())
                     continue;
+
+                saved_count++;
                 if (!p->getModified())
                     continue;
 
                 CHARGELAB_LOG_MESSAGE(info) << "Setting was modified: " << p->getId();
-                modified = true;
+                modified.push_back(p);
             }
 
-            if (!modified)
+            if (modified.empty())
                 return;
 
-            CHARGELAB_LOG_MESSAGE(info) << "Setting modified - writing to file";
             CHARGELAB_TRY {
-                storage_interface_->write([&](auto file) {
+                // Records are replayed in order on load, so changes can be appended until superseded records make up
+                // too much of the file, at which point it's compacted back down to one record per setting.
+                if (log_record_count_.has_value() && log_record_count_.value() + modified.size() <= kLogCompactionFactor*saved_count) {
+                    CHARGELAB_LOG_MESSAGE(info) << "Setting modified - appending to file";
+                    bool appended = storage_interface_->append([&](auto file) {
+                        // Start on a new line in case a previous append was interrupted part way through a record
+                        std::fputc('\n', file);
+                        for (auto const& p : modified) {
+                            file::json_write_object_to_file(file, detail::SettingKeyValue{
+                                    p->getId(),
+                                    p->save()
+                            });
+                        }
+
+                        return true;
+                    });
+
+                    if (appended) {
+                        log_record_count_ = log_record_count_.value() + modified.size();
+                        return;
+                    }
+
+                    for (auto const& p : modified)
+                        p->setModified(true);
+                }
+
+                CHARGELAB_LOG_MESSAGE(info) << "Setting modified - writing to file";
+                bool written = storage_interface_->write([&](auto file) {
                     for (auto const& p : combined_setting_list_) {
                         if (p == nullptr)
                             continue;
@@ -3399,6 +3580,12 @@ namespace chargelab {
 
                     return true;
                 });
+
+                if (written) {
+                    log_record_count_ = saved_count;
+                } else {
+                    log_record_count_ = std::nullopt;
+                }
             } CHARGELAB_CATCH {
                 CHARGELAB_LOG_MESSAGE(error) << "Failed writing settings: " << e.what();
             }
@@ -3409,18 +3596,13 @@ namespace chargelab {
                 return;
 
             std::lock_guard lock(mutex_);
-            for (auto const& p : combined_setting_list_) {
-                if (p == nullptr)
-                    continue;
-                if (!string::EqualsIgnoreCaseAscii(p->getId(), setting->getId()))
-                    continue;
-
+            if (findSettingInternal(setting->getId()) != nullptr)
                 CHARGELAB_LOG_MESSAGE(error) << "Custom setting name conflicts with existing entries: " << setting->getId();
-                break;
-            }
 
             auto const id = setting->getId();
-            bool saved = setting->getMetadata().config.isIncludeInSave();
+            bool saved = setting->getConfig().isIncludeInSave();
+            indexSetting(setting.get());
+            custom_setting_index_.emplace(detail::settingIdKey(id), setting);
             combined_setting_list_.resize(combined_setting_list_.size()+1);
             combined_setting_list_.back() = setting.get();
             custom_setting_list_.resize(custom_setting_list_.size()+1);
@@ -3435,45 +3617,62 @@ namespace chargelab {
         [[nodiscard]] std::shared_ptr<SettingBase> getCustomSetting(std::string const& id) {
             std::lock_guard lock(mutex_);
 
-            for (auto const& x : custom_setting_list_)
-                if (string::EqualsIgnoreCaseAscii(id, x->getId()))
-                    return x;
+            auto it = custom_setting_index_.find(detail::settingIdKey(id));
+            if (it == custom_setting_index_.end())
+                return nullptr;
 
-            return nullptr;
+            return it->second;
         }
 
         std::optional<SettingState> getSettingState(std::string const& id) {
             std::lock_guard lock(mutex_);
-            for (auto const& p : combined_setting_list_) {
-                if (p == nullptr)
-                    continue;
-                if (!string::EqualsIgnoreCaseAscii(p->getId(), id))
-                    continue;
-                
-                return SettingState{
-                        p->getId(),
-                        p->getConfig(),
-                        p->getModel16(),
-                        p->getModel20(),
-                        p->getValueAsString()
-                };
-            }
+            auto const p = findSettingInternal(id);
+            if (p == nullptr)
+                return std::nullopt;
 
-            return std::nullopt;
+            auto metadata = p->getMetadata();
+            return SettingState{
+                    std::move(metadata.id),
+                    metadata.config,
+                    std::move(metadata.model1_6),
+                    std::move(metadata.model2_0),
+                    p->getValueAsString()
+            };
         }
 
         bool setSettingValue(std::string const& id, std::string const& value) {
             std::lock_guard lock(mutex_);
-            for (auto const& p : combined_setting_list_) {
-                if (p == nullptr)
-                    continue;
-                if (!string::EqualsIgnoreCaseAscii(p->getId(), id))
-                    continue;
-                
-                return p->setValueFromString(value);
-            }
+            auto const p = findSettingInternal(id);
+            if (p == nullptr)
+                return false;
 
-            return false;
+            return p->setValueFromString(value);
+        }
+
+        /**
+         * Looks up a setting by its (case-insensitive) id. Settings are never removed, so the returned pointer remains
+         * valid for the lifetime of this object.
+         */
+        [[nodiscard]] SettingBase* findSetting(std::string const& id) {
+            std::lock_guard lock(mutex_);
+            return findSettingInternal(id);
+        }
+
+        /**
+         * Looks up the setting mapped to an OCPP 2.0.1 component/variable pair, or nullptr if there is none.
+         */
+        [[nodiscard]] SettingBase* findSetting2_0(ocpp2_0::ComponentType const& component, ocpp2_0::VariableType const& variable) {
+            std::lock_guard lock(mutex_);
+            auto it = variable_index_.find(detail::settingVariableKey(detail::settingComponentKey(component), variable));
+            if (it == variable_index_.end())
+                return nullptr;
+
+            return it->second;
+        }
+
+        [[nodiscard]] bool hasComponent2_0(ocpp2_0::ComponentType const& component) {
+            std::lock_guard lock(mutex_);
+            return component_index_.find(detail::settingComponentKey(component)) != component_index_.end();
         }
 
         void visitSettings(std::function<void(SettingBase const&)> const& visitor) const {
@@ -3496,6 +3695,30 @@ namespace chargelab {
             }
         }
 
+        /**
+         * Visits settings in registration order, starting from index start, until the visitor returns false. Returns
+         * the index of the first setting that wasn't visited; settings are only ever appended, so this can be used as
+         * a cursor to resume from later.
+         */
+        std::size_t visitSettingsFrom(std::size_t start, std::function<bool(SettingBase&)> const& visitor) {
+            std::lock_guard lock(mutex_);
+            auto index = start;
+            for (; index < combined_setting_list_.size(); index++) {
+                auto const& p = combined_setting_list_[index];
+                if (p == nullptr)
+                    continue;
+                if (!visitor(*p))
+                    break;
+            }
+
+            return index;
+        }
+
+        [[nodiscard]] std::size_t settingCount() const {
+            std::lock_guard lock(mutex_);
+            return combined_setting_list_.size();
+        }
+
         bool hasPendingTransition(SettingTransitionType const& type) {
             for (auto ptr : combined_setting_list_) {
                 if (ptr != nullptr && ptr->hasPendingTransition(type)) {
@@ -3559,11 +3782,13 @@ namespace chargelab {
     private:
         void loadFromStorageInternal(std::optional<std::string> const& key) {
             CHARGELAB_TRY {
-                storage_interface_->read([&](auto file) {
+                std::size_t record_count = 0;
+                bool read = storage_interface_->read([&](auto file) {
                     while (true) {
                         if (file::is_eof_ignore_whitespace(file))
                             break;
 
+                        record_count++;
                         auto const json = file::json_read_object_from_file<detail::SettingKeyValue>(file);
                         if (!json.has_value())
                             continue;
@@ -3572,40 +3797,73 @@ namespace chargelab {
                         if (key.has_value() && record.key != key)
                             continue;
 
-                        bool loaded_setting = false;
-                        for (auto const& p : combined_setting_list_) {
-                            if (p == nullptr)
-                                continue;
-                            if (!string::EqualsIgnoreCaseAscii(p->getId(), record.key))
-                                continue;
-
-                            if (p->load(record.value))
-                                p->setModified(false);
-
-                            CHARGELAB_LOG_MESSAGE(info) << "Load settings: " << record;
-                            loaded_setting = true;
-                            break;
-                        }
-
-                        if (!loaded_setting) {
+                        auto const p = findSettingInternal(record.key);
+                        if (p == nullptr) {
                             CHARGELAB_LOG_MESSAGE(warning) << "Unrecognised entry in saved settings: " << record;
+                            continue;
                         }
+
+                        if (p->load(record.value))
+                            p->setModified(false);
+
+                        CHARGELAB_LOG_MESSAGE(info) << "Load settings: " << record;
                     }
 
                     return true;
                 });
+
+                if (!key.has_value()) {
+                    if (read) {
+                        log_record_count_ = record_count;
+                    } else {
+                        log_record_count_ = std::nullopt;
+                    }
+                }
             } CHARGELAB_CATCH {
                 CHARGELAB_LOG_MESSAGE(error) << "Failed reading settings: " << e.what();
             }
         }
 
+        SettingBase* findSettingInternal(std::string const& id) const {
+            auto it = id_index_.find(detail::settingIdKey(id));
+            if (it == id_index_.end())
+                return nullptr;
+
+            return it->second;
+        }
+
+        void indexSetting(SettingBase* setting) {
+            if (setting == nullptr)
+                return;
+
+            // Note: the first registration wins on conflicts, matching the order of combined_setting_list_
+            id_index_.emplace(detail::settingIdKey(setting->getId()), setting);
+
+            auto const model = setting->getModel20();
+            if (model.has_value()) {
+                auto component_key = detail::settingComponentKey(model->component_type);
+                variable_index_.emplace(detail::settingVariableKey(component_key, model->variable_type), setting);
+                component_index_.insert(std::move(component_key));
+            }
+        }
+
     private:
+        // Maximum size of the settings file, in records per saved setting, before it's rewritten
+        static constexpr std::size_t kLogCompactionFactor = 2;
+
         std::shared_ptr<StorageInterface> storage_interface_;
 
         mutable std::recursive_mutex mutex_ {};
         std::vector<std::shared_ptr<SettingBase>> custom_setting_list_;
         std::vector<SettingBase*> combined_setting_list_;
+        std::unordered_map<std::string, SettingBase*> id_index_;
+        std::unordered_map<std::string, SettingBase*> variable_index_;
+        std::unordered_set<std::string> component_index_;
+        std::unordered_map<std::string, std::shared_ptr<SettingBase>> custom_setting_index_;
         std::optional<SettingTransitionType> active_transition_;
+
+        // Number of records in the settings file, or std::nullopt if unknown and the next save must rewrite it
+        std::optional<std::size_t> log_record_count_ = std::nullopt;
     };
 
 #undef CHARGELAB_DEVICE_MODEL
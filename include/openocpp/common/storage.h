@@ -2,6 +2,7 @@
 #define CHARGELAB_OPEN_FIRMWARE_STORAGE_H
 
 #include <string>
+#include <memory>
 
 #include "openocpp/interface/element/storage_interface.h"
 
@@ -32,20 +33,69 @@ namespace chargelab {
     public:
         bool read(std::function<bool(FILE *)> const& function) override {
             auto file = std::fopen(filename_.c_str(), "r");
-            if (file == nullptr)
-                return false;
+            if (file == nullptr) {
+                // Only the temporary copy is left if a write was interrupted between removing and renaming the files
+                file = std::fopen(temporaryFilename().c_str(), "r");
+                if (file == nullptr)
+                    return false;
+            }
 
             detail::CloseFileWrapper wrapper{file};
             return function(file);
         }
 
+        // Note: the content is written to a temporary file first and then renamed over the original, so an
+        // interrupted write leaves the previous content intact rather than a truncated file.
         bool write(std::function<bool(FILE *)> const& function) override {
-            auto file = std::fopen(filename_.c_str(), "w");
+            auto const temporary = temporaryFilename();
+            bool success;
+            {
+                auto file = std::fopen(temporary.c_str(), "w");
+                if (file == nullptr)
+                    return false;
+
+                detail::CloseFileWrapper wrapper{file};
+                success = function(file) && std::fflush(file) == 0 && !std::ferror(file);
+            }
+
+            if (!success) {
+                std::remove(temporary.c_str());
+                return false;
+            }
+
+            if (std::rename(temporary.c_str(), filename_.c_str()) == 0)
+                return true;
+
+            // Some filesystems (for example SPIFFS) refuse to rename over an existing file
+            std::remove(filename_.c_str());
+            return std::rename(temporary.c_str(), filename_.c_str()) == 0;
+        }
+
+        bool append(std::function<bool(FILE *)> const& function) override {
+            // Note: not created if missing, since the only copy may still be in the temporary file
+            auto file = std::fopen(filename_.c_str(), "r+");
             if (file == nullptr)
                 return false;
 
             detail::CloseFileWrapper wrapper{file};
-            return function(file);
+            if (std::fseek(file, 0, SEEK_END) != 0)
+                return false;
+
+            return function(file) && std::fflush(file) == 0 && !std::ferror(file);
+        }
+
+        std::unique_ptr<StorageInterface> sibling(std::string const& suffix) override {
+            return std::make_unique<StorageFile>(filename_ + "." + suffix);
+        }
+
+        bool remove() override {
+            std::remove(temporaryFilename().c_str());
+            return std::remove(filename_.c_str()) == 0;
+        }
+
+    private:
+        [[nodiscard]] std::string temporaryFilename() const {
+            return filename_ + ".tmp";
         }
 
     private:
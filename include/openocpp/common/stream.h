@@ -3,11 +3,25 @@
 
 #include <array>
 #include <utility>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
 
 #include "openocpp/interface/element/byte_reader_interface.h"
 #include "openocpp/interface/element/byte_writer_interface.h"
 
+#ifndef CHARGELAB_STREAM_BUFFER_BYTES
+// Note: default buffer size of the buffered readers and writers below, which live on the stack while (de)serializing
+#define CHARGELAB_STREAM_BUFFER_BYTES 256
+#endif
+
 namespace chargelab::stream {
+    /**
+     * Collects small writes (typically single characters from the JSON writer) and passes them on in blocks of
+     * BufferSize bytes. If the output can expose that much of its own buffer through reserve, bytes are produced
+     * directly into it; otherwise they're gathered locally and handed over with a single write.
+     */
+    template <std::size_t BufferSize=CHARGELAB_STREAM_BUFFER_BYTES>
     class BufferedByteWriter {
     public:
         BufferedByteWriter(ByteWriterInterface& output)
@@ -15,17 +29,35 @@ namespace chargelab::stream {
         {
         }
 
+        BufferedByteWriter(BufferedByteWriter const&) = delete;
+        BufferedByteWriter& operator=(BufferedByteWriter const&) = delete;
+
+        ~BufferedByteWriter() {
+            flush();
+        }
+
         void put(char ch) {
-            if (index_ >= buffer_.size())
-                flush();
+            if (index_ >= BufferSize)
+                next();
 
-            buffer_[index_++] = ch;
+            data_[index_++] = ch;
         }
 
         void write(char const* s, std::size_t n) {
-            for (int i = 0; i < n; i++) {
-                put(s[i]);
+            if (n > BufferSize - index_) {
+                flush();
+
+                // Note: nothing to gain from copying blocks at least as large as the buffer
+                if (n >= BufferSize) {
+                    output_.write(s, n);
+                    return;
+                }
+
+                next();
             }
+
+            std::memcpy(data_ + index_, s, n);
+            index_ += n;
         }
 
         void write(char const* s) {
@@ -37,19 +69,45 @@ namespace chargelab::stream {
         }
 
         void flush() {
-            if (index_ == 0)
-                return;
+            if (reserved_) {
+                output_.commit(index_);
+            } else if (data_ != nullptr && index_ > 0) {
+                output_.write(data_, index_);
+            }
+
+            data_ = nullptr;
+            index_ = BufferSize;
+            reserved_ = false;
+        }
+
+    private:
+        // Note: kept out of line so put stays small enough to be inlined into the JSON writer
+        [[gnu::noinline]] void next() {
+            flush();
+
+            auto const span = output_.reserve(BufferSize);
+            if (span.size >= BufferSize) {
+                data_ = span.data;
+                reserved_ = true;
+            } else {
+                if (span.size > 0)
+                    output_.commit(0);
+
+                data_ = buffer_.data();
+            }
 
-            output_.write(buffer_.data(), index_);
             index_ = 0;
         }
 
     private:
         ByteWriterInterface& output_;
-        std::array<char, 128> buffer_ {};
-        std::size_t index_ = 0;
+        char* data_ = nullptr;
+        std::size_t index_ = BufferSize;
+        bool reserved_ = false;
+        std::array<char, BufferSize> buffer_;
     };
 
+    template <std::size_t BufferSize=CHARGELAB_STREAM_BUFFER_BYTES>
     class BufferedByteReader {
     public:
         BufferedByteReader(ByteReaderInterface& input)
@@ -88,7 +146,7 @@ namespace chargelab::stream {
 
     private:
         ByteReaderInterface& input_;
-        std::array<char, 128> buffer_ {};
+        std::array<char, BufferSize> buffer_;
         std::size_t index_ = 0;
         std::size_t count_ = 0;
         std::size_t offset_ = 0;
@@ -118,17 +176,32 @@ namespace chargelab::stream {
     class StringWriter : public ByteWriterInterface {
     public:
         void write(char const *s, std::size_t count) override {
-            auto const index = text_.size();
-            text_.resize(text_.size() + count);
-            std::memcpy(&text_[index], s, count);
+            text_.append(s, count);
+        }
+
+        // Note: the span covers the string's spare capacity, growing it first if that's smaller than size_hint
+        ByteSpan reserve(std::size_t size_hint) override {
+            reserved_ = text_.size();
+            text_.resize(std::max(text_.capacity(), reserved_ + size_hint));
+            return {&text_[reserved_], text_.size() - reserved_};
+        }
+
+        void commit(std::size_t count) override {
+            text_.resize(reserved_ + count);
         }
 
         std::string const& str() const {
             return text_;
         }
 
+        // Note: retains the allocated capacity so the writer can be reused
+        void clear() {
+            text_.clear();
+        }
+
     private:
         std::string text_;
+        std::size_t reserved_ = 0;
     };
 
     class SizeCalculator : public ByteWriterInterface {
@@ -0,0 +1,44 @@
+#ifndef CHARGELAB_OPEN_FIRMWARE_WAKEUP_SIGNAL_H
+#define CHARGELAB_OPEN_FIRMWARE_WAKEUP_SIGNAL_H
+
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+
+namespace chargelab {
+    /**
+     * Wakes a thread sleeping in waitFor() early, for example when a websocket message arrives. A notification that
+     * arrives while the thread isn't waiting is retained, so the next waitFor() returns immediately.
+     */
+    class WakeupSignal {
+    public:
+        void notify() {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                pending_ = true;
+            }
+
+            condition_.notify_all();
+        }
+
+        /**
+         * @return true if woken by notify(), otherwise false if the timeout elapsed
+         */
+        bool waitFor(int timeout_millis) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            auto const result = condition_.wait_for(lock, std::chrono::milliseconds(timeout_millis), [&]() {
+                return pending_;
+            });
+
+            pending_ = false;
+            return result;
+        }
+
+    private:
+        std::mutex mutex_;
+        std::condition_variable condition_;
+        bool pending_ = false;
+    };
+}
+
+#endif //CHARGELAB_OPEN_FIRMWARE_WAKEUP_SIGNAL_H
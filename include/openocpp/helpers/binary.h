@@ -0,0 +1,437 @@
+#ifndef CHARGELAB_OPEN_FIRMWARE_BINARY_H
+#define CHARGELAB_OPEN_FIRMWARE_BINARY_H
+
+#include "openocpp/helpers/json.h"
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+namespace chargelab {
+    // Note: compact binary encoding for the types that are serialized with the CHARGELAB_JSON_* macros, used for
+    // records that are stored for a while before being sent (such as the offline message queue). Integers are
+    // written as varints, enums as their ordinal, and the optional fields of an object are packed into a single
+    // presence bitmap. Types without a binary encoding of their own are written as JSON text.
+    //
+    // The encoding follows the declaration order of fields and enum values, so reordering them changes the format.
+
+    namespace binary {
+        class Writer {
+        public:
+            explicit Writer(std::string& output) : output_(output)
+            {
+            }
+
+            void writeVarint(std::uint64_t value) {
+                while (value >= 0x80) {
+                    output_.push_back((char)((value & 0x7F) | 0x80));
+                    value >>= 7;
+                }
+
+                output_.push_back((char)value);
+            }
+
+            void writeSignedVarint(std::int64_t value) {
+                writeVarint(((std::uint64_t)value << 1) ^ (std::uint64_t)(value >> 63));
+            }
+
+            void writeByte(std::uint8_t value) {
+                output_.push_back((char)value);
+            }
+
+            void writeBytes(void const* data, std::size_t size) {
+                output_.append((char const*)data, size);
+            }
+
+            void writeString(std::string_view const& value) {
+                writeVarint(value.size());
+                writeBytes(value.data(), value.size());
+            }
+
+        private:
+            std::string& output_;
+        };
+
+        class Reader {
+        public:
+            explicit Reader(std::string_view const& input) : input_(input)
+            {
+            }
+
+            bool readVarint(std::uint64_t& value) {
+                value = 0;
+                for (int shift=0; shift < 64; shift += 7) {
+                    if (index_ >= input_.size())
+                        return false;
+
+                    auto const byte = (std::uint8_t)input_[index_++];
+                    value |= (std::uint64_t)(byte & 0x7F) << shift;
+                    if ((byte & 0x80) == 0)
+                        return true;
+                }
+
+                return false;
+            }
+
+            bool readSignedVarint(std::int64_t& value) {
+                std::uint64_t raw;
+                if (!readVarint(raw))
+                    return false;
+
+                value = (std::int64_t)(raw >> 1) ^ -(std::int64_t)(raw & 1);
+                return true;
+            }
+
+            bool readByte(std::uint8_t& value) {
+                if (index_ >= input_.size())
+                    return false;
+
+                value = (std::uint8_t)input_[index_++];
+                return true;
+            }
+
+            bool readBytes(void* data, std::size_t size) {
+                if (input_.size() - index_ < size)
+                    return false;
+
+                std::memcpy(data, input_.data() + index_, size);
+                index_ += size;
+                return true;
+            }
+
+            bool readString(std::string& value) {
+                std::uint64_t size;
+                if (!readVarint(size) || input_.size() - index_ < size)
+                    return false;
+
+                value.assign(input_.data() + index_, size);
+                index_ += size;
+                return true;
+            }
+
+            [[nodiscard]] bool atEnd() const {
+                return index_ >= input_.size();
+            }
+
+        private:
+            std::string_view input_;
+            std::size_t index_ = 0;
+        };
+
+        /**
+         * Fallback for types without a binary encoding: the value is stored as JSON text.
+         */
+        template <typename T, typename U=bool>
+        struct ReadValue {
+            static bool read_binary(Reader& reader, T& value) {
+                std::string text;
+                if (!reader.readString(text))
+                    return false;
+
+                auto result = read_json_from_string<T>(text);
+                if (!result.has_value())
+                    return false;
+
+                value = std::move(result.value());
+                return true;
+            }
+        };
+
+        template <typename T, typename U=void>
+        struct WriteValue {
+            static void write_binary(Writer& writer, T const& value) {
+                writer.writeString(write_json_to_string(value));
+            }
+        };
+
+        template <typename T>
+        struct ReadValue <T, decltype(T::read_binary(std::declval<Reader&>(), std::declval<T&>()))> {
+            static bool read_binary(Reader& reader, T& value) {
+                return T::read_binary(reader, value);
+            }
+        };
+
+        template <typename T>
+        struct WriteValue <T, std::void_t<decltype(T::write_binary(std::declval<Writer&>(), std::declval<T const&>()))>> {
+            static void write_binary(Writer& writer, T const& value) {
+                T::write_binary(writer, value);
+            }
+        };
+
+        template <>
+        struct ReadValue <bool, bool> {
+            static bool read_binary(Reader& reader, bool& value) {
+                std::uint8_t byte;
+                if (!reader.readByte(byte) || byte > 1)
+                    return false;
+
+                value = byte != 0;
+                return true;
+            }
+        };
+
+        template <>
+        struct WriteValue <bool, void> {
+            static void write_binary(Writer& writer, bool const& value) {
+                writer.writeByte(value ? 1 : 0);
+            }
+        };
+
+        // Note: also covers SystemTimeMillis and SteadyPointMillis, which are enums over std::int64_t
+        template <typename T>
+        struct ReadValue <T, typename std::enable_if<(std::is_integral<T>::value || std::is_enum<T>::value) && !std::is_same<T, bool>::value, bool>::type> {
+            static bool read_binary(Reader& reader, T& value) {
+                if constexpr (std::is_enum<T>::value) {
+                    std::int64_t raw;
+                    if (!reader.readSignedVarint(raw))
+                        return false;
+
+                    value = static_cast<T>(raw);
+                } else if constexpr (std::is_signed<T>::value) {
+                    std::int64_t raw;
+                    if (!reader.readSignedVarint(raw))
+                        return false;
+                    if (raw < (std::int64_t)std::numeric_limits<T>::min() || raw > (std::int64_t)std::numeric_limits<T>::max())
+                        return false;
+
+                    value = (T)raw;
+                } else {
+                    std::uint64_t raw;
+                    if (!reader.readVarint(raw) || raw > (std::uint64_t)std::numeric_limits<T>::max())
+                        return false;
+
+                    value = (T)raw;
+                }
+
+                return true;
+            }
+        };
+
+        template <typename T>
+        struct WriteValue <T, typename std::enable_if<(std::is_integral<T>::value || std::is_enum<T>::value) && !std::is_same<T, bool>::value>::type> {
+            static void write_binary(Writer& writer, T const& value) {
+                if constexpr (std::is_enum<T>::value) {
+                    writer.writeSignedVarint((std::int64_t)value);
+                } else if constexpr (std::is_signed<T>::value) {
+                    writer.writeSignedVarint(value);
+                } else {
+                    writer.writeVarint(value);
+                }
+            }
+        };
+
+        /**
+         * Floating point values are tagged: whole numbers (most meter readings) are stored as a varint, and other
+         * values as a float when that's exact, falling back to a double.
+         */
+        template <typename T>
+        struct ReadValue <T, typename std::enable_if<std::is_floating_point<T>::value, bool>::type> {
+            static bool read_binary(Reader& reader, T& value) {
+                std::uint8_t tag;
+                if (!reader.readByte(tag))
+                    return false;
+
+                switch (tag) {
+                    default:
+                        return false;
+
+                    case kTagInteger:
+                        {
+                            std::int64_t raw;
+                            if (!reader.readSignedVarint(raw))
+                                return false;
+
+                            value = (T)raw;
+                            return true;
+                        }
+
+                    case kTagFloat:
+                        {
+                            float raw;
+                            if (!reader.readBytes(&raw, sizeof(raw)))
+                                return false;
+
+                            value = (T)raw;
+                            return true;
+                        }
+
+                    case kTagDouble:
+                        {
+                            double raw;
+                            if (!reader.readBytes(&raw, sizeof(raw)))
+                                return false;
+
+                            value = (T)raw;
+                            return true;
+                        }
+                }
+            }
+
+            static constexpr std::uint8_t kTagInteger = 0;
+            static constexpr std::uint8_t kTagFloat = 1;
+            static constexpr std::uint8_t kTagDouble = 2;
+        };
+
+        template <typename T>
+        struct WriteValue <T, typename std::enable_if<std::is_floating_point<T>::value>::type> {
+            static void write_binary(Writer& writer, T const& value) {
+                using tags = ReadValue<T>;
+                constexpr double kMaxExactInteger = 9007199254740992.0;
+
+                auto const raw = (double)value;
+                auto const whole = std::isfinite(raw) && std::trunc(raw) == raw && std::fabs(raw) < kMaxExactInteger;
+                if (whole && !(raw == 0 && std::signbit(raw))) {
+                    writer.writeByte(tags::kTagInteger);
+                    writer.writeSignedVarint((std::int64_t)raw);
+                } else if (std::isnan(raw) || (double)(float)raw == raw) {
+                    auto const narrow = (float)raw;
+                    writer.writeByte(tags::kTagFloat);
+                    writer.writeBytes(&narrow, sizeof(narrow));
+                } else {
+                    writer.writeByte(tags::kTagDouble);
+                    writer.writeBytes(&raw, sizeof(raw));
+                }
+            }
+        };
+
+        template <>
+        struct ReadValue <std::string, bool> {
+            static bool read_binary(Reader& reader, std::string& value) {
+                return reader.readString(value);
+            }
+        };
+
+        template <>
+        struct WriteValue <std::string, void> {
+            static void write_binary(Writer& writer, std::string const& value) {
+                writer.writeString(value);
+            }
+        };
+
+        template <typename T>
+        struct ReadValue <std::optional<T>, bool> {
+            static bool read_binary(Reader& reader, std::optional<T>& value) {
+                bool present;
+                if (!ReadValue<bool>::read_binary(reader, present))
+                    return false;
+
+                if (!present) {
+                    value = std::nullopt;
+                    return true;
+                }
+
+                value = T{};
+                return ReadValue<T>::read_binary(reader, value.value());
+            }
+        };
+
+        template <typename T>
+        struct WriteValue <std::optional<T>, void> {
+            static void write_binary(Writer& writer, std::optional<T> const& value) {
+                WriteValue<bool>::write_binary(writer, value.has_value());
+                if (value.has_value())
+                    WriteValue<T>::write_binary(writer, value.value());
+            }
+        };
+
+        template <typename T, typename Allocator>
+        struct ReadValue <std::vector<T, Allocator>, bool> {
+            static bool read_binary(Reader& reader, std::vector<T, Allocator>& value) {
+                std::uint64_t size;
+                if (!reader.readVarint(size))
+                    return false;
+
+                value.clear();
+                for (std::uint64_t i=0; i < size; i++) {
+                    T element {};
+                    if (!ReadValue<T>::read_binary(reader, element))
+                        return false;
+
+                    value.push_back(std::move(element));
+                }
+
+                return true;
+            }
+        };
+
+        template <typename T, typename Allocator>
+        struct WriteValue <std::vector<T, Allocator>, void> {
+            static void write_binary(Writer& writer, std::vector<T, Allocator> const& value) {
+                writer.writeVarint(value.size());
+                for (auto const& x : value)
+                    WriteValue<T>::write_binary(writer, x);
+            }
+        };
+
+        /**
+         * Fields of CHARGELAB_JSON_INTRUSIVE objects; presence of optional fields is recorded in the object's bitmap
+         * rather than next to each value.
+         */
+        template <typename T>
+        struct Field {
+            static constexpr bool kOptional = false;
+
+            static bool present(T const&) {
+                return true;
+            }
+
+            static bool read_binary(Reader& reader, T& value, bool) {
+                return ReadValue<T>::read_binary(reader, value);
+            }
+
+            static void write_binary(Writer& writer, T const& value) {
+                WriteValue<T>::write_binary(writer, value);
+            }
+        };
+
+        template <typename T>
+        struct Field <std::optional<T>> {
+            static constexpr bool kOptional = true;
+
+            static bool present(std::optional<T> const& value) {
+                return value.has_value();
+            }
+
+            static bool read_binary(Reader& reader, std::optional<T>& value, bool present) {
+                if (!present) {
+                    value = std::nullopt;
+                    return true;
+                }
+
+                value = T{};
+                return ReadValue<T>::read_binary(reader, value.value());
+            }
+
+            static void write_binary(Writer& writer, std::optional<T> const& value) {
+                if (value.has_value())
+                    WriteValue<T>::write_binary(writer, value.value());
+            }
+        };
+    }
+
+    template <typename T>
+    std::string write_binary_to_string(T const& value) {
+        std::string result;
+        binary::Writer writer {result};
+        binary::WriteValue<T>::write_binary(writer, value);
+        return result;
+    }
+
+    template <typename T>
+    std::optional<T> read_binary_from_string(std::string_view const& text) {
+        T result {};
+        binary::Reader reader {text};
+        if (!binary::ReadValue<T>::read_binary(reader, result) || !reader.atEnd())
+            return std::nullopt;
+
+        return std::move(result);
+    }
+}
+
+#endif //CHARGELAB_OPEN_FIRMWARE_BINARY_H
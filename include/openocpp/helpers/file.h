@@ -16,16 +16,50 @@ namespace chargelab::file {
                 assert(file_ != nullptr);
             }
 
+            FileByteWriter(FileByteWriter const&) = delete;
+            FileByteWriter& operator=(FileByteWriter const&) = delete;
+
             ~FileByteWriter() {
+                flush();
             }
 
             void write(const char *s, std::size_t length) override {
-                std::fwrite(s, sizeof(CharType), length, file_);
+                if (length > buffer_.size() - index_) {
+                    flush();
+
+                    if (length >= buffer_.size()) {
+                        std::fwrite(s, sizeof(CharType), length, file_);
+                        return;
+                    }
+                }
+
+                std::memcpy(buffer_.data() + index_, s, length);
+                index_ += length;
+            }
+
+            ByteSpan reserve(std::size_t) override {
+                if (index_ == buffer_.size())
+                    flush();
+
+                return {buffer_.data() + index_, buffer_.size() - index_};
+            }
+
+            void commit(std::size_t count) override {
+                index_ += count;
+            }
+
+        private:
+            void flush() {
+                if (index_ == 0)
+                    return;
+
+                std::fwrite(buffer_.data(), sizeof(CharType), index_, file_);
+                index_ = 0;
             }
 
         private:
             FILE* file_;
-            std::array<CharType, 128> buffer_ {};
+            std::array<char, CHARGELAB_STREAM_BUFFER_BYTES> buffer_;
             std::size_t index_ = 0;
         };
     }
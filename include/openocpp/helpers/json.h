@@ -6,9 +6,14 @@
 #include "openocpp/common/logging.h"
 
 #include <optional>
+#include <array>
+#include <string_view>
+#include <utility>
+#include <cstdint>
 #include <type_traits>
 #include <rapidjson/reader.h>
 #include <rapidjson/writer.h>
+#include <rapidjson/memorystream.h>
 #include <variant>
 #include <limits>
 #include <cmath>
@@ -51,7 +56,7 @@ namespace chargelab {
                 EndArrayType
         >;
 
-        std::string token_to_string(TokenType const& token) {
+        inline std::string token_to_string(TokenType const& token) {
             if (std::holds_alternative<NullType>(token)) return "NullType";
             if (std::holds_alternative<BoolType>(token)) return std::string("BoolType{") + (std::get<BoolType>(token).value ? "true" : "false") + "}";
             if (std::holds_alternative<IntType>(token)) return "IntType{" + std::to_string(std::get<IntType>(token).value) + "}";
@@ -69,7 +74,7 @@ namespace chargelab {
             return "Unknown";
         }
 
-        std::string token_to_string(std::optional<TokenType> const& token) {
+        inline std::string token_to_string(std::optional<TokenType> const& token) {
             if (!token.has_value())
                 return "nullopt";
 
@@ -119,6 +124,10 @@ namespace chargelab {
                 writer_.put(c);
             }
 
+            void Write(Ch const* s, std::size_t n) {
+                writer_.write(s, n);
+            }
+
             void Flush() {
                 writer_.flush();
             }
@@ -131,7 +140,7 @@ namespace chargelab {
             size_t PutEnd(char*) { assert(false); return 0; }
 
         private:
-            stream::BufferedByteWriter writer_;
+            stream::BufferedByteWriter<> writer_;
         };
 
         class ByteReaderAdapter {
@@ -157,9 +166,16 @@ namespace chargelab {
                 if (result == EOF)
                     return '\0';
 
+                if (capture_ != nullptr)
+                    capture_->push_back((Ch)result);
                 return (Ch)result;
             }
 
+            // While set, every character consumed from the input is also appended to capture
+            void setCapture(std::string* capture) {
+                capture_ = capture;
+            }
+
             std::size_t Tell() const {
                 return reader_.tellg();
             }
@@ -171,17 +187,34 @@ namespace chargelab {
             size_t PutEnd(Ch*) { assert(false); return 0; }
 
         private:
-            stream::BufferedByteReader reader_;
+            stream::BufferedByteReader<> reader_;
+            std::string* capture_ = nullptr;
         };
 
         class JsonReader {
         public:
             JsonReader(ByteReaderInterface& input)
-                : input_(input)
+                : input_(std::in_place, input)
+            {
+                reader_.IterativeParseInit();
+            }
+
+            /**
+             * Parses a copy of text in place in scratch, reusing its capacity. String tokens point into scratch
+             * rather than being copied, so they stay valid until scratch is next modified. Both text and scratch
+             * must outlive the reader.
+             */
+            JsonReader(std::string_view text, std::string& scratch)
+                : source_(text),
+                  insitu_(copyInto(scratch, text))
             {
                 reader_.IterativeParseInit();
             }
 
+            [[nodiscard]] bool isInsitu() const {
+                return !input_.has_value();
+            }
+
             std::optional<TokenType> nextToken() {
                 if (next_.has_value()) {
                     std::optional<TokenType> result = std::nullopt;
@@ -189,11 +222,7 @@ namespace chargelab {
                     return result;
                 }
 
-                if (reader_.HasParseError())
-                    return std::nullopt;
-                if (reader_.IterativeParseComplete())
-                    return std::nullopt;
-                if (!reader_.IterativeParseNext<rapidjson::kParseDefaultFlags>(input_, handler_))
+                if (!parseNext())
                     return std::nullopt;
 
                 return handler_.getToken();
@@ -203,24 +232,147 @@ namespace chargelab {
                 if (next_.has_value())
                     return next_;
 
-                if (reader_.HasParseError())
-                    return std::nullopt;
-                if (reader_.IterativeParseComplete())
-                    return std::nullopt;
-                if (!reader_.IterativeParseNext<rapidjson::kParseDefaultFlags>(input_, handler_))
+                if (!parseNext())
                     return std::nullopt;
 
                 return next_ = handler_.getToken();
             }
 
+            /**
+             * Consumes the next complete value and copies its source text into result as-is, without
+             * decoding and re-encoding each token. Returns false if the input ends or the next token
+             * does not start a value.
+             */
+            bool readRawValue(std::string& result) {
+                result.clear();
+                if (isInsitu())
+                    return readRawValueInsitu(result);
+
+                int depth = 0;
+                std::size_t prefix = 0;
+                if (next_.has_value()) {
+                    // The opening token was already consumed by a peek; recreate it and capture the rest
+                    auto const token = std::move(next_.value());
+                    next_ = std::nullopt;
+
+                    if (std::holds_alternative<StartObjectType>(token)) {
+                        result.push_back('{');
+                    } else if (std::holds_alternative<StartArrayType>(token)) {
+                        result.push_back('[');
+                    } else if (std::holds_alternative<EndObjectType>(token) ||
+                               std::holds_alternative<EndArrayType>(token) ||
+                               std::holds_alternative<KeyType>(token)) {
+                        return false;
+                    } else {
+                        return write_token(token, result);
+                    }
+
+                    depth = 1;
+                    prefix = 1;
+                }
+
+                input_->setCapture(&result);
+                do {
+                    if (!parseNext()) {
+                        input_->setCapture(nullptr);
+                        return false;
+                    }
+
+                    auto const& token = handler_.getToken();
+                    if (std::holds_alternative<StartObjectType>(token) || std::holds_alternative<StartArrayType>(token)) {
+                        depth++;
+                    } else if (std::holds_alternative<EndObjectType>(token) || std::holds_alternative<EndArrayType>(token)) {
+                        depth--;
+                    } else if (depth == 0 && std::holds_alternative<KeyType>(token)) {
+                        input_->setCapture(nullptr);
+                        return false;
+                    }
+                } while (depth > 0);
+                input_->setCapture(nullptr);
+
+                if (depth < 0)
+                    return false;
+
+                // The captured text includes the separators and whitespace consumed around the value
+                auto const begin = result.find_first_not_of(" \t\r\n:,", prefix);
+                auto const end = result.find_last_not_of(" \t\r\n");
+                if (begin == std::string::npos || end == std::string::npos || end < begin)
+                    return false;
+
+                result.erase(end + 1);
+                result.erase(prefix, begin - prefix);
+                return true;
+            }
+
         private:
-            ByteReaderAdapter input_;
+            static char* copyInto(std::string& scratch, std::string_view text) {
+                scratch.assign(text.data(), text.size());
+                return scratch.data();
+            }
+
+            bool parseNext() {
+                if (reader_.HasParseError() || reader_.IterativeParseComplete())
+                    return false;
+                if (input_.has_value())
+                    return reader_.IterativeParseNext<rapidjson::kParseDefaultFlags>(*input_, handler_);
+
+                position_ = insitu_.Tell();
+                return reader_.IterativeParseNext<rapidjson::kParseInsituFlag>(insitu_, handler_);
+            }
+
+            // Note: parsing in place overwrites the scratch copy, so the text is taken from the original at the same
+            // offsets instead
+            bool readRawValueInsitu(std::string& result) {
+                auto const start = next_.has_value() ? position_ : insitu_.Tell();
+
+                int depth = 0;
+                do {
+                    auto const next = nextToken();
+                    if (!next.has_value())
+                        return false;
+
+                    auto const& token = next.value();
+                    if (std::holds_alternative<StartObjectType>(token) || std::holds_alternative<StartArrayType>(token)) {
+                        depth++;
+                    } else if (std::holds_alternative<EndObjectType>(token) || std::holds_alternative<EndArrayType>(token)) {
+                        depth--;
+                    } else if (depth == 0 && std::holds_alternative<KeyType>(token)) {
+                        return false;
+                    }
+                } while (depth > 0);
+
+                if (depth < 0)
+                    return false;
+
+                auto const text = source_.substr(start, insitu_.Tell() - start);
+                auto const begin = text.find_first_not_of(" \t\r\n:,");
+                auto const end = text.find_last_not_of(" \t\r\n");
+                if (begin == std::string_view::npos || end == std::string_view::npos || end < begin)
+                    return false;
+
+                result.assign(text.data() + begin, end + 1 - begin);
+                return true;
+            }
+
+            static bool write_token(TokenType const& token, std::string& result);
+
+        private:
+            std::optional<ByteReaderAdapter> input_;
+            std::string_view source_;
+            rapidjson::InsituStringStream insitu_ {nullptr};
+            std::size_t position_ = 0;
             SaxToTokenHandler handler_;
-            rapidjson::Reader  reader_;
+            // Note: passed to the reader so it doesn't allocate its own for every message
+            rapidjson::CrtAllocator stack_allocator_;
+            rapidjson::Reader  reader_ {&stack_allocator_};
             std::optional<TokenType> next_ = std::nullopt;
         };
 
         class JsonWriter {
+        private:
+            // Note: below this, writing the string through rapidjson is cheaper than the separate prefix and copy
+            static constexpr std::size_t kMinPlainLength = 16;
+
         public:
             using char_type = char;
             using size_type = std::size_t;
@@ -241,9 +393,9 @@ namespace chargelab {
             bool Uint64(uint64_t value) {return writer_.Uint64(value);}
             bool Double(double value) {return writer_.Double(value);}
             bool RawNumber(const char_type *str, size_type length) {return writer_.RawNumber(str, length);}
-            bool String(const char_type *str, size_type length) {return writer_.String(str, length);}
+            bool String(const char_type *str, size_type length) {return isPlain(str, length) ? writePlain(str, length) : writer_.String(str, length);}
             bool StartObject() {return writer_.StartObject();}
-            bool Key(const char_type *str, size_type length) {return writer_.Key(str, length);}
+            bool Key(const char_type *str, size_type length) {return isPlain(str, length) ? writePlain(str, length) : writer_.Key(str, length);}
             bool EndObject() {return writer_.EndObject();}
             bool StartArray() {return writer_.StartArray();}
             bool EndArray() {return writer_.EndArray();}
@@ -254,12 +406,128 @@ namespace chargelab {
             bool Key(std::string const& str) {return Key(str.data(), str.size());}
             bool String(const char_type* str) {return String(str, std::strlen(str));}
             bool String(std::string const& str) {return String(str.data(), str.size());}
+            bool String(std::string_view const& str) {return String(str.data(), str.size());}
+
+            /**
+             * Writes pre-serialized JSON text as the next value. The text is copied verbatim, so the
+             * caller is responsible for it holding exactly one well-formed value.
+             */
+            bool RawValue(std::string_view const& json) {
+                auto const begin = json.find_first_not_of(" \t\r\n");
+                if (begin == std::string_view::npos)
+                    return false;
+
+                rapidjson::Type type;
+                switch (json[begin]) {
+                    case '{': type = rapidjson::kObjectType; break;
+                    case '[': type = rapidjson::kArrayType; break;
+                    case '"': type = rapidjson::kStringType; break;
+                    case 't': type = rapidjson::kTrueType; break;
+                    case 'f': type = rapidjson::kFalseType; break;
+                    case 'n': type = rapidjson::kNullType; break;
+                    default: type = rapidjson::kNumberType; break;
+                }
+
+                // Let rapidjson emit any separator and track nesting, then copy the text in one pass
+                writer_.RawValue("", 0, type);
+                output_.Write(json.data(), json.size());
+                if (writer_.IsComplete())
+                    output_.Flush();
+
+                return true;
+            }
+
+        private:
+            /**
+             * True if the string is long enough to be worth copying in one pass and rapidjson wouldn't escape any of
+             * its characters (control characters, quotes and backslashes). Checks eight bytes at a time.
+             */
+            static bool isPlain(const char_type *str, size_type length) {
+                constexpr std::uint64_t kOnes = 0x0101010101010101ull;
+                constexpr std::uint64_t kHighBits = 0x8080808080808080ull;
+                if (length < kMinPlainLength)
+                    return false;
+
+                size_type i = 0;
+                for (; i + sizeof(std::uint64_t) <= length; i += sizeof(std::uint64_t)) {
+                    std::uint64_t x;
+                    std::memcpy(&x, str + i, sizeof(x));
+
+                    auto const quote = x ^ (kOnes*'"');
+                    auto const backslash = x ^ (kOnes*'\\');
+                    auto const found = ((x - kOnes*0x20) | (quote - kOnes) | (backslash - kOnes)) & ~x & kHighBits;
+                    if (found != 0)
+                        return false;
+                }
+
+                for (; i < length; i++) {
+                    auto const ch = (unsigned char)str[i];
+                    if (ch < 0x20 || ch == '"' || ch == '\\')
+                        return false;
+                }
+
+                return true;
+            }
+
+            // Note: keys and string values are written the same way; rapidjson tells them apart by position
+            bool writePlain(const char_type *str, size_type length) {
+                writer_.RawValue("", 0, rapidjson::kStringType);
+                output_.Put('"');
+                output_.Write(str, length);
+                output_.Put('"');
+                if (writer_.IsComplete())
+                    output_.Flush();
+
+                return true;
+            }
 
         private:
             ByteWriterAdapter output_;
             rapidjson::Writer<ByteWriterAdapter> writer_;
         };
 
+        inline bool JsonReader::write_token(TokenType const& token, std::string& result) {
+            stream::StringWriter stream;
+            JsonWriter writer {stream};
+            if (std::holds_alternative<NullType>(token)) {
+                writer.Null();
+            } else if (std::holds_alternative<BoolType>(token)) {
+                writer.Bool(std::get<BoolType>(token).value);
+            } else if (std::holds_alternative<IntType>(token)) {
+                writer.Int(std::get<IntType>(token).value);
+            } else if (std::holds_alternative<UintType>(token)) {
+                writer.Uint(std::get<UintType>(token).value);
+            } else if (std::holds_alternative<Int64Type>(token)) {
+                writer.Int64(std::get<Int64Type>(token).value);
+            } else if (std::holds_alternative<Uint64Type>(token)) {
+                writer.Uint64(std::get<Uint64Type>(token).value);
+            } else if (std::holds_alternative<DoubleType>(token)) {
+                writer.Double(std::get<DoubleType>(token).value);
+            } else if (std::holds_alternative<RawNumberType>(token)) {
+                auto const& x = std::get<RawNumberType>(token);
+                writer.RawNumber(x.str, x.length);
+            } else if (std::holds_alternative<StringType>(token)) {
+                auto const& x = std::get<StringType>(token);
+                writer.String(x.str, x.length);
+            } else {
+                return false;
+            }
+
+            result = stream.str();
+            return true;
+        }
+
+        /**
+         * Checks that text holds exactly one well-formed JSON value, without building any tokens or
+         * copies of it.
+         */
+        inline bool is_valid_json(std::string_view const& text) {
+            rapidjson::MemoryStream stream {text.data(), text.size()};
+            rapidjson::BaseReaderHandler<> handler;
+            rapidjson::Reader reader;
+            return !reader.Parse<rapidjson::kParseDefaultFlags>(stream, handler).IsError();
+        }
+
         template <typename T>
         bool expect_type(JsonReader& reader)
         {
@@ -507,11 +775,44 @@ namespace chargelab {
                 }
 
                 auto const& container = std::get<StringType>(token);
-                value = std::string {container.str, container.length};
+                value.assign(container.str, container.length);
                 return true;
             };
         };
 
+        /**
+         * Borrows the text instead of copying it. Only supported by in-situ readers, where the view stays valid for
+         * as long as the reader's scratch buffer; for inbound calls that is the duration of dispatch.
+         */
+        template <>
+        struct ReadPrimitive<std::string_view, void> {
+            static bool read_json(JsonReader& reader, std::string_view& value) {
+                if (!reader.isInsitu()) {
+                    CHARGELAB_LOG_MESSAGE(error) << "Unexpected state - borrowing a string requires an in-situ reader";
+                    return false;
+                }
+
+                return read_transient(reader, value);
+            }
+
+            // Note: unless the reader is in-situ the view is only valid until the next token is read
+            static bool read_transient(JsonReader& reader, std::string_view& value) {
+                auto const& next = reader.nextToken();
+                if (!next.has_value())
+                    return false;
+
+                auto const& token = next.value();
+                if (!std::holds_alternative<StringType>(token)) {
+                    CHARGELAB_LOG_MESSAGE(warning) << "Unexpected type - expecting string type for field" << token_to_string(token);
+                    return false;
+                }
+
+                auto const& container = std::get<StringType>(token);
+                value = std::string_view {container.str, container.length};
+                return true;
+            }
+        };
+
         template <typename T, typename U=void>
         struct WritePrimitive;
 
@@ -564,6 +865,13 @@ namespace chargelab {
             }
         };
 
+        template <>
+        struct WritePrimitive <std::string_view, void> {
+            static void write_json(JsonWriter& writer, std::string_view const& value) {
+                writer.String(value.data(), value.size());
+            }
+        };
+
         template <typename T, typename U=bool>
         struct ReadValue {
             static bool read_json(JsonReader& reader, T& value) {
@@ -1074,7 +1382,7 @@ namespace chargelab {
             }
         };
 
-        bool skip_field(JsonReader& reader) {
+        inline bool skip_field(JsonReader& reader) {
             int object_stack = 0;
             int array_stack = 0;
             do {
@@ -1097,7 +1405,7 @@ namespace chargelab {
             return true;
         }
 
-        bool names_match_ci_ignore_ws(char const* lhs, std::size_t lhs_len, char const* rhs, std::size_t rhs_len) {
+        inline bool names_match_ci_ignore_ws(char const* lhs, std::size_t lhs_len, char const* rhs, std::size_t rhs_len) {
             std::size_t index_lhs = 0;
             std::size_t index_rhs = 0;
 
@@ -1130,13 +1438,132 @@ namespace chargelab {
             return true;
         }
 
-        bool is_field(KeyType const& key, char const* name) {
+        inline bool is_field(KeyType const& key, char const* name) {
             return names_match_ci_ignore_ws(key.str, key.length, name, std::strlen(name));
         }
 
-        bool is_enum(char const* key, std::size_t key_len, char const* entry) {
+        inline bool is_enum(char const* key, std::size_t key_len, char const* entry) {
             return names_match_ci_ignore_ws(key, key_len, entry, std::strlen(entry));
         }
+
+        namespace detail {
+            constexpr bool is_space_ascii(char ch) {
+                return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\v' || ch == '\f' || ch == '\r';
+            }
+
+            constexpr char to_lower_ascii(char ch) {
+                return (ch >= 'A' && ch <= 'Z') ? (char)(ch - 'A' + 'a') : ch;
+            }
+
+            // FNV-1a over the characters compared by names_match_ci_ignore_ws, so names that match hash the same
+            constexpr std::uint32_t hash_name_ci_ignore_ws(char const* name, std::size_t length) {
+                std::uint32_t hash = 2166136261u;
+                for (std::size_t i=0; i < length; i++) {
+                    if (is_space_ascii(name[i]))
+                        continue;
+
+                    hash = (hash ^ (std::uint8_t)to_lower_ascii(name[i])) * 16777619u;
+                }
+
+                return hash;
+            }
+
+            constexpr std::size_t constexpr_strlen(char const* str) {
+                std::size_t result = 0;
+                while (str[result] != '\0')
+                    result++;
+
+                return result;
+            }
+
+            constexpr bool constexpr_streq(char const* lhs, char const* rhs) {
+                std::size_t i = 0;
+                for (; lhs[i] != '\0' && rhs[i] != '\0'; i++) {
+                    if (lhs[i] != rhs[i])
+                        return false;
+                }
+
+                return lhs[i] == rhs[i];
+            }
+        }
+
+        /**
+         * Compile-time hash table over the field names of an intrusive type (or the entries of an enum), used to
+         * resolve a key to the index of the matching name without comparing it against every name in turn. Matching
+         * is the same as is_field() and is_enum(); candidates found through the hash are confirmed with
+         * names_match_ci_ignore_ws.
+         */
+        template <std::size_t N>
+        class NameIndex {
+        private:
+            static constexpr std::size_t kSlots = [] {
+                std::size_t result = 1;
+                while (result < 2*N)
+                    result *= 2;
+
+                return result;
+            }();
+
+        public:
+            static constexpr int kNotFound = -1;
+
+            constexpr explicit NameIndex(std::array<char const*, N> const& names)
+                : names_ {names}
+            {
+                for (std::size_t i=0; i < N; i++) {
+                    lengths_[i] = detail::constexpr_strlen(names_[i]);
+                    hashes_[i] = detail::hash_name_ci_ignore_ws(names_[i], lengths_[i]);
+
+                    // Note: inserting in field order so that the first of any fields with matching names is found first
+                    auto slot = hashes_[i] & (kSlots - 1);
+                    while (slots_[slot] != 0)
+                        slot = (slot + 1) & (kSlots - 1);
+
+                    slots_[slot] = (std::uint8_t)(i + 1);
+                }
+            }
+
+            [[nodiscard]] constexpr int indexOf(char const* name) const {
+                for (std::size_t i=0; i < N; i++) {
+                    if (detail::constexpr_streq(names_[i], name))
+                        return (int)i;
+                }
+
+                return kNotFound;
+            }
+
+            [[nodiscard]] int find(char const* str, std::size_t length) const {
+                auto const hash = detail::hash_name_ci_ignore_ws(str, length);
+                for (auto slot = hash & (kSlots - 1); slots_[slot] != 0; slot = (slot + 1) & (kSlots - 1)) {
+                    auto const index = slots_[slot] - 1;
+                    if (hashes_[index] == hash && names_match_ci_ignore_ws(str, length, names_[index], lengths_[index]))
+                        return index;
+                }
+
+                return kNotFound;
+            }
+
+            [[nodiscard]] int find(KeyType const& key) const {
+                return find(key.str, key.length);
+            }
+
+        private:
+            static_assert(N < std::numeric_limits<std::uint8_t>::max(), "Too many fields");
+
+            std::array<char const*, N> names_ {};
+            std::array<std::size_t, N> lengths_ {};
+            std::array<std::uint32_t, N> hashes_ {};
+            std::array<std::uint8_t, kSlots> slots_ {};
+        };
+
+        template <typename T, std::size_t N>
+        constexpr NameIndex<N> make_name_index(std::pair<T, char const*> const (&entries)[N]) {
+            std::array<char const*, N> names {};
+            for (std::size_t i=0; i < N; i++)
+                names[i] = entries[i].second;
+
+            return NameIndex<N> {names};
+        }
     }
 
     template <typename T>
@@ -1303,13 +1730,15 @@ namespace chargelab {
                     std::void_t<decltype(write_json_to_string(std::declval<T const&>()))>
                 >::type
         > {
-            static void write(std::string& accumulator, T const& value) {
-                accumulator += write_json_to_string(value);
+            static void write(LogRecordWriter& writer, T const& value) {
+                writer.writeText(write_json_to_string(value));
             }
         };
     };
 }
 
+#include "openocpp/helpers/binary.h"
+
 #define CHARGELAB_SET_REQUIRED(FIELD)                                                           \
     {                                                                                           \
         using type = typename std::decay<decltype(value.FIELD)>::type;                          \
@@ -1317,15 +1746,15 @@ namespace chargelab {
         index++;                                                                                \
     }
 
+#define CHARGELAB_FIELD_NAME(FIELD) #FIELD,
 #define CHARGELAB_READ_FIELD(FIELD)                                                             \
-    if (::chargelab::json::is_field(key, #FIELD)) {                                             \
+    case kFieldIndex.indexOf(#FIELD): {                                                         \
         using type = typename std::decay<decltype(value.FIELD)>::type;                          \
         if (!::chargelab::json::ReadValue<type>::read_json(reader, value.FIELD))                \
             return false;                                                                       \
-        missing[index] = false;                                                                 \
+        missing[kFieldIndex.indexOf(#FIELD)] = false;                                           \
         continue;                                                                               \
-    }                                                                                           \
-    index++;
+    }
 
 #define CHARGELAB_WRITE_FIELD(FIELD)                                                            \
     {                                                                                           \
@@ -1336,12 +1765,43 @@ namespace chargelab {
         }                                                                                       \
     }
 
+#define CHARGELAB_BINARY_PRESENCE(FIELD)                                                        \
+    {                                                                                           \
+        using type = typename std::decay<decltype(value.FIELD)>::type;                          \
+        if (::chargelab::binary::Field<type>::kOptional) {                                      \
+            if (::chargelab::binary::Field<type>::present(value.FIELD))                         \
+                presence |= bit;                                                                \
+            bit <<= 1;                                                                          \
+        }                                                                                       \
+    }
+
+#define CHARGELAB_READ_BINARY_FIELD(FIELD)                                                      \
+    {                                                                                           \
+        using type = typename std::decay<decltype(value.FIELD)>::type;                          \
+        bool present = true;                                                                    \
+        if (::chargelab::binary::Field<type>::kOptional) {                                      \
+            present = (presence & bit) != 0;                                                    \
+            bit <<= 1;                                                                          \
+        }                                                                                       \
+        if (!::chargelab::binary::Field<type>::read_binary(reader, value.FIELD, present))       \
+            return false;                                                                       \
+    }
+
+#define CHARGELAB_WRITE_BINARY_FIELD(FIELD)                                                     \
+    {                                                                                           \
+        using type = typename std::decay<decltype(value.FIELD)>::type;                          \
+        ::chargelab::binary::Field<type>::write_binary(writer, value.FIELD);                    \
+    }
+
 #define CHARGELAB_OPERATOR_EQUAL(FIELD) if((FIELD) != rhs.FIELD) return false;
 #define CHARGELAB_JSON_INTRUSIVE(TYPE, ...)                                                     \
     static bool read_json(::chargelab::json::JsonReader& reader, TYPE& value) {                 \
         if (!::chargelab::json::expect_type<::chargelab::json::StartObjectType>(reader))        \
             return false;                                                                       \
                                                                                                 \
+        static constexpr ::chargelab::json::NameIndex<CHARGELAB_NUM_ARGS(__VA_ARGS__)> kFieldIndex  \
+            {{CHARGELAB_PASTE(CHARGELAB_FIELD_NAME, __VA_ARGS__)}};                             \
+                                                                                                \
         std::array<bool,CHARGELAB_NUM_ARGS(__VA_ARGS__)> missing{};                             \
         int index = 0;                                                                          \
         CHARGELAB_PASTE(CHARGELAB_SET_REQUIRED, __VA_ARGS__)                                    \
@@ -1358,8 +1818,12 @@ namespace chargelab {
                 return false;                                                                   \
                                                                                                 \
             auto const& key = std::get<::chargelab::json::KeyType>(token);                      \
-            index = 0;                                                                          \
-            CHARGELAB_PASTE(CHARGELAB_READ_FIELD, __VA_ARGS__)                                  \
+            switch (kFieldIndex.find(key)) {                                                    \
+                CHARGELAB_PASTE(CHARGELAB_READ_FIELD, __VA_ARGS__)                              \
+                default:                                                                        \
+                    break;                                                                      \
+            }                                                                                   \
+                                                                                                \
             if (!::chargelab::json::skip_field(reader))                                         \
                 return false;                                                                   \
         }                                                                                       \
@@ -1374,6 +1838,24 @@ namespace chargelab {
         CHARGELAB_PASTE(CHARGELAB_WRITE_FIELD, __VA_ARGS__)                                     \
         writer.EndObject();                                                                     \
     }                                                                                           \
+    /* Note: presence of the optional fields is packed into one bitmap ahead of the values */  \
+    static bool read_binary(::chargelab::binary::Reader& reader, TYPE& value) {                 \
+        static_assert(CHARGELAB_NUM_ARGS(__VA_ARGS__) <= 64);                                   \
+        std::uint64_t presence;                                                                 \
+        if (!reader.readVarint(presence))                                                       \
+            return false;                                                                       \
+                                                                                                \
+        std::uint64_t bit = 1;                                                                  \
+        CHARGELAB_PASTE(CHARGELAB_READ_BINARY_FIELD, __VA_ARGS__)                               \
+        return true;                                                                            \
+    }                                                                                           \
+    static void write_binary(::chargelab::binary::Writer& writer, TYPE const& value) {          \
+        std::uint64_t presence = 0;                                                             \
+        std::uint64_t bit = 1;                                                                  \
+        CHARGELAB_PASTE(CHARGELAB_BINARY_PRESENCE, __VA_ARGS__)                                 \
+        writer.writeVarint(presence);                                                           \
+        CHARGELAB_PASTE(CHARGELAB_WRITE_BINARY_FIELD, __VA_ARGS__)                              \
+    }                                                                                           \
     bool operator==(TYPE const& rhs) const {                                                    \
         CHARGELAB_PASTE(CHARGELAB_OPERATOR_EQUAL, __VA_ARGS__)                                  \
         return true;                                                                            \
@@ -1407,6 +1889,11 @@ namespace chargelab {
         writer.StartObject();                                                                   \
         writer.EndObject();                                                                     \
     }                                                                                           \
+    static bool read_binary(::chargelab::binary::Reader&, TYPE&) {                              \
+        return true;                                                                            \
+    }                                                                                           \
+    static void write_binary(::chargelab::binary::Writer&, TYPE const&) {                       \
+    }                                                                                           \
     bool operator==(TYPE const& rhs) const {                                                    \
         return true;                                                                            \
     }                                                                                           \
@@ -1415,13 +1902,20 @@ namespace chargelab {
     }
 
 #define CHARGELAB_ENUM_DEFINE(KEY) ,k ## KEY
-#define CHARGELAB_ENUM_TO_STRING(KEY) case k ## KEY: return #KEY;
-#define CHARGELAB_ENUM_FROM_STRING(KEY) if (::chargelab::json::is_enum(str, len, #KEY)) return k ## KEY;
+#define CHARGELAB_ENUM_NAME(KEY) #KEY,
 #define CHARGELAB_JSON_ENUM(TYPE, ...)                                                          \
     class TYPE {                                                                                \
     public:                                                                                     \
         enum Value {kValueNotFoundInEnum CHARGELAB_PASTE(CHARGELAB_ENUM_DEFINE, __VA_ARGS__)};  \
                                                                                                 \
+    private:                                                                                    \
+        /* Note: indexed by Value, which is sequential starting from kValueNotFoundInEnum */     \
+        static constexpr std::array<std::string_view, CHARGELAB_NUM_ARGS(__VA_ARGS__) + 1> kNames \
+            {{"ValueNotFoundInEnum", CHARGELAB_PASTE(CHARGELAB_ENUM_NAME, __VA_ARGS__)}};       \
+        static constexpr ::chargelab::json::NameIndex<CHARGELAB_NUM_ARGS(__VA_ARGS__)> kNameIndex \
+            {{CHARGELAB_PASTE(CHARGELAB_ENUM_NAME, __VA_ARGS__)}};                              \
+                                                                                                \
+    public:                                                                                     \
         TYPE() = default;                                                                       \
         constexpr TYPE(Value value) : value_(value) {}                                          \
         constexpr operator Value() const {return value_;}                                       \
@@ -1446,19 +1940,32 @@ namespace chargelab {
         }                                                                                       \
         static void write_json(::chargelab::json::JsonWriter& writer, TYPE const& value) {      \
             writer.String(value.to_string());                                                   \
+        }                                                                                       \
+        static bool read_binary(::chargelab::binary::Reader& reader, TYPE& value) {             \
+            std::uint64_t index;                                                                \
+            if (!reader.readVarint(index) || index == kValueNotFoundInEnum || index >= kNames.size()) \
+                return false;                                                                   \
+                                                                                                \
+            value = (Value)index;                                                               \
+            return true;                                                                        \
+        }                                                                                       \
+        static void write_binary(::chargelab::binary::Writer& writer, TYPE const& value) {      \
+            writer.writeVarint((std::uint64_t)value.value_);                                    \
         }                                                                                       \
                                                                                                 \
-        std::string to_string() const {                                                         \
-            switch (value_) {                                                                   \
-                CHARGELAB_PASTE(CHARGELAB_ENUM_TO_STRING, __VA_ARGS__)                          \
+        constexpr std::string_view to_string() const {                                          \
+            auto const index = (std::size_t)value_;                                             \
+            if (index >= kNames.size())                                                         \
+                return kNames[kValueNotFoundInEnum];                                            \
                                                                                                 \
-                default:                                                                        \
-                case kValueNotFoundInEnum: return "ValueNotFoundInEnum";                        \
-            }                                                                                   \
+            return kNames[index];                                                               \
         }                                                                                       \
         static TYPE from_string(char const* str, std::size_t len) {                             \
-            CHARGELAB_PASTE(CHARGELAB_ENUM_FROM_STRING, __VA_ARGS__)                            \
-            return kValueNotFoundInEnum;                                                        \
+            auto const index = kNameIndex.find(str, len);                                       \
+            if (index == ::chargelab::json::NameIndex<0>::kNotFound)                            \
+                return kValueNotFoundInEnum;                                                    \
+                                                                                                \
+            return (Value)(index + 1);                                                          \
         }                                                                                       \
         static TYPE from_string(std::string_view const& str) {                                  \
             return from_string(str.data(), str.size());                                         \
@@ -1469,6 +1976,10 @@ namespace chargelab {
     };
 
 #define CHARGELAB_JSON_ENUM_CUSTOM(TYPE, ...)                                                   \
+    private:                                                                                    \
+        static constexpr std::pair<Value, char const*> kEntries[] = __VA_ARGS__;                \
+        static constexpr auto kNameIndex = ::chargelab::json::make_name_index(kEntries);        \
+                                                                                                \
     public:                                                                                     \
         TYPE() = default;                                                                       \
         constexpr TYPE(Value value) : value_(value) {}                                          \
@@ -1491,39 +2002,38 @@ namespace chargelab {
         static void write_json(::chargelab::json::JsonWriter& writer, TYPE const& value) {      \
             writer.String(value.to_string());                                                   \
         }                                                                                       \
+        /* Note: unknown values are read as the first entry, as with read_json */               \
+        static bool read_binary(::chargelab::binary::Reader& reader, TYPE& value) {             \
+            std::int64_t raw;                                                                   \
+            if (!reader.readSignedVarint(raw))                                                  \
+                return false;                                                                   \
+                                                                                                \
+            value = kEntries[0].first;                                                          \
+            for (auto const& x : kEntries) {                                                    \
+                if ((std::int64_t)x.first == raw)                                               \
+                    value = x.first;                                                            \
+            }                                                                                   \
                                                                                                 \
-        std::string to_string() const {                                                         \
-            const std::pair<Value, char const*> m[] = __VA_ARGS__;                              \
-            auto const value = value_;                                                          \
-            auto it = std::find_if(                                                             \
-                std::begin(m),                                                                  \
-                std::end(m),                                                                    \
-                [value](auto const& x) -> bool                                                  \
-            {                                                                                   \
-                return x.first == value;                                                        \
-            });                                                                                 \
+            return true;                                                                        \
+        }                                                                                       \
+        static void write_binary(::chargelab::binary::Writer& writer, TYPE const& value) {      \
+            writer.writeSignedVarint((std::int64_t)value.value_);                               \
+        }                                                                                       \
                                                                                                 \
-            if (it != std::end(m)) {                                                            \
-                return it->second;                                                              \
-            } else {                                                                            \
-                return m[0].second;                                                             \
+        constexpr std::string_view to_string() const {                                          \
+            for (auto const& x : kEntries) {                                                    \
+                if (x.first == value_)                                                          \
+                    return x.second;                                                            \
             }                                                                                   \
+                                                                                                \
+            return kEntries[0].second;                                                          \
         }                                                                                       \
         static TYPE from_string(char const* str, std::size_t len) {                             \
-            const std::pair<Value, char const*> m[] = __VA_ARGS__;                              \
-            auto it = std::find_if(                                                             \
-                std::begin(m),                                                                  \
-                std::end(m),                                                                    \
-                [str, len](auto const& x) -> bool                                               \
-            {                                                                                   \
-                return ::chargelab::json::is_enum(str, len, x.second);                          \
-            });                                                                                 \
+            auto const index = kNameIndex.find(str, len);                                       \
+            if (index == ::chargelab::json::NameIndex<0>::kNotFound)                            \
+                return kEntries[0].first;                                                       \
                                                                                                 \
-            if (it != std::end(m)) {                                                            \
-                return it->first;                                                               \
-            } else {                                                                            \
-                return m[0].first;                                                              \
-            }                                                                                   \
+            return kEntries[index].first;                                                       \
         }                                                                                       \
         static TYPE from_string(std::string_view const& str) {                                  \
             return from_string(str.data(), str.size());                                         \
@@ -1548,6 +2058,14 @@ namespace chargelab {
         using type = typename std::decay<decltype(value.FIELD)>::type;                          \
         ::chargelab::json::WritePrimitive<type>::write_json(writer, value.FIELD);               \
     }                                                                                           \
+    static bool read_binary(::chargelab::binary::Reader& reader, TYPE& value) {                 \
+        using type = typename std::decay<decltype(value.FIELD)>::type;                          \
+        return ::chargelab::binary::ReadValue<type>::read_binary(reader, value.FIELD);          \
+    }                                                                                           \
+    static void write_binary(::chargelab::binary::Writer& writer, TYPE const& value) {          \
+        using type = typename std::decay<decltype(value.FIELD)>::type;                          \
+        ::chargelab::binary::WriteValue<type>::write_binary(writer, value.FIELD);               \
+    }                                                                                           \
     bool operator==(TYPE const& rhs) const {                                                    \
         return true;                                                                            \
     }                                                                                           \
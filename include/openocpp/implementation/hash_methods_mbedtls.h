@@ -38,7 +38,9 @@ namespace chargelab {
             }
 
             std::optional<std::vector<uint8_t>> finishBinary() {
-                auto md_info = mbedtls_md_info_from_ctx(&context_);
+                // Note: keeping md_info rather than using mbedtls_md_info_from_ctx, which requires MbedTLS 3.2+ and
+                // isn't available in the 2.28 LTS releases shipped by most Linux distributions
+                auto md_info = md_info_;
                 if (md_info == nullptr) {
                     CHARGELAB_LOG_MESSAGE(error) << "Unexpected state - missing md_info in context";
                     return std::nullopt;
@@ -75,6 +77,7 @@ namespace chargelab {
 
         private:
             mbedtls_md_context_t context_;
+            mbedtls_md_info_t const* md_info_ = nullptr;
         };
     }
 
@@ -102,6 +105,7 @@ namespace chargelab {
                 CHARGELAB_LOG_MESSAGE(error) << "Failed setting up context - error code: " << err;
                 return nullptr;
             }
+            result->md_info_ = md_info;
 
             err = mbedtls_md_starts(&result->context_);
             if (err != 0) {
@@ -84,6 +84,19 @@ namespace chargelab::logging {
         }
     }
 
+    // Note: messages are formatted and printed on the calling task; only the capture at the call site is shared with
+    // the Linux backend
+    void SubmitLogRecord(LogMetadata const& metadata, std::string_view const& arguments) {
+        std::string text;
+        if (!FormatLogRecord(text, arguments))
+            text += "<malformed log record>";
+
+        PrintLogMessage(metadata, text);
+    }
+
+    void FlushLogMessages() {
+    }
+
     void RegisterLoggingListener(std::shared_ptr<LoggingListenerFunction> const& callback) {
         std::lock_guard lock {gMutex};
         for (auto const& x : gListeners) {
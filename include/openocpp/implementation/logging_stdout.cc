@@ -1,20 +1,32 @@
 #include "openocpp/common/logging.h"
+#include "openocpp/common/record_ring.h"
 #include "openocpp/helpers/chrono.h"
 #include "openocpp/helpers/optional.h"
 
 #include <iostream>
 #include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <cstdlib>
 #include <mutex>
+#include <sstream>
 
 namespace chargelab::logging {
     namespace {
+        // Note: 256 KiB; a debug message with a typical OCPP frame takes 4-8 slots
+        constexpr std::size_t kRecordRingSlots = 4096;
+        constexpr int kConsumerIdleMillis = 20;
+
         std::atomic<LogLevel> gLogLevel {LogLevel::trace};
 
         std::atomic<int> gRecursiveCounter {};
         std::recursive_mutex gMutex {};
         std::vector<std::shared_ptr<LoggingListenerFunction>> gListeners {};
 
+        // Note: set while the listeners are called; messages logged by a listener are printed but not passed back to
+        // the listeners
+        thread_local bool gDelivering = false;
+
         class RaiiCounter {
         public:
             explicit RaiiCounter(std::atomic<int>& counter) : counter_{counter} {
@@ -28,6 +40,13 @@ namespace chargelab::logging {
         private:
             std::atomic<int>& counter_;
         };
+
+        struct RecordHeader {
+            LogMetadata metadata;
+            std::int64_t timestamp;
+            std::thread::id thread;
+        };
+        static_assert(std::is_trivially_copyable<RecordHeader>::value);
     }
 
     std::string_view ToString(LogLevel const& level) {
@@ -52,16 +71,20 @@ namespace chargelab::logging {
         return static_cast<int>(level) >= static_cast<int>(limit);
     }
 
-    std::ostream& LogPrefix(LogMetadata const& metadata) {
+    std::int64_t CurrentTimestamp() {
         auto const now = std::chrono::system_clock::now();
-        auto const millis = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count();
-        auto const ts = chrono::ToString(static_cast<chargelab::SystemTimeMillis>(millis));
+        return std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count();
+    }
 
-        std::ios_base::fmtflags original_flags(std::cout.flags());
+    std::ostream& LogPrefix(LogMetadata const& metadata, std::int64_t timestamp, std::thread::id thread) {
+        auto const ts = chrono::ToString(static_cast<chargelab::SystemTimeMillis>(timestamp));
 
+        // Note: formatted separately rather than switching std::cout to hex, which races with other threads printing
+        std::ostringstream thread_id;
+        thread_id << std::hex << thread;
 
         std::cout << "[" << optional::GetOrDefault<std::string>(ts, "<bad timestamp>")
-                         << "] [" << std::hex << std::this_thread::get_id()
+                         << "] [" << thread_id.str()
                          << "] [" << ToString(metadata.level)
 #if defined(LOG_WITH_FILE_AND_LINE)
                          << "] [" << metadata.file << ":" << metadata.line << "(" << metadata.function << ")] ";
@@ -69,13 +92,14 @@ namespace chargelab::logging {
                          << "] [" << "(" << metadata.function << ")] ";
 #endif
 
-        std::cout.flags(original_flags);
         return std::cout;
     }
 
-    void PrintLogMessage(LogMetadata const& metadata, std::string const& message) {
-        LogPrefix(metadata) << message << std::endl;
+    std::ostream& LogPrefix(LogMetadata const& metadata) {
+        return LogPrefix(metadata, CurrentTimestamp(), std::this_thread::get_id());
+    }
 
+    void NotifyListeners(LogMetadata const& metadata, std::string_view const& message) {
         std::lock_guard lock {gMutex};
         RaiiCounter counter {gRecursiveCounter};
         if (gRecursiveCounter > 2) {
@@ -84,33 +108,170 @@ namespace chargelab::logging {
         }
 
         if (!gListeners.empty()) {
+            gDelivering = true;
             for (auto const& x : gListeners) {
                 if (x != nullptr) {
                     (*x)(metadata, message);
                 }
             }
+            gDelivering = false;
         }
     }
 
+    void PrintLogMessage(LogMetadata const& metadata, std::string const& message) {
+        LogPrefix(metadata) << message << std::endl;
+        NotifyListeners(metadata, message);
+    }
+
     void PrintLogMessage(LogMetadata const& metadata, std::string_view const& message) {
         LogPrefix(metadata) << message << std::endl;
+        NotifyListeners(metadata, message);
+    }
 
-        std::lock_guard lock {gMutex};
-        RaiiCounter counter {gRecursiveCounter};
-        if (gRecursiveCounter > 2) {
-            LogPrefix(metadata) << "Recursive PrintLogMessage call - suppressing messages" << std::endl;
-            return;
-        }
+    void PrintLogRecord(RecordHeader const& header, std::string_view const& arguments, std::string& text, bool notify) {
+        text.clear();
+        if (!FormatLogRecord(text, arguments))
+            text += "<malformed log record>";
 
-        if (!gListeners.empty()) {
-            for (auto const& x : gListeners) {
-                if (x != nullptr) {
-                    (*x)(metadata, message);
+        LogPrefix(header.metadata, header.timestamp, header.thread) << text << "\n";
+        if (notify)
+            NotifyListeners(header.metadata, text);
+    }
+
+    namespace {
+        /**
+         * Messages are written to a lock-free ring by the logging threads, and formatted, printed and passed to the
+         * listeners by a consumer thread. When the ring is full the message is dropped and counted, rather than
+         * blocking the caller.
+         */
+        class LogBackend {
+        public:
+            LogBackend() : consumer_ {[this]() {run();}}
+            {
+            }
+
+            /**
+             * Returns false if the consumer has stopped, in which case the caller prints the message itself.
+             */
+            bool submit(RecordHeader const& header, std::string_view const& arguments) {
+                if (stopping_.load(std::memory_order_relaxed))
+                    return false;
+
+                std::string_view const raw_header {(char const*)&header, sizeof(header)};
+                if (!ring_.tryPush(raw_header, arguments)) {
+                    dropped_.fetch_add(1, std::memory_order_relaxed);
+                    return true;
                 }
+
+                // Note: pairs with the fence in run(), so either the consumer sees the record or the flag is seen here
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (sleeping_.load(std::memory_order_relaxed))
+                    wakeup_.notify_one();
+
+                return true;
+            }
+
+            void flush() {
+                auto const target = ring_.writePosition();
+                std::unique_lock lock {mutex_};
+                while ((std::intptr_t)(delivered_ - target) < 0 && !stopped_) {
+                    wakeup_.notify_one();
+                    drained_.wait_for(lock, std::chrono::milliseconds(kConsumerIdleMillis));
+                }
+            }
+
+            void stop() {
+                {
+                    std::lock_guard lock {mutex_};
+                    stopping_ = true;
+                }
+
+                wakeup_.notify_one();
+                if (consumer_.joinable())
+                    consumer_.join();
             }
+
+        private:
+            void run() {
+                std::string text;
+                while (true) {
+                    while (ring_.tryPop([&](std::string_view const& record) {
+                        RecordHeader header;
+                        std::memcpy(&header, record.data(), sizeof(header));
+                        PrintLogRecord(header, record.substr(sizeof(header)), text, true);
+                    })) {}
+
+                    if (ring_.readable()) {
+                        // Note: a producer is still writing the record at the front
+                        std::this_thread::yield();
+                        continue;
+                    }
+
+                    auto const dropped = dropped_.exchange(0, std::memory_order_relaxed);
+                    if (dropped > 0)
+                        CHARGELAB_LOG_MESSAGE(warning) << "Log buffer full - dropped " << dropped << " messages";
+
+                    std::cout.flush();
+
+                    std::unique_lock lock {mutex_};
+                    delivered_ = ring_.readPosition();
+                    drained_.notify_all();
+                    if (stopping_ && !ring_.readable()) {
+                        stopped_ = true;
+                        break;
+                    }
+
+                    sleeping_.store(true, std::memory_order_relaxed);
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                    if (!ring_.readable() && !stopping_)
+                        wakeup_.wait_for(lock, std::chrono::milliseconds(kConsumerIdleMillis));
+                    sleeping_.store(false, std::memory_order_relaxed);
+                }
+            }
+
+        private:
+            RecordRing<kRecordRingSlots> ring_;
+            std::atomic<bool> stopping_ {false};
+            std::atomic<bool> sleeping_ {false};
+            std::atomic<std::size_t> dropped_ {0};
+
+            std::mutex mutex_;
+            std::condition_variable wakeup_;
+            std::condition_variable drained_;
+            std::size_t delivered_ = 0;
+            bool stopped_ = false;
+
+            std::thread consumer_;
+        };
+
+        // Note: never destroyed, so that messages logged during static destruction still have somewhere to go; the
+        // consumer is stopped (after printing what's queued) when the process exits
+        LogBackend& GetLogBackend() {
+            static LogBackend* backend = []() {
+                auto result = new LogBackend();
+                std::atexit([]() {GetLogBackend().stop();});
+                return result;
+            }();
+
+            return *backend;
         }
     }
 
+    void SubmitLogRecord(LogMetadata const& metadata, std::string_view const& arguments) {
+        RecordHeader const header {metadata, CurrentTimestamp(), std::this_thread::get_id()};
+        if (!gDelivering && GetLogBackend().submit(header, arguments))
+            return;
+
+        std::string text;
+        PrintLogRecord(header, arguments, text, !gDelivering);
+        std::cout.flush();
+    }
+
+    void FlushLogMessages() {
+        if (!gDelivering)
+            GetLogBackend().flush();
+    }
+
     void RegisterLoggingListener(std::shared_ptr<LoggingListenerFunction> const& callback) {
         std::lock_guard lock {gMutex};
         for (auto const& x : gListeners) {
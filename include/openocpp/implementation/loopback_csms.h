@@ -0,0 +1,319 @@
+#ifndef CHARGELAB_OPEN_FIRMWARE_LOOPBACK_CSMS_H
+#define CHARGELAB_OPEN_FIRMWARE_LOOPBACK_CSMS_H
+
+#include "openocpp/interface/element/websocket_interface.h"
+#include "openocpp/interface/component/system_interface.h"
+#include "openocpp/protocol/common/raw_json.h"
+#include "openocpp/helpers/chrono.h"
+#include "openocpp/helpers/string.h"
+#include "openocpp/common/logging.h"
+#include "openocpp/common/stream.h"
+
+#include <map>
+#include <deque>
+#include <string>
+#include <memory>
+#include <optional>
+#include <functional>
+
+namespace chargelab {
+    /**
+     * In-process stand-in for a central system, connected to the charger through the WebsocketInterface returned by
+     * connection(). CALLs from the charger are answered by per-action handlers, with defaults that accept everything;
+     * responses are delivered after a configurable latency measured on the charger's steady clock. The central system
+     * can also send its own CALLs with sendCall().
+     *
+     * Note: not thread safe; script the central system from the thread running the charger.
+     */
+    class LoopbackCsms {
+    public:
+        /**
+         * Returns the JSON payload of the CallResult, or std::nullopt to drop the CALL without responding.
+         */
+        using call_handler = std::function<std::optional<std::string>(common::RawJson const& payload)>;
+
+        /**
+         * Receives the JSON payload of the CallResult, or std::nullopt if the charger responded with a CallError.
+         */
+        using result_handler = std::function<void(std::optional<std::string> const& payload)>;
+
+    private:
+        class Connection : public WebsocketInterface {
+        public:
+            explicit Connection(LoopbackCsms& csms) : csms_(csms)
+            {
+            }
+
+            bool isConnected() override {
+                return csms_.connected_;
+            }
+
+            std::optional<std::string> getSubprotocol() override {
+                return csms_.subprotocol_;
+            }
+
+            std::size_t pendingMessages() override {
+                auto const now = csms_.system_->steadyClockNow();
+                std::size_t result = 0;
+                for (auto const& x : csms_.inbound_) {
+                    if (x.first - now > 0)
+                        break;
+
+                    result++;
+                }
+
+                return result;
+            }
+
+            std::optional<std::string> pollMessages() override {
+                if (csms_.inbound_.empty() || csms_.inbound_.front().first - csms_.system_->steadyClockNow() > 0)
+                    return std::nullopt;
+
+                auto result = std::move(csms_.inbound_.front().second);
+                csms_.inbound_.pop_front();
+                return result;
+            }
+
+            void sendCustom(std::function<void(ByteWriterInterface&)> payload) override {
+                stream::StringWriter writer;
+                payload(writer);
+                csms_.onChargerMessage(writer.str());
+            }
+
+        private:
+            LoopbackCsms& csms_;
+        };
+
+    public:
+        LoopbackCsms(std::shared_ptr<SystemInterface> system, std::string subprotocol)
+                : system_(std::move(system)),
+                  subprotocol_(std::move(subprotocol)),
+                  connection_(std::make_shared<Connection>(*this))
+        {
+        }
+
+        LoopbackCsms(LoopbackCsms const&) = delete;
+        LoopbackCsms& operator=(LoopbackCsms const&) = delete;
+
+        [[nodiscard]] std::shared_ptr<WebsocketInterface> connection() const {
+            return connection_;
+        }
+
+        void setLatency(int latency_millis) {
+            latency_millis_ = latency_millis;
+        }
+
+        /**
+         * Simulates losing or regaining the connection. Messages in flight in either direction are lost when the
+         * connection drops.
+         */
+        void setConnected(bool connected) {
+            if (connected_ && !connected)
+                inbound_.clear();
+
+            connected_ = connected;
+        }
+
+        /**
+         * Replaces the handler for CALLs with the provided action.
+         */
+        void onCall(std::string const& action, call_handler handler) {
+            handlers_[action] = std::move(handler);
+        }
+
+        /**
+         * Sends a CALL to the charger.
+         * @return the unique ID of the CALL
+         */
+        std::string sendCall(std::string const& action, std::string const& payload, result_handler on_result = {}) {
+            auto unique_id = "csms-" + std::to_string(next_unique_id_++);
+            stream::StringWriter stream;
+            json::JsonWriter writer {stream};
+            writer.StartArray();
+            writer.Int(2);
+            writer.String(unique_id);
+            writer.String(action);
+            writer.RawValue(payload);
+            writer.EndArray();
+
+            if (on_result)
+                pending_results_[unique_id] = std::move(on_result);
+
+            deliver(stream.str());
+            return unique_id;
+        }
+
+        /**
+         * @return the time at which the next message becomes available to the charger, if any
+         */
+        [[nodiscard]] std::optional<SteadyPointMillis> nextDelivery() const {
+            if (inbound_.empty())
+                return std::nullopt;
+
+            return inbound_.front().first;
+        }
+
+        [[nodiscard]] std::map<std::string, std::size_t> const& receivedCalls() const {
+            return received_calls_;
+        }
+
+        [[nodiscard]] std::size_t receivedBytes() const {
+            return received_bytes_;
+        }
+
+        [[nodiscard]] std::size_t sentBytes() const {
+            return sent_bytes_;
+        }
+
+    private:
+        void onChargerMessage(std::string const& message) {
+            if (!connected_) {
+                CHARGELAB_LOG_MESSAGE(debug) << "Dropping message sent while disconnected: " << message;
+                return;
+            }
+
+            received_bytes_ += message.size();
+            stream::StringReader stream {message};
+            json::JsonReader reader {stream};
+
+            int message_type;
+            std::string unique_id;
+            if (!json::expect_type<json::StartArrayType>(reader) ||
+                !json::ReadValue<int>::read_json(reader, message_type) ||
+                !json::ReadValue<std::string>::read_json(reader, unique_id))
+            {
+                CHARGELAB_LOG_MESSAGE(warning) << "Loopback CSMS received a malformed message: " << message;
+                return;
+            }
+
+            switch (message_type) {
+                default:
+                    CHARGELAB_LOG_MESSAGE(warning) << "Loopback CSMS received an unexpected message type: " << message;
+                    break;
+
+                case 2: // CALL
+                    {
+                        std::string action;
+                        common::RawJson payload;
+                        if (!json::ReadValue<std::string>::read_json(reader, action) ||
+                            !json::ReadValue<common::RawJson>::read_json(reader, payload))
+                        {
+                            CHARGELAB_LOG_MESSAGE(warning) << "Loopback CSMS received a malformed CALL: " << message;
+                            return;
+                        }
+
+                        received_calls_[action]++;
+                        respondToCall(unique_id, action, payload);
+                    }
+                    break;
+
+                case 3: // CALLRESULT
+                case 4: // CALLERROR
+                    {
+                        auto it = pending_results_.find(unique_id);
+                        if (it == pending_results_.end())
+                            break;
+
+                        std::optional<std::string> result;
+                        common::RawJson payload;
+                        if (message_type == 3 && json::ReadValue<common::RawJson>::read_json(reader, payload))
+                            result = payload.data();
+
+                        auto handler = std::move(it->second);
+                        pending_results_.erase(it);
+                        handler(result);
+                    }
+                    break;
+            }
+        }
+
+        void respondToCall(std::string const& unique_id, std::string const& action, common::RawJson const& payload) {
+            std::optional<std::string> response;
+            auto it = handlers_.find(action);
+            if (it != handlers_.end()) {
+                response = it->second(payload);
+                if (!response.has_value())
+                    return;
+            } else {
+                response = defaultResponse(action);
+            }
+
+            stream::StringWriter stream;
+            json::JsonWriter writer {stream};
+            writer.StartArray();
+            if (response.has_value()) {
+                writer.Int(3);
+                writer.String(unique_id);
+                writer.RawValue(response.value());
+            } else {
+                writer.Int(4);
+                writer.String(unique_id);
+                writer.String("NotImplemented");
+                writer.String("No loopback handler for action: " + action);
+                writer.StartObject();
+                writer.EndObject();
+            }
+            writer.EndArray();
+
+            deliver(stream.str());
+        }
+
+        std::optional<std::string> defaultResponse(std::string const& action) {
+            auto const ocpp1_6 = string::EqualsIgnoreCaseAscii(subprotocol_, "ocpp1.6");
+            auto const current_time = "\"" + chrono::ToString(system_->systemClockNow()).value_or("") + "\"";
+
+            if (action == "BootNotification")
+                return R"({"currentTime":)" + current_time + R"(,"interval":300,"status":"Accepted"})";
+            if (action == "Heartbeat")
+                return R"({"currentTime":)" + current_time + "}";
+            if (action == "Authorize")
+                return ocpp1_6 ? R"({"idTagInfo":{"status":"Accepted"}})" : R"({"idTokenInfo":{"status":"Accepted"}})";
+            if (action == "StartTransaction")
+                return R"({"idTagInfo":{"status":"Accepted"},"transactionId":)" + std::to_string(next_transaction_id_++) + "}";
+            if (action == "StopTransaction")
+                return R"({"idTagInfo":{"status":"Accepted"}})";
+            if (action == "DataTransfer")
+                return R"({"status":"Accepted"})";
+
+            if (action == "StatusNotification" || action == "MeterValues" || action == "TransactionEvent" ||
+                action == "NotifyReport" || action == "NotifyEvent" || action == "SecurityEventNotification" ||
+                action == "FirmwareStatusNotification" || action == "DiagnosticsStatusNotification" ||
+                action == "LogStatusNotification" || action == "NotifyChargingLimit" ||
+                action == "ReportChargingProfiles" || action == "NotifyMonitoringReport")
+            {
+                return "{}";
+            }
+
+            return std::nullopt;
+        }
+
+        void deliver(std::string message) {
+            if (!connected_)
+                return;
+
+            sent_bytes_ += message.size();
+            auto const at = (SteadyPointMillis)(system_->steadyClockNow() + latency_millis_);
+            inbound_.emplace_back(at, std::move(message));
+        }
+
+    private:
+        std::shared_ptr<SystemInterface> system_;
+        std::string subprotocol_;
+        std::shared_ptr<Connection> connection_;
+
+        bool connected_ = true;
+        int latency_millis_ = 0;
+        std::deque<std::pair<SteadyPointMillis, std::string>> inbound_;
+
+        std::map<std::string, call_handler> handlers_;
+        std::map<std::string, result_handler> pending_results_;
+        int next_unique_id_ = 1;
+        int next_transaction_id_ = 1;
+
+        std::map<std::string, std::size_t> received_calls_;
+        std::size_t received_bytes_ = 0;
+        std::size_t sent_bytes_ = 0;
+    };
+}
+
+#endif //CHARGELAB_OPEN_FIRMWARE_LOOPBACK_CSMS_H
@@ -8,6 +8,8 @@
 #include "openocpp/interface/platform_interface.h"
 #include "openocpp/common/storage.h"
 #include "openocpp/common/ring_buffer.h"
+#include "openocpp/common/frame_queue.h"
+#include "openocpp/common/wakeup_signal.h"
 #include "openocpp/common/macro.h"
 #include "openocpp/common/serialization.h"
 #include "openocpp/helpers/set.h"
@@ -17,6 +19,8 @@
 #include <atomic>
 #include <optional>
 #include <functional>
+#include <string_view>
+#include <cctype>
 
 #include "esp_system.h"
 #include "esp_wifi.h"
@@ -500,6 +504,15 @@ namespace chargelab {
                 return true;
             }
 
+            bool eraseSector(std::size_t offset) override {
+                ESP_ERROR_CHECK(esp_partition_erase_range(partition_, offset, partition_->erase_size));
+                return true;
+            }
+
+            [[nodiscard]] std::size_t sectorSize() const override {
+                return partition_->erase_size;
+            }
+
             [[nodiscard]] virtual std::size_t size() const override {
                 auto result = partition_->size;
                 if ((result % partition_->erase_size) != 0) {
@@ -561,6 +574,20 @@ namespace chargelab {
                 }
             }
 
+            // Note: lets the JSON writer serialize straight into the frame buffer
+            ByteSpan reserve(std::size_t) override {
+                if (failed_)
+                    return {};
+                if (index_ >= buffer_.size() && !flush())
+                    return {};
+
+                return {buffer_.data() + index_, buffer_.size() - index_};
+            }
+
+            void commit(std::size_t count) override {
+                index_ += count;
+            }
+
         private:
             bool flush() {
                 if (failed_)
@@ -606,8 +633,8 @@ namespace chargelab {
 
         class WebsocketImpl : public WebsocketInterface {
         private:
-            static const int kMaxMessageBufferBytes = 4*1024;
-            static const int kMaxRingBufferSize = 4;
+            static const int kMaxRejectedCalls = 4;
+            static const int kCallPrefixBytes = 64;
             static const int kTimeoutCloseMillis = 1000;
             friend class ::chargelab::PlatformESP;
 
@@ -635,12 +662,18 @@ namespace chargelab {
                     std::string const& charge_point_id,
                     std::string const& ocpp_protocol,
                     std::string const& basic_auth_password,
-                    std::atomic<int>& failed_connection_attempts
+                    std::atomic<int>& failed_connection_attempts,
+                    WakeupSignal& wakeup_signal
             )
                 : settings_(std::move(settings)),
                   basic_auth_username_(charge_point_id),
                   basic_auth_password_(basic_auth_password),
-                  failed_connection_attempts_(failed_connection_attempts)
+                  failed_connection_attempts_(failed_connection_attempts),
+                  wakeup_signal_(wakeup_signal),
+                  received_messages_(
+                          settings_->WebsocketInboundQueueBytes.getValue(),
+                          settings_->WebsocketMaxMessageBytes.getValue()
+                  )
             {
                 uri_ = central_system_url;
                 if (!uri_.empty() && uri_[uri_.size()-1] != '/')
@@ -695,12 +728,25 @@ namespace chargelab {
 
             std::size_t pendingMessages() override {
                 std::lock_guard<std::mutex> lock(mutex_);
-                return received_messages_.size();
+                return received_messages_.size() + rejected_calls_.size();
             }
 
             std::optional<std::string> pollMessages() override {
-                std::lock_guard<std::mutex> lock(mutex_);
-                return received_messages_.popFront();
+                sendRejectedCalls();
+
+                auto message = received_messages_.pop();
+                if (message.has_value())
+                    CHARGELAB_LOG_MESSAGE(info) << "Received message: " << message.value();
+
+                return message;
+            }
+
+            [[nodiscard]] std::size_t droppedMessages() const {
+                return received_messages_.droppedFrames();
+            }
+
+            [[nodiscard]] std::size_t highWaterBytes() const {
+                return received_messages_.highWaterBytes();
             }
 
             void sendCustom(std::function<void(ByteWriterInterface&)> payload) override {
@@ -733,6 +779,7 @@ namespace chargelab {
                     case WEBSOCKET_EVENT_CONNECTED:
                         CHARGELAB_LOG_MESSAGE(info) << "Websocket connected";
                         this_ptr->clearBuffer();
+                        this_ptr->wakeup_signal_.notify();
                         break;
 
                     case WEBSOCKET_EVENT_DISCONNECTED:
@@ -758,7 +805,7 @@ namespace chargelab {
                             case 0x0: // Continuation frame
                                 this_ptr->addToBuffer(data->data_ptr, data->data_len);
                                 if (data->payload_offset + data->data_len >= data->payload_len && data->fin) {
-                                    CHARGELAB_LOG_MESSAGE(info) << "Received multi-part websocket message: " << this_ptr->buffer_;
+                                    CHARGELAB_LOG_MESSAGE(info) << "Received multi-part websocket message";
                                     this_ptr->flushBuffer();
                                 }
                                 break;
@@ -814,35 +861,101 @@ namespace chargelab {
             }
 
         private:
+            // Note: runs on the websocket task. Blocking here until the OCPP loop frees space isn't an option since
+            // the client holds its connection lock while dispatching events, which would stall sendCustom() on the
+            // OCPP loop. Messages that don't fit are rejected instead.
             void addToBuffer(char const* data, std::size_t length) {
-                if (buffer_.size() + length > kMaxMessageBufferBytes) {
-                    CHARGELAB_LOG_MESSAGE(warning) << "Dropping part of websocket message - maximum message size exceeded";
-                    length = kMaxMessageBufferBytes - buffer_.size();
-                }
-                if (length == 0)
-                    return;
+                auto const prefix_bytes = std::min(length, kCallPrefixBytes - prefix_length_);
+                std::memcpy(prefix_.data() + prefix_length_, data, prefix_bytes);
+                prefix_length_ += prefix_bytes;
 
-                auto const index = buffer_.size();
-                buffer_.resize(buffer_.size() + length);
-                std::memcpy(buffer_.data() + index, data, length);
+                received_messages_.append(data, length);
             }
 
             void flushBuffer() {
-                std::lock_guard<std::mutex> lock(mutex_);
+                auto const result = received_messages_.commitFrame();
+                switch (result) {
+                    case FrameQueue::PushResult::kQueued:
+                        break;
 
-                CHARGELAB_TRY {
-                    CHARGELAB_LOG_MESSAGE(info) << "Received message: " << buffer_;
-                    received_messages_.pushBack(buffer_);
-                } CHARGELAB_CATCH {
-                    CHARGELAB_LOG_MESSAGE(warning) << "Failed parsing websocket message: " << buffer_;
+                    case FrameQueue::PushResult::kQueueFull:
+                    case FrameQueue::PushResult::kFrameTooLarge:
+                        {
+                            auto const prefix = std::string_view{prefix_.data(), prefix_length_};
+                            CHARGELAB_LOG_MESSAGE(warning) << "Dropped websocket message - "
+                                                           << (result == FrameQueue::PushResult::kQueueFull ? "inbound queue full" : "maximum message size exceeded")
+                                                           << " (dropped: " << received_messages_.droppedFrames() << "): " << prefix << "...";
+
+                            auto unique_id = callUniqueId(prefix);
+                            if (unique_id.has_value()) {
+                                std::lock_guard<std::mutex> lock(mutex_);
+                                rejected_calls_.pushBack(RejectedCall {
+                                        std::move(unique_id.value()),
+                                        result == FrameQueue::PushResult::kQueueFull
+                                });
+                            }
+                        }
+                        break;
                 }
 
                 clearBuffer();
+                wakeup_signal_.notify();
             }
 
             void clearBuffer() {
-                std::string empty;
-                std::swap(empty, buffer_);
+                received_messages_.beginFrame();
+                prefix_length_ = 0;
+            }
+
+            void sendRejectedCalls() {
+                while (true) {
+                    std::optional<RejectedCall> call;
+                    {
+                        std::lock_guard<std::mutex> lock(mutex_);
+                        call = rejected_calls_.popFront();
+                    }
+                    if (!call.has_value())
+                        break;
+
+                    // Note: the platform isn't tied to an OCPP version; InternalError is valid in both 1.6 and 2.0.1
+                    sendCustom([&](ByteWriterInterface& stream) {
+                        json::JsonWriter writer {stream};
+                        writer.StartArray();
+                        writer.Int(4); // CALLERROR
+                        writer.String(call->unique_id);
+                        writer.String("InternalError");
+                        writer.String(call->queue_full ? "Inbound message queue full" : "Message exceeds maximum size");
+                        writer.StartObject();
+                        writer.EndObject();
+                        writer.EndArray();
+                    });
+                }
+            }
+
+            /**
+             * Extracts the unique ID from the start of a CALL message ([2,"<id>",...), or std::nullopt if the message
+             * isn't a CALL.
+             */
+            static std::optional<std::string> callUniqueId(std::string_view text) {
+                std::size_t index = 0;
+                auto const expect = [&](char c) {
+                    while (index < text.size() && std::isspace((unsigned char)text[index]))
+                        index++;
+                    if (index >= text.size() || text[index] != c)
+                        return false;
+
+                    index++;
+                    return true;
+                };
+
+                if (!expect('[') || !expect('2') || !expect(',') || !expect('"'))
+                    return std::nullopt;
+
+                auto const end = text.find('"', index);
+                if (end == std::string_view::npos)
+                    return std::nullopt;
+
+                return std::string {text.substr(index, end - index)};
             }
 
         private:
@@ -850,6 +963,7 @@ namespace chargelab {
             std::string basic_auth_username_;
             std::string basic_auth_password_;
             std::atomic<int>& failed_connection_attempts_;
+            WakeupSignal& wakeup_signal_;
 
             esp_websocket_client_handle_t client_;
             WebsocketByteWriterImpl* active_writer_ = nullptr;
@@ -857,12 +971,21 @@ namespace chargelab {
             std::string uri_;
             uri::WebsocketParts uri_parts_;
             std::string subprotocol_;
-            std::string buffer_;
             std::atomic<bool> running_ = true;
             std::atomic<bool> established_connection_ = false;
 
+            struct RejectedCall {
+                std::string unique_id;
+                bool queue_full;
+            };
+
+            // Producer state for the message being received; only accessed from the websocket task
+            std::array<char, kCallPrefixBytes> prefix_;
+            std::size_t prefix_length_ = 0;
+
             std::mutex mutex_;
-            RingBuffer<std::string, kMaxRingBufferSize> received_messages_;
+            FrameQueue received_messages_;
+            RingBuffer<RejectedCall, kMaxRejectedCalls> rejected_calls_;
         };
 
         class RestRequest : public RestConnectionInterface {
@@ -1215,9 +1338,24 @@ namespace chargelab {
             }
         }
 
+        void waitForWakeup(int timeout_millis) override {
+            wakeup_signal_.waitFor(timeout_millis);
+        }
+
         void runStep(ocpp1_6::OcppRemote&) override {
         }
 
+        bool handlesRequest(ocpp1_6::ActionId const&) const override {
+            return false;
+        }
+
+        std::optional<SteadyPointMillis> nextWakeup(SteadyPointMillis now) override {
+            if (!pending_security_events_.empty())
+                return now;
+
+            return std::nullopt;
+        }
+
         void runStep(ocpp2_0::OcppRemote &remote) override {
             if (!pending_security_events_.empty()) {
                 if (remote.sendCall(pending_security_events_.front()).has_value())
@@ -1428,6 +1566,18 @@ namespace chargelab {
         }
 
     private:
+        bool handlesRequest(ocpp2_0::ActionId const& action_id) const override {
+            switch (action_id) {
+                default:
+                    return false;
+
+                case ocpp2_0::ActionId::kDeleteCertificate:
+                case ocpp2_0::ActionId::kGetInstalledCertificateIds:
+                case ocpp2_0::ActionId::kInstallCertificate:
+                    return true;
+            }
+        }
+
         std::optional<ocpp2_0::ResponseToRequest<ocpp2_0::InstallCertificateResponse>>
         onInstallCertificateReq(const ocpp2_0::InstallCertificateRequest &request) override {
             // Note: M04.FR.07 is ambiguous - assuming *the charging station* is free to set the "hashAlgorithm, which
@@ -1875,7 +2025,8 @@ namespace chargelab {
                             chargePointId,
                             protocol,
                             settings_->BasicAuthPassword.transitionCurrentValue(),
-                            failed_connection_attempts_
+                            failed_connection_attempts_,
+                            wakeup_signal_
                     );
                 }
             } else {
@@ -1980,6 +2131,10 @@ namespace chargelab {
 
             settings_->DiagnosticFreeHeap.setValue(free_heap);
             settings_->DiagnosticFreeHeapMinimum.setValue(free_heap_minimum);
+            if (websocket_ != nullptr) {
+                settings_->DiagnosticInboundMessagesDropped.setValue((int)websocket_->droppedMessages());
+                settings_->DiagnosticInboundQueueHighWaterBytes.setValue((int)websocket_->highWaterBytes());
+            }
 
             CHARGELAB_LOG_MESSAGE(info) << "Free heap: " << free_heap
                                         << " Minimum free heap: " << free_heap_minimum
@@ -2125,6 +2280,8 @@ namespace chargelab {
 
     private:
         std::shared_ptr<Settings> settings_;
+        // Note: declared ahead of the websocket, which notifies it from the websocket event task
+        WakeupSignal wakeup_signal_;
         std::shared_ptr<detail::WebsocketImpl> websocket_;
 
         bool initialised_ = false;
@@ -0,0 +1,339 @@
+#ifndef CHARGELAB_OPEN_FIRMWARE_PLATFORM_POSIX_H
+#define CHARGELAB_OPEN_FIRMWARE_PLATFORM_POSIX_H
+
+#include "openocpp/interface/platform_interface.h"
+#include "openocpp/implementation/loopback_csms.h"
+#include "openocpp/common/settings.h"
+#include "openocpp/common/storage.h"
+#include "openocpp/common/wakeup_signal.h"
+#include "openocpp/common/logging.h"
+#include "openocpp/helpers/chrono.h"
+
+#include <map>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+
+namespace chargelab {
+    namespace detail {
+        /**
+         * Contents and wear counters of a simulated NOR flash partition, shared by every handle opened on it.
+         */
+        struct SimulatedFlashState {
+            std::string path;
+            std::vector<std::uint8_t> data;
+            // Sector erases; erasing the whole partition counts each of its sectors
+            std::size_t erase_count = 0;
+            std::size_t write_count = 0;
+            std::size_t bytes_written = 0;
+            // Writes that attempted to set bits that were already cleared, which NOR flash can't do without an erase
+            std::size_t bits_set_violations = 0;
+        };
+
+        /**
+         * NOR flash partition simulated on top of a file: writes can only clear bits, and only an erase of the whole
+         * partition sets them again.
+         */
+        class SimulatedFlash : public FlashBlockInterface {
+        private:
+            // Erase sector size of the SPI flash used on the ESP32
+            static constexpr std::size_t kSectorSize = 0x1000;
+
+        public:
+            explicit SimulatedFlash(std::shared_ptr<SimulatedFlashState> state) : state_(std::move(state))
+            {
+            }
+
+        public:
+            bool read(std::size_t src_offset, void *dst, std::size_t size) const override {
+                if (src_offset + size > state_->data.size())
+                    return false;
+
+                std::memcpy(dst, state_->data.data() + src_offset, size);
+                return true;
+            }
+
+            bool write(std::size_t dst_offset, void *src, std::size_t size) override {
+                if (dst_offset + size > state_->data.size())
+                    return false;
+
+                auto const bytes = (std::uint8_t const*)src;
+                bool sets_bits = false;
+                for (std::size_t i=0; i < size; i++) {
+                    auto& target = state_->data[dst_offset + i];
+                    sets_bits |= (bytes[i] & ~target) != 0;
+                    target &= bytes[i];
+                }
+
+                if (sets_bits) {
+                    CHARGELAB_LOG_MESSAGE(warning) << "Flash write attempted to set cleared bits at offset " << dst_offset << ": " << state_->path;
+                    state_->bits_set_violations++;
+                }
+
+                state_->write_count++;
+                state_->bytes_written += size;
+                return save();
+            }
+
+            bool erase() override {
+                std::fill(state_->data.begin(), state_->data.end(), 0xFF);
+                state_->erase_count += std::max((std::size_t)1, state_->data.size()/sectorSize());
+                return save();
+            }
+
+            bool eraseSector(std::size_t offset) override {
+                if (offset % sectorSize() != 0 || offset + sectorSize() > state_->data.size())
+                    return false;
+
+                std::fill(state_->data.begin() + offset, state_->data.begin() + offset + sectorSize(), 0xFF);
+                state_->erase_count++;
+                return save();
+            }
+
+            [[nodiscard]] std::size_t size() const override {
+                return state_->data.size();
+            }
+
+            [[nodiscard]] std::size_t sectorSize() const override {
+                return std::min(kSectorSize, state_->data.size());
+            }
+
+        private:
+            bool save() {
+                auto file = std::fopen(state_->path.c_str(), "wb");
+                if (file == nullptr)
+                    return false;
+
+                CloseFileWrapper wrapper {file};
+                return std::fwrite(state_->data.data(), 1, state_->data.size(), file) == state_->data.size();
+            }
+
+        private:
+            std::shared_ptr<SimulatedFlashState> state_;
+        };
+
+        class DiscardingRestRequest : public RestConnectionInterface {
+        public:
+            int getStatusCode() override {
+                return 200;
+            }
+
+            std::size_t getContentLength() override {
+                return 0;
+            }
+
+            void setHeader(std::string const&, std::string const&) override {
+            }
+
+            bool open(std::size_t) override {
+                return true;
+            }
+
+            bool send() override {
+                return true;
+            }
+
+            int read(char*, int) override {
+                return 0;
+            }
+
+            int write(char const*, int len) override {
+                return len;
+            }
+        };
+    }
+
+    /**
+     * Platform for running the charger on a POSIX host, for example to profile StandardCharger::runStep under perf or
+     * valgrind. Files and flash partitions are kept in a storage directory, and the OCPP connection is provided by a
+     * LoopbackCsms. REST requests (log uploads) succeed without sending anything.
+     *
+     * The clocks run at clock_rate times real time. A clock_rate of 0 selects a simulated clock that only advances
+     * while the main loop waits in waitForWakeup(), so hours of charger time run as fast as the CPU allows.
+     */
+    class PlatformPOSIX : public PlatformInterface {
+    private:
+        static constexpr const char* kSettingsFile = "settings.json";
+        static constexpr const char* kFlashFileSuffix = ".flash";
+        static constexpr std::int64_t kSteadyClockStart = 1000*1000;
+
+    public:
+        explicit PlatformPOSIX(
+                std::string storage_directory,
+                double clock_rate = 1.0,
+                std::map<std::string, std::size_t> partition_sizes = {{"pmjournal", 0x2000}}
+        )
+                : storage_directory_(std::move(storage_directory)),
+                  clock_rate_(clock_rate),
+                  partition_sizes_(std::move(partition_sizes)),
+                  real_start_(std::chrono::steady_clock::now())
+        {
+            CHARGELAB_LOG_MESSAGE(debug) << "Setting up platform in: " << storage_directory_;
+
+            auto const system_now = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::system_clock::now().time_since_epoch()
+            ).count();
+            system_clock_offset_ = system_now - kSteadyClockStart;
+
+            settings_ = std::make_shared<Settings>(std::make_shared<StorageFile>(path(kSettingsFile)));
+            settings_->loadFromStorage();
+        }
+
+        ~PlatformPOSIX() override {
+            CHARGELAB_LOG_MESSAGE(debug) << "Deleting PlatformPOSIX";
+        }
+
+    public:
+        void setCsms(std::shared_ptr<LoopbackCsms> const& csms) {
+            csms_ = csms;
+        }
+
+        /**
+         * @return true once resetSoft() or resetHard() was called; the host application is expected to tear down and
+         *  recreate the charger to simulate the restart
+         */
+        [[nodiscard]] bool resetRequested() const {
+            return reset_requested_;
+        }
+
+        [[nodiscard]] std::map<std::string, std::shared_ptr<detail::SimulatedFlashState>> const& flashPartitions() const {
+            return flash_partitions_;
+        }
+
+    public:
+        chargelab::SystemTimeMillis systemClockNow() override {
+            return (SystemTimeMillis)(system_clock_offset_ + steadyClockNow());
+        }
+
+        chargelab::SteadyPointMillis steadyClockNow() override {
+            auto const real_elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now() - real_start_
+            ).count();
+
+            return (SteadyPointMillis)(kSteadyClockStart + (std::int64_t)((double)real_elapsed*clock_rate_) + skipped_millis_);
+        }
+
+        void setSystemClock(SystemTimeMillis now) override {
+            CHARGELAB_LOG_MESSAGE(debug) << "Setting system clock to: " << chrono::ToString(now);
+            system_clock_offset_ = now - steadyClockNow();
+        }
+
+        void resetSoft() override {
+            resetHard();
+        }
+
+        void resetHard() override {
+            CHARGELAB_LOG_MESSAGE(info) << "Restart requested";
+            settings_->saveIfModified();
+            reset_requested_ = true;
+        }
+
+        bool isClockOutOfSync() override {
+            return false;
+        }
+
+        std::unique_ptr<chargelab::StorageInterface> getStorage(std::string const& file_name) override {
+            return std::make_unique<chargelab::StorageFile>(path(file_name));
+        }
+
+        std::unique_ptr<chargelab::FlashBlockInterface> getPartition(std::string const& label) override {
+            auto it = flash_partitions_.find(label);
+            if (it == flash_partitions_.end()) {
+                auto const size = partition_sizes_.find(label);
+                if (size == partition_sizes_.end())
+                    return nullptr;
+
+                auto state = std::make_shared<detail::SimulatedFlashState>();
+                state->path = path(label + kFlashFileSuffix);
+                state->data.resize(size->second, 0xFF);
+
+                auto file = std::fopen(state->path.c_str(), "rb");
+                if (file != nullptr) {
+                    detail::CloseFileWrapper wrapper {file};
+                    if (std::fread(state->data.data(), 1, state->data.size(), file) != state->data.size())
+                        std::fill(state->data.begin(), state->data.end(), 0xFF);
+                }
+
+                it = flash_partitions_.emplace(label, std::move(state)).first;
+            }
+
+            return std::make_unique<detail::SimulatedFlash>(it->second);
+        }
+
+        std::shared_ptr<RestConnectionInterface> restRequest(RestMethod, std::string const& uri) override {
+            CHARGELAB_LOG_MESSAGE(debug) << "Discarding REST request to: " << uri;
+            return std::make_shared<detail::DiscardingRestRequest>();
+        }
+
+        bool verifyManufacturerCertificate(std::string const&, std::optional<SignatureAndHash> const&) override {
+            CHARGELAB_LOG_MESSAGE(warning) << "Manufacturer certificates aren't supported on this platform";
+            return false;
+        }
+
+        std::shared_ptr<WebsocketInterface> ocppConnection() override {
+            auto csms = csms_.lock();
+            if (csms == nullptr)
+                return nullptr;
+
+            return csms->connection();
+        }
+
+        void waitForWakeup(int timeout_millis) override {
+            if (clock_rate_ <= 0) {
+                skipped_millis_ += timeout_millis;
+                return;
+            }
+
+            wakeup_signal_.waitFor(std::max(1, (int)(timeout_millis/clock_rate_)));
+        }
+
+        std::optional<SteadyPointMillis> nextWakeup(SteadyPointMillis) override {
+            auto csms = csms_.lock();
+            if (csms == nullptr)
+                return std::nullopt;
+
+            return csms->nextDelivery();
+        }
+
+        std::shared_ptr<Settings> getSettings() override {
+            return settings_;
+        }
+
+        bool handlesRequest(ocpp1_6::ActionId const&) const override {
+            return false;
+        }
+
+        bool handlesRequest(ocpp2_0::ActionId const&) const override {
+            return false;
+        }
+
+    private:
+        [[nodiscard]] std::string path(std::string const& file_name) const {
+            return storage_directory_ + "/" + file_name;
+        }
+
+    private:
+        std::string storage_directory_;
+        double clock_rate_;
+        std::map<std::string, std::size_t> partition_sizes_;
+
+        std::chrono::steady_clock::time_point real_start_;
+        std::atomic<std::int64_t> skipped_millis_ = 0;
+        std::atomic<std::int64_t> system_clock_offset_ = 0;
+
+        std::shared_ptr<Settings> settings_;
+        std::weak_ptr<LoopbackCsms> csms_;
+        WakeupSignal wakeup_signal_;
+        bool reset_requested_ = false;
+
+        std::map<std::string, std::shared_ptr<detail::SimulatedFlashState>> flash_partitions_;
+    };
+}
+
+#endif //CHARGELAB_OPEN_FIRMWARE_PLATFORM_POSIX_H
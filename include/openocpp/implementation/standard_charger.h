@@ -22,8 +22,14 @@
 
 #include "openocpp/implementation/hash_methods_mbedtls.h"
 
+#include <algorithm>
+
 namespace chargelab {
     class StandardCharger {
+    private:
+        static constexpr int kMinStepIntervalMillis = 10;
+        static constexpr int kMaxIdleIntervalMillis = 500;
+
     public:
         std::shared_ptr<PlatformInterface> platform;
         std::shared_ptr<StationInterface> station;
@@ -175,14 +181,32 @@ namespace chargelab {
 
         void runLoop() {
             while (true) {
-                message_handler1_6->runStep(platform->ocppConnection());
-                message_handler2_0->runStep(platform->ocppConnection());
-
-                using namespace std::chrono_literals;
-                std::this_thread::sleep_for(10ms);
+                runStep();
+                waitForNextStep();
             }
         }
 
+        /**
+         * Blocks until the next step is due: the earliest wakeup requested by the modules, an inbound websocket
+         * message, or kMaxIdleIntervalMillis for state that's still polled (e.g. connector status). Returns
+         * immediately if inbound messages are still queued.
+         */
+        void waitForNextStep() {
+            auto const connection = platform->ocppConnection();
+            if (connection != nullptr && connection->pendingMessages() > 0)
+                return;
+
+            auto const now = platform->steadyClockNow();
+            auto wakeup = (SteadyPointMillis)(now + kMaxIdleIntervalMillis);
+            detail::EarliestWakeup(wakeup, message_handler1_6->nextWakeup(connection));
+            detail::EarliestWakeup(wakeup, message_handler2_0->nextWakeup(connection));
+
+            // Note: modules that are due but can't make progress yet report a wakeup in the past, so a minimum
+            // interval is kept between steps
+            auto const delay = std::clamp<std::int64_t>(wakeup - now, kMinStepIntervalMillis, kMaxIdleIntervalMillis);
+            platform->waitForWakeup((int)delay);
+        }
+
         template <typename T, typename... Args>
         void addAfter(std::shared_ptr<T> module, Args&&... args) {
             message_handler1_6->addAfter(module, std::forward<Args>(args)...);
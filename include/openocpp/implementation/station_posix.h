@@ -0,0 +1,119 @@
+#ifndef CHARGELAB_OPEN_FIRMWARE_STATION_POSIX_H
+#define CHARGELAB_OPEN_FIRMWARE_STATION_POSIX_H
+
+#include "openocpp/interface/station_interface.h"
+#include "openocpp/common/logging.h"
+
+#include <string>
+#include <cstdio>
+
+namespace chargelab {
+    /**
+     * Firmware update support for stations running on a POSIX host. Updates are written to one of two slot files in
+     * the storage directory; a successful update selects the other slot for the next start-up, mirroring the A/B OTA
+     * partitions used on the ESP32.
+     */
+    class StationPOSIX : public StationInterface {
+    private:
+        static constexpr const char* kBootSlotFile = "boot_slot";
+
+    public:
+        explicit StationPOSIX(std::string storage_directory)
+                : storage_directory_(std::move(storage_directory))
+        {
+            auto file = std::fopen(path(kBootSlotFile).c_str(), "r");
+            if (file != nullptr) {
+                active_slot_ = std::fgetc(file) == '1' ? 1 : 0;
+                std::fclose(file);
+            }
+
+            CHARGELAB_LOG_MESSAGE(debug) << "Running slot: " << getActiveSlotId();
+        }
+
+        std::string getActiveSlotId() override {
+            return "slot" + std::to_string(active_slot_);
+        }
+
+        std::string getUpdateSlotId() override {
+            return "slot" + std::to_string(1 - active_slot_);
+        }
+
+        Result startUpdateProcess(std::size_t update_size) override {
+            if (update_file_ != nullptr) {
+                CHARGELAB_LOG_MESSAGE(error) << "Another firmware update operation was in progress";
+                return Result::kFailed;
+            }
+
+            update_file_ = std::fopen(path(getUpdateSlotId() + ".bin").c_str(), "wb");
+            if (update_file_ == nullptr) {
+                CHARGELAB_LOG_MESSAGE(error) << "Failed to start firmware update - couldn't open slot file";
+                return Result::kFailed;
+            }
+
+            CHARGELAB_LOG_MESSAGE(info) << "Starting firmware update for slot: " << getUpdateSlotId();
+            update_size_ = update_size;
+            update_offset_ = 0;
+            return Result::kSucceeded;
+        }
+
+        Result processFirmwareChunk(std::uint8_t const* block, std::size_t size) override {
+            if (update_file_ == nullptr) {
+                CHARGELAB_LOG_MESSAGE(error) << "Process chunk called outside of a firmware update operation";
+                return Result::kFailed;
+            }
+
+            if (update_offset_ + size > update_size_) {
+                CHARGELAB_LOG_MESSAGE(error) << "Firmware update chunks exceeded update size";
+                return Result::kFailed;
+            }
+
+            if (std::fwrite(block, 1, size, update_file_) != size) {
+                CHARGELAB_LOG_MESSAGE(error) << "Firmware update write failed";
+                std::fclose(update_file_);
+                update_file_ = nullptr;
+                return Result::kFailed;
+            }
+
+            update_offset_ += size;
+            return Result::kSucceeded;
+        }
+
+        Result finishUpdateProcess(bool succeeded) override {
+            if (update_file_ == nullptr) {
+                CHARGELAB_LOG_MESSAGE(error) << "Finish update called outside of a firmware update operation";
+                return Result::kFailed;
+            }
+
+            auto const closed = std::fclose(update_file_) == 0;
+            update_file_ = nullptr;
+            if (!succeeded)
+                return Result::kSucceeded;
+            if (!closed)
+                return Result::kFailed;
+
+            auto file = std::fopen(path(kBootSlotFile).c_str(), "w");
+            if (file == nullptr)
+                return Result::kFailed;
+
+            std::fputc(active_slot_ == 0 ? '1' : '0', file);
+            std::fclose(file);
+            CHARGELAB_LOG_MESSAGE(info) << "Update applied - the next start will use slot: " << getUpdateSlotId();
+            return Result::kSucceeded;
+        }
+
+    private:
+        [[nodiscard]] std::string path(std::string const& file_name) const {
+            return storage_directory_ + "/" + file_name;
+        }
+
+    private:
+        std::string storage_directory_;
+        int active_slot_ = 0;
+
+        FILE* update_file_ = nullptr;
+        std::size_t update_size_ = 0;
+        std::size_t update_offset_ = 0;
+    };
+}
+
+#endif //CHARGELAB_OPEN_FIRMWARE_STATION_POSIX_H
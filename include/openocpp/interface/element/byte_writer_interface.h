@@ -5,9 +5,27 @@
 #include <cstring>
 
 namespace chargelab {
+    struct ByteSpan {
+        char* data = nullptr;
+        std::size_t size = 0;
+    };
+
     class ByteWriterInterface {
     public:
         virtual void write(char const *s, std::size_t count) = 0;
+
+        /**
+         * Optional: exposes free space in the writer's own buffer (ideally at least size_hint bytes) so callers can
+         * produce output in place rather than passing it through write. Returns an empty span if the writer doesn't
+         * support this. The bytes become part of the output when commit is called with the number used; write must
+         * not be called while a span is outstanding.
+         */
+        virtual ByteSpan reserve(std::size_t size_hint) {
+            return {};
+        }
+
+        virtual void commit(std::size_t count) {
+        }
     };
 }
 
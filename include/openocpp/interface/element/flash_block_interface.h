@@ -12,6 +12,23 @@ namespace chargelab {
         virtual bool write(std::size_t dst_offset, void *src, std::size_t size) = 0;
         virtual bool erase() = 0;
         [[nodiscard]] virtual std::size_t size() const = 0;
+
+        /**
+         * @return the smallest region that can be erased on its own; defaults to the whole partition
+         */
+        [[nodiscard]] virtual std::size_t sectorSize() const {
+            return size();
+        }
+
+        /**
+         * Erases the sector starting at offset, which must be a multiple of sectorSize().
+         */
+        virtual bool eraseSector(std::size_t offset) {
+            if (offset != 0 || sectorSize() != size())
+                return false;
+
+            return erase();
+        }
     };
 }
 
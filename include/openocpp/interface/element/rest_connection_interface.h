@@ -1,6 +1,7 @@
 #ifndef CHARGELAB_OPEN_FIRMWARE_REST_CONNECTION_INTERFACE_H
 #define CHARGELAB_OPEN_FIRMWARE_REST_CONNECTION_INTERFACE_H
 
+#include <string>
 #include <optional>
 
 namespace chargelab {
@@ -2,6 +2,8 @@
 #define CHARGELAB_OPEN_FIRMWARE_STORAGE_INTERFACE_H
 
 #include <cstdio>
+#include <memory>
+#include <string>
 #include <functional>
 
 namespace chargelab {
@@ -11,6 +13,23 @@ namespace chargelab {
 
         virtual bool read(std::function<bool(FILE*)> const& function) = 0;
         virtual bool write(std::function<bool(FILE*)> const& function) = 0;
+
+        // Writes to the end of the existing content. Returns false if appending isn't supported, in which case the
+        // caller should fall back to rewriting the whole content with write.
+        virtual bool append(std::function<bool(FILE*)> const&) {
+            return false;
+        }
+
+        // Returns storage for a separate file kept alongside this one, named by the given suffix. Returns nullptr if
+        // that isn't supported, in which case the caller should keep everything in this storage.
+        virtual std::unique_ptr<StorageInterface> sibling(std::string const&) {
+            return nullptr;
+        }
+
+        // Deletes the content. Returns false if that isn't supported or failed.
+        virtual bool remove() {
+            return false;
+        }
     };
 }
 
@@ -11,6 +11,8 @@
 
 #include <cstdint>
 #include <memory>
+#include <thread>
+#include <chrono>
 
 namespace chargelab {
     enum class RestMethod {
@@ -52,6 +54,15 @@ namespace chargelab {
         virtual std::shared_ptr<RestConnectionInterface> putRequest(std::string const& uri) {
             return restRequest(RestMethod::kPut, uri);
         }
+
+        /**
+         * Blocks the main loop until the timeout elapses or an event that needs processing occurs, such as an inbound
+         * websocket message. Platforms without event notification simply sleep for the timeout.
+         * @param timeout_millis
+         */
+        virtual void waitForWakeup(int timeout_millis) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(timeout_millis));
+        }
     };
 }
 
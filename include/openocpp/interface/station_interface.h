@@ -79,7 +79,9 @@ namespace chargelab {
     class StationInterface {
     public:
         using schedule_type1_6 = std::pair<ocpp1_6::SetChargingProfileReq, ocpp1_6::ChargingSchedulePeriod>;
-        using schedule_type2_0 = std::pair<ocpp2_0::SetChargingProfileRequest, ocpp2_0::ChargingSchedulePeriodType>;
+        // Note: refers to the charging profiles held by the power management module; the references are only valid
+        // for the duration of the setActive*Profiles call.
+        using schedule_type2_0 = std::pair<ocpp2_0::SetChargingProfileRequest const&, ocpp2_0::ChargingSchedulePeriodType const&>;
 
         enum class Result {
             kSucceeded,
@@ -165,7 +167,8 @@ namespace chargelab {
         /**
          * Sets the active OCPP 2.0 charging schedules that were assigned to the charger.
          *
-         * @param active_schedules the active schedule periods and their associated charging profiles
+         * @param active_schedules the active schedule periods and their associated charging profiles; copy anything
+         *                         that needs to outlive the call
          */
         virtual void setActiveChargePointMaxProfiles(std::vector<schedule_type2_0> const& active_schedules) = 0;
 
@@ -179,7 +182,8 @@ namespace chargelab {
         /**
          * Sets the active OCPP 2.0 charging schedules that were assigned to a specific EVSE ID.
          *
-         * @param active_schedules the active schedule periods and their associated charging profiles
+         * @param active_schedules the active schedule periods and their associated charging profiles; copy anything
+         *                         that needs to outlive the call
          */
         virtual void setActiveEvseProfiles(int evse_id, std::vector<schedule_type2_0> const& active_schedules) = 0;
 
@@ -7,6 +7,9 @@
 #include "openocpp/protocol/ocpp2_0/handlers/abstract_request_handler.h"
 #include "openocpp/protocol/ocpp2_0/handlers/abstract_response_handler.h"
 #include "openocpp/protocol/ocpp2_0/handlers/abstract_service.h"
+#include "openocpp/model/system_types.h"
+
+#include <optional>
 
 namespace chargelab {
     namespace detail {
@@ -14,8 +17,36 @@ namespace chargelab {
         public:
             virtual void runUnconditionally() {
             };
+
+            /**
+             * Returns the time by which the module needs to run again, or std::nullopt if it has no timed work
+             * pending; the main loop otherwise only runs on inbound messages or its idle interval.
+             * @param now current steady clock time
+             */
+            virtual std::optional<SteadyPointMillis> nextWakeup(SteadyPointMillis now) {
+                (void)now;
+                return std::nullopt;
+            }
         };
 
+        /**
+         * Lowers the wakeup to the given time if that's earlier.
+         */
+        inline void EarliestWakeup(std::optional<SteadyPointMillis>& wakeup, SteadyPointMillis ts) {
+            if (!wakeup.has_value() || ts < wakeup.value())
+                wakeup = ts;
+        }
+
+        inline void EarliestWakeup(std::optional<SteadyPointMillis>& wakeup, std::optional<SteadyPointMillis> const& ts) {
+            if (ts.has_value())
+                EarliestWakeup(wakeup, ts.value());
+        }
+
+        inline void EarliestWakeup(SteadyPointMillis& wakeup, std::optional<SteadyPointMillis> const& ts) {
+            if (ts.has_value() && ts.value() < wakeup)
+                wakeup = ts.value();
+        }
+
         struct ConcreteImplementationsOCPP1_6 {
             ocpp1_6::AbstractService* service;
             ocpp1_6::AbstractRequestHandler* request_handler;
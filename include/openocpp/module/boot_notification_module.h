@@ -59,6 +59,25 @@ namespace chargelab {
         }
 
     private:
+        std::optional<SteadyPointMillis> nextWakeup(SteadyPointMillis now) override {
+            std::optional<SteadyPointMillis> result = std::nullopt;
+            if (connection_transition_timeout_.has_value())
+                detail::EarliestWakeup(result, allow_ocpp_calls_ ? now : connection_transition_timeout_.value());
+            if (force_boot_notification_req_)
+                return now;
+
+            // Note: if the last request couldn't be sent (e.g. while offline) it's retried on the idle interval
+            if (!registrationComplete() && !send_failed_) {
+                auto next = pending_boot_notification_req_.idleDeadline(settings_->HeartbeatInterval.getValue());
+                if (requested_next_boot_notification_req_.has_value())
+                    next = std::max(next, requested_next_boot_notification_req_.value());
+
+                detail::EarliestWakeup(result, next);
+            }
+
+            return result;
+        }
+
         // OCPP 1.6 implementation
         void runStep(ocpp1_6::OcppRemote &remote) override {
             // Clear this flag if present
@@ -143,6 +162,8 @@ namespace chargelab {
             }
         }
 
+        // Note: handlesRequest isn't overridden; calls for every action are rejected here until the charger is accepted
+
         std::optional<ocpp1_6::ResponseToRequest<ocpp1_6::TriggerMessageRsp>>
         onTriggerMessageReq(const ocpp1_6::TriggerMessageReq &req) override {
             switch (req.requestedMessage) {
@@ -631,6 +652,7 @@ namespace chargelab {
                         settings_->DefaultMessageTimeout.getValue(),
                         sendBootNotification()
                 );
+                send_failed_ = pending_boot_notification_req_ == kNoOperation;
                 return;
             }
 
@@ -647,6 +669,7 @@ namespace chargelab {
                         settings_->DefaultMessageTimeout.getValue(),
                         sendBootNotification()
                 );
+                send_failed_ = pending_boot_notification_req_ == kNoOperation;
             }
         }
 
@@ -693,6 +716,7 @@ namespace chargelab {
         std::atomic<bool> allow_ocpp_calls_ = false;
         std::atomic<bool> force_boot_notification_req_ = false;
         std::atomic<bool> security_profile_checked_ = false;
+        bool send_failed_ = false;
     };
 }
 
@@ -35,59 +35,50 @@ namespace chargelab {
             settings_->saveIfModified();
         }
 
+        std::optional<SteadyPointMillis> nextWakeup(SteadyPointMillis now) override {
+            // Note: a frame the remote refused (e.g. while the in-flight window is full) is retried on the next
+            // inbound message or idle interval
+            if (!ocpp2_0_pending_base_report_.has_value() || ocpp2_0_pending_base_report_->send_refused)
+                return std::nullopt;
+
+            return now;
+        }
+
         void runStep(ocpp1_6::OcppRemote&) override {
         }
 
         void runStep(ocpp2_0::OcppRemote &remote) override {
-            if (ocpp2_0_pending_base_report_.has_value()) {
-                auto request = ocpp2_0_pending_base_report_.value();
-                auto settings = settings_;
-                ocpp2_0::NotifyReportRequest response {
-                        request.requestId,
-                        {system_->systemClockNow()},
-                        false,
-                        0,
-                        {[&](std::function<void(ocpp2_0::ReportDataType const &)> const &visitor) {
-                            settings->visitSettings([&](SettingBase& setting) {
-                                auto const metadata = setting.getMetadata();
-                                bool include_characteristics;
-                                switch (request.reportBase) {
-                                    default:
-                                        CHARGELAB_LOG_MESSAGE(error) << "Unexpected report type in generator: " << request.reportBase;
-                                        return;
-
-                                    case ocpp2_0::ReportBaseEnumType::kConfigurationInventory:
-                                        include_characteristics = true;
-                                        if (!metadata.config.isAllowOcppWrite())
-                                            return;
-                                        break;
-
-                                    case ocpp2_0::ReportBaseEnumType::kFullInventory:
-                                        include_characteristics = true;
-                                        break;
-                                }
-
-                                if (!metadata.model2_0.has_value())
-                                    return;
+            if (!ocpp2_0_pending_base_report_.has_value())
+                return;
 
-                                auto element = ocpp2_0::ReportDataType {
-                                        metadata.model2_0->component_type,
-                                        metadata.model2_0->variable_type,
-                                        setting.getAttributes2_0()
-                                };
+            auto& report = ocpp2_0_pending_base_report_.value();
+            if (!report.frame.has_value())
+                report.frame = nextReportFrame(report);
 
-                                if (include_characteristics) {
-                                    element.variableCharacteristics = metadata.model2_0->variable_characteristics;
-                                }
+            report.send_refused = !remote.sendNotifyReportReq(report.frame.value()).has_value();
+            if (report.send_refused)
+                return;
 
-                                visitor(element);
-                            });
-                        }}
-                };
+            if (report.frame->tbc.value_or(false)) {
+                report.cursor = report.next_cursor;
+                report.seq_no++;
+                report.frame = std::nullopt;
+            } else {
+                ocpp2_0_pending_base_report_ = std::nullopt;
+            }
+        }
 
-                if (remote.sendNotifyReportReq(response).has_value()) {
-                    ocpp2_0_pending_base_report_ = std::nullopt;
-                }
+        bool handlesRequest(ocpp2_0::ActionId const& action_id) const override {
+            switch (action_id) {
+                default:
+                    return false;
+
+                case ocpp2_0::ActionId::kGetBaseReport:
+                case ocpp2_0::ActionId::kGetMonitoringReport:
+                case ocpp2_0::ActionId::kGetVariables:
+                case ocpp2_0::ActionId::kSetNetworkProfile:
+                case ocpp2_0::ActionId::kSetVariables:
+                    return true;
             }
         }
 
@@ -105,8 +96,6 @@ namespace chargelab {
             return ocpp2_0::GetVariablesResponse {
                     {[=](std::function<void(ocpp2_0::GetVariableResultType const &)> const &visitor) {
                         for (auto const& get_variable : request.getVariableData) {
-                            bool componentFound = false;
-                            bool variableFound = false;
                             auto result = ocpp2_0::GetVariableResultType {
                                     ocpp2_0::GetVariableStatusEnumType::kValueNotFoundInEnum,
                                     get_variable.attributeType,
@@ -115,46 +104,21 @@ namespace chargelab {
                                     get_variable.variable
                             };
 
-                            settings->visitSettings([&](SettingBase& setting) {
-                                auto const metadata = setting.getMetadata();
-                                if (variableFound)
-                                    return;
-                                if (!metadata.model2_0.has_value())
-                                    return;
-
-                                if (metadata.model2_0->component_type != get_variable.component) {
-                                    return;
+                            auto const setting = settings->findSetting2_0(get_variable.component, get_variable.variable);
+                            if (setting == nullptr) {
+                                if (!settings->hasComponent2_0(get_variable.component)) {
+                                    result.attributeStatus = ocpp2_0::GetVariableStatusEnumType::kUnknownComponent;
                                 } else {
-                                    componentFound = true;
+                                    result.attributeStatus = ocpp2_0::GetVariableStatusEnumType::kUnknownVariable;
                                 }
-
-                                if (metadata.model2_0->variable_type != get_variable.variable) {
-                                    return;
-                                } else {
-                                    variableFound = true;
-                                }
-
-                                if (get_variable.attributeType.has_value()) {
-                                    // TODO - right now everything defined is "actual"
-                                    if (get_variable.attributeType.value() != ocpp2_0::AttributeEnumType::kActual) {
-                                        result.attributeStatus = ocpp2_0::GetVariableStatusEnumType::kNotSupportedAttributeType;
-                                        return;
-                                    }
-                                }
-
-                                if (!metadata.config.isAllowOcppRead()) {
-                                    result.attributeStatus = ocpp2_0::GetVariableStatusEnumType::kRejected;
-                                    return;
-                                }
-
+                            } else if (get_variable.attributeType.has_value() && get_variable.attributeType.value() != ocpp2_0::AttributeEnumType::kActual) {
+                                // TODO - right now everything defined is "actual"
+                                result.attributeStatus = ocpp2_0::GetVariableStatusEnumType::kNotSupportedAttributeType;
+                            } else if (!setting->getConfig().isAllowOcppRead()) {
+                                result.attributeStatus = ocpp2_0::GetVariableStatusEnumType::kRejected;
+                            } else {
                                 result.attributeStatus = ocpp2_0::GetVariableStatusEnumType::kAccepted;
-                                result.attributeValue = setting.getValueAsString();
-                            });
-
-                            if (!componentFound) {
-                                result.attributeStatus = ocpp2_0::GetVariableStatusEnumType::kUnknownComponent;
-                            } else if (!variableFound) {
-                                result.attributeStatus = ocpp2_0::GetVariableStatusEnumType::kUnknownVariable;
+                                result.attributeValue = setting->getValueAsString();
                             }
 
                             visitor(result);
@@ -167,8 +131,6 @@ namespace chargelab {
         onSetVariablesReq(const ocpp2_0::SetVariablesRequest &request) override {
             std::vector<ocpp2_0::SetVariableResultType> results;
             for (auto const& set_variable : request.setVariableData) {
-                bool componentFound = false;
-                bool variableFound = false;
                 auto result = ocpp2_0::SetVariableResultType {
                         set_variable.attributeType,
                         ocpp2_0::SetVariableStatusEnumType::kValueNotFoundInEnum,
@@ -176,96 +138,15 @@ namespace chargelab {
                         set_variable.variable
                 };
 
-                auto const network_configuration_priority_id = settings_->NetworkConfigurationPriority.getId();
-                settings_->visitSettings([&](SettingBase& setting) {
-                    auto const metadata = setting.getMetadata();
-                    if (variableFound)
-                        return;
-                    if (!metadata.model2_0.has_value())
-                        return;
-
-                    if (metadata.model2_0->component_type != set_variable.component) {
-                        return;
-                    } else {
-                        componentFound = true;
-                    }
-
-                    if (metadata.model2_0->variable_type != set_variable.variable) {
-                        return;
+                auto const setting = settings_->findSetting2_0(set_variable.component, set_variable.variable);
+                if (setting == nullptr) {
+                    if (!settings_->hasComponent2_0(set_variable.component)) {
+                        result.attributeStatus = ocpp2_0::SetVariableStatusEnumType::kUnknownComponent;
                     } else {
-                        variableFound = true;
-                    }
-
-                    if (set_variable.attributeType.has_value()) {
-                        // TODO - right now everything defined is "actual"
-                        if (set_variable.attributeType.value() != ocpp2_0::AttributeEnumType::kActual) {
-                            result.attributeStatus = ocpp2_0::SetVariableStatusEnumType::kNotSupportedAttributeType;
-                            return;
-                        }
-                    }
-
-                    if (!metadata.config.isAllowOcppWrite()) {
-                        result.attributeStatus = ocpp2_0::SetVariableStatusEnumType::kRejected;
-                        return;
+                        result.attributeStatus = ocpp2_0::SetVariableStatusEnumType::kUnknownVariable;
                     }
-
-                    // A05.FR.02
-                    if (metadata.id == network_configuration_priority_id) {
-                        bool missing_profile = false;
-                        int target_security_profile = 0;
-                        string::SplitVisitor(set_variable.attributeValue.value(), ",", [&](std::string const& text) {
-                            auto slot = string::ToInteger(text);
-                            if (!slot.has_value())
-                                return;
-
-                            auto const& profile = settings_->NetworkConnectionProfiles.getValue(slot.value());
-                            if (!profile.has_value()) {
-                                missing_profile = true;
-                                return;
-                            }
-
-                            target_security_profile = std::max(target_security_profile, profile->securityProfile);
-                        });
-
-                        // TODO: Is there a specific requirement for this?
-                        if (target_security_profile < settings_->SecurityProfile.getValue()) {
-                            result.attributeStatus = ocpp2_0::SetVariableStatusEnumType::kRejected;
-                            return;
-                        }
-
-                        if (target_security_profile > settings_->SecurityProfile.getValue()) {
-                            // A05.FR.02
-                            if (target_security_profile >= 2 && settings_->InstalledCSMSRootCertificateCount.getValue() <= 0) {
-                                result.attributeStatus = ocpp2_0::SetVariableStatusEnumType::kRejected;
-                                return;
-                            }
-
-                            // A05.FR.03
-                            // TODO: Not relevant until we have something that can store a charging station certificate
-                            if (target_security_profile == 3) {
-                                result.attributeStatus = ocpp2_0::SetVariableStatusEnumType::kRejected;
-                                return;
-                            }
-                        }
-                    }
-
-                    // TODO: move to update attribute?
-                    if (!settings_->setSettingValue(metadata.id, set_variable.attributeValue.value())) {
-                        result.attributeStatus = ocpp2_0::SetVariableStatusEnumType::kRejected;
-                        return;
-                    }
-
-                    if (metadata.config.isRebootRequired()) {
-                        result.attributeStatus = ocpp2_0::SetVariableStatusEnumType::kRebootRequired;
-                    } else {
-                        result.attributeStatus = ocpp2_0::SetVariableStatusEnumType::kAccepted;
-                    }
-                });
-
-                if (!componentFound) {
-                    result.attributeStatus = ocpp2_0::SetVariableStatusEnumType::kUnknownComponent;
-                } else if (!variableFound) {
-                    result.attributeStatus = ocpp2_0::SetVariableStatusEnumType::kUnknownVariable;
+                } else {
+                    result.attributeStatus = setVariable(*setting, set_variable);
                 }
 
                 results.push_back(std::move(result));
@@ -294,12 +175,23 @@ namespace chargelab {
                     break;
             }
 
-            ocpp2_0_pending_base_report_ = request;
+            ocpp2_0_pending_base_report_ = PendingBaseReport {request, system_->systemClockNow()};
             return ocpp2_0::GetBaseReportResponse {
                     ocpp2_0::GenericDeviceModelStatusEnumType::kAccepted
             };
         }
 
+        bool handlesRequest(ocpp1_6::ActionId const& action_id) const override {
+            switch (action_id) {
+                default:
+                    return false;
+
+                case ocpp1_6::ActionId::kChangeConfiguration:
+                case ocpp1_6::ActionId::kGetConfiguration:
+                    return true;
+            }
+        }
+
         std::optional<ocpp1_6::ResponseToRequest<ocpp1_6::ChangeConfigurationRsp>>
         onChangeConfigurationReq(const ocpp1_6::ChangeConfigurationReq& req) override {
             return changeConfiguration(req, false);
@@ -352,21 +244,19 @@ namespace chargelab {
                     };
                 }
 
-                unknown_keys = req.key.value();
-                settings_->visitSettings([&](SettingBase const& setting) {
-                    auto const metadata = setting.getMetadata();
-                    if (!metadata.config.isAllowOcppRead() && !metadata.config.isAllowOcppWrite())
-                        return;
-
-                    auto it = std::remove_if(unknown_keys.begin(), unknown_keys.end(), [&] (auto const& x) {
-                        return string::EqualsIgnoreCaseAscii(x.value(), metadata.id);
-                    });
-
-                    if (it != unknown_keys.end()) {
-                        include_keys.push_back(metadata.id);
-                        unknown_keys.erase(it, unknown_keys.end());
+                unknown_keys.clear();
+                for (auto const& key : req.key.value()) {
+                    auto const setting = settings_->findSetting(key.value());
+                    if (setting != nullptr) {
+                        auto const config = setting->getConfig();
+                        if (config.isAllowOcppRead() || config.isAllowOcppWrite()) {
+                            include_keys.push_back(setting->getId());
+                            continue;
+                        }
                     }
-                });
+
+                    unknown_keys.push_back(key);
+                }
             }
 
             auto settings = settings_;
@@ -374,24 +264,24 @@ namespace chargelab {
                     {[=](std::function<void(ocpp1_6::KeyValue const &)> const &visitor) {
                         auto const& keys = include_keys;
                         settings->visitSettings([&](SettingBase const& setting) {
-                            auto const metadata = setting.getMetadata();
-                            if (!metadata.config.isAllowOcppRead() && !metadata.config.isAllowOcppWrite())
+                            auto const config = setting.getConfig();
+                            if (!config.isAllowOcppRead() && !config.isAllowOcppWrite())
+                                return;
+                            if (!include_all_keys && std::find(keys.begin(), keys.end(), setting.getId()) == keys.end())
                                 return;
 
                             std::string value;
-                            if (metadata.config.isAllowOcppRead()) {
+                            if (config.isAllowOcppRead()) {
                                 value = setting.getValueAsString();
                             } else {
                                 value = kMaskedValue;
                             }
 
-                            if (include_all_keys || std::find(keys.begin(), keys.end(), setting.getId()) != keys.end()) {
-                                visitor(ocpp1_6::KeyValue{
-                                        {metadata.id},
-                                        !metadata.config.isAllowOcppWrite(),
-                                        std::move(value)
-                                });
-                            }
+                            visitor(ocpp1_6::KeyValue{
+                                    {setting.getId()},
+                                    !config.isAllowOcppWrite(),
+                                    std::move(value)
+                            });
                         });
                     }},
                     std::move(unknown_keys)
@@ -495,6 +385,145 @@ namespace chargelab {
         }
 
     private:
+        struct PendingBaseReport {
+            ocpp2_0::GetBaseReportRequest request;
+            ocpp2_0::DateTime generated_at;
+            int seq_no = 0;
+            std::size_t cursor = 0;
+
+            // The frame currently being sent, and the cursor to continue from once it's accepted
+            std::optional<ocpp2_0::NotifyReportRequest> frame = std::nullopt;
+            std::size_t next_cursor = 0;
+            bool send_refused = false;
+        };
+
+        // Builds the next NotifyReport frame, starting from the report cursor and stopping once the frame would
+        // exceed NotifyReportMaxBytes. Each element is serialized once to measure it, and the frame holds its elements
+        // directly so that validating and sizing it doesn't walk the settings again.
+        ocpp2_0::NotifyReportRequest nextReportFrame(PendingBaseReport& report) {
+            ocpp2_0::NotifyReportRequest frame {
+                    report.request.requestId,
+                    report.generated_at,
+                    true,
+                    report.seq_no,
+                    {}
+            };
+
+            auto const max_bytes = (std::size_t)settings_->NotifyReportMaxBytes.getValue();
+            std::size_t frame_bytes = kOcpp20NotifyReportRequestOverheadBytes + calculate_size(frame);
+
+            std::vector<ocpp2_0::ReportDataType> elements;
+            report.next_cursor = settings_->visitSettingsFrom(report.cursor, [&](SettingBase& setting) {
+                auto element = generateReportData(report.request.reportBase, setting);
+                if (!element.has_value())
+                    return true;
+
+                // Note: an element that is too large for an empty frame is still sent on its own
+                auto const element_bytes = calculate_size(element.value()) + 1; // Count the ',' separator
+                if (!elements.empty() && frame_bytes + element_bytes > max_bytes)
+                    return false;
+
+                frame_bytes += element_bytes;
+                elements.push_back(std::move(element.value()));
+                return true;
+            });
+
+            frame.tbc = report.next_cursor < settings_->settingCount();
+            frame.reportData = std::move(elements);
+            return frame;
+        }
+
+        static std::optional<ocpp2_0::ReportDataType> generateReportData(ocpp2_0::ReportBaseEnumType const& report_base, SettingBase const& setting) {
+            bool include_characteristics;
+            switch (report_base) {
+                default:
+                    CHARGELAB_LOG_MESSAGE(error) << "Unexpected report type in generator: " << report_base;
+                    return std::nullopt;
+
+                case ocpp2_0::ReportBaseEnumType::kConfigurationInventory:
+                    include_characteristics = true;
+                    if (!setting.getConfig().isAllowOcppWrite())
+                        return std::nullopt;
+                    break;
+
+                case ocpp2_0::ReportBaseEnumType::kFullInventory:
+                    include_characteristics = true;
+                    break;
+            }
+
+            auto model = setting.getModel20();
+            if (!model.has_value())
+                return std::nullopt;
+
+            auto element = ocpp2_0::ReportDataType {
+                    std::move(model->component_type),
+                    std::move(model->variable_type),
+                    setting.getAttributes2_0()
+            };
+
+            if (include_characteristics) {
+                element.variableCharacteristics = std::move(model->variable_characteristics);
+            }
+
+            return element;
+        }
+
+        ocpp2_0::SetVariableStatusEnumType setVariable(SettingBase const& setting, ocpp2_0::SetVariableDataType const& set_variable) {
+            if (set_variable.attributeType.has_value()) {
+                // TODO - right now everything defined is "actual"
+                if (set_variable.attributeType.value() != ocpp2_0::AttributeEnumType::kActual)
+                    return ocpp2_0::SetVariableStatusEnumType::kNotSupportedAttributeType;
+            }
+
+            auto const config = setting.getConfig();
+            if (!config.isAllowOcppWrite())
+                return ocpp2_0::SetVariableStatusEnumType::kRejected;
+
+            // A05.FR.02
+            if (&setting == &settings_->NetworkConfigurationPriority) {
+                bool missing_profile = false;
+                int target_security_profile = 0;
+                string::SplitVisitor(set_variable.attributeValue.value(), ",", [&](std::string const& text) {
+                    auto slot = string::ToInteger(text);
+                    if (!slot.has_value())
+                        return;
+
+                    auto const& profile = settings_->NetworkConnectionProfiles.getValue(slot.value());
+                    if (!profile.has_value()) {
+                        missing_profile = true;
+                        return;
+                    }
+
+                    target_security_profile = std::max(target_security_profile, profile->securityProfile);
+                });
+
+                // TODO: Is there a specific requirement for this?
+                if (target_security_profile < settings_->SecurityProfile.getValue())
+                    return ocpp2_0::SetVariableStatusEnumType::kRejected;
+
+                if (target_security_profile > settings_->SecurityProfile.getValue()) {
+                    // A05.FR.02
+                    if (target_security_profile >= 2 && settings_->InstalledCSMSRootCertificateCount.getValue() <= 0)
+                        return ocpp2_0::SetVariableStatusEnumType::kRejected;
+
+                    // A05.FR.03
+                    // TODO: Not relevant until we have something that can store a charging station certificate
+                    if (target_security_profile == 3)
+                        return ocpp2_0::SetVariableStatusEnumType::kRejected;
+                }
+            }
+
+            // TODO: move to update attribute?
+            if (!settings_->setSettingValue(setting.getId(), set_variable.attributeValue.value()))
+                return ocpp2_0::SetVariableStatusEnumType::kRejected;
+
+            if (config.isRebootRequired()) {
+                return ocpp2_0::SetVariableStatusEnumType::kRebootRequired;
+            } else {
+                return ocpp2_0::SetVariableStatusEnumType::kAccepted;
+            }
+        }
+
         template<int N>
         static bool ciEquals(ocpp2_0::IdentifierStringPrimitive<N> const& lhs, ocpp2_0::IdentifierStringPrimitive<N> const& rhs) {
             return string::EqualsIgnoreCaseAscii(lhs.value(), rhs.value());
@@ -514,7 +543,7 @@ namespace chargelab {
         std::shared_ptr<Settings> settings_;
         std::shared_ptr<SystemInterface> system_;
 
-        std::optional<ocpp2_0::GetBaseReportRequest> ocpp2_0_pending_base_report_ = std::nullopt;
+        std::optional<PendingBaseReport> ocpp2_0_pending_base_report_ = std::nullopt;
     };
 }
 
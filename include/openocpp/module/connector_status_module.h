@@ -172,6 +172,17 @@ namespace chargelab {
             }
         }
 
+        bool handlesRequest(ocpp2_0::ActionId const& action_id) const override {
+            switch (action_id) {
+                default:
+                    return false;
+
+                case ocpp2_0::ActionId::kChangeAvailability:
+                case ocpp2_0::ActionId::kTriggerMessage:
+                    return true;
+            }
+        }
+
         std::optional<ocpp2_0::ResponseToRequest<ocpp2_0::TriggerMessageResponse>>
         onTriggerMessageReq(const ocpp2_0::TriggerMessageRequest &req) override {
             if (req.requestedMessage != ocpp2_0::MessageTriggerEnumType::kStatusNotification)
@@ -281,6 +292,17 @@ namespace chargelab {
             }
         }
 
+        bool handlesRequest(ocpp1_6::ActionId const& action_id) const override {
+            switch (action_id) {
+                default:
+                    return false;
+
+                case ocpp1_6::ActionId::kChangeAvailability:
+                case ocpp1_6::ActionId::kTriggerMessage:
+                    return true;
+            }
+        }
+
         std::optional<ocpp1_6::ResponseToRequest<ocpp1_6::TriggerMessageRsp>>
         onTriggerMessageReq(const ocpp1_6::TriggerMessageReq &req) override {
             if (req.requestedMessage != ocpp1_6::MessageTrigger::kStatusNotification)
@@ -637,7 +659,7 @@ namespace chargelab {
 
                 if (connector_status.has_value()) {
                     auto const& status = getStatus2_0(entry.first, connector_status.value());
-                    availability_state.setValue(status.to_string());
+                    availability_state.setValue(std::string {status.to_string()});
                 }
 
                 // 2.13.4
@@ -31,11 +31,38 @@ namespace chargelab {
             }
         }
 
+        bool handlesRequest(ocpp1_6::ActionId const& action_id) const override {
+            switch (action_id) {
+                default:
+                    return false;
+
+                case ocpp1_6::ActionId::kClearCache:
+                case ocpp1_6::ActionId::kDataTransfer:
+                case ocpp1_6::ActionId::kTriggerMessage:
+                case ocpp1_6::ActionId::kUnlockConnector:
+                    return true;
+            }
+        }
+
         std::optional<ocpp1_6::ResponseToRequest<ocpp1_6::TriggerMessageRsp>>
         onTriggerMessageReq(const ocpp1_6::TriggerMessageReq&) override {
             return ocpp1_6::TriggerMessageRsp {ocpp1_6::TriggerMessageStatus::kNotImplemented};
         }
 
+        bool handlesRequest(ocpp2_0::ActionId const& action_id) const override {
+            switch (action_id) {
+                default:
+                    return false;
+
+                case ocpp2_0::ActionId::kClearCache:
+                case ocpp2_0::ActionId::kCustomerInformation:
+                case ocpp2_0::ActionId::kDataTransfer:
+                case ocpp2_0::ActionId::kTriggerMessage:
+                case ocpp2_0::ActionId::kUnlockConnector:
+                    return true;
+            }
+        }
+
         std::optional<ocpp2_0::ResponseToRequest<ocpp2_0::TriggerMessageResponse>>
         onTriggerMessageReq(const ocpp2_0::TriggerMessageRequest&) override {
             // F06.FR.08
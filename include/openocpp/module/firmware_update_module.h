@@ -78,6 +78,17 @@ namespace chargelab {
         }
 
     private:
+        bool handlesRequest(ocpp1_6::ActionId const& action_id) const override {
+            switch (action_id) {
+                default:
+                    return false;
+
+                case ocpp1_6::ActionId::kTriggerMessage:
+                case ocpp1_6::ActionId::kUpdateFirmware:
+                    return true;
+            }
+        }
+
         std::optional<ocpp1_6::ResponseToRequest<ocpp1_6::UpdateFirmwareRsp>>
         onUpdateFirmwareReq(const ocpp1_6::UpdateFirmwareReq &req) override {
             if (operation_.has_value()) {
@@ -127,6 +138,17 @@ namespace chargelab {
             return ocpp1_6::UpdateFirmwareRsp {};
         }
 
+        bool handlesRequest(ocpp2_0::ActionId const& action_id) const override {
+            switch (action_id) {
+                default:
+                    return false;
+
+                case ocpp2_0::ActionId::kTriggerMessage:
+                case ocpp2_0::ActionId::kUpdateFirmware:
+                    return true;
+            }
+        }
+
         std::optional<ocpp2_0::ResponseToRequest<ocpp2_0::UpdateFirmwareResponse>>
         onUpdateFirmwareReq(const ocpp2_0::UpdateFirmwareRequest &request) override {
             // Note: there doesn't appear to be any specific requirement here in the 2.0.1 specification and this is
@@ -8,6 +8,10 @@
 #include "openocpp/interface/platform_interface.h"
 #include "openocpp/common/ring_buffer.h"
 #include "openocpp/common/serialization.h"
+#include "openocpp/common/compressed_queue.h"
+#include "openocpp/common/stream.h"
+
+#include <mutex>
 
 namespace chargelab {
     namespace detail {
@@ -24,6 +28,9 @@ namespace chargelab {
             int max_index = 0;
             int last_index = 0;
 
+            // Note: resumes the upload where the previous step left off rather than re-reading the queue
+            CompressedQueueRawZLib::Cursor cursor {};
+
             std::optional<ocpp2_0::UploadLogStatusEnumType> last_status2_0 = std::nullopt;
             std::optional<SteadyPointMillis> first_attempt = std::nullopt;
         };
@@ -101,6 +108,8 @@ namespace chargelab {
 #endif
                 merged_message += message;
 
+                // Note: the logging backend calls listeners from its own thread
+                std::lock_guard lock {log_buffer_mutex_};
                 log_buffer_.pushBack(detail::LogLine{
                         index_++,
                         platform_->systemClockNow(),
@@ -118,7 +127,23 @@ namespace chargelab {
             CHARGELAB_LOG_MESSAGE(info) << "Size of buffer: " << sizeof(log_buffer_);
         }
 
+        ~GetLogsModule() override {
+            logging::UnregisterLoggingListener(listener_);
+        }
+
     private:
+        std::optional<SteadyPointMillis> nextWakeup(SteadyPointMillis now) override {
+            if (!operation_.has_value())
+                return std::nullopt;
+
+            // Note: uploads are written in time slices, so the next slice is due immediately
+            if (operation_->connection != nullptr || !operation_->first_attempt.has_value())
+                return now;
+
+            auto const interval = optional::GetOrDefault(operation_->request.retryInterval, 0);
+            return (SteadyPointMillis)(operation_->first_attempt.value() + (std::int64_t)interval*operation_->total_failures*1000);
+        }
+
         void runUnconditionally() override {
             reportQueueSize();
             uploadLogs();
@@ -127,13 +152,20 @@ namespace chargelab {
 
         void flushLogMessages() {
             for (int i=0; i < 10; i++) {
-                auto next = log_buffer_.popFront();
+                std::optional<detail::LogLine> next;
+                {
+                    std::lock_guard lock {log_buffer_mutex_};
+                    next = log_buffer_.popFront();
+                }
+
                 if (!next.has_value())
                     break;
 
                 log_queue_.pushBack(std::move(next.value()));
             }
 
+            // Note: this rewrites the queue, in which case an upload in progress resumes from the front and skips
+            // lines up to last_index
             while (log_queue_.totalBytes() > kMaxRetainedLogMessagesBytes) {
                 std::size_t total_removed = 0;
                 log_queue_.removeIf([&] (std::string_view const& text, detail::LogLine const&) {
@@ -146,6 +178,17 @@ namespace chargelab {
             }
         }
 
+        bool handlesRequest(ocpp2_0::ActionId const& action_id) const override {
+            switch (action_id) {
+                default:
+                    return false;
+
+                case ocpp2_0::ActionId::kGetLog:
+                case ocpp2_0::ActionId::kTriggerMessage:
+                    return true;
+            }
+        }
+
         std::optional<ocpp2_0::ResponseToRequest<ocpp2_0::GetLogResponse>>
         onGetLogReq(const ocpp2_0::GetLogRequest& request) override {
             if (!uri::parseHttpUri(request.log.remoteLocation.value()).has_value()) {
@@ -185,6 +228,10 @@ namespace chargelab {
             return ocpp2_0::GetLogResponse {status, filename};
         }
 
+        bool handlesRequest(ocpp1_6::ActionId const& action_id) const override {
+            return action_id == ocpp1_6::ActionId::kTriggerMessage;
+        }
+
         std::optional<ocpp1_6::ResponseToRequest<ocpp1_6::TriggerMessageRsp>>
         onTriggerMessageReq(const ocpp1_6::TriggerMessageReq &req) override {
             (void)req;
@@ -250,64 +297,61 @@ namespace chargelab {
 
             checkAndUpdateStatus(ocpp2_0::UploadLogStatusEnumType::kUploading);
 
-            bool wrote_first = false;
             bool ran_out_of_time = false;
             auto const start_ts = platform_->steadyClockNow();
             {
                 bool only_security_logs = operation_->request.logType == ocpp2_0::LogEnumType::kSecurityLog;
-                log_queue_.visit([&] (std::string_view const&, detail::LogLine const& line) {
-                    if (ran_out_of_time)
-                        return;
+                log_queue_.visitFrom(operation_->cursor, [&] (std::string_view const&, detail::LogLine const& line) {
                     if (operation_->connection == nullptr)
-                        return;
+                        return false;
                     if (operation_->bytes_written >= operation_->content_length)
-                        return;
-
-                    if (wrote_first) {
-                        if (platform_->steadyClockNow() - start_ts > kUploadStepMaxTimeMillis) {
-                            ran_out_of_time = true;
-                            return;
-                        }
-                    }
+                        return false;
 
                     auto const& log = operation_->request.log;
                     if (log.oldestTimestamp.has_value() && log.oldestTimestamp->isAfter(line.timestamp, false))
-                        return;
+                        return true;
                     if (log.latestTimestamp.has_value() && log.latestTimestamp->isBefore(line.timestamp, false))
-                        return;
+                        return true;
                     if (only_security_logs && line.message.find("[security]") == std::string::npos)
-                        return;
+                        return true;
 
                     // Note: allowing for integer overflow; checking if message_index < min_index
                     if (line.message_index - operation_->min_index < 0)
-                        return;
+                        return true;
 
                     // Note: allowing for integer overflow; checking if message_index > max_index
                     if (line.message_index - operation_->max_index > 0)
-                        return;
+                        return false;
 
-                    // Note: allowing for integer overflow; checking if message_index <= last_index
+                    // Note: allowing for integer overflow; checking if message_index <= last_index. Lines may be
+                    // visited again if the queue was rewritten since the previous step.
                     if (line.message_index - operation_->last_index <= 0)
-                        return;
+                        return true;
 
                     // Truncate the message to fit in the original content_length
-                    auto message = renderLine(line);
-                    if (operation_->bytes_written + message.size() > operation_->content_length) {
-                        auto const truncated = operation_->bytes_written + message.size() - operation_->content_length;
-                        message.resize(std::min(std::max((std::size_t)0, truncated), message.size()));
-                    }
+                    renderLine(line);
+                    auto size = render_buffer_.str().size();
+                    if (operation_->bytes_written + size > operation_->content_length)
+                        size = operation_->content_length - operation_->bytes_written;
 
-                    if (!operation_->connection->write(message.data(), message.size())) {
+                    if (!operation_->connection->write(render_buffer_.str().data(), size)) {
                         CHARGELAB_LOG_MESSAGE(info) << "Failed writing payload at " << operation_->bytes_written << " bytes";
                         checkAndUpdateStatus(ocpp2_0::UploadLogStatusEnumType::kUploadFailure);
                         operation_->total_failures++;
                         operation_->connection = nullptr;
-                        return;
+                        return false;
                     }
 
                     operation_->last_index = line.message_index;
-                    operation_->bytes_written += message.size();
-                    wrote_first = true;
+                    operation_->bytes_written += size;
+
+                    // Note: at least one line is written per step; the cursor resumes after it on the next step
+                    if (platform_->steadyClockNow() - start_ts > kUploadStepMaxTimeMillis) {
+                        ran_out_of_time = true;
+                        return false;
+                    }
+
+                    return true;
                 });
             }
 
@@ -364,13 +408,16 @@ namespace chargelab {
             operation_ = std::nullopt;
         }
 
-        static std::string renderLine(detail::LogLine const& line) {
-            std::string result;
-            result += "[" + write_json_to_string(ocpp2_0::DateTime{line.timestamp}) + "] ";
-            result += "[" + write_json_to_string(line.level) + "] ";
-            result += line.message;
-            result += "\n";
-            return result;
+        // Note: renders into render_buffer_, which is reused between lines to avoid allocating for each line
+        void renderLine(detail::LogLine const& line) {
+            render_buffer_.clear();
+            render_buffer_.write("[", 1);
+            write_json(render_buffer_, ocpp2_0::DateTime{line.timestamp});
+            render_buffer_.write("] [", 3);
+            write_json(render_buffer_, line.level);
+            render_buffer_.write("] ", 2);
+            render_buffer_.write(line.message.data(), line.message.size());
+            render_buffer_.write("\n", 1);
         }
 
         bool checkOrRetryConnection() {
@@ -425,7 +472,8 @@ namespace chargelab {
                             max_index = line.message_index;
                     }
 
-                    content_length += renderLine(line).size();
+                    renderLine(line);
+                    content_length += render_buffer_.str().size();
                 });
             }
 
@@ -434,6 +482,7 @@ namespace chargelab {
             operation_->min_index = optional::GetOrDefault(min_index, 0);
             operation_->max_index = optional::GetOrDefault(max_index, 0);
             operation_->last_index = optional::GetOrDefault(min_index, 0) - 1;
+            operation_->cursor = {};
 
             // N01.FR.19
             operation_->connection->setHeader("Content-Type", "text/plain");
@@ -483,9 +532,11 @@ namespace chargelab {
         std::optional<detail::UploadState> operation_ = std::nullopt;
         std::optional<SteadyPointMillis> last_queue_size_report_ = std::nullopt;
         RingBuffer<detail::LogLine, kMaxRingBufferSize> log_buffer_;
+        std::mutex log_buffer_mutex_;
 
         std::atomic<int> index_ = 0;
         CompressedQueueCustom<detail::LogLine, detail::LogLineSerializer> log_queue_;
+        stream::StringWriter render_buffer_;
     };
 }
 
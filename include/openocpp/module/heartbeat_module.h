@@ -26,6 +26,16 @@ namespace chargelab {
         }
 
     public:
+        std::optional<SteadyPointMillis> nextWakeup(SteadyPointMillis now) override {
+            // Note: if the last heartbeat couldn't be sent (e.g. before registration) it's retried on the idle interval
+            if (send_failed_)
+                return std::nullopt;
+            if (force_heartbeat_ && !pending_heartbeat_req_.operationInProgress())
+                return now;
+
+            return pending_heartbeat_req_.idleDeadline(settings_->HeartbeatInterval.getValue());
+        }
+
         void runStep(ocpp1_6::OcppRemote &remote) override {
             if (!pending_heartbeat_req_.wasIdleFor(settings_->HeartbeatInterval.getValue())) {
                 if (!force_heartbeat_ || pending_heartbeat_req_.operationInProgress())
@@ -36,6 +46,7 @@ namespace chargelab {
                     settings_->DefaultMessageTimeout.getValue(),
                     remote.sendHeartbeatReq({})
             );
+            send_failed_ = pending_heartbeat_req_ == kNoOperation;
             force_heartbeat_ = false;
         }
 
@@ -72,6 +83,7 @@ namespace chargelab {
                     settings_->DefaultMessageTimeout.getValue(),
                     remote.sendHeartbeatReq({})
             );
+            send_failed_ = pending_heartbeat_req_ == kNoOperation;
             force_heartbeat_ = false;
         }
 
@@ -98,20 +110,30 @@ namespace chargelab {
             }
         }
 
+        bool handlesRequest(ocpp1_6::ActionId const& action_id) const override {
+            return action_id == ocpp1_6::ActionId::kTriggerMessage;
+        }
+
         std::optional<ocpp1_6::ResponseToRequest<ocpp1_6::TriggerMessageRsp>>
         onTriggerMessageReq(const ocpp1_6::TriggerMessageReq &req) override {
             if (req.requestedMessage == ocpp1_6::MessageTrigger::kHeartbeat) {
                 force_heartbeat_ = true;
+                send_failed_ = false;
                 return ocpp1_6::TriggerMessageRsp {ocpp1_6::TriggerMessageStatus::kAccepted};
             }
 
             return std::nullopt;
         }
 
+        bool handlesRequest(ocpp2_0::ActionId const& action_id) const override {
+            return action_id == ocpp2_0::ActionId::kTriggerMessage;
+        }
+
         std::optional<ocpp2_0::ResponseToRequest<ocpp2_0::TriggerMessageResponse>>
         onTriggerMessageReq(const ocpp2_0::TriggerMessageRequest &request) override {
             if (request.requestedMessage == ocpp2_0::MessageTriggerEnumType::kHeartbeat) {
                 force_heartbeat_ = true;
+                send_failed_ = false;
                 return ocpp2_0::TriggerMessageResponse {ocpp2_0::TriggerMessageStatusEnumType::kAccepted};
             }
 
@@ -123,6 +145,7 @@ namespace chargelab {
         std::shared_ptr<SystemInterface> system_interface_;
         OperationHolder<std::string> pending_heartbeat_req_;
         bool force_heartbeat_ = false;
+        bool send_failed_ = false;
     };
 }
 
@@ -11,6 +11,13 @@
 #include <string>
 #include <optional>
 #include <unordered_set>
+#include <vector>
+#include <algorithm>
+#include <map>
+#include <numeric>
+#include <random>
+#include <limits>
+#include <type_traits>
 
 namespace chargelab {
     CHARGELAB_JSON_ENUM(PendingMessageType,
@@ -53,11 +60,19 @@ namespace chargelab {
             std::optional<ocpp2_0::ActionId> action_id2_0;
 
             int attempts = 0;
+
+            // Note: only set for records in the offline queue (see PendingPayloadCodec); the live queue and the records
+            // saved as JSON always hold JSON payloads.
+            bool binary_payload = false;
             CHARGELAB_JSON_INTRUSIVE(PendingMessageWrapper, unique_id, payload, policy, action_id1_6, action_id2_0, attempts)
         };
 
+        struct PendingMessageSummary;
+
         class PendingMessageSerializer {
         public:
+            using summary_type = PendingMessageSummary;
+
             static std::optional<PendingMessageWrapper> read(std::string_view const& text) {
                 PendingMessageWrapper result;
                 std::optional<int> index = 0;
@@ -76,6 +91,10 @@ namespace chargelab {
                 index = readPrimitive(text, index, result.action_id2_0);
                 index = readPrimitive(text, index, result.attempts);
 
+                // Note: records written before binary payloads were introduced end here
+                if (index.has_value() && (std::size_t)index.value() < text.size())
+                    index = readPrimitive(text, index, result.binary_payload);
+
                 if (!index.has_value())
                     return std::nullopt;
 
@@ -98,9 +117,435 @@ namespace chargelab {
                 writePrimitive(result, wrapper.action_id1_6);
                 writePrimitive(result, wrapper.action_id2_0);
                 writePrimitive(result, wrapper.attempts);
+                writePrimitive(result, wrapper.binary_payload);
+                return result;
+            }
+
+            /**
+             * Reads the unique ID, priority and group ID of a record without copying its payload.
+             */
+            static bool readKey(std::string_view const& text, int64_t& unique_id, int& priority, std::optional<uint64_t>& group_id) {
+                std::optional<std::size_t> index = 0;
+                int32_t payload_size = 0;
+                index = readPrimitive(text, index, unique_id);
+                index = readPrimitive(text, index, payload_size);
+                if (!index.has_value() || payload_size < 0)
+                    return false;
+
+                PendingMessageType message_type;
+                int retry_interval_seconds;
+                int message_attempts;
+                index = readPrimitive(text, index.value() + payload_size, message_type);
+                index = readPrimitive(text, index, group_id);
+                index = readPrimitive(text, index, retry_interval_seconds);
+                index = readPrimitive(text, index, message_attempts);
+                index = readPrimitive(text, index, priority);
+                return index.has_value();
+            }
+        };
+
+        struct PendingMessageGroupStats {
+            int priority = 0;
+            std::optional<uint64_t> group_id;
+            int records = 0;
+            int bytes = 0;
+            CHARGELAB_JSON_INTRUSIVE(PendingMessageGroupStats, priority, group_id, records, bytes)
+        };
+
+        /**
+         * Summary of the records in one block of the offline queue, updated as records are added and removed so that
+         * the queue doesn't need to be decompressed to find what it holds. Saved alongside each block.
+         */
+        struct PendingMessageSummary {
+            int records = 0;
+            int bytes = 0;
+            int min_priority = 0;
+            int max_priority = 0;
+            std::vector<PendingMessageGroupStats> groups;
+
+            // Note: bounds of the unique IDs added to the block; these aren't narrowed as records are removed
+            int64_t min_unique_id = std::numeric_limits<int64_t>::max();
+            int64_t max_unique_id = std::numeric_limits<int64_t>::min();
+            CHARGELAB_JSON_INTRUSIVE(
+                    PendingMessageSummary,
+                    records,
+                    bytes,
+                    min_priority,
+                    max_priority,
+                    groups,
+                    min_unique_id,
+                    max_unique_id
+            )
+
+            void add(std::string_view const& record) {
+                update(record, 1);
+            }
+
+            void remove(std::string_view const& record) {
+                update(record, -1);
+            }
+
+        private:
+            void update(std::string_view const& record, int sign) {
+                int64_t unique_id = 0;
+                int priority = 0;
+                std::optional<uint64_t> group_id;
+                if (!PendingMessageSerializer::readKey(record, unique_id, priority, group_id)) {
+                    CHARGELAB_LOG_MESSAGE(warning) << "Failed reading pending message key";
+                    return;
+                }
+
+                if (sign > 0) {
+                    min_unique_id = std::min(min_unique_id, unique_id);
+                    max_unique_id = std::max(max_unique_id, unique_id);
+                }
+
+                auto it = std::find_if(groups.begin(), groups.end(), [&](PendingMessageGroupStats const& x) {
+                    return x.priority == priority && x.group_id == group_id;
+                });
+                if (it == groups.end()) {
+                    if (sign < 0)
+                        return;
+
+                    it = groups.insert(groups.end(), PendingMessageGroupStats {priority, group_id});
+                }
+
+                records += sign;
+                bytes += sign*(int)record.size();
+                it->records += sign;
+                it->bytes += sign*(int)record.size();
+                if (it->records <= 0)
+                    groups.erase(it);
+
+                min_priority = groups.empty() ? 0 : std::numeric_limits<int>::max();
+                max_priority = groups.empty() ? 0 : std::numeric_limits<int>::min();
+                for (auto const& x : groups) {
+                    min_priority = std::min(min_priority, x.priority);
+                    max_priority = std::max(max_priority, x.priority);
+                }
+            }
+        };
+
+        using PendingMessageQueue = CompressedQueueCustom<PendingMessageWrapper, PendingMessageSerializer>;
+
+        struct PendingMessageEviction {
+            std::size_t records = 0;
+            std::size_t decompressed_bytes = 0;
+        };
+
+        struct PendingBlockLocation {
+            int64_t segment = 0;
+            int index = 0;
+            CHARGELAB_JSON_INTRUSIVE(PendingBlockLocation, segment, index)
+        };
+
+        /**
+         * Saved in place of the offline queue blocks when they're kept in segment files: where each block is, in queue
+         * order, and how many records were consumed from the first one.
+         */
+        struct PendingSegmentManifest {
+            std::vector<PendingBlockLocation> blocks;
+            std::vector<int64_t> dropped_segments;
+            int64_t next_segment = 0;
+            int front_consumed_records = 0;
+            CHARGELAB_JSON_INTRUSIVE(PendingSegmentManifest, blocks, dropped_segments, next_segment, front_consumed_records)
+        };
+
+        /**
+         * Drops up to target_records of the records with the highest priority value, keeping the first and last record
+         * of each group where there's anything else to drop. The records are taken from a single block, picked at
+         * random weighted by the number of records it could drop, so only that block is decompressed and rewritten.
+         */
+        template <typename Visitor>
+        PendingMessageEviction evictPendingMessages(
+                PendingMessageQueue& queue,
+                std::default_random_engine& random_engine,
+                int target_records,
+                Visitor&& on_dropped
+        ) {
+            using key_type = std::pair<int, std::optional<uint64_t>>;
+
+            std::vector<PendingMessageSummary const*> summaries;
+            std::map<key_type, int> totals;
+            queue.visitSummaries([&](PendingMessageSummary const& summary) {
+                summaries.push_back(&summary);
+                for (auto const& x : summary.groups)
+                    totals[std::make_pair(x.priority, x.group_id)] += x.records;
+            });
+
+            if (totals.empty())
+                return {};
+
+            int max_priority = std::numeric_limits<int>::min();
+            for (auto const& x : totals)
+                max_priority = std::max(x.first.first, max_priority);
+
+            bool delete_safely = false;
+            for (auto const& x : totals) {
+                if (!x.first.second.has_value() || (x.first.first == max_priority && x.second > 2)) {
+                    delete_safely = true;
+                    break;
+                }
+            }
+
+            // Candidates per block, where seen holds the records of each group in the blocks before it
+            auto const candidates = [&](PendingMessageSummary const& summary, std::map<uint64_t, int>& seen) {
+                int result = 0;
+                for (auto const& x : summary.groups) {
+                    if (x.priority != max_priority)
+                        continue;
+
+                    result += x.records;
+                    if (!x.group_id.has_value() || !delete_safely)
+                        continue;
+
+                    auto& before = seen[x.group_id.value()];
+                    auto const total = totals[std::make_pair(x.priority, x.group_id)];
+                    if (before == 0)
+                        result--;
+                    if (total > 1 && before + x.records == total)
+                        result--;
+
+                    before += x.records;
+                }
+
+                return result;
+            };
+
+            std::vector<int> block_candidates;
+            int total_candidates = 0;
+            {
+                std::map<uint64_t, int> seen;
+                for (auto const& x : summaries) {
+                    block_candidates.push_back(candidates(*x, seen));
+                    total_candidates += block_candidates.back();
+                }
+            }
+
+            if (total_candidates <= 0)
+                return {};
+
+            std::size_t block = 0;
+            std::map<uint64_t, int> counter;
+            {
+                auto pick = std::uniform_int_distribution<int>(0, total_candidates-1)(random_engine);
+                while (pick >= block_candidates[block]) {
+                    pick -= block_candidates[block];
+                    candidates(*summaries[block], counter);
+                    block++;
+                }
+            }
+
+            std::vector<int> ordinals(block_candidates[block]);
+            std::iota(ordinals.begin(), ordinals.end(), 0);
+            std::shuffle(ordinals.begin(), ordinals.end(), random_engine);
+            std::vector<bool> selected(ordinals.size(), false);
+            for (std::size_t i=0; i < ordinals.size() && i < (std::size_t)target_records; i++)
+                selected[ordinals[i]] = true;
+
+            PendingMessageEviction result;
+            std::size_t ordinal = 0;
+            queue.removeIfInBlock(block, [&](std::string_view const& text, PendingMessageWrapper const& wrapper) {
+                if (wrapper.policy.priority != max_priority)
+                    return false;
+
+                if (wrapper.policy.group_id.has_value() && delete_safely) {
+                    auto const index = counter[wrapper.policy.group_id.value()]++;
+                    auto const total = totals[std::make_pair(wrapper.policy.priority, wrapper.policy.group_id)];
+                    if (index == 0 || index == total-1)
+                        return false;
+                }
+
+                if (ordinal >= selected.size() || !selected[ordinal++])
+                    return false;
+
+                result.records++;
+                result.decompressed_bytes += text.size();
+                on_dropped(wrapper);
+                return true;
+            });
+
+            return result;
+        }
+
+        template <typename T>
+        struct PendingPayloadType {
+            using type = T;
+        };
+
+        template <typename T, typename = void>
+        struct HasTransactionId : std::false_type {};
+
+        template <typename T>
+        struct HasTransactionId<T, std::void_t<decltype(std::declval<T&>().transactionId = 0)>> : std::true_type {};
+
+        template <typename T, typename = void>
+        struct HasSeqNo : std::false_type {};
+
+        template <typename T>
+        struct HasSeqNo<T, std::void_t<decltype(std::declval<T&>().seqNo = 0)>> : std::true_type {};
+
+        /**
+         * Payloads of the transaction messages, which make up most of the offline queue, are stored there using the
+         * binary encoding from helpers/binary.h and are only written as JSON when they're sent. Other messages keep
+         * their JSON payload.
+         */
+        class PendingPayloadCodec {
+        public:
+            static constexpr char kBinaryVersion = 1;
+
+            template <typename T>
+            static constexpr bool kBinaryType =
+                    std::is_same_v<T, ocpp1_6::StartTransactionReq> ||
+                    std::is_same_v<T, ocpp1_6::StopTransactionReq> ||
+                    std::is_same_v<T, ocpp1_6::MeterValuesReq> ||
+                    std::is_same_v<T, ocpp2_0::TransactionEventRequest>;
+
+            /**
+             * Calls the visitor with a PendingPayloadType for the request type of the message, if it's one of the
+             * kBinaryType types; returns false otherwise.
+             */
+            template <typename Visitor>
+            static bool visitBinaryType(PendingMessageWrapper const& wrapper, Visitor&& visitor) {
+                if (wrapper.action_id1_6.has_value()) {
+                    switch (wrapper.action_id1_6.value()) {
+                        case ocpp1_6::ActionId::kStartTransaction:
+                            visitor(PendingPayloadType<ocpp1_6::StartTransactionReq> {});
+                            return true;
+                        case ocpp1_6::ActionId::kStopTransaction:
+                            visitor(PendingPayloadType<ocpp1_6::StopTransactionReq> {});
+                            return true;
+                        case ocpp1_6::ActionId::kMeterValues:
+                            visitor(PendingPayloadType<ocpp1_6::MeterValuesReq> {});
+                            return true;
+                        default:
+                            return false;
+                    }
+                }
+
+                if (wrapper.action_id2_0.has_value()) {
+                    switch (wrapper.action_id2_0.value()) {
+                        case ocpp2_0::ActionId::kTransactionEvent:
+                            visitor(PendingPayloadType<ocpp2_0::TransactionEventRequest> {});
+                            return true;
+                        default:
+                            return false;
+                    }
+                }
+
+                return false;
+            }
+
+            template <typename T>
+            static void write(PendingMessageWrapper& wrapper, T const& request) {
+                if constexpr (kBinaryType<T>) {
+                    wrapper.payload.assign(1, kBinaryVersion);
+                    binary::Writer writer {wrapper.payload};
+                    binary::WriteValue<T>::write_binary(writer, request);
+                    wrapper.binary_payload = true;
+                } else {
+                    wrapper.payload = write_json_to_string(request);
+                    wrapper.binary_payload = false;
+                }
+            }
+
+            template <typename T>
+            static std::optional<T> read(PendingMessageWrapper const& wrapper) {
+                if (!wrapper.binary_payload)
+                    return read_json_from_string<T>(wrapper.payload);
+                if (wrapper.payload.empty() || wrapper.payload[0] != kBinaryVersion)
+                    return std::nullopt;
+
+                return read_binary_from_string<T>(std::string_view {wrapper.payload}.substr(1));
+            }
+
+            /**
+             * Converts a JSON payload to the binary encoding if it's one of the kBinaryType types.
+             */
+            static void toBinary(PendingMessageWrapper& wrapper) {
+                if (wrapper.binary_payload)
+                    return;
+
+                visitBinaryType(wrapper, [&](auto tag) {
+                    using type = typename decltype(tag)::type;
+                    auto const request = read_json_from_string<type>(wrapper.payload);
+                    if (request.has_value())
+                        write(wrapper, request.value());
+                });
+            }
+
+            /**
+             * Returns the JSON payload to send, after applying the patch to the decoded request for binary payloads;
+             * nullopt if the payload couldn't be decoded.
+             */
+            template <typename Patch>
+            static std::optional<std::string> toJson(PendingMessageWrapper const& wrapper, Patch&& patch) {
+                std::optional<std::string> result = std::nullopt;
+                visitBinaryType(wrapper, [&](auto tag) {
+                    using type = typename decltype(tag)::type;
+                    auto request = read<type>(wrapper);
+                    if (!request.has_value())
+                        return;
+
+                    patch(request.value());
+                    result = write_json_to_string(request.value());
+                });
+
                 return result;
             }
         };
+
+        /**
+         * Merges meter value requests that are queued while the station is offline, so that each queued request can
+         * carry several samples.
+         */
+        template <typename T>
+        struct PendingBatch {
+            static constexpr bool kSupported = false;
+        };
+
+        template <>
+        struct PendingBatch<ocpp1_6::MeterValuesReq> {
+            static constexpr bool kSupported = true;
+
+            static std::size_t entries(ocpp1_6::MeterValuesReq const& request) {
+                return request.meterValue.size();
+            }
+
+            static bool merge(ocpp1_6::MeterValuesReq& batch, ocpp1_6::MeterValuesReq const& request) {
+                if (batch.connectorId != request.connectorId || batch.transactionId != request.transactionId)
+                    return false;
+
+                batch.meterValue.insert(batch.meterValue.end(), request.meterValue.begin(), request.meterValue.end());
+                return true;
+            }
+        };
+
+        template <>
+        struct PendingBatch<ocpp2_0::TransactionEventRequest> {
+            static constexpr bool kSupported = true;
+
+            static std::size_t entries(ocpp2_0::TransactionEventRequest const& request) {
+                return request.meterValue.has_value() ? request.meterValue->size() : 0;
+            }
+
+            // Note: the merged event keeps the header (timestamp, charging state) of the first request
+            static bool merge(ocpp2_0::TransactionEventRequest& batch, ocpp2_0::TransactionEventRequest const& request) {
+                if (batch.eventType != ocpp2_0::TransactionEventEnumType::kUpdated || request.eventType != batch.eventType)
+                    return false;
+                if (batch.triggerReason != request.triggerReason || batch.offline != request.offline)
+                    return false;
+                if (batch.transactionInfo.transactionId != request.transactionInfo.transactionId || batch.evse != request.evse)
+                    return false;
+                if (batch.idToken.has_value() || request.idToken.has_value())
+                    return false;
+                if (!batch.meterValue.has_value() || !request.meterValue.has_value())
+                    return false;
+
+                batch.meterValue->insert(batch.meterValue->end(), request.meterValue->begin(), request.meterValue->end());
+                return true;
+            }
+        };
     }
 
     class PendingMessagesModule : public ServiceStatefulGeneral {
@@ -109,8 +554,24 @@ namespace chargelab {
         static constexpr int kMaxLiveMessages = 5;
         static constexpr int kOfflineSizeLimitBytes = 10*1024;
         static constexpr int kTargetDeleteRecordCount = 10;
+        static constexpr int kBlockSummaryMarker = -2;
+        static constexpr int kManifestMarker = -3;
+        static constexpr int kBlocksPerSegment = 4;
+        static constexpr int kManifestBytesPerBlock = 32;
         static constexpr int kMaxStorageBlockSize = 50*1024;
         static constexpr int kFlushToDiskFrequencyMillis = 30*60*1000; // half hour
+        static constexpr int kMaxOfflineLookaheadRecords = 50;
+
+        // One slot per message that may be in flight at a time, as configured by MaxInFlightMessages
+        struct InFlightMessage {
+            explicit InFlightMessage(std::shared_ptr<SystemInterface> const& system)
+                : operation {system}
+            {
+            }
+
+            OperationHolder<std::string> operation;
+            std::optional<detail::PendingMessageWrapper> message = std::nullopt;
+        };
 
     public:
         using saved_message_supplier = std::function<void(std::function<void(detail::PendingMessageWrapper const&)> const&)>;
@@ -124,12 +585,11 @@ namespace chargelab {
             : settings_ {std::move(settings)},
               system_ {system},
               storage_ {std::move(storage)},
-              random_engine_ {std::random_device{}()},
-              // TODO: Review this; timeout will not change until reboot
-              request_operation_ {system}
+              random_engine_ {std::random_device{}()}
         {
             std::uniform_int_distribution<int64_t> distribution(0, std::numeric_limits<int64_t>::max());
             request_id_ = distribution(random_engine_);
+            segmented_storage_ = segmentStorage(0) != nullptr;
             loadFromStorage();
             // Clear transaction_ids_ and sequence_ids_ if offline_queue_ and live_queue_ are both empty
             if (offline_queue_.empty() && live_queue_.empty()) {
@@ -186,41 +646,55 @@ namespace chargelab {
 
         template<typename T>
         std::string sendRequest1_6(T const& request, PendingMessagePolicy policy = PendingMessagePolicy{}) {
-            detail::PendingMessageWrapper wrapper = generateRequest1_6(request, policy);
-            if (activeGroupsContains(policy.group_id)) {
-                offline_queue_.pushBack(wrapper);
-                pending_messages_changed_ = true;
-            } else {
-                live_queue_.push_back(wrapper);
-            }
-
-            if (policy.must_flush_to_disk)
-                must_flush_to_disk_ = true;
-
-            return std::to_string(wrapper.unique_id);
+            return sendRequest(
+                    detail::PendingMessageWrapper {request_id_++, {}, policy, T::kActionId, std::nullopt},
+                    request
+            );
         }
 
         template<typename T>
         std::string sendRequest2_0(T const& request, PendingMessagePolicy const& policy) {
-            detail::PendingMessageWrapper wrapper = generateRequest2_0(request, policy);
-
-            if (activeGroupsContains(policy.group_id)) {
-                offline_queue_.pushBack(wrapper);
-                pending_messages_changed_ = true;
-            } else {
-                live_queue_.push_back(wrapper);
-            }
+            return sendRequest(
+                    detail::PendingMessageWrapper {request_id_++, {}, policy, std::nullopt, T::kActionId},
+                    request
+            );
+        }
 
-            if (policy.must_flush_to_disk)
-                must_flush_to_disk_ = true;
+        /**
+         * Queues a meter value request taken while the station is offline, merging it into the previous request in its
+         * group when possible so that a long outage doesn't leave one request per sample to send on reconnecting. A
+         * merged request holds at most max_entries meter values and max_bytes of JSON.
+         *
+         * The open request of a group is queued when another message is sent for the group, when it's full, or once
+         * a message is sent successfully again.
+         */
+        template<typename T>
+        std::string sendBatchedRequest1_6(T const& request, PendingMessagePolicy const& policy, std::size_t max_entries, std::size_t max_bytes) {
+            return sendBatchedRequest(
+                    detail::PendingMessageWrapper {request_id_++, {}, policy, T::kActionId, std::nullopt},
+                    request,
+                    max_entries,
+                    max_bytes
+            );
+        }
 
-            return std::to_string(wrapper.unique_id);
+        template<typename T>
+        std::string sendBatchedRequest2_0(T const& request, PendingMessagePolicy const& policy, std::size_t max_entries, std::size_t max_bytes) {
+            return sendBatchedRequest(
+                    detail::PendingMessageWrapper {request_id_++, {}, policy, std::nullopt, T::kActionId},
+                    request,
+                    max_entries,
+                    max_bytes
+            );
         }
 
+        // Note: payloads in the offline queue may use the binary encoding; see detail::PendingPayloadCodec
         template <typename Visitor>
         void visitPending(Visitor&& visitor) {
             for (auto const& x : live_queue_)
                 visitor(x.policy, x.payload);
+            for (auto const& x : open_batches_)
+                visitor(x.second.policy, x.second.payload);
 
             offline_queue_.visit([&] (std::string_view const&, detail::PendingMessageWrapper const& wrapper) {
                 visitor(wrapper.policy, wrapper.payload);
@@ -233,318 +707,511 @@ namespace chargelab {
             limitOfflineQueueSize();
             flushToDisk();
 
-            // If an operation is not in progress, flush messages from the live queue to the offline queue as necessary
-            if (!request_operation_.operationInProgress() && !live_queue_.empty()) {
-                while (live_queue_.size() > kMaxLiveMessages) {
-                    auto it = live_queue_.begin();
-                    if (it->policy.group_id.has_value())
-                        active_group_ids_.insert(it->policy.group_id.value());
+            flushLiveQueue();
+        }
 
-                    offline_queue_.pushBack(live_queue_.front());
-                    live_queue_.erase(live_queue_.begin());
-                    pending_messages_changed_ = true;
-                }
+        std::optional<SteadyPointMillis> nextWakeup(SteadyPointMillis now) override {
+            if (must_flush_to_disk_)
+                return now;
 
-                // Make sure live messages with the same group IDs also get moved to offline messages so that they're
-                // not sent out of order.
-                live_queue_.erase(
-                        std::remove_if(
-                                live_queue_.begin(),
-                                live_queue_.end(),
-                                [&](detail::PendingMessageWrapper const& wrapper) {
-                                    if (activeGroupsContains(wrapper.policy.group_id)) {
-                                        offline_queue_.pushBack(wrapper);
-                                        pending_messages_changed_ = true;
-                                        return true;
-                                    } else {
-                                        return false;
-                                    }
-                                }
-                        ),
-                        live_queue_.end()
-                );
+            // Note: if the remote refused the last call (e.g. while offline) sending resumes on the next connection
+            // event or idle interval instead
+            if (remote_refused_)
+                return std::nullopt;
+
+            std::optional<SteadyPointMillis> result = std::nullopt;
+            if (send_pending_)
+                detail::EarliestWakeup(result, now);
+
+            // Messages assigned to a slot are retried once their previous attempt completed and the retry interval
+            // elapsed
+            for (auto const& slot : in_flight_) {
+                if (!slot.message.has_value())
+                    continue;
+
+                int threshold = 0;
+                if (slot.message->attempts > 0)
+                    threshold = std::max(slot.message->attempts, 1) * slot.message->policy.retry_interval_seconds;
+
+                detail::EarliestWakeup(result, slot.operation.idleDeadline(threshold));
             }
+
+            return result;
         }
 
         void runStep(ocpp1_6::OcppRemote& remote) override {
-            // Send out a live message, if one is available
-            if (!request_operation_.operationInProgress() && !live_queue_.empty()) {
-                auto it = live_queue_.begin();
-                bool delete_message = false;
-                bool send_message = true;
-
-                if (blacklistContains(it->policy.group_id))
-                    delete_message = true;
-                if (!it->action_id1_6.has_value())
-                    delete_message = true;
-                if (it->attempts > 0 && it->attempts >= it->policy.message_attempts)
-                    delete_message = true;
-
-                if (it->attempts > 0) {
-                    auto const threshold = std::max(it->attempts, 1) * it->policy.retry_interval_seconds;
-                    if (request_operation_.getIdleDurationSeconds() < threshold)
-                        send_message = false;
-                }
+            sendPendingMessages(remote);
+        }
 
-                if (delete_message) {
-                    live_queue_.erase(it);
-                } else if (send_message) {
-                    if (sendWithTransactionId(remote, *it)) {
-                        it->attempts++;
-                        request_operation_.setWithTimeout(
-                                settings_->DefaultMessageTimeout.getValue(),
-                                std::to_string(it->unique_id)
-                        );
-                        request_object_ = *it;
-                    }
-                }
+        bool handlesRequest(ocpp1_6::ActionId const&) const override {
+            return false;
+        }
+
+        void runStep(ocpp2_0::OcppRemote &remote) override {
+            updateCacheAndStats();
+            limitOfflineQueueSize();
+            flushLiveQueue();
+            sendPendingMessages(remote);
+        }
+
+        bool handlesRequest(ocpp2_0::ActionId const&) const override {
+            return false;
+        }
+
+        void onStartTransactionRsp(
+                const std::string &unique_id,
+                const ocpp1_6::ResponseMessage<ocpp1_6::StartTransactionRsp> &rsp
+        ) override {
+            auto const slot = findInFlight(unique_id);
+            if (slot != nullptr && std::holds_alternative<ocpp1_6::StartTransactionRsp>(rsp)) {
+                auto const& message = std::get<ocpp1_6::StartTransactionRsp>(rsp);
+                if (!slot->message.has_value())
+                    return;
+                if (!slot->message->policy.group_id.has_value())
+                    return;
+
+                transaction_ids_.insert(std::make_pair(slot->message->policy.group_id.value(), message.transactionId));
+
+                // Flush the pending message to remove StartTransaction from the live_queue_ and
+                // update the StopTransaction with transaction Id is the StartTransaction is accepted
+                must_flush_to_disk_ = true;
             }
+        }
 
-            // Next send out an offline message, if one is available
-            if (!request_operation_.operationInProgress() && !offline_queue_.empty()) {
-                auto record = offline_queue_.pollFront();
-                if (record.has_value()) {
-                    bool delete_message = false;
-                    bool send_message = true;
-
-                    if (blacklistContains(record->policy.group_id))
-                        delete_message = true;
-                    if (!record->action_id1_6.has_value())
-                        delete_message = true;
-                    if (record->attempts > 0 && record->attempts >= record->policy.message_attempts)
-                        delete_message = true;
-
-                    if (record->attempts > 0) {
-                        auto const threshold = std::max(record->attempts, 1) * record->policy.retry_interval_seconds;
-                        if (request_operation_.getIdleDurationSeconds() < threshold)
-                            send_message = false;
-                    }
+    private:
+        template<typename T>
+        std::string sendRequest(detail::PendingMessageWrapper wrapper, T const& request) {
+            if (wrapper.policy.group_id.has_value())
+                closeBatch(wrapper.policy.group_id.value());
 
-                    if (delete_message) {
-                        CHARGELAB_LOG_MESSAGE(info) << "popFront: delete_message";
-                        offline_queue_.popFront();
+            if (activeGroupsContains(wrapper.policy.group_id)) {
+                detail::PendingPayloadCodec::write(wrapper, request);
+                offline_queue_.pushBack(wrapper);
+                pending_messages_changed_ = true;
+            } else {
+                wrapper.payload = write_json_to_string(request);
+                live_queue_.push_back(wrapper);
+            }
+
+            send_pending_ = true;
+            if (wrapper.policy.must_flush_to_disk)
+                must_flush_to_disk_ = true;
+
+            return std::to_string(wrapper.unique_id);
+        }
+
+        template<typename T>
+        std::string sendBatchedRequest(detail::PendingMessageWrapper wrapper, T const& request, std::size_t max_entries, std::size_t max_bytes) {
+            static_assert(detail::PendingBatch<T>::kSupported);
+            if (!wrapper.policy.group_id.has_value())
+                return sendRequest(std::move(wrapper), request);
+
+            auto const group_id = wrapper.policy.group_id.value();
+            auto it = open_batches_.find(group_id);
+            if (it != open_batches_.end()) {
+                auto batch = detail::PendingPayloadCodec::read<T>(it->second);
+                if (batch.has_value() && detail::PendingBatch<T>::entries(batch.value()) + detail::PendingBatch<T>::entries(request) <= max_entries) {
+                    auto merged = batch.value();
+                    if (detail::PendingBatch<T>::merge(merged, request) && calculate_size(merged) <= max_bytes) {
+                        detail::PendingPayloadCodec::write(it->second, merged);
                         pending_messages_changed_ = true;
-                    } else if (send_message) {
-                        if (sendWithTransactionId(remote, record.value())) {
-                            record->attempts++;
-                            offline_queue_.updateFront(record.value());
-                            pending_messages_changed_ = true;
-                            request_operation_.setWithTimeout(
-                                    settings_->DefaultMessageTimeout.getValue(),
-                                    std::to_string(record->unique_id)
-                            );
-                            request_object_ = record.value();
-                        }
+                        return std::to_string(it->second.unique_id);
                     }
                 }
+
+                closeBatch(group_id);
             }
+
+            detail::PendingPayloadCodec::write(wrapper, request);
+            open_batches_.emplace(group_id, wrapper);
+            pending_messages_changed_ = true;
+            if (wrapper.policy.must_flush_to_disk)
+                must_flush_to_disk_ = true;
+
+            return std::to_string(wrapper.unique_id);
         }
 
-        void runStep(ocpp2_0::OcppRemote &remote) override {
-            updateCacheAndStats();
-            limitOfflineQueueSize();
+        void closeBatch(int64_t group_id) {
+            auto it = open_batches_.find(group_id);
+            if (it == open_batches_.end())
+                return;
 
-            // If an operation is not in progress, flush messages from the live queue to the offline queue as necessary
-            if (!request_operation_.operationInProgress() && !live_queue_.empty()) {
-                while (live_queue_.size() > kMaxLiveMessages) {
-                    auto it = live_queue_.begin();
-                    if (it->policy.group_id.has_value())
-                        active_group_ids_.insert(it->policy.group_id.value());
+            // Earlier messages in the group that are still in the live queue are moved ahead of the batch
+            active_group_ids_.insert(group_id);
+            flushLiveQueue();
 
-                    offline_queue_.pushBack(live_queue_.front());
-                    live_queue_.erase(live_queue_.begin());
-                    pending_messages_changed_ = true;
-                }
+            pushOffline(std::move(it->second));
+            open_batches_.erase(it);
+            send_pending_ = true;
+        }
 
-                // Make sure live messages with the same group IDs also get moved to offline messages so that they're
-                // not sent out of order.
-                live_queue_.erase(
-                        std::remove_if(
-                                live_queue_.begin(),
-                                live_queue_.end(),
-                                [&](detail::PendingMessageWrapper const& wrapper) {
-                                    if (activeGroupsContains(wrapper.policy.group_id)) {
-                                        offline_queue_.pushBack(wrapper);
-                                        pending_messages_changed_ = true;
-                                        return true;
-                                    } else {
-                                        return false;
-                                    }
-                                }
-                        ),
-                        live_queue_.end()
-                );
-            }
+        void closeBatches() {
+            while (!open_batches_.empty())
+                closeBatch(open_batches_.begin()->first);
+        }
+
+        // Open batches are saved with JSON payloads like the live queue, and are queued when loaded again
+        std::optional<detail::PendingMessageWrapper> savedBatch(detail::PendingMessageWrapper const& wrapper) {
+            auto payload = detail::PendingPayloadCodec::toJson(wrapper, [](auto&) {});
+            if (!payload.has_value())
+                return std::nullopt;
+
+            auto result = wrapper;
+            result.payload = std::move(payload.value());
+            result.binary_payload = false;
+            return result;
+        }
 
-            // First send out a live message, if one is available
-            if (!request_operation_.operationInProgress() && !live_queue_.empty()) {
+        void pushOffline(detail::PendingMessageWrapper wrapper) {
+            detail::PendingPayloadCodec::toBinary(wrapper);
+            offline_queue_.pushBack(wrapper);
+            pending_messages_changed_ = true;
+        }
+
+        [[nodiscard]] bool activeGroupsContains(std::optional<int64_t> const& group_id) const {
+            if (!group_id.has_value())
+                return false;
+
+            return active_group_ids_.find(group_id.value()) != active_group_ids_.end();
+        }
+
+        [[nodiscard]] bool blacklistContains(std::optional<int64_t> const& group_id) const {
+            if (!group_id.has_value())
+                return false;
+
+            return group_blacklist_.find(group_id.value()) != group_blacklist_.end();
+        }
+
+        void flushLiveQueue() {
+            if (live_queue_.empty())
+                return;
+
+            // Note: messages that are in flight may be moved here as well; responses are matched to the message by ID
+            // wherever it's queued.
+            while (live_queue_.size() > kMaxLiveMessages) {
                 auto it = live_queue_.begin();
-                bool delete_message = false;
-                bool send_message = true;
-
-                if (blacklistContains(it->policy.group_id))
-                    delete_message = true;
-                if (!it->action_id2_0.has_value())
-                    delete_message = true;
-                if (it->attempts > 0 && it->attempts >= it->policy.message_attempts)
-                    delete_message = true;
-
-                if (it->attempts > 0) {
-                    auto const threshold = std::max(it->attempts, 1) * it->policy.retry_interval_seconds;
-                    if (request_operation_.getIdleDurationSeconds() < threshold)
-                        send_message = false;
-                }
+                if (it->policy.group_id.has_value())
+                    active_group_ids_.insert(it->policy.group_id.value());
 
-                if (delete_message) {
-                    if (it->policy.group_id.has_value()) {
-                        auto sequence = sequence_ids_.find(it->policy.group_id.value());
-                        if (sequence != sequence_ids_.end()) {
-                            if (shouldRemoveSequenceId(*it)) {
-                                sequence_ids_.erase(sequence);
-                                pending_messages_changed_ = true;
-                            } else {
-                                sequence->second++;
+                pushOffline(live_queue_.front());
+                live_queue_.erase(live_queue_.begin());
+            }
+
+            // Make sure live messages with the same group IDs also get moved to offline messages so that they're
+            // not sent out of order.
+            live_queue_.erase(
+                    std::remove_if(
+                            live_queue_.begin(),
+                            live_queue_.end(),
+                            [&](detail::PendingMessageWrapper const& wrapper) {
+                                if (activeGroupsContains(wrapper.policy.group_id)) {
+                                    pushOffline(wrapper);
+                                    return true;
+                                } else {
+                                    return false;
+                                }
                             }
-                        }
-                    }
+                    ),
+                    live_queue_.end()
+            );
+        }
 
-                    live_queue_.erase(it);
-                } else if (send_message) {
-                    if (sendWithSequenceNumber(remote, *it)) {
-                        it->attempts++;
-                        request_operation_.setWithTimeout(
-                                settings_->DefaultMessageTimeout.getValue(),
-                                std::to_string(it->unique_id)
-                        );
-                        request_object_ = *it;
+        void updateWindowSize() {
+            auto const window = (std::size_t)std::max(settings_->MaxInFlightMessages.getValue(), 1);
+            while (in_flight_.size() < window)
+                in_flight_.emplace_back(system_);
+
+            // Slots that still hold a message are only released once that message completes
+            for (auto it = in_flight_.end(); in_flight_.size() > window && it != in_flight_.begin();) {
+                --it;
+                if (!it->message.has_value())
+                    it = in_flight_.erase(it);
+            }
+        }
+
+        InFlightMessage* findInFlight(std::string const& unique_id) {
+            for (auto& slot : in_flight_) {
+                if (slot.message.has_value() && slot.operation == unique_id)
+                    return &slot;
+            }
+
+            return nullptr;
+        }
+
+        [[nodiscard]] bool isInFlight(int64_t unique_id) const {
+            for (auto const& slot : in_flight_) {
+                if (slot.message.has_value() && slot.message->unique_id == unique_id)
+                    return true;
+            }
+
+            return false;
+        }
+
+        template <typename Remote>
+        void sendPendingMessages(Remote& remote) {
+            updateWindowSize();
+            send_pending_ = false;
+            remote_refused_ = false;
+
+            // Retry or drop messages that are still assigned to a slot once their previous attempt has completed
+            for (auto& slot : in_flight_) {
+                if (slot.message.has_value() && !slot.operation.operationInProgress()) {
+                    if (!processMessage(remote, slot, slot.message.value())) {
+                        remote_refused_ = true;
+                        return;
                     }
                 }
             }
 
-            // Next send out an offline message, if one is available
-            if (!request_operation_.operationInProgress() && !offline_queue_.empty()) {
-                auto record = offline_queue_.pollFront();
-                if (record.has_value()) {
-                    bool delete_message = false;
-                    bool send_message = true;
-
-                    if (blacklistContains(record->policy.group_id))
-                        delete_message = true;
-                    if (!record->action_id2_0.has_value())
-                        delete_message = true;
-                    if (record->attempts > 0 && record->attempts >= record->policy.message_attempts)
-                        delete_message = true;
-
-                    if (record->attempts > 0) {
-                        auto const threshold = std::max(record->attempts, 1) * record->policy.retry_interval_seconds;
-                        if (request_operation_.getIdleDurationSeconds() < threshold)
-                            send_message = false;
-                    }
+            auto const free_slots = (std::size_t)std::count_if(in_flight_.begin(), in_flight_.end(), [](auto const& slot) {
+                return !slot.message.has_value();
+            });
+            if (free_slots == 0)
+                return;
 
-                    if (delete_message) {
-                        CHARGELAB_LOG_MESSAGE(info) << "popFront: delete_message";
-                        if (record->policy.group_id.has_value()) {
-                            auto sequence = sequence_ids_.find(record->policy.group_id.value());
-                            if (sequence != sequence_ids_.end()) {
-                                if (shouldRemoveSequenceId(record.value())) {
-                                    sequence_ids_.erase(sequence);
-                                } else {
-                                    sequence->second++;
-                                }
-                            }
-                        }
+            // Messages within a group are sent one at a time and in order, so any group with an earlier message that
+            // hasn't completed yet is skipped. Live messages are considered first, followed by the offline queue.
+            std::unordered_set<int64_t> blocked_groups;
+            for (auto const& slot : in_flight_) {
+                if (slot.message.has_value() && slot.message->policy.group_id.has_value())
+                    blocked_groups.insert(slot.message->policy.group_id.value());
+            }
 
-                        offline_queue_.popFront();
-                        pending_messages_changed_ = true;
-                    } else if (send_message) {
-                        if (sendWithSequenceNumber(remote, record.value())) {
-                            record->attempts++;
-                            offline_queue_.updateFront(record.value());
-                            pending_messages_changed_ = true;
-                            request_operation_.setWithTimeout(
-                                    settings_->DefaultMessageTimeout.getValue(),
-                                    std::to_string(record->unique_id)
-                            );
-                            request_object_ = record.value();
-                        }
-                    }
+            std::vector<detail::PendingMessageWrapper> candidates;
+            auto consider = [&](detail::PendingMessageWrapper const& wrapper) {
+                if (isInFlight(wrapper.unique_id))
+                    return;
+                if (wrapper.policy.group_id.has_value() && !blocked_groups.insert(wrapper.policy.group_id.value()).second)
+                    return;
+
+                candidates.push_back(wrapper);
+            };
+
+            for (auto const& x : live_queue_) {
+                if (candidates.size() >= free_slots)
+                    break;
+
+                consider(x);
+            }
+
+            if (candidates.size() < free_slots) {
+                int visited = 0;
+                offline_queue_.visitWhile([&](std::string_view const&, detail::PendingMessageWrapper const& wrapper) {
+                    if (completed_offline_ids_.find(wrapper.unique_id) == completed_offline_ids_.end())
+                        consider(wrapper);
+
+                    return candidates.size() < free_slots && ++visited < kMaxOfflineLookaheadRecords;
+                });
+            }
+
+            for (auto const& wrapper : candidates) {
+                auto slot = std::find_if(in_flight_.begin(), in_flight_.end(), [](auto const& x) {
+                    return !x.message.has_value();
+                });
+                if (slot == in_flight_.end())
+                    break;
+                if (!processMessage(remote, *slot, wrapper)) {
+                    remote_refused_ = true;
+                    break;
                 }
             }
         }
 
-        void onStartTransactionRsp(
-                const std::string &unique_id,
-                const ocpp1_6::ResponseMessage<ocpp1_6::StartTransactionRsp> &rsp
-        ) override {
-            if (request_operation_ == unique_id && std::holds_alternative<ocpp1_6::StartTransactionRsp>(rsp)) {
-                auto const& message = std::get<ocpp1_6::StartTransactionRsp>(rsp);
-                if (!request_object_.has_value())
+        /**
+         * Sends, defers or drops the message using the given slot; returns false if the remote refused the call.
+         */
+        template <typename Remote>
+        bool processMessage(Remote& remote, InFlightMessage& slot, detail::PendingMessageWrapper wrapper) {
+            constexpr bool kOcpp1_6 = std::is_same_v<Remote, ocpp1_6::OcppRemote>;
+            bool delete_message = false;
+            bool send_message = true;
+
+            if (blacklistContains(wrapper.policy.group_id))
+                delete_message = true;
+            if (kOcpp1_6 ? !wrapper.action_id1_6.has_value() : !wrapper.action_id2_0.has_value())
+                delete_message = true;
+            if (wrapper.attempts > 0 && wrapper.attempts >= wrapper.policy.message_attempts)
+                delete_message = true;
+
+            if (wrapper.attempts > 0) {
+                auto const threshold = std::max(wrapper.attempts, 1) * wrapper.policy.retry_interval_seconds;
+                if (slot.operation.getIdleDurationSeconds() < threshold)
+                    send_message = false;
+            }
+
+            auto const drop = [&]() {
+                CHARGELAB_LOG_MESSAGE(info) << "Dropping pending message: " << wrapper.unique_id;
+                if constexpr (!kOcpp1_6)
+                    advanceSequenceId(wrapper);
+
+                slot.message = std::nullopt;
+                removeMessage(wrapper.unique_id);
+                return true;
+            };
+
+            if (delete_message)
+                return drop();
+
+            slot.message = wrapper;
+            if (!send_message)
+                return true;
+
+            std::optional<std::string> payload;
+            if constexpr (kOcpp1_6) {
+                payload = payloadWithTransactionId(wrapper);
+            } else {
+                payload = payloadWithSequenceNumber(wrapper);
+            }
+
+            if (!payload.has_value()) {
+                CHARGELAB_LOG_MESSAGE(error) << "Failed decoding pending message payload: " << wrapper.unique_id;
+                return drop();
+            }
+
+            // Payloads are only ever produced by the JSON writer, so they can be framed without re-parsing
+            bool sent;
+            if constexpr (kOcpp1_6) {
+                sent = remote.sendCall(
+                        std::to_string(wrapper.unique_id),
+                        wrapper.action_id1_6.value(),
+                        common::RawJson::from_validated(std::move(payload.value()))
+                );
+            } else {
+                sent = remote.sendCall(
+                        std::to_string(wrapper.unique_id),
+                        wrapper.action_id2_0.value(),
+                        common::RawJson::from_validated(std::move(payload.value()))
+                );
+            }
+
+            if (!sent)
+                return false;
+
+            // The connection is back, so there's nothing left to gain from holding batches open
+            closeBatches();
+
+            slot.message->attempts++;
+            updateMessage(slot.message.value());
+            slot.operation.setWithTimeout(
+                    settings_->DefaultMessageTimeout.getValue(),
+                    std::to_string(wrapper.unique_id)
+            );
+            return true;
+        }
+
+        void updateMessage(detail::PendingMessageWrapper const& wrapper) {
+            for (auto& x : live_queue_) {
+                if (x.unique_id == wrapper.unique_id) {
+                    x = wrapper;
                     return;
-                if (!request_object_->policy.group_id.has_value())
+                }
+            }
+
+            // Note: the attempt count is only persisted for the front of the offline queue; for other in-flight
+            // records it's tracked by the slot until the record completes.
+            auto const front = offline_queue_.pollFront();
+            if (front.has_value() && front->unique_id == wrapper.unique_id) {
+                offline_queue_.updateFront(wrapper);
+                pending_messages_changed_ = true;
+            }
+        }
+
+        void removeMessage(int64_t unique_id) {
+            // Note: completing a message may free a slot or unblock its group
+            send_pending_ = true;
+            for (auto it = live_queue_.begin(); it != live_queue_.end(); ++it) {
+                if (it->unique_id == unique_id) {
+                    live_queue_.erase(it);
                     return;
+                }
+            }
 
-                transaction_ids_.insert(std::make_pair(request_object_->policy.group_id.value(), message.transactionId));
+            // Records that complete ahead of the front of the offline queue are held back until they reach it
+            completed_offline_ids_.insert(unique_id);
+            while (true) {
+                auto const front = offline_queue_.pollFront();
+                if (!front.has_value())
+                    break;
 
-                // Flush the pending message to remove StartTransaction from the live_queue_ and
-                // update the StopTransaction with transaction Id is the StartTransaction is accepted
-                must_flush_to_disk_ = true;
+                auto const it = completed_offline_ids_.find(front->unique_id);
+                if (it == completed_offline_ids_.end())
+                    break;
+
+                CHARGELAB_LOG_MESSAGE(info) << "popFront: completed";
+                completed_offline_ids_.erase(it);
+                offline_queue_.popFront();
+                pending_messages_changed_ = true;
             }
         }
 
-    private:
-        [[nodiscard]] bool activeGroupsContains(std::optional<int64_t> const& group_id) const {
-            if (!group_id.has_value())
-                return false;
-
-            return active_group_ids_.find(group_id.value()) != active_group_ids_.end();
-        }
+        void advanceSequenceId(detail::PendingMessageWrapper const& wrapper) {
+            if (!wrapper.policy.group_id.has_value())
+                return;
 
-        [[nodiscard]] bool blacklistContains(std::optional<int64_t> const& group_id) const {
-            if (!group_id.has_value())
-                return false;
+            auto it = sequence_ids_.find(wrapper.policy.group_id.value());
+            if (it == sequence_ids_.end())
+                return;
 
-            return group_blacklist_.find(group_id.value()) != group_blacklist_.end();
+            if (shouldRemoveSequenceId(wrapper)) {
+                sequence_ids_.erase(it);
+                pending_messages_changed_ = true;
+            } else {
+                it->second++;
+            }
         }
 
-        bool sendWithTransactionId(ocpp1_6::OcppRemote& remote, detail::PendingMessageWrapper const& wrapper) {
-            if (!wrapper.action_id1_6.has_value())
-                return false;
-
-            std::string payload = wrapper.payload;
+        std::optional<std::string> payloadWithTransactionId(detail::PendingMessageWrapper const& wrapper) {
+            std::optional<int> transaction_id = std::nullopt;
             if (wrapper.policy.group_id.has_value()) {
                 auto it = transaction_ids_.find(wrapper.policy.group_id.value());
                 if (it != transaction_ids_.end())
-                    payload = insert_into_object(payload, "transactionId", it->second);
+                    transaction_id = it->second;
             }
 
-            return remote.sendCall(
-                    std::to_string(wrapper.unique_id),
-                    wrapper.action_id1_6.value(),
-                    payload
-            );
-        }
+            if (wrapper.binary_payload) {
+                return detail::PendingPayloadCodec::toJson(wrapper, [&](auto& request) {
+                    using type = std::decay_t<decltype(request)>;
+                    if constexpr (detail::HasTransactionId<type>::value) {
+                        if (transaction_id.has_value())
+                            request.transactionId = transaction_id.value();
+                    }
+                });
+            }
 
-        bool sendWithSequenceNumber(ocpp2_0::OcppRemote& remote, detail::PendingMessageWrapper const& wrapper) {
-            if (!wrapper.action_id2_0.has_value())
-                return false;
+            if (!transaction_id.has_value())
+                return wrapper.payload;
 
-            std::string payload = wrapper.payload;
-            if (wrapper.policy.add_message_sequence_number && wrapper.policy.group_id.has_value()) {
-                auto it = sequence_ids_.find(wrapper.policy.group_id.value());
+            return insert_into_object(wrapper.payload, "transactionId", transaction_id.value());
+        }
+
+        std::optional<std::string> payloadWithSequenceNumber(detail::PendingMessageWrapper const& wrapper) {
+            auto const add_sequence_number = wrapper.policy.add_message_sequence_number && wrapper.policy.group_id.has_value();
+            auto const current_sequence_number = [&](std::optional<int> const& first) {
+                auto const group_id = wrapper.policy.group_id.value();
+                auto it = sequence_ids_.find(group_id);
                 if (it == sequence_ids_.end()) {
-                    auto first = read_field_from_object<int>(payload, "seqNo");
-                    sequence_ids_[wrapper.policy.group_id.value()] = first.value_or(0);
+                    it = sequence_ids_.emplace(group_id, first.value_or(0)).first;
                     pending_messages_changed_ = true;
                 }
 
-                payload = insert_into_object(payload, "seqNo", sequence_ids_[wrapper.policy.group_id.value()]);
+                return it->second;
+            };
+
+            if (wrapper.binary_payload) {
+                return detail::PendingPayloadCodec::toJson(wrapper, [&](auto& request) {
+                    using type = std::decay_t<decltype(request)>;
+                    if constexpr (detail::HasSeqNo<type>::value) {
+                        if (add_sequence_number)
+                            request.seqNo = current_sequence_number(request.seqNo);
+                    }
+                });
             }
 
-            return remote.sendCall(
-                    std::to_string(wrapper.unique_id),
-                    wrapper.action_id2_0.value(),
-                    payload
-            );
+            if (!add_sequence_number)
+                return wrapper.payload;
+
+            auto const sequence_number = current_sequence_number(read_field_from_object<int>(wrapper.payload, "seqNo"));
+            return insert_into_object(wrapper.payload, "seqNo", sequence_number);
         }
 
         void limitOfflineQueueSize() {
@@ -556,176 +1223,79 @@ namespace chargelab {
                                         << initial_total_bytes << " > " << kOfflineSizeLimitBytes;
 
             auto const start_ts = system_->steadyClockNow();
-            std::map<std::pair<int, std::optional<int>>, std::pair<int, int>> stats;
-            offline_queue_.visit([&] (std::string_view const& text, detail::PendingMessageWrapper const& wrapper) {
-                auto& value = stats[std::make_pair(wrapper.policy.priority, wrapper.policy.group_id)];
-                value.first += 1;
-                value.second += (int)text.size();
-            });
-            auto const middle_ts1 = system_->steadyClockNow();
-
-            int max_priority = std::numeric_limits<int>::min();
-            for (auto const& x : stats)
-                max_priority = std::max(x.first.first, max_priority);
-
-            bool delete_safely = false;
-            for (auto const& x : stats) {
-                if (!x.first.second.has_value()) {
-                    delete_safely = true;
-                    break;
-                }
-                if (x.first.first == max_priority && x.second.first > 2) {
-                    delete_safely = true;
-                    break;
-                }
-            }
-
-            int delete_count = 0;
-            for (auto const& x : stats) {
-                if (!x.first.second.has_value()) {
-                    delete_count++;
-                } else if (delete_safely) {
-                    delete_count += std::max(x.second.first - 2, 0);
-                } else {
-                    delete_count += x.second.first;
-                }
-            }
-
-            std::size_t deleted_records = 0;
-            std::size_t deleted_decompressed_bytes = 0;
-
-            std::uniform_int_distribution<int64_t> distribution(0, delete_count-1);
-            std::map<int64_t, int> counter;
-            auto const middle_ts2 = system_->steadyClockNow();
-            offline_queue_.removeIf([&] (std::string_view const& text, detail::PendingMessageWrapper const& wrapper) {
-                if (wrapper.policy.priority != max_priority)
-                    return false;
-
-                if (wrapper.policy.group_id.has_value() && delete_safely) {
-                    auto index = counter[wrapper.policy.group_id.value()]++;
-                    auto const& stat = stats[std::make_pair(wrapper.policy.priority, wrapper.policy.group_id)];
-                    if (index == 0 || index == stat.first-1)
-                        return false;
-                }
-
-                if (distribution(random_engine_) < kTargetDeleteRecordCount) {
-                    deleted_records++;
-                    deleted_decompressed_bytes += text.size();
-                    CHARGELAB_LOG_MESSAGE(info) << "Dropping offline message: " << wrapper.payload;
-                    pending_messages_changed_ = true;
-                    return true;
-                } else {
-                    return false;
-                }
-            });
+            auto const result = detail::evictPendingMessages(
+                    offline_queue_,
+                    random_engine_,
+                    kTargetDeleteRecordCount,
+                    [&](detail::PendingMessageWrapper const& wrapper) {
+                        CHARGELAB_LOG_MESSAGE(info) << "Dropping offline message: " << wrapper.unique_id;
+                    }
+            );
             auto const end_ts = system_->steadyClockNow();
 
+            if (result.records > 0)
+                pending_messages_changed_ = true;
+
             CHARGELAB_LOG_MESSAGE(info) << "Delete stats:"
                                         << " processing_ms=" << (end_ts - start_ts)
-                                        << " deleted_records=" << deleted_records
-                                        << " deleted_decompressed_bytes=" << deleted_decompressed_bytes
+                                        << " deleted_records=" << result.records
+                                        << " deleted_decompressed_bytes=" << result.decompressed_bytes
                                         << " new_compressed_size=" << offline_queue_.totalBytes();
-
-            CHARGELAB_LOG_MESSAGE(info) << "Times: "
-                                        << " block1=" << (middle_ts1 - start_ts)
-                                        << " block2=" << (middle_ts2 - middle_ts1)
-                                        << " block3=" << (end_ts - middle_ts2);
         }
 
         void onCallRsp(const std::string &unique_id, const ocpp1_6::ResponseMessage<common::RawJson>& payload) override {
-            if (request_operation_ == unique_id) {
-                request_operation_ = kNoOperation;
-
-                if (std::holds_alternative<common::RawJson>(payload)) {
-                    if (!request_object_.has_value())
-                        return;
-
-                    auto onCallRsp = [this](detail::PendingMessageWrapper const &wrapper) {
-                        if (wrapper.action_id1_6 && wrapper.action_id1_6.value() == ocpp1_6::ActionId::kStopTransaction) {
-                            auto const request = read_json_from_string<ocpp1_6::StopTransactionReq>(wrapper.payload);
-                            if (!request.has_value()) {
-                                CHARGELAB_LOG_MESSAGE(warning) << "Failed read StopTransaction request from: " << wrapper.payload;
-                                return;
-                            }
-
-                            // remove transaction id from transaction_ids_ if there is one
-                            for (auto it = transaction_ids_.begin(); it != transaction_ids_.end(); ) {
-                                if (it->second == request->transactionId) {
-                                    it = transaction_ids_.erase(it);
-                                    pending_messages_changed_ = true;
-                                } else {
-                                    ++it;
-                                }
-                            }
+            auto const slot = findInFlight(unique_id);
+            if (slot == nullptr)
+                return;
 
+            // Note: on a CallError the message stays assigned to the slot and is retried once the retry interval elapses
+            slot->operation = kNoOperation;
+            if (!std::holds_alternative<common::RawJson>(payload))
+                return;
 
-                            if (request->reason == ocpp1_6::Reason::kHardReset || request->reason == ocpp1_6::Reason::kSoftReset) {
-                                must_flush_to_disk_ = true;
-                                flushToDisk();
-                            }
-                        }
-                    };
+            auto const wrapper = std::move(slot->message.value());
+            slot->message = std::nullopt;
+            removeMessage(wrapper.unique_id);
 
-                    if (!live_queue_.empty() && live_queue_.front().unique_id == request_object_->unique_id) {
-                        auto wrapper = live_queue_.front();
-                        live_queue_.erase(live_queue_.begin());
-                        onCallRsp(wrapper);
-                        return;
-                    }
+            if (wrapper.action_id1_6 && wrapper.action_id1_6.value() == ocpp1_6::ActionId::kStopTransaction) {
+                auto const request = detail::PendingPayloadCodec::read<ocpp1_6::StopTransactionReq>(wrapper);
+                if (!request.has_value()) {
+                    CHARGELAB_LOG_MESSAGE(warning) << "Failed read StopTransaction request from: " << wrapper.unique_id;
+                    return;
+                }
 
-                    if (offline_queue_.pollFront().has_value() && offline_queue_.pollFront()->unique_id == request_object_->unique_id) {
-                        CHARGELAB_LOG_MESSAGE(info) << "popFront: onCallRsp";
-                        auto record = offline_queue_.pollFront();
-                        offline_queue_.popFront();
-                        onCallRsp(record.value());
+                // remove transaction id from transaction_ids_ if there is one
+                for (auto it = transaction_ids_.begin(); it != transaction_ids_.end(); ) {
+                    if (it->second == request->transactionId) {
+                        it = transaction_ids_.erase(it);
                         pending_messages_changed_ = true;
-                        return;
+                    } else {
+                        ++it;
                     }
                 }
+
+
+                if (request->reason == ocpp1_6::Reason::kHardReset || request->reason == ocpp1_6::Reason::kSoftReset) {
+                    must_flush_to_disk_ = true;
+                    flushToDisk();
+                }
             }
         }
 
         void onCallRsp(const std::string &unique_id, const ocpp2_0::ResponseMessage<common::RawJson>& payload) override {
-            if (request_operation_ == unique_id) {
-                request_operation_ = kNoOperation;
-
-                if (std::holds_alternative<common::RawJson>(payload)) {
-                    if (!request_object_.has_value())
-                        return;
-
-                    if (!live_queue_.empty() && live_queue_.front().unique_id == request_object_->unique_id) {
-                        auto it = sequence_ids_.find(live_queue_.front().policy.group_id.value());
-                        if (it != sequence_ids_.end()) {
-                            if (shouldRemoveSequenceId(live_queue_.front())) {
-                                sequence_ids_.erase(it);
-                                pending_messages_changed_ = true;
-                            } else {
-                                it->second++;
-                            }
-                        }
-
-                        live_queue_.erase(live_queue_.begin());
-                        return;
-                    }
+            auto const slot = findInFlight(unique_id);
+            if (slot == nullptr)
+                return;
 
-                    auto const& record = offline_queue_.pollFront();
-                    if (record.has_value() && record->unique_id == request_object_->unique_id) {
-                        CHARGELAB_LOG_MESSAGE(info) << "popFront: onCallRsp";
-                        auto it = sequence_ids_.find(record->policy.group_id.value());
-                        if (it != sequence_ids_.end()) {
-                            if (shouldRemoveSequenceId(record.value())) {
-                                sequence_ids_.erase(it);
-                            } else {
-                                it->second++;
-                            }
-                        }
+            // Note: on a CallError the message stays assigned to the slot and is retried once the retry interval elapses
+            slot->operation = kNoOperation;
+            if (!std::holds_alternative<common::RawJson>(payload))
+                return;
 
-                        offline_queue_.popFront();
-                        pending_messages_changed_ = true;
-                        return;
-                    }
-                }
-            }
+            auto const wrapper = std::move(slot->message.value());
+            slot->message = std::nullopt;
+            advanceSequenceId(wrapper);
+            removeMessage(wrapper.unique_id);
         }
 
     private:
@@ -743,14 +1313,27 @@ namespace chargelab {
             std::size_t total_decompressed_size = 0;
 
             active_group_ids_.clear();
-            offline_queue_.visit([&](std::string_view const& text, detail::PendingMessageWrapper const& wrapper) {
-                if (wrapper.policy.group_id.has_value())
-                    active_group_ids_.insert(wrapper.policy.group_id.value());
+            offline_queue_.visitSummaries([&](detail::PendingMessageSummary const& summary) {
+                for (auto const& x : summary.groups) {
+                    if (x.group_id.has_value())
+                        active_group_ids_.insert(x.group_id.value());
+                }
 
-                total_records++;
-                total_decompressed_size += text.size();
+                total_records += summary.records;
+                total_decompressed_size += summary.bytes;
             });
 
+            // Note: dropping completed IDs for records that are no longer queued (e.g. removed to limit the queue size)
+            if (!completed_offline_ids_.empty()) {
+                std::unordered_set<int64_t> completed_offline_ids;
+                offline_queue_.visit([&](std::string_view const&, detail::PendingMessageWrapper const& wrapper) {
+                    if (completed_offline_ids_.find(wrapper.unique_id) != completed_offline_ids_.end())
+                        completed_offline_ids.insert(wrapper.unique_id);
+                });
+
+                std::swap(completed_offline_ids_, completed_offline_ids);
+            }
+
             auto const total_compressed_size = offline_queue_.totalBytes();
             double compression_ratio = 0;
             if (total_decompressed_size > 0)
@@ -788,6 +1371,33 @@ namespace chargelab {
             last_flush_to_disk_ = now;
             must_flush_to_disk_ = false;
 
+            // Remove records that completed ahead of the front of the offline queue so they aren't sent again after a
+            // restart
+            if (!completed_offline_ids_.empty()) {
+                // Note: only the blocks that may hold them are rewritten, so the other blocks needn't be saved again
+                std::vector<std::size_t> blocks;
+                std::size_t index = 0;
+                offline_queue_.visitSummaries([&](detail::PendingMessageSummary const& summary) {
+                    for (auto const& x : completed_offline_ids_) {
+                        if (x >= summary.min_unique_id && x <= summary.max_unique_id) {
+                            blocks.push_back(index);
+                            break;
+                        }
+                    }
+
+                    index++;
+                });
+
+                // Note: going from the back, since emptied blocks are removed
+                for (auto it = blocks.rbegin(); it != blocks.rend(); ++it) {
+                    offline_queue_.removeIfInBlock(*it, [&] (std::string_view const&, detail::PendingMessageWrapper const& wrapper) {
+                        return completed_offline_ids_.find(wrapper.unique_id) != completed_offline_ids_.end();
+                    });
+                }
+
+                completed_offline_ids_.clear();
+            }
+
             // Note: must flush to disk here even if online, otherwise the Ended messages aren't added to the stream and
             //       a dangling transaction is created if the station looses power. On the other hand, at one extra
             //       write per hour here we'll end up exhausting one block of flash memory on an ESP32 every ~11 years,
@@ -804,37 +1414,238 @@ namespace chargelab {
             //  the buffer (and nothing added via the registered suppliers).
 
             CHARGELAB_LOG_MESSAGE(info) << "Saving pending messages to storage, write count: " << pending_messages_write_count_;
+            if (segmented_storage_) {
+                saveSegments();
+                return;
+            }
+
             storage_->write([&](auto file) {
-                offline_queue_.write([&](void* data, std::size_t size) {
-                    auto length = (int)size;
-                    std::fwrite(&length, sizeof(length), 1, file);
-                    std::fwrite(data, size, 1, file);
+                offline_queue_.write([&](void* data, std::size_t size, detail::PendingMessageSummary const& summary) {
+                    writeBlock(file, data, size, summary);
                 });
 
                 int terminator = -1;
                 std::fwrite(&terminator, sizeof(terminator), 1, file);
 
-                file::json_write_object_to_file(file, active_group_ids_);
-                file::json_write_object_to_file(file, group_blacklist_);
-                file::json_write_object_to_file(file, transaction_ids_);
-                file::json_write_object_to_file(file, sequence_ids_);
-                file::json_write_object_to_file(file, pending_messages_write_count_);
+                writeState(file);
+                return true;
+            });
+        }
 
-                for (auto const& x : live_queue_) {
-                    file::json_write_object_to_file(file, x);
-                }
+        /**
+         * Saves the offline queue incrementally: sealed blocks are appended to segment files once, and the main file
+         * becomes a manifest listing where each block is along with the position in the front block, the final
+         * block, and the rest of the state. Segment files are deleted once none of their blocks are queued.
+         */
+        void saveSegments() {
+            detail::PendingSegmentManifest manifest;
+            std::unordered_map<uint64_t, detail::PendingBlockLocation> saved_blocks;
+            bool failed = false;
+            offline_queue_.visitSealedBlocks([&](uint64_t id, void const* data, std::size_t size, detail::PendingMessageSummary const& summary) {
+                if (failed)
+                    return;
 
-                for (auto const& supplier : saved_message_suppliers_) {
-                    if (supplier == nullptr)
-                        continue;
+                auto it = saved_blocks_.find(id);
+                if (it == saved_blocks_.end()) {
+                    auto const location = appendToSegment(data, size, summary);
+                    if (!location.has_value()) {
+                        failed = true;
+                        return;
+                    }
 
-                    (*supplier)([&](auto const& record) {
-                        file::json_write_object_to_file(file, record);
-                    });
+                    it = saved_blocks_.emplace(id, location.value()).first;
                 }
 
+                saved_blocks.insert(*it);
+                manifest.blocks.push_back(it->second);
+            });
+
+            if (failed) {
+                CHARGELAB_LOG_MESSAGE(error) << "Failed writing offline queue segment - keeping the previous state";
+                return;
+            }
+
+            std::unordered_set<int64_t> live_segments;
+            for (auto const& x : manifest.blocks)
+                live_segments.insert(x.segment);
+            for (auto const& x : segments_) {
+                if (live_segments.find(x.first) == live_segments.end())
+                    manifest.dropped_segments.push_back(x.first);
+            }
+
+            auto const front = offline_queue_.sealedFrontState();
+            manifest.next_segment = next_segment_id_;
+            manifest.front_consumed_records = (int)front.consumed_records;
+
+            auto const saved = storage_->write([&](auto file) {
+                int marker = kManifestMarker;
+                std::fwrite(&marker, sizeof(marker), 1, file);
+                file::json_write_object_to_file(file, manifest);
+
+                int front_length = front.modified_record.has_value() ? (int)front.modified_record->size() : -1;
+                std::fwrite(&front_length, sizeof(front_length), 1, file);
+                if (front.modified_record.has_value())
+                    std::fwrite(front.modified_record->data(), front.modified_record->size(), 1, file);
+
+                offline_queue_.writeTail([&](void* data, std::size_t size, detail::PendingMessageSummary const& summary) {
+                    writeBlock(file, data, size, summary);
+                });
+
+                int terminator = -1;
+                std::fwrite(&terminator, sizeof(terminator), 1, file);
+
+                writeState(file);
                 return true;
             });
+
+            if (!saved) {
+                CHARGELAB_LOG_MESSAGE(error) << "Failed writing pending messages manifest";
+                return;
+            }
+
+            std::swap(saved_blocks_, saved_blocks);
+            for (auto const& x : manifest.dropped_segments)
+                dropSegment(x);
+        }
+
+        /**
+         * Adds a block to the open segment file, or to a new one once that's full.
+         */
+        std::optional<detail::PendingBlockLocation> appendToSegment(
+                void const* data,
+                std::size_t size,
+                detail::PendingMessageSummary const& summary
+        ) {
+            auto const write = [&](FILE* file) {
+                writeBlock(file, data, size, summary);
+                return true;
+            };
+
+            if (open_segment_.has_value()) {
+                auto const id = open_segment_.value();
+                auto& blocks = segments_[id];
+                auto storage = segmentStorage(id);
+                if (blocks < kBlocksPerSegment && storage != nullptr && storage->append(write))
+                    return detail::PendingBlockLocation {id, blocks++};
+
+                // Note: a failed append may have left part of the block behind, so nothing more is added to the segment
+                open_segment_ = std::nullopt;
+            }
+
+            auto const id = next_segment_id_++;
+            auto storage = segmentStorage(id);
+            if (storage == nullptr || !storage->write(write))
+                return std::nullopt;
+
+            segments_[id] = 1;
+            open_segment_ = id;
+            return detail::PendingBlockLocation {id, 0};
+        }
+
+        void dropSegment(int64_t id) {
+            segments_.erase(id);
+            if (open_segment_ == id)
+                open_segment_ = std::nullopt;
+
+            auto storage = segmentStorage(id);
+            if (storage != nullptr)
+                storage->remove();
+        }
+
+        std::unique_ptr<StorageInterface> segmentStorage(int64_t id) {
+            return storage_->sibling("seg" + std::to_string(id));
+        }
+
+        void writeState(FILE* file) {
+            file::json_write_object_to_file(file, active_group_ids_);
+            file::json_write_object_to_file(file, group_blacklist_);
+            file::json_write_object_to_file(file, transaction_ids_);
+            file::json_write_object_to_file(file, sequence_ids_);
+            file::json_write_object_to_file(file, pending_messages_write_count_);
+
+            for (auto const& x : live_queue_) {
+                file::json_write_object_to_file(file, x);
+            }
+
+            for (auto const& x : open_batches_) {
+                auto const saved = savedBatch(x.second);
+                if (saved.has_value())
+                    file::json_write_object_to_file(file, saved.value());
+            }
+
+            for (auto const& supplier : saved_message_suppliers_) {
+                if (supplier == nullptr)
+                    continue;
+
+                (*supplier)([&](auto const& record) {
+                    file::json_write_object_to_file(file, record);
+                });
+            }
+        }
+
+        // Note: each block is preceded by its summary; files written before summaries were saved don't have them and
+        // the summaries are rebuilt when loading.
+        static void writeBlock(FILE* file, void const* data, std::size_t size, detail::PendingMessageSummary const& summary) {
+            auto const summary_text = write_binary_to_string(summary);
+            auto marker = kBlockSummaryMarker;
+            auto summary_length = (int)summary_text.size();
+            std::fwrite(&marker, sizeof(marker), 1, file);
+            std::fwrite(&summary_length, sizeof(summary_length), 1, file);
+            std::fwrite(summary_text.data(), summary_text.size(), 1, file);
+
+            auto length = (int)size;
+            std::fwrite(&length, sizeof(length), 1, file);
+            std::fwrite(data, size, 1, file);
+        }
+
+        static std::optional<std::vector<uint8_t>> readBlock(FILE* file, std::optional<detail::PendingMessageSummary>& summary) {
+            std::optional<std::vector<uint8_t>> result = std::nullopt;
+
+            int length;
+            if (std::fread(&length, sizeof(length), 1, file) != 1)
+                return result;
+
+            if (length == kBlockSummaryMarker) {
+                int summary_length;
+                if (std::fread(&summary_length, sizeof(summary_length), 1, file) != 1)
+                    return result;
+                if (summary_length < 0 || summary_length > kMaxStorageBlockSize) {
+                    CHARGELAB_LOG_MESSAGE(error) << "Bad summary length encountered reading historic data: " << summary_length;
+                    return result;
+                }
+
+                std::string summary_text;
+                summary_text.resize(summary_length);
+                if (std::fread(summary_text.data(), sizeof(char), summary_text.size(), file) != summary_text.size()) {
+                    CHARGELAB_LOG_MESSAGE(error) << "Failed reading block summary";
+                    return result;
+                }
+
+                summary = read_binary_from_string<detail::PendingMessageSummary>(summary_text);
+                if (!summary.has_value())
+                    CHARGELAB_LOG_MESSAGE(warning) << "Failed reading block summary - rebuilding from records";
+
+                if (std::fread(&length, sizeof(length), 1, file) != 1)
+                    return result;
+            }
+
+            if (length == -1)
+                return result;
+
+            if (length < 0 || length > kMaxStorageBlockSize) {
+                CHARGELAB_LOG_MESSAGE(error) << "Bad block length encountered reading historic data: " << length;
+                return result;
+            }
+
+            std::vector<uint8_t> buffer;
+            buffer.resize(length);
+            if (std::fread(buffer.data(), sizeof(uint8_t), buffer.size(), file) != buffer.size()) {
+                CHARGELAB_LOG_MESSAGE(error) << "Failed reading block data";
+                return result;
+            }
+
+            result = std::move(buffer);
+            return result;
         }
 
         template <typename T>
@@ -851,30 +1662,17 @@ namespace chargelab {
         void loadFromStorage() {
             CHARGELAB_LOG_MESSAGE(info) << "Reading pending messages from storage";
             storage_->read([&](auto file) {
-                offline_queue_.read([&]() {
-                    std::optional<std::vector<uint8_t>> result = std::nullopt;
-
-                    int length;
-                    if (std::fread(&length, sizeof(length), 1, file) != 1)
-                        return result;
-                    if (length == -1)
-                        return result;
-
-                    if (length < 0 || length > kMaxStorageBlockSize) {
-                        CHARGELAB_LOG_MESSAGE(error) << "Bad block length encountered reading historic data: " << length;
-                        return result;
-                    }
-
-                    std::vector<uint8_t> buffer;
-                    buffer.resize(length);
-                    if (std::fread(buffer.data(), sizeof(uint8_t), buffer.size(), file) != buffer.size()) {
-                        CHARGELAB_LOG_MESSAGE(error) << "Failed reading block data";
-                        return result;
-                    }
-
-                    result = std::move(buffer);
-                    return result;
-                });
+                int marker;
+                if (std::fread(&marker, sizeof(marker), 1, file) == 1 && marker == kManifestMarker) {
+                    if (!loadSegments(file))
+                        return false;
+                } else {
+                    // Note: the offline queue was saved in full before segment files were introduced
+                    std::fseek(file, 0, SEEK_SET);
+                    offline_queue_.read([&](std::optional<detail::PendingMessageSummary>& summary) {
+                        return readBlock(file, summary);
+                    });
+                }
 
                 {
                     readFromFile(file, active_group_ids_);
@@ -890,17 +1688,129 @@ namespace chargelab {
                     if (!record.has_value())
                         break;
 
-                    offline_queue_.pushBack(record.value());
+                    pushOffline(record.value());
                 }
 
                 return true;
             });
         }
 
+        bool loadSegments(FILE* file) {
+            auto const manifest = file::json_read_object_from_file<detail::PendingSegmentManifest>(file);
+            if (!manifest.has_value()) {
+                CHARGELAB_LOG_MESSAGE(error) << "Failed reading pending messages manifest";
+                return false;
+            }
+
+            detail::PendingMessageQueue::FrontState front {(std::size_t)std::max(manifest->front_consumed_records, 0)};
+            int front_length;
+            if (std::fread(&front_length, sizeof(front_length), 1, file) != 1)
+                return false;
+            if (front_length > kMaxStorageBlockSize)
+                return false;
+            if (front_length >= 0) {
+                std::string record;
+                record.resize(front_length);
+                if (std::fread(record.data(), sizeof(char), record.size(), file) != record.size())
+                    return false;
+
+                front.modified_record = std::move(record);
+            }
+
+            // Each segment file is read once, keeping the blocks the manifest refers to. If a segment can't be read
+            // only the records it held are lost.
+            struct LoadedBlock {
+                std::optional<std::vector<uint8_t>> data;
+                std::optional<detail::PendingMessageSummary> summary;
+            };
+
+            std::map<int64_t, std::map<int, LoadedBlock>> segments;
+            for (auto const& x : manifest->blocks)
+                segments[x.segment][x.index] = LoadedBlock {};
+
+            next_segment_id_ = manifest->next_segment;
+            for (auto& segment : segments) {
+                auto const last = segment.second.rbegin()->first;
+                segments_[segment.first] = last+1;
+                next_segment_id_ = std::max(next_segment_id_, segment.first+1);
+
+                auto storage = segmentStorage(segment.first);
+                auto const read = storage != nullptr && storage->read([&](FILE* segment_file) {
+                    for (int index=0; index <= last; index++) {
+                        std::optional<detail::PendingMessageSummary> summary = std::nullopt;
+                        auto data = readBlock(segment_file, summary);
+                        if (!data.has_value())
+                            return false;
+
+                        auto const it = segment.second.find(index);
+                        if (it != segment.second.end())
+                            it->second = LoadedBlock {std::move(data), std::move(summary)};
+                    }
+
+                    return true;
+                });
+
+                if (!read)
+                    CHARGELAB_LOG_MESSAGE(error) << "Failed reading offline queue segment " << segment.first << " - records were dropped";
+            }
+
+            // The final block follows in the manifest itself
+            std::vector<detail::PendingBlockLocation> locations;
+            auto next = manifest->blocks.begin();
+            offline_queue_.read([&](std::optional<detail::PendingMessageSummary>& summary) {
+                while (next != manifest->blocks.end()) {
+                    auto const location = *next++;
+                    auto& block = segments[location.segment][location.index];
+                    if (!block.data.has_value())
+                        continue;
+
+                    locations.push_back(location);
+                    summary = std::move(block.summary);
+                    return std::move(block.data);
+                }
+
+                return readBlock(file, summary);
+            });
+
+            std::size_t index = 0;
+            offline_queue_.visitSealedBlocks([&](uint64_t id, void const*, std::size_t, detail::PendingMessageSummary const&) {
+                if (index < locations.size())
+                    saved_blocks_[id] = locations[index];
+
+                index++;
+            });
+
+            // Note: the position only applies to the first block in the manifest
+            if (!locations.empty() && locations.front() == manifest->blocks.front())
+                offline_queue_.restoreFront(front);
+
+            for (auto const& x : manifest->dropped_segments)
+                dropSegment(x);
+
+            return true;
+        }
+
         int calculateAllPendingSavedInfoSize() {
             int total_bytes = 0;
-            total_bytes += offline_queue_.totalBytes();
             total_bytes += sizeof(int); // integer terminator size
+            if (segmented_storage_) {
+                // Only blocks that aren't in a segment file yet are written, along with the manifest and final block
+                std::size_t sealed_bytes = 0;
+                offline_queue_.visitSealedBlocks([&](uint64_t id, void const*, std::size_t size, detail::PendingMessageSummary const& summary) {
+                    sealed_bytes += size;
+                    total_bytes += kManifestBytesPerBlock;
+                    if (saved_blocks_.find(id) == saved_blocks_.end())
+                        total_bytes += 3*sizeof(int) + size + write_binary_to_string(summary).size();
+                });
+
+                total_bytes += offline_queue_.totalBytes() - std::min(offline_queue_.totalBytes(), sealed_bytes);
+            } else {
+                total_bytes += offline_queue_.totalBytes();
+                offline_queue_.visitSummaries([&](detail::PendingMessageSummary const& summary) {
+                    // Marker and length ahead of the block summary, plus the block length
+                    total_bytes += 3*sizeof(int) + write_binary_to_string(summary).size();
+                });
+            }
 
             total_bytes += calculate_size(active_group_ids_) + 1; // Count the newline '\n' character
             total_bytes += calculate_size(group_blacklist_) + 1;  // Count the newline '\n' character
@@ -914,6 +1824,12 @@ namespace chargelab {
                 total_bytes += calculate_size(x) + 1; // Count the newline '\n' character
             }
 
+            for (auto const& x : open_batches_) {
+                auto const saved = savedBatch(x.second);
+                if (saved.has_value())
+                    total_bytes += calculate_size(saved.value()) + 1; // Count the newline '\n' character
+            }
+
             for (auto const& supplier : saved_message_suppliers_) {
                 if (supplier == nullptr)
                     continue;
@@ -930,9 +1846,9 @@ namespace chargelab {
             if (!wrapper.action_id2_0 || wrapper.action_id2_0.value() != chargelab::ocpp2_0::ActionId::kTransactionEvent)
                 return false;
 
-            auto const request = read_json_from_string<ocpp2_0::TransactionEventRequest>(wrapper.payload);
+            auto const request = detail::PendingPayloadCodec::read<ocpp2_0::TransactionEventRequest>(wrapper);
             if (!request.has_value()) {
-                CHARGELAB_LOG_MESSAGE(warning) << "Failed read TransactionEvent request from: " << wrapper.payload;
+                CHARGELAB_LOG_MESSAGE(warning) << "Failed read TransactionEvent request from: " << wrapper.unique_id;
                 return false;
             }
 
@@ -946,9 +1862,10 @@ namespace chargelab {
 
         std::default_random_engine random_engine_;
         std::vector<detail::PendingMessageWrapper> live_queue_;
-        CompressedQueueCustom<detail::PendingMessageWrapper, detail::PendingMessageSerializer> offline_queue_;
-        OperationHolder<std::string> request_operation_;
-        std::optional<detail::PendingMessageWrapper> request_object_;
+        std::map<int64_t, detail::PendingMessageWrapper> open_batches_;
+        detail::PendingMessageQueue offline_queue_;
+        std::vector<InFlightMessage> in_flight_;
+        std::unordered_set<int64_t> completed_offline_ids_;
         std::vector<std::shared_ptr<saved_message_supplier>> saved_message_suppliers_ {};
 
         bool must_flush_to_disk_ = false;
@@ -961,6 +1878,18 @@ namespace chargelab {
         std::optional<SteadyPointMillis> last_flush_to_disk_ = std::nullopt;
         bool pending_messages_changed_ = false;
         int32_t pending_messages_write_count_ = 0;
+
+        // Segment files holding the sealed blocks of the offline queue, with the number of blocks written to each, and
+        // the location of each block by its ID in the queue (see saveSegments)
+        bool segmented_storage_ = false;
+        std::map<int64_t, int> segments_;
+        std::unordered_map<uint64_t, detail::PendingBlockLocation> saved_blocks_;
+        std::optional<int64_t> open_segment_ = std::nullopt;
+        int64_t next_segment_id_ = 0;
+
+        // Set when queued messages may be sendable, and cleared once they were considered for sending
+        bool send_pending_ = true;
+        bool remote_refused_ = false;
     };
 }
 
@@ -7,7 +7,6 @@
 #include "openocpp/common/settings.h"
 #include "openocpp/common/compressed_journal.h"
 #include "openocpp/helpers/set.h"
-#include <queue>
 
 namespace chargelab {
     class TransactionModule1_6;
@@ -23,6 +22,35 @@ namespace chargelab {
             CHARGELAB_JSON_INTRUSIVE(SchedulePeriod, startPeriod, endTime, limit, stackLevel, purpose, chargingProfileId)
         };
 
+        struct CompositeSchedulePeriod1_6 {
+            SchedulePeriod period;
+            std::size_t profile_index; // index into charging_profiles_ when the schedules were built
+        };
+
+        /**
+         * Composite schedules for every connector covering [from, until) in seconds, built from one sweep over the
+         * periods of all installed charging profiles. Only valid until the charging profiles or the transaction start
+         * times change.
+         */
+        struct CompositeSchedules1_6 {
+            std::int64_t from;
+            std::int64_t until;
+            // Set if a schedule was anchored at the build time rather than a fixed point in time, in which case the
+            // schedules are only valid for the second they were built in
+            bool anchored_at_build_time;
+            std::map<int, std::vector<CompositeSchedulePeriod1_6>> connectors;
+        };
+
+        struct ScheduleInterval1_6 {
+            std::int64_t start;
+            std::int64_t end;
+            double limit;
+            int stackLevel;
+            ocpp1_6::ChargingProfilePurposeType purpose;
+            std::size_t profile_index;
+            std::optional<int> connector; // empty if the interval applies to every connector
+        };
+
         struct JournalUpdate1_6 {
             std::optional<ocpp1_6::SetChargingProfileReq> setChargingProfileReq = std::nullopt;
             std::optional<ocpp1_6::ClearChargingProfileReq> clearChargingProfileReq = std::nullopt;
@@ -36,6 +64,7 @@ namespace chargelab {
     class PowerManagementModule1_6 : public ServiceStateful1_6 {
         static constexpr int kCriticalWriteCreditsInitial = 100;
         static constexpr std::int64_t kSecondsPerDay = 24 * 60 * 60;
+        static constexpr std::int64_t kActiveScheduleHorizonSeconds = 60 * 60;
 
         static constexpr int kMillisInDay = 1000*60*60*24;
         static constexpr int kMillisInWeek = kMillisInDay * 7;
@@ -128,6 +157,7 @@ namespace chargelab {
                     connector_id,
                     transaction_profile.value()
                 };
+                composite_schedules_ = std::nullopt;
                 publishProfileUpdates();
             }
         }
@@ -139,6 +169,10 @@ namespace chargelab {
             */
             transaction_start_times_[connector_id] = system_->systemClockNow();
             active_transactions_[connector_id] = transaction_id;
+
+            // Relative profiles are anchored at the transaction start time
+            composite_schedules_ = std::nullopt;
+            publishProfileUpdates();
         }
 
         void onActiveTransactionFinished(int connector_id) {
@@ -164,9 +198,22 @@ namespace chargelab {
                 active_transactions_.erase(it);
             }
 
+            composite_schedules_ = std::nullopt;
             publishProfileUpdates();
         }
 
+        bool handlesRequest(ocpp1_6::ActionId const& action_id) const override {
+            switch (action_id) {
+                default:
+                    return false;
+
+                case ocpp1_6::ActionId::kClearChargingProfile:
+                case ocpp1_6::ActionId::kGetCompositeSchedule:
+                case ocpp1_6::ActionId::kSetChargingProfile:
+                    return true;
+            }
+        }
+
         std::optional<ocpp1_6::ResponseToRequest <ocpp1_6::SetChargingProfileRsp>>
         onSetChargingProfileReq(const ocpp1_6::SetChargingProfileReq &req) override {
             return onSetChargingProfileReqInternal(req, true);
@@ -284,6 +331,7 @@ namespace chargelab {
             // - The same profile purpose and stack level
             // - The same profile ID (this is assumed to be the intent here)
             auto old_profiles = charging_profiles_;
+            composite_schedules_ = std::nullopt;
 
             charging_profiles_.erase(
                     std::remove_if(
@@ -360,6 +408,8 @@ namespace chargelab {
                 old_profiles = charging_profiles_;
             }
 
+            composite_schedules_ = std::nullopt;
+
             charging_profiles_.erase(
                     std::remove_if(
                             charging_profiles_.begin(),
@@ -408,54 +458,66 @@ namespace chargelab {
 
         std::optional<ocpp1_6::ResponseToRequest<ocpp1_6::GetCompositeScheduleRsp>>
         onGetCompositeScheduleReq(const ocpp1_6::GetCompositeScheduleReq& req) override {
-            auto time_now = system_->systemClockNow();
-            std::optional<ocpp1_6::ResponseToRequest<ocpp1_6::GetCompositeScheduleRsp>> rsp;
-
-            getCompositeSchedule(req, time_now,
-                                        [&](std::vector<detail::SchedulePeriod> const& periods, int duration) {
-                std::vector<ocpp1_6::ChargingSchedulePeriod> target(periods.size());
-
-                std::transform(periods.begin(), periods.end(), target.begin(),
-                               [=](detail::SchedulePeriod const &source) {
-                                   return ocpp1_6::ChargingSchedulePeriod{ std::max(static_cast<std::int64_t>(0),
-                                                                                    source.startPeriod - time_now/1000),
-                                                                          source.limit, std::nullopt};
-                               });
-                if (duration < req.duration) {
-                    // add a period with default device voltage as its limit
-                    double connector_default_max_amps = 0;
-
-                    for (auto const& x : station_->getConnectorMetadata()) {
-                        if (x.second.connector_id1_6 == req.connectorId) {
-                            connector_default_max_amps = x.second.power_max_amps;
-                            break;
-                        }
-                    }
+            auto const time_now = system_->systemClockNow();
+            auto const time_now_seconds = time_now/1000;
+            auto const& schedules = getCompositeSchedules(time_now, req.duration);
+
+            auto it = schedules.connectors.find(req.connectorId);
+            if (it == schedules.connectors.end())
+                return ocpp1_6::GetCompositeScheduleRsp {ocpp1_6::GetCompositeScheduleStatus::kRejected, req.connectorId};
+
+            // Periods without an active profile use the default device limit
+            double connector_default_max_amps = 0;
+            for (auto const& x : station_->getConnectorMetadata()) {
+                if (x.second.connector_id1_6 == req.connectorId) {
+                    connector_default_max_amps = x.second.power_max_amps;
+                    break;
+                }
+            }
 
-                    target.emplace_back(ocpp1_6::ChargingSchedulePeriod{
-                            duration,
-                            connector_default_max_amps,
-                            std::nullopt
-                    });
+            std::vector<ocpp1_6::ChargingSchedulePeriod> target;
+            auto const end_time = time_now_seconds + req.duration;
+            auto covered_until = time_now_seconds;
+            for (auto const& x : it->second) {
+                auto const& period = x.period;
+                if (period.startPeriod >= end_time)
+                    break;
 
-                    duration = req.duration;
-                }
+                if (period.startPeriod > covered_until)
+                    target.emplace_back(ocpp1_6::ChargingSchedulePeriod {covered_until - time_now_seconds, connector_default_max_amps, std::nullopt});
 
-                rsp = std::make_optional(ocpp1_6::GetCompositeScheduleRsp{
-                        ocpp1_6::GetCompositeScheduleStatus::kAccepted,
-                        req.connectorId,
-                        target.empty() ? std::nullopt : std::make_optional(ocpp1_6::DateTime(time_now)), // schedule stat from now
-                        target.empty() ? std::nullopt : std::make_optional(ocpp1_6::ChargingSchedule {
-                                duration,
-                                ocpp1_6::DateTime(time_now),  // start the schedule right now
-                                ocpp1_6::ChargingRateUnitType::kA,
-                                std::move(target),
-                                std::nullopt
-                        })
+                target.emplace_back(ocpp1_6::ChargingSchedulePeriod {
+                        std::max(static_cast<std::int64_t>(0), period.startPeriod - time_now_seconds),
+                        period.limit,
+                        std::nullopt
                 });
-            });
+                covered_until = period.endTime;
+            }
 
-            return rsp;
+            if (covered_until < end_time)
+                target.emplace_back(ocpp1_6::ChargingSchedulePeriod {covered_until - time_now_seconds, connector_default_max_amps, std::nullopt});
+
+            return ocpp1_6::GetCompositeScheduleRsp {
+                    ocpp1_6::GetCompositeScheduleStatus::kAccepted,
+                    req.connectorId,
+                    ocpp1_6::DateTime(time_now), // schedule start from now
+                    ocpp1_6::ChargingSchedule {
+                            req.duration,
+                            ocpp1_6::DateTime(time_now),  // start the schedule right now
+                            ocpp1_6::ChargingRateUnitType::kA,
+                            std::move(target),
+                            std::nullopt
+                    }
+            };
+        }
+
+        std::optional<SteadyPointMillis> nextWakeup(SteadyPointMillis now) override {
+            // Note: profiles aren't applied until the clock is synchronized, which is polled on the idle interval
+            if (!charging_profile_applied_ || !next_profile_update_.has_value())
+                return std::nullopt;
+
+            auto const remaining = next_profile_update_.value() - system_->systemClockNow();
+            return (SteadyPointMillis)(now + std::max(remaining, (std::int64_t)0));
         }
 
         void runStep(ocpp1_6::OcppRemote&) override {
@@ -483,313 +545,290 @@ namespace chargelab {
         }
 
     private:
-        void getCompositeSchedule(const ocpp1_6::GetCompositeScheduleReq& req, SystemTimeMillis const& time_now,
-                                  std::function<void(std::vector<detail::SchedulePeriod> const& periods,
-                                          int duration)> handler) const {
-            // 1: Get connectorId relevant charging profiles
-            std::vector<ocpp1_6::ChargingProfile> transactionProfiles; // profiles for transaction and default transaction profiles
-            std::vector<ocpp1_6::ChargingProfile> maxProfiles; // max profiles
-            
-            for (auto const& profile : charging_profiles_) {
-                if (profile.connectorId == 0 || profile.connectorId == req.connectorId) {
-                    if (profile.csChargingProfiles.chargingProfilePurpose == ocpp1_6::ChargingProfilePurposeType::kChargePointMaxProfile) {
-                        maxProfiles.push_back(profile.csChargingProfiles);
-                    } else {
-                        transactionProfiles.push_back(profile.csChargingProfiles);
-                    }
-                }
+        detail::CompositeSchedules1_6 const& getCompositeSchedules(SystemTimeMillis const& time_now, std::int64_t duration_seconds) {
+            auto const time_now_seconds = time_now/1000;
+            if (composite_schedules_.has_value()) {
+                auto const& x = composite_schedules_.value();
+                bool valid = time_now_seconds >= x.from && time_now_seconds + duration_seconds <= x.until;
+                if (x.anchored_at_build_time && time_now_seconds != x.from)
+                    valid = false;
+
+                if (valid)
+                    return x;
             }
 
-            // 2: Build all charging schedule periods for txProfiles and maxProfiles separately
-            auto it = transaction_start_times_.find(req.connectorId);
-            auto raw_transaction_schedule = generateUnorderedSchedule(transactionProfiles,
-                req.duration, 
-                time_now,
-                it == transaction_start_times_.end() ? std::nullopt : it->second);
-            auto transaction_schedule = generateCompositeSchedule(raw_transaction_schedule, time_now, false);
-                         
-            auto raw_max_schedule = generateUnorderedSchedule(maxProfiles,
-                req.duration, 
-                time_now,
-                it == transaction_start_times_.end() ? std::nullopt : it->second);
-            auto max_schedule = generateCompositeSchedule(raw_max_schedule, time_now, false);
-
-            // 3: generate the composite schedule based on the combined schedules of the above schedule periods
-            max_schedule.insert(max_schedule.end(), transaction_schedule.begin(), transaction_schedule.end());    
-            auto composite_schedule = generateCompositeSchedule(max_schedule, time_now, true);
-
-            int duration = !composite_schedule.empty() ? std::min(composite_schedule.back().endTime - time_now/1000, static_cast<std::int64_t>(req.duration)) : 0;
-
-            // 4: let the caller handle the result
-            handler(composite_schedule, duration);
+            composite_schedules_ = buildCompositeSchedules(
+                    time_now_seconds,
+                    time_now_seconds + std::max(duration_seconds, kActiveScheduleHorizonSeconds)
+            );
+            return composite_schedules_.value();
         }
 
-        // Generate the final composite schedule but with real timestamps
-        std::vector<detail::SchedulePeriod> generateCompositeSchedule(
-                std::vector<detail::SchedulePeriod> const & raw_schedule,
-                SystemTimeMillis const & time_now,
-                bool transaction_max_mixed_schedules) const {
+        // Builds the composite schedules of all connectors with a single sweep over the start and end points of every
+        // schedule period. At each point the winning TxProfile/TxDefaultProfile and ChargePointMaxProfile are
+        // selected by purpose and stack level, and the lower of the two limits applies.
+        detail::CompositeSchedules1_6 buildCompositeSchedules(std::int64_t from, std::int64_t until) const {
+            detail::CompositeSchedules1_6 result {from, until, false, {}};
 
-            std::int64_t time_now_seconds = time_now/1000;
+            std::set<int> connector_ids;
+            connector_ids.insert(0);
+            for (auto const& x : station_->getConnectorMetadata())
+                connector_ids.insert(x.second.connector_id1_6);
 
-            // Create the comparator for the priority_queue so that it works for our algorithm
-            auto cmp = [](detail::SchedulePeriod const& a, detail::SchedulePeriod const& b) {
-                if (a.startPeriod == b.startPeriod) {
-                    if (a.purpose != b.purpose) {
-                        // get element with bigger profile level first (make the maximum profile last!!! So it can check the limit not greater than the max value)
-                        return a.purpose < b.purpose;
-                    } else {
-                        return a.stackLevel < b.stackLevel;  // get the bigger stack level first in case of MAX profile, so the right one comes first and lower stack level will be ignored
-                    }
+            // 1: Expand the profiles into intervals within [from, until)
+            std::vector<detail::ScheduleInterval1_6> intervals;
+            for (std::size_t i=0; i < charging_profiles_.size(); i++) {
+                auto const& profile = charging_profiles_[i];
+                bool const relative = profile.csChargingProfiles.chargingProfileKind == ocpp1_6::ChargingProfileKindType::kRelative;
+                if (relative && profile.connectorId == 0) {
+                    // Relative profiles start with the transaction on each connector
+                    for (auto const& connector : connector_ids)
+                        appendScheduleIntervals(i, connector, from, until, intervals, result.anchored_at_build_time);
+                } else if (profile.connectorId == 0) {
+                    appendScheduleIntervals(i, std::nullopt, from, until, intervals, result.anchored_at_build_time);
                 } else {
-                    return a.startPeriod > b.startPeriod;  // get element with smaller start value first
+                    appendScheduleIntervals(i, profile.connectorId, from, until, intervals, result.anchored_at_build_time);
                 }
-            };
-
-            // Put all the raw_schedule items into a priority_queue for handling
-            std::priority_queue<detail::SchedulePeriod, std::vector<detail::SchedulePeriod>,
-                decltype(cmp)> pq(std::make_move_iterator(raw_schedule.begin()), std::make_move_iterator(raw_schedule.end()), cmp);
-
-            if (pq.empty()) {
-                return { };
             }
 
-            // handle all the periods in the priority queue
-            std::vector<detail::SchedulePeriod> composite;
-            std::optional<detail::SchedulePeriod> last = std::nullopt;
+            // 2: Sweep over the interval start and end points in order
+            std::vector<std::pair<std::int64_t, std::size_t>> events;
+            events.reserve(intervals.size()*2);
+            for (std::size_t i=0; i < intervals.size(); i++) {
+                events.emplace_back(intervals[i].start, i);
+                events.emplace_back(intervals[i].end, i);
+            }
+            std::sort(events.begin(), events.end());
+
+            std::vector<std::size_t> active_shared;
+            std::map<int, std::vector<std::size_t>> active_connector;
+            std::set<int> touched;
+            for (std::size_t e=0; e < events.size();) {
+                auto const ts = events[e].first;
+                bool touched_all = false;
+                touched.clear();
+
+                for (; e < events.size() && events[e].first == ts; e++) {
+                    auto const index = events[e].second;
+                    auto const& interval = intervals[index];
+                    auto& active = interval.connector.has_value() ? active_connector[interval.connector.value()] : active_shared;
+                    if (interval.start == ts) {
+                        active.push_back(index);
+                    } else {
+                        active.erase(std::find(active.begin(), active.end(), index));
+                    }
 
-            while (!pq.empty()) {
-                auto current = pq.top();
-                pq.pop();
-                if (current.startPeriod == current.endTime) {
-                    continue;
-                }
-                if (last) {
-                    if (last->startPeriod >= last->endTime) {
-                        last = std::nullopt;
+                    if (interval.connector.has_value()) {
+                        touched.insert(interval.connector.value());
+                    } else {
+                        touched_all = true;
                     }
                 }
 
-                if (!last) {
-                    last = std::move(current);
-                    continue;
-                }
+                for (auto const& connector : connector_ids) {
+                    if (!touched_all && !set::contains(touched, connector))
+                        continue;
+
+                    auto const winner = selectScheduleInterval(intervals, active_shared, active_connector[connector]);
+                    auto& periods = result.connectors[connector];
+                    if (!periods.empty() && periods.back().period.endTime == std::numeric_limits<std::int64_t>::max()) {
+                        if (winner != nullptr && winner->limit == periods.back().period.limit)
+                            continue;
 
-                if (current.startPeriod > last->startPeriod) {
-                    // Now is a chance to finish the last node
-                    auto last2 = last.value();
-                    last2.endTime = current.startPeriod;
-                    if (last2.endTime > time_now_seconds) {
-                        composite.push_back(last2);
+                        periods.back().period.endTime = ts;
                     }
 
-                    last->startPeriod = current.startPeriod;
-                    if (last->startPeriod != last->endTime) {
-                        pq.push(std::move(last.value()));
-                        last = std::nullopt; // start over
+                    if (winner != nullptr) {
+                        periods.push_back(detail::CompositeSchedulePeriod1_6 {
+                                detail::SchedulePeriod {
+                                        ts,
+                                        std::numeric_limits<std::int64_t>::max(),
+                                        winner->limit,
+                                        winner->stackLevel,
+                                        winner->purpose,
+                                        charging_profiles_[winner->profile_index].csChargingProfiles.chargingProfileId
+                                },
+                                winner->profile_index
+                        });
                     }
-                    pq.push(current);
-                    continue;
                 }
+            }
 
-                // Save part of current if it is longer than last
-                if (current.endTime > last->endTime) {
-                    auto current2 = current;
-                    current2.startPeriod = last->endTime;
-                    pq.push(current2); // push back the current2 for future handling
-                    current.endTime = last->endTime;
-                } 
-                
-                // The logic below is for handling maxProfile and TxProfile mixed schedules
-                if (transaction_max_mixed_schedules) {
-                    if (current.endTime < last->endTime) {
-                        auto last2 = last.value();
-                        last2.startPeriod = current.endTime;
-                        pq.push(last2); // push back the last2 for future process
-                        last->endTime = current.endTime;
-                    }
+            for (auto const& connector : connector_ids)
+                result.connectors[connector];
 
-                    if (current.purpose != last->purpose) {
-                        if (last->purpose == ocpp1_6::ChargingProfilePurposeType::kChargePointMaxProfile) {
-                            if (last->limit >= current.limit) {
-                                last = current; // current should be selected
-                            }
-                        } else {  // current is max profile
-                            if (last->limit > current.limit) {
-                                last = current; // current should be selected
-                            }
-                        }
+            return result;
+        }
+
+        static detail::ScheduleInterval1_6 const* selectScheduleInterval(
+                std::vector<detail::ScheduleInterval1_6> const& intervals,
+                std::vector<std::size_t> const& active_shared,
+                std::vector<std::size_t> const& active_connector
+        ) {
+            detail::ScheduleInterval1_6 const* transaction = nullptr;
+            detail::ScheduleInterval1_6 const* max = nullptr;
+            auto const visit = [&](std::vector<std::size_t> const& active) {
+                for (auto const& index : active) {
+                    auto const& x = intervals[index];
+                    if (x.purpose == ocpp1_6::ChargingProfilePurposeType::kChargePointMaxProfile) {
+                        if (max == nullptr || x.stackLevel > max->stackLevel)
+                            max = &x;
+                    } else if (transaction == nullptr || x.purpose > transaction->purpose) {
+                        // TxProfile overrides TxDefaultProfile
+                        transaction = &x;
+                    } else if (x.purpose == transaction->purpose && x.stackLevel > transaction->stackLevel) {
+                        transaction = &x;
                     }
                 }
-            }
+            };
 
-            if (last.has_value()) {
-                composite.push_back(last.value());
-            }
+            visit(active_shared);
+            visit(active_connector);
 
-            auto it = composite.begin();
-            while (it != composite.end()) {
-                if (it->endTime <= time_now_seconds) {
-                    it = composite.erase(it);
-                    continue;
-                }
-                auto it2 = it + 1;
-                if (it2 == composite.end()) {
-                    break;
-                }
-                if (it2->limit == it->limit) {
-                    it->endTime = it2->endTime;
-                    composite.erase(it2);
-                } else {
-                    it = it2;
-                }
-            }
+            if (transaction == nullptr)
+                return max;
+            if (max == nullptr)
+                return transaction;
 
-            return composite;
+            return max->limit < transaction->limit ? max : transaction;
         }
 
-        // Generate initial schedule periods from the profiles without checking their priority, e.g. stackLevel, ChargingProfilePurposeType
-        std::vector<detail::SchedulePeriod> generateUnorderedSchedule(
-                std::vector<ocpp1_6::ChargingProfile> const & profiles,
-                int requested_duration_seconds,
-                SystemTimeMillis const & time_now,
-                std::optional<SystemTimeMillis> const& transaction_start_time) const {
-            std::vector<detail::SchedulePeriod> merged;
-            std::int64_t time_now_seconds = time_now/1000;
-            std::int64_t end_time = time_now_seconds + requested_duration_seconds;
-
-            for (auto const& profile : profiles) {
-                if (profile.validFrom && profile.validFrom.value().getTimestamp() &&
-                    (profile.validFrom.value().getTimestamp().value() - (time_now + requested_duration_seconds*1000))/1000 >= 0) {
-                    continue;
-                }
-                if (profile.validTo && profile.validTo.value().getTimestamp() && profile.validTo.value().getTimestamp().value()/1000 <= time_now_seconds) {
-                    continue;
-                }
+        // Appends the periods of a profile that fall within [from, until) to intervals
+        void appendScheduleIntervals(
+                std::size_t profile_index,
+                std::optional<int> connector,
+                std::int64_t from,
+                std::int64_t until,
+                std::vector<detail::ScheduleInterval1_6>& intervals,
+                bool& anchored_at_build_time
+        ) const {
+            auto const& profile = charging_profiles_[profile_index].csChargingProfiles;
+            auto const& schedule = profile.chargingSchedule;
+            if (schedule.chargingSchedulePeriod.empty())
+                return;
 
-                auto adjusted_end_time = end_time;
+            auto lower = from;
+            auto upper = until;
+            if (profile.validFrom.has_value() && profile.validFrom->getTimestamp().has_value())
+                lower = std::max(lower, profile.validFrom->getTimestamp().value()/1000);
+            if (profile.validTo.has_value() && profile.validTo->getTimestamp().has_value())
+                upper = std::min(upper, profile.validTo->getTimestamp().value()/1000);
+            if (lower >= upper)
+                return;
 
-                if (profile.validTo && profile.validTo.value().getTimestamp()) {
-                    adjusted_end_time = std::min(adjusted_end_time, profile.validTo.value().getTimestamp().value()/1000);
-                }
+            std::optional<std::int64_t> base_start_time;
+            if (schedule.startSchedule.has_value() && schedule.startSchedule->getTimestamp().has_value())
+                base_start_time = schedule.startSchedule->getTimestamp().value()/1000;
 
-                if (profile.chargingProfileKind == ocpp1_6::ChargingProfileKindType::kRecurring && profile.recurrencyKind.has_value()) {
-                    auto start_time = time_now_seconds;
-                    while (start_time < end_time) {
-                        auto periods = generateSchedulePeriods(profile, start_time, adjusted_end_time, transaction_start_time);
-                        merged.insert(merged.begin(), periods.begin(), periods.end());
-                        start_time += profile.recurrencyKind.value() == ocpp1_6::RecurrencyKindType::kDaily ? kSecondsPerDay : 7 * kSecondsPerDay;
-                    }
-                } else {
-                    auto periods = generateSchedulePeriods(profile, time_now_seconds, adjusted_end_time, transaction_start_time);
-                    merged.insert(merged.begin(), periods.begin(), periods.end());
-                }
+            if (profile.chargingProfileKind == ocpp1_6::ChargingProfileKindType::kRelative) {
+                // Use the transaction start time as the start point if it has a value
+                // TODO: else use the absolute time or ignore this profile ?
+                auto it = transaction_start_times_.find(connector.value_or(0));
+                if (it != transaction_start_times_.end() && it->second.has_value())
+                    base_start_time = it->second.value()/1000;
             }
 
-            return merged;
-        }
+            if (!base_start_time.has_value()) {
+                base_start_time = from;
+                anchored_at_build_time = true;
+            }
 
-        // Generate schedule periods and add them to the periods parameter, each period has a start and end time
-        std::vector<detail::SchedulePeriod> generateSchedulePeriods(
-            ocpp1_6::ChargingProfile const &profile,
-            std::int64_t start_time_now,
-            std::int64_t end_time,
-            std::optional<SystemTimeMillis> const& transaction_start_time // for relative profile kind
-            ) const {
-            auto startSchedule = profile.chargingSchedule.startSchedule;
-            std::int64_t base_start_time = startSchedule.has_value() && startSchedule.value().getTimestamp().has_value() ?
-                                            startSchedule->getTimestamp().value()/1000 : start_time_now;
-
-            std::vector<detail::SchedulePeriod> periods;
-
-            for (auto const& period : profile.chargingSchedule.chargingSchedulePeriod) {
-                std::int64_t absolute_start_time = base_start_time + period.startPeriod;
-
-                if (profile.chargingProfileKind == ocpp1_6::ChargingProfileKindType::kRelative) {
-                    // Use transaction_start_time if it has value as the time start point
-                    // TODO: else use the absolute time or ignore this profile ?
-                    if (transaction_start_time.has_value()) {
-                        absolute_start_time = transaction_start_time.value()/1000 + period.startPeriod;
-                    }
+            if (profile.chargingProfileKind == ocpp1_6::ChargingProfileKindType::kRecurring && profile.recurrencyKind.has_value()) {
+                auto const recurrence = profile.recurrencyKind.value() == ocpp1_6::RecurrencyKindType::kDaily ? kSecondsPerDay : 7 * kSecondsPerDay;
+                auto const delta = lower - base_start_time.value();
+                auto index = delta / recurrence;
+                if (delta < 0 && delta % recurrence != 0)
+                    index -= 1;
+
+                for (auto start = base_start_time.value() + index*recurrence; start < upper; start += recurrence) {
+                    appendSchedulePeriods(
+                            profile,
+                            profile_index,
+                            connector,
+                            start,
+                            std::max(lower, start),
+                            std::min(upper, start + recurrence),
+                            intervals
+                    );
                 }
+            } else {
+                appendSchedulePeriods(profile, profile_index, connector, base_start_time.value(), lower, upper, intervals);
+            }
+        }
 
-                // Only add periods within the requested duration
-                if (absolute_start_time < end_time) {
-                    if (profile.chargingSchedule.duration.has_value()) {
-                        if (absolute_start_time - base_start_time < profile.chargingSchedule.duration.value()) {
-                            // Pre-set the endTime as the min value of end_time and base_start_time + profile.chargingSchedule.duration.value()
-                            // if not the last period, it will be overridden by the next time's start time
-                            if (!periods.empty()) {
-                                periods.back().endTime = absolute_start_time;
-                            }
-                            periods.emplace_back(detail::SchedulePeriod{ absolute_start_time,
-                                                 std::min(base_start_time + profile.chargingSchedule.duration.value(), end_time),
-                                                 period.limit,
-                                                 profile.stackLevel,
-                                                 profile.chargingProfilePurpose,
-                                                 profile.chargingProfileId});
-                        } else {
-                            break;
-                        }
-                    } else {
-                        // Set endTime with INT64_MAX so the last period will last forever
-                        if (!periods.empty()) {
-                            periods.back().endTime = absolute_start_time;
-                        }
+        // Appends the periods of a schedule starting at start_time, clipped to [lower, upper)
+        static void appendSchedulePeriods(
+                ocpp1_6::ChargingProfile const& profile,
+                std::size_t profile_index,
+                std::optional<int> connector,
+                std::int64_t start_time,
+                std::int64_t lower,
+                std::int64_t upper,
+                std::vector<detail::ScheduleInterval1_6>& intervals
+        ) {
+            auto const& schedule = profile.chargingSchedule;
+            auto const& periods = schedule.chargingSchedulePeriod;
+            if (schedule.duration.has_value())
+                upper = std::min(upper, start_time + schedule.duration.value());
+
+            for (std::size_t i=0; i < periods.size(); i++) {
+                auto start = start_time + periods[i].startPeriod;
+                auto end = i+1 < periods.size() ? start_time + periods[i+1].startPeriod : upper;
+                start = std::max(start, lower);
+                end = std::min(end, upper);
+                if (start >= end)
+                    continue;
 
-                        periods.emplace_back(detail::SchedulePeriod{ absolute_start_time, INT64_MAX, period.limit, profile.stackLevel,
-                                             profile.chargingProfilePurpose, profile.chargingProfileId});
-                    }
-                }
+                intervals.push_back(detail::ScheduleInterval1_6 {
+                        start,
+                        end,
+                        periods[i].limit,
+                        profile.stackLevel,
+                        profile.chargingProfilePurpose,
+                        profile_index,
+                        connector
+                });
             }
-
-            return periods;
         }
 
         void updateActiveSchedules() {
             auto const now = system_->systemClockNow();
             auto const time_now_seconds = now/1000;
+            auto const& schedules = getCompositeSchedules(now, kActiveScheduleHorizonSeconds);
+
+            auto next_update = time_now_seconds + kActiveScheduleHorizonSeconds;
+            for (auto const& x : schedules.connectors) {
+                auto const connector = x.first;
+                auto const& periods = x.second;
+
+                // Periods are sorted and don't overlap; the active one is the last that started at or before now
+                auto it = std::upper_bound(
+                        periods.begin(),
+                        periods.end(),
+                        time_now_seconds,
+                        [](std::int64_t ts, detail::CompositeSchedulePeriod1_6 const& period) {
+                            return ts < period.period.startPeriod;
+                        }
+                );
 
-            const int one_hour_duration = 60*60; // 1 hour
-            std::int64_t shortest_duration = one_hour_duration;
-
-            std::set<int> connector_ids;
-            connector_ids.insert(0);
-            for (auto const& x : station_->getConnectorMetadata())
-                connector_ids.insert(x.second.connector_id1_6);
+                std::vector<StationInterface::schedule_type1_6> active_schedules;
+                if (it != periods.begin() && std::prev(it)->period.endTime > time_now_seconds) {
+                    auto const& active = *std::prev(it);
+                    active_schedules.push_back({charging_profiles_[active.profile_index], ocpp1_6::ChargingSchedulePeriod {
+                        active.period.startPeriod - time_now_seconds, active.period.limit}});
+                    next_update = std::min(next_update, active.period.endTime);
+                } else if (it != periods.end()) {
+                    next_update = std::min(next_update, it->period.startPeriod);
+                }
 
-            for (auto const & connector : connector_ids) {
-                getCompositeSchedule(ocpp1_6::GetCompositeScheduleReq {
-                    connector,
-                    one_hour_duration,
-                    ocpp1_6::ChargingRateUnitType::kA },
-                                     now,
-                                     [&](std::vector<detail::SchedulePeriod> const& periods, int duration) {
-                    for (auto const& p : periods) {
-                        if (p.endTime > time_now_seconds) {
-                            shortest_duration = std::min(shortest_duration, p.endTime - std::max(p.startPeriod, time_now_seconds));
-                            std::vector<StationInterface::schedule_type1_6> active_schedules;
-
-                            auto it = std::find_if(charging_profiles_.begin(), charging_profiles_.end(), [=](auto const& profile) {
-                                return profile.csChargingProfiles.chargingProfileId == p.chargingProfileId;
-                            });
-
-                            active_schedules.push_back({*it, ocpp1_6::ChargingSchedulePeriod {
-                                p.startPeriod - time_now_seconds, p.limit}});
-
-                            if (connector == 0) {
-                                station_->setActiveChargePointMaxProfiles(active_schedules);
-                            } else {
-                                station_->setActiveEvseProfiles(connector, active_schedules);
-                            }
-                            break;
-                        }
-                    }
-                });
+                if (connector == 0) {
+                    station_->setActiveChargePointMaxProfiles(active_schedules);
+                } else {
+                    station_->setActiveEvseProfiles(connector, active_schedules);
+                }
             }
-            //
-            auto time_now2 = static_cast<std::int64_t>(now) + shortest_duration * 1000;
-            next_profile_update_ = static_cast<SystemTimeMillis>(time_now2);
+
+            next_profile_update_ = static_cast<SystemTimeMillis>(next_update*1000);
         }
 
 #if 0
@@ -1130,6 +1169,7 @@ namespace chargelab {
         std::unordered_map<int, int> active_transactions_;
         std::vector<ocpp1_6::SetChargingProfileReq> charging_profiles_;
         std::optional<SystemTimeMillis> next_profile_update_;
+        std::optional<detail::CompositeSchedules1_6> composite_schedules_;
 
         // Saving charging profiles to storage but Tx Profiles are excluded because once power cycled the transaction would be stopped.
         chargelab::CompressedJournalJson<detail::JournalUpdate1_6> journal_;
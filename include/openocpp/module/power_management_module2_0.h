@@ -25,10 +25,30 @@ namespace chargelab {
         };
 
         struct ActiveSchedulePeriod {
-            std::optional<ocpp2_0::ChargingSchedulePeriodType> period;
+            // Note: points into the charging profile that was evaluated
+            ocpp2_0::ChargingSchedulePeriodType const* period;
             SystemTimeMillis next_update;
         };
 
+        using ActiveSchedule2_0 = std::pair<ocpp2_0::SetChargingProfileRequest const*, ocpp2_0::ChargingSchedulePeriodType const*>;
+
+        struct ChargingLimitBreakpoint {
+            SystemTimeMillis start;
+            // The winning profile and period for each purpose from start until the next breakpoint
+            std::vector<ActiveSchedule2_0> active_schedules;
+        };
+
+        /**
+         * Active schedules for one EVSE, compiled ahead of time into the points at which they change. The entries
+         * point into PowerManagementModule2_0::charging_profiles_, so the timeline must be rebuilt whenever the
+         * profiles are modified.
+         */
+        struct ChargingLimitTimeline {
+            std::vector<ChargingLimitBreakpoint> breakpoints;
+            SystemTimeMillis end;
+            std::optional<std::size_t> applied_index = std::nullopt;
+        };
+
         struct ReportCharingProfileState {
             ocpp2_0::ChargingLimitSourceEnumType current_source = ocpp2_0::ChargingLimitSourceEnumType::kEMS;
             int current_evseId = 0;
@@ -42,6 +62,8 @@ namespace chargelab {
         static constexpr int kMillisInDay = 1000*60*60*24;
         static constexpr int kMillisInWeek = kMillisInDay * 7;
         static constexpr int kJournalCapacityReportFrequencySeconds = 10;
+        static constexpr int kChargingLimitTimelineHorizonMillis = kMillisInDay;
+        static constexpr std::size_t kMaxChargingLimitBreakpoints = 64;
 
         static constexpr int kFlashWriteCapacityOnBoot = 1024;
         static constexpr int kRequiredFlashLifetimeYears = 10;
@@ -128,10 +150,12 @@ namespace chargelab {
                     evse_id,
                     transaction_profile.value()
                 };
-                last_charging_profile_update_ = std::nullopt; // Re-calculate the charging schedule
             }
 
+            // Note: Relative profiles are evaluated from the transaction start time, so the schedule is re-calculated
+            // even if no TxProfile was provided
             transaction_start_times_[evse_id] = start_ts;
+            last_charging_profile_update_ = std::nullopt;
         }
 
         void onActiveTransactionIdAssigned(int evse_id, std::string const& transaction_id) {
@@ -169,6 +193,20 @@ namespace chargelab {
 
             transaction_start_times_[evse_id] = std::nullopt;
             transaction_id_map_[evse_id] = std::nullopt;
+            last_charging_profile_update_ = std::nullopt;
+        }
+
+        bool handlesRequest(ocpp2_0::ActionId const& action_id) const override {
+            switch (action_id) {
+                default:
+                    return false;
+
+                case ocpp2_0::ActionId::kClearChargingProfile:
+                case ocpp2_0::ActionId::kGetChargingProfiles:
+                case ocpp2_0::ActionId::kGetCompositeSchedule:
+                case ocpp2_0::ActionId::kSetChargingProfile:
+                    return true;
+            }
         }
 
         std::optional<ocpp2_0::ResponseToRequest <ocpp2_0::SetChargingProfileResponse>>
@@ -209,6 +247,15 @@ namespace chargelab {
             return std::nullopt;
         }
 
+        std::optional<SteadyPointMillis> nextWakeup(SteadyPointMillis now) override {
+            if (pending_get_charging_profiles_request_.has_value() || !last_charging_profile_update_.has_value())
+                return now;
+
+            // Note: the re-compute threshold is in system clock time
+            auto const remaining = last_charging_profile_update_->second - system_->systemClockNow();
+            return (SteadyPointMillis)(now + std::max(remaining, (std::int64_t)0));
+        }
+
         void runStep(ocpp2_0::OcppRemote& remote) override {
             reportJournalCapacity();
 
@@ -216,17 +263,19 @@ namespace chargelab {
                 sendChargingProfilesReport(remote);
 
             auto const now = system_->systemClockNow();
+            bool rebuild = true;
             if (last_charging_profile_update_.has_value()) {
                 if (now - last_charging_profile_update_->first < 0) {
                     CHARGELAB_LOG_MESSAGE(warning) << "Re-computing charging profiles: system clock decreased";
                 } else if (now - last_charging_profile_update_->second >= 0) {
-                    CHARGELAB_LOG_MESSAGE(info) << "Re-computing charging profiles: passed re-compute threshold";
+                    CHARGELAB_LOG_MESSAGE(debug) << "Updating active charging profiles: passed next breakpoint";
+                    rebuild = false;
                 } else {
                     return;
                 }
             }
 
-            last_charging_profile_update_ = std::make_pair(now, updateActiveChargingProfiles(now));
+            last_charging_profile_update_ = std::make_pair(now, updateActiveChargingProfiles(now, rebuild));
 
             // TODO: Charging profiles shouldn't be applied until the clock is synchronized
             // TODO: Support for offline overrides should be preserved for now?
@@ -695,18 +744,86 @@ namespace chargelab {
             }
         }
 
-        SystemTimeMillis updateActiveChargingProfiles(SystemTimeMillis now) {
-            sortChargingProfiles();
-            auto next_update = static_cast<SystemTimeMillis>(now + 60*1000);
+        SystemTimeMillis updateActiveChargingProfiles(SystemTimeMillis now, bool rebuild) {
+            for (auto const& x : charging_limit_timelines_) {
+                if (now - x.second.end >= 0 || now - x.second.breakpoints.front().start < 0)
+                    rebuild = true;
+            }
+
+            if (rebuild || charging_limit_timelines_.empty())
+                rebuildChargingLimitTimelines(now);
+
+            auto next_update = static_cast <SystemTimeMillis> (std::numeric_limits<int64_t>::max());
+            for (auto& x : charging_limit_timelines_) {
+                auto const evse_id = x.first;
+                auto& timeline = x.second;
+
+                // Breakpoints are sorted by start time; the active one is the last that started at or before now
+                auto const it = std::upper_bound(
+                        timeline.breakpoints.begin(),
+                        timeline.breakpoints.end(),
+                        now,
+                        [](SystemTimeMillis ts, detail::ChargingLimitBreakpoint const& breakpoint) {
+                            return ts < breakpoint.start;
+                        }
+                );
+
+                auto const index = static_cast<std::size_t>(std::distance(timeline.breakpoints.begin(), it) - 1);
+                if (timeline.applied_index != index) {
+                    timeline.applied_index = index;
+
+                    std::vector<StationInterface::schedule_type2_0> active_schedules;
+                    for (auto const& schedule : timeline.breakpoints[index].active_schedules)
+                        active_schedules.emplace_back(*schedule.first, *schedule.second);
 
-            station_->setActiveChargePointMaxProfiles(getActiveChargingProfiles(0, now, next_update));
-            for (auto const& evse_id : getEvseIds())
-                station_->setActiveEvseProfiles(evse_id, getActiveChargingProfiles(evse_id, now, next_update));
+                    if (evse_id == 0) {
+                        station_->setActiveChargePointMaxProfiles(active_schedules);
+                    } else {
+                        station_->setActiveEvseProfiles(evse_id, active_schedules);
+                    }
+                }
+
+                if (it != timeline.breakpoints.end()) {
+                    next_update = std::min(next_update, it->start);
+                } else {
+                    next_update = std::min(next_update, timeline.end);
+                }
+            }
 
             return next_update;
         }
 
-        std::vector<StationInterface::schedule_type2_0> getActiveChargingProfiles(
+        void rebuildChargingLimitTimelines(SystemTimeMillis now) {
+            sortChargingProfiles();
+            charging_limit_timelines_.clear();
+
+            auto const horizon = static_cast<SystemTimeMillis> (now + kChargingLimitTimelineHorizonMillis);
+            auto evse_ids = getEvseIds();
+            evse_ids.insert(0);
+            for (auto const& evse_id : evse_ids) {
+                auto& timeline = charging_limit_timelines_[evse_id];
+
+                // Note: stepping through the points at which the active schedules change, up to the horizon; the
+                // timeline is rebuilt once the clock passes its end.
+                auto ts = now;
+                while (true) {
+                    auto next_update = static_cast <SystemTimeMillis> (std::numeric_limits<int64_t>::max());
+                    auto active_schedules = getActiveChargingProfiles(evse_id, ts, next_update);
+                    if (timeline.breakpoints.empty() || timeline.breakpoints.back().active_schedules != active_schedules)
+                        timeline.breakpoints.push_back(detail::ChargingLimitBreakpoint {ts, std::move(active_schedules)});
+
+                    timeline.end = next_update;
+                    if (next_update - horizon >= 0 || next_update - ts <= 0)
+                        break;
+                    if (timeline.breakpoints.size() >= kMaxChargingLimitBreakpoints)
+                        break;
+
+                    ts = next_update;
+                }
+            }
+        }
+
+        std::vector<detail::ActiveSchedule2_0> getActiveChargingProfiles(
                 int evse_id,
                 SystemTimeMillis now,
                 SystemTimeMillis& next_update
@@ -716,7 +833,7 @@ namespace chargelab {
             //       are selected *for a particular EVSE ID*, not across a charging station. That is, for each EVSE ID
             //       the stacking rules are applied to determine which profiles are active.
 
-            std::map<ocpp2_0::ChargingProfilePurposeEnumType, StationInterface::schedule_type2_0> active_profiles;
+            std::map<ocpp2_0::ChargingProfilePurposeEnumType, detail::ActiveSchedule2_0> active_profiles;
             for (auto const& charging_profile : charging_profiles_) {
                 if (evse_id == 0) {
                     // If the EVSE ID is 0 then only the ChargingStationMaxProfiles apply
@@ -743,31 +860,35 @@ namespace chargelab {
                 auto active_period = getActiveSchedulePeriod(charging_profile, now, start_time);
                 next_update = std::min(next_update, active_period.next_update);
 
-                if (!active_period.period.has_value())
+                if (active_period.period == nullptr)
                     continue;
 
                 if (charging_profile.chargingProfile.validFrom.has_value()) {
                     auto const ts = charging_profile.chargingProfile.validFrom->getTimestamp();
-                    if (ts.has_value() && ts.value() > now)
+                    if (ts.has_value() && ts.value() > now) {
+                        next_update = std::min(next_update, ts.value());
                         break;
+                    }
                 }
                 if (charging_profile.chargingProfile.validTo.has_value()) {
                     auto const ts = charging_profile.chargingProfile.validTo->getTimestamp();
                     if (ts.has_value() && ts.value() <= now)
                         break;
+                    if (ts.has_value())
+                        next_update = std::min(next_update, ts.value());
                 }
 
                 auto it = active_profiles.find(charging_profile.chargingProfile.chargingProfilePurpose);
                 if (it == active_profiles.end()) {
                     active_profiles.insert(std::make_pair(
                             charging_profile.chargingProfile.chargingProfilePurpose,
-                            StationInterface::schedule_type2_0 {charging_profile, active_period.period.value()}
+                            detail::ActiveSchedule2_0 {&charging_profile, active_period.period}
                     ));
                 } else {
                     // Quote: [...] a ChargingProfile with a higher stack level overrules a ChargingSchedule from a
                     //        ChargingProfile with a lower stack level.
-                    if (charging_profile.chargingProfile.stackLevel > it->second.first.chargingProfile.stackLevel)
-                        it->second = StationInterface::schedule_type2_0 {charging_profile, active_period.period.value()};
+                    if (charging_profile.chargingProfile.stackLevel > it->second.first->chargingProfile.stackLevel)
+                        it->second = detail::ActiveSchedule2_0 {&charging_profile, active_period.period};
                 }
             }
 
@@ -780,7 +901,7 @@ namespace chargelab {
                     active_profiles.erase(it);
             }
 
-            std::vector<StationInterface::schedule_type2_0> result;
+            std::vector<detail::ActiveSchedule2_0> result;
             for (auto const& x : active_profiles)
                 result.push_back(x.second);
 
@@ -797,7 +918,7 @@ namespace chargelab {
             auto const max_ts = static_cast <SystemTimeMillis> (std::numeric_limits<int64_t>::max());
             if (profile.chargingProfile.chargingSchedule.size() != 1) {
                 CHARGELAB_LOG_MESSAGE(warning) << "Bad charging profile - charging schedule size was not 1";
-                return {std::nullopt, max_ts};
+                return {nullptr, max_ts};
             }
 
             auto const& schedule = profile.chargingProfile.chargingSchedule.front();
@@ -808,14 +929,14 @@ namespace chargelab {
 
             // K01.FR.30
             if (start_schedule.has_value() && start_schedule.value() > now)
-                return {std::nullopt, start_schedule.value()};
+                return {nullptr, start_schedule.value()};
 
             if (profile.chargingProfile.chargingProfileKind == ocpp2_0::ChargingProfileKindEnumType::kAbsolute) {
                 // Quote: Schedule periods are relative to a fixed point in time defined in the schedule. This requires that startSchedule
                 //        is set to a starting point in time.
                 if (!start_schedule.has_value()) {
                     CHARGELAB_LOG_MESSAGE(warning) << "Bad charging profile - missing expected startSchedule";
-                    return {std::nullopt, max_ts};
+                    return {nullptr, max_ts};
                 }
 
                 auto const start_ts = start_schedule.value();
@@ -823,38 +944,28 @@ namespace chargelab {
                 if (schedule.duration.has_value()) {
                     // Schedule has expired
                     if (now >= start_ts + schedule.duration.value()*1000)
-                        return {std::nullopt, max_ts};
+                        return {nullptr, max_ts};
 
                     next_update = static_cast<SystemTimeMillis> (start_ts + schedule.duration.value()*1000);
                 }
 
                 if (schedule.chargingSchedulePeriod.empty()) {
                     CHARGELAB_LOG_MESSAGE(warning) << "Bad charging profile - expected at least one chargingSchedulePeriod";
-                    return {std::nullopt, max_ts};
+                    return {nullptr, max_ts};
                 }
 
-                auto const elapsed_seconds = (now - start_ts)/1000;
-                std::size_t index;
-                for (index=1; index < schedule.chargingSchedulePeriod.size(); index++) {
-                    auto const start_period = schedule.chargingSchedulePeriod[index].startPeriod;
-                    if (start_period > elapsed_seconds) {
-                        next_update = std::min(next_update, static_cast<SystemTimeMillis> (start_ts + start_period*1000));
-                        break;
-                    }
-                }
-
-                return {schedule.chargingSchedulePeriod[index-1], next_update};
+                return findSchedulePeriod(schedule, start_ts, now, next_update);
             } else if (profile.chargingProfile.chargingProfileKind == ocpp2_0::ChargingProfileKindEnumType::kRecurring) {
                 // Quote: The schedule restarts periodically at the first schedule period. To be most useful, this requires that
                 //        startSchedule is set to a starting point in time.
                 if (!start_schedule.has_value()) {
                     CHARGELAB_LOG_MESSAGE(warning) << "Bad charging profile - missing expected startSchedule";
-                    return {std::nullopt, max_ts};
+                    return {nullptr, max_ts};
                 }
 
                 if (!profile.chargingProfile.recurrencyKind.has_value()) {
                     CHARGELAB_LOG_MESSAGE(warning) << "Bad charging profile - missing expected recurrencyKind for Recurring charging profile";
-                    return {std::nullopt, max_ts};
+                    return {nullptr, max_ts};
                 }
 
                 auto next_update = max_ts;
@@ -875,33 +986,23 @@ namespace chargelab {
 
                     case ocpp2_0::RecurrencyKindEnumType::kValueNotFoundInEnum:
                         CHARGELAB_LOG_MESSAGE(warning) << "Bad charging profile - invalid recurrencyKind";
-                        return {std::nullopt, max_ts};
+                        return {nullptr, max_ts};
                 }
 
                 if (schedule.duration.has_value()) {
                     // Schedule has expired
                     if (now >= start_ts + schedule.duration.value()*1000)
-                        return {std::nullopt, next_update};
+                        return {nullptr, next_update};
 
                     next_update = std::min(next_update, static_cast<SystemTimeMillis> (start_ts + schedule.duration.value()*1000));
                 }
 
                 if (schedule.chargingSchedulePeriod.empty()) {
                     CHARGELAB_LOG_MESSAGE(warning) << "Bad charging profile - expected at least one chargingSchedulePeriod";
-                    return {std::nullopt, max_ts};
-                }
-
-                auto const elapsed_seconds = (now - start_ts)/1000;
-                std::size_t index;
-                for (index=1; index < schedule.chargingSchedulePeriod.size(); index++) {
-                    auto const start_period = schedule.chargingSchedulePeriod[index].startPeriod;
-                    if (start_period > elapsed_seconds) {
-                        next_update = std::min(next_update, static_cast<SystemTimeMillis> (start_ts + start_period*1000));
-                        break;
-                    }
+                    return {nullptr, max_ts};
                 }
 
-                return {schedule.chargingSchedulePeriod[index-1], next_update};
+                return findSchedulePeriod(schedule, start_ts, now, next_update);
             } else if (profile.chargingProfile.chargingProfileKind == ocpp2_0::ChargingProfileKindEnumType::kRelative) {
                 // Quote: Charging schedule periods should start when the EVSE is ready to deliver energy. i.e. when the
                 //        EV driver is authorized and the EV is connected. When a ChargingProfile is received for a
@@ -917,33 +1018,47 @@ namespace chargelab {
                 if (schedule.duration.has_value()) {
                     // Schedule has expired
                     if (now >= start_ts + schedule.duration.value()*1000)
-                        return {std::nullopt, max_ts};
+                        return {nullptr, max_ts};
 
                     next_update = static_cast<SystemTimeMillis> (start_ts + schedule.duration.value()*1000);
                 }
 
                 if (schedule.chargingSchedulePeriod.empty()) {
                     CHARGELAB_LOG_MESSAGE(warning) << "Bad charging profile - expected at least one chargingSchedulePeriod";
-                    return {std::nullopt, max_ts};
+                    return {nullptr, max_ts};
                 }
 
-                auto const elapsed_seconds = (now - start_ts)/1000;
-                std::size_t index;
-                for (index=1; index < schedule.chargingSchedulePeriod.size(); index++) {
-                    auto const start_period = schedule.chargingSchedulePeriod[index].startPeriod;
-                    if (start_period > elapsed_seconds) {
-                        next_update = std::min(next_update, static_cast<SystemTimeMillis> (start_ts + start_period*1000));
-                        break;
-                    }
-                }
-
-                return {schedule.chargingSchedulePeriod[index-1], next_update};
+                return findSchedulePeriod(schedule, start_ts, now, next_update);
             } else {
                 CHARGELAB_LOG_MESSAGE(warning) << "Bad charging profile - invalid chargingProfileKind";
-                return {std::nullopt, max_ts};
+                return {nullptr, max_ts};
             }
         }
 
+        static detail::ActiveSchedulePeriod findSchedulePeriod(
+                ocpp2_0::ChargingScheduleType const& schedule,
+                SystemTimeMillis start_ts,
+                SystemTimeMillis now,
+                SystemTimeMillis next_update
+        ) {
+            // Note: periods are sorted by startPeriod (K01.FR.35) and the first period starts at 0 (K01.FR.31)
+            auto const& periods = schedule.chargingSchedulePeriod;
+            auto const elapsed_seconds = (now - start_ts)/1000;
+            auto const it = std::upper_bound(
+                    periods.begin() + 1,
+                    periods.end(),
+                    elapsed_seconds,
+                    [](std::int64_t seconds, ocpp2_0::ChargingSchedulePeriodType const& period) {
+                        return seconds < period.startPeriod;
+                    }
+            );
+
+            if (it != periods.end())
+                next_update = std::min(next_update, static_cast<SystemTimeMillis> (start_ts + it->startPeriod*(std::int64_t)1000));
+
+            return {&*std::prev(it), next_update};
+        }
+
         void sortChargingProfiles() {
             std::sort(
                     charging_profiles_.begin(),
@@ -1147,6 +1262,7 @@ namespace chargelab {
         std::map<int, std::optional<SteadyPointMillis>> transaction_start_times_;
         std::map<int, std::optional<std::string>> transaction_id_map_;
         std::vector<ocpp2_0::SetChargingProfileRequest> charging_profiles_;
+        std::map<int, detail::ChargingLimitTimeline> charging_limit_timelines_;
     };
 }
 
@@ -66,6 +66,10 @@ namespace chargelab {
             runStepCommon();
         }
 
+        bool handlesRequest(ocpp2_0::ActionId const& action_id) const override {
+            return action_id == ocpp2_0::ActionId::kReset;
+        }
+
         std::optional<ocpp2_0::ResponseToRequest <ocpp2_0::ResetResponse>>
         onResetReq(const ocpp2_0::ResetRequest &req) override {
             // B11.FR.09
@@ -111,6 +115,10 @@ namespace chargelab {
             return ocpp2_0::ResetResponse {ocpp2_0::ResetStatusEnumType::kAccepted};
         }
 
+        bool handlesRequest(ocpp1_6::ActionId const& action_id) const override {
+            return action_id == ocpp1_6::ActionId::kReset;
+        }
+
         std::optional<ocpp1_6::ResponseToRequest <ocpp1_6::ResetRsp>>
         onResetReq(const ocpp1_6::ResetReq &req) override {
             switch (req.type) {
@@ -161,7 +169,7 @@ namespace chargelab {
                 if (delta >= 0) {
                     CHARGELAB_LOG_MESSAGE(info) << "Resetting system";
                     hard_reset_threshold_ = std::nullopt;
-                    settings_->CustomBootReason.setValue(reason.to_string());
+                    settings_->CustomBootReason.setValue(std::string {reason.to_string()});
                     settings_->saveIfModified();
                     system_->resetHard();
                 }
@@ -177,7 +185,7 @@ namespace chargelab {
                     if (delta >= 0) {
                         CHARGELAB_LOG_MESSAGE(info) << "Resetting system";
                         soft_reset_threshold_ = std::nullopt;
-                        settings_->CustomBootReason.setValue(reason.to_string());
+                        settings_->CustomBootReason.setValue(std::string {reason.to_string()});
                         settings_->saveIfModified();
                         system_->resetSoft();
                     }
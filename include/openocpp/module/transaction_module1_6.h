@@ -122,6 +122,30 @@ namespace chargelab {
         }
 
     private:
+        std::optional<SteadyPointMillis> nextWakeup(SteadyPointMillis now) override {
+            // Note: plug and RFID state changes are polled, so only the meter value deadlines are reported here
+            std::optional<SteadyPointMillis> result = std::nullopt;
+            auto const add_reading_deadline = [&](std::optional<SteadyPointMillis> const& last, int interval_seconds) {
+                if (interval_seconds <= 0)
+                    return;
+                if (!last.has_value()) {
+                    detail::EarliestWakeup(result, now);
+                } else {
+                    detail::EarliestWakeup(result, (SteadyPointMillis)(last.value() + (std::int64_t)interval_seconds*1000));
+                }
+            };
+
+            for (auto const& entry : active_transactions_) {
+                if (!entry.second.has_value())
+                    continue;
+
+                add_reading_deadline(entry.second->last_reading_timestamp, settings_->MeterValueSampleInterval.getValue());
+                add_reading_deadline(entry.second->last_clock_aligned_reading_timestamp, settings_->ClockAlignedDataInterval.getValue());
+            }
+
+            return result;
+        }
+
         void runStep(ocpp1_6::OcppRemote& remote) override {
             // If a reset was requested stop all active transactions
             if (connector_status_module_->getPendingReset()) {
@@ -217,6 +241,18 @@ namespace chargelab {
 #endif
         }
 
+        bool handlesRequest(ocpp1_6::ActionId const& action_id) const override {
+            switch (action_id) {
+                default:
+                    return false;
+
+                case ocpp1_6::ActionId::kRemoteStartTransaction:
+                case ocpp1_6::ActionId::kRemoteStopTransaction:
+                case ocpp1_6::ActionId::kTriggerMessage:
+                    return true;
+            }
+        }
+
         std::optional<ocpp1_6::ResponseToRequest<ocpp1_6::RemoteStartTransactionRsp>> onRemoteStartTransactionReq(
                 const ocpp1_6::RemoteStartTransactionReq &req
         ) override {
@@ -303,6 +339,11 @@ namespace chargelab {
             }
         }
 
+        bool observesResponses(ocpp1_6::ActionId const& action_id) const override {
+            // Note: the transaction events are sent by the pending messages module
+            return action_id == ocpp1_6::ActionId::kStartTransaction;
+        }
+
         void onStartTransactionRsp(
                 const std::string &unique_id,
                 const std::variant<ocpp1_6::StartTransactionRsp, ocpp1_6::CallError> &rsp
@@ -666,29 +707,45 @@ namespace chargelab {
             for (auto& value : sampled_values)
                 value.context = context;
 
-            // TODO: It may be helpful to batch these while offline so that fewer requests are sent when the station
-            //  reconnects instead of persisting individual samples.
-            pending_messages_module_->sendRequest1_6(
-                    ocpp1_6::MeterValuesReq {
-                            entry.connector_id,
-                            entry.transaction_id.value_or(0),
-                            {
-                                    ocpp1_6::MeterValue {
-                                            platform_->systemClockNow(),
-                                            std::move(sampled_values)
-                                    }
+            ocpp1_6::MeterValuesReq const request {
+                    entry.connector_id,
+                    entry.transaction_id.value_or(0),
+                    {
+                            ocpp1_6::MeterValue {
+                                    platform_->systemClockNow(),
+                                    std::move(sampled_values)
                             }
-                    },
-                    PendingMessagePolicy {
-                            PendingMessageType::kTransactionEvent,
-                            entry.group_id,
-                            settings_->TransactionMessageAttempts.getValue(),
-                            settings_->TransactionMessageRetryInterval.getValue(),
-                            kPriorityMeterValue,
-                            false,
-                            false
                     }
-            );
+            };
+            PendingMessagePolicy const policy {
+                    PendingMessageType::kTransactionEvent,
+                    entry.group_id,
+                    settings_->TransactionMessageAttempts.getValue(),
+                    settings_->TransactionMessageRetryInterval.getValue(),
+                    kPriorityMeterValue,
+                    false,
+                    false
+            };
+
+            // Samples taken while offline are merged so that fewer requests are sent when the station reconnects
+            if (isWebsocketConnected()) {
+                pending_messages_module_->sendRequest1_6(request, policy);
+            } else {
+                pending_messages_module_->sendBatchedRequest1_6(
+                        request,
+                        policy,
+                        (std::size_t)settings_->MeterValuesMaxPointsPerRequest.getValue(),
+                        (std::size_t)settings_->MeterValuesMaxBytesPerRequest.getValue()
+                );
+            }
+        }
+
+        bool isWebsocketConnected() {
+            auto const websocket = platform_->ocppConnection();
+            if (websocket == nullptr)
+                return false;
+
+            return websocket->isConnected();
         }
 
         bool shouldTakeReading(std::optional<SteadyPointMillis>& last, int interval_seconds) {
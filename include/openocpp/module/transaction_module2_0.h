@@ -160,6 +160,39 @@ namespace chargelab {
         }
 
     public:
+        std::optional<SteadyPointMillis> nextWakeup(SteadyPointMillis now) override {
+            // Note: plug and RFID state changes are polled, so only the meter value and connection timeout deadlines
+            // are reported here. Readings are aligned to the system clock, so those deadlines are translated into
+            // steady clock time.
+            auto const system_now = platform_->systemClockNow();
+            std::optional<SteadyPointMillis> result = std::nullopt;
+            auto const add_reading_deadline = [&](SystemTimeMillis last, int interval_seconds) {
+                if (interval_seconds <= 0)
+                    return;
+
+                auto const remaining = last + (std::int64_t)interval_seconds*1000 - system_now;
+                detail::EarliestWakeup(result, (SteadyPointMillis)(now + std::max(remaining, (std::int64_t)0)));
+            };
+
+            for (auto const& entry : active_transactions_) {
+                if (!entry.second.has_value())
+                    continue;
+
+                if (!entry.first.has_value() || !entry.second->plugged_in) {
+                    auto const timeout = (std::int64_t)settings_->ConnectionTimeOut.getValue()*1000;
+                    detail::EarliestWakeup(result, (SteadyPointMillis)(entry.second->start_ts + timeout + 1));
+                }
+
+                add_reading_deadline(entry.second->last_sampled_reading_timestamp, settings_->MeterValueSampleInterval.getValue());
+                add_reading_deadline(entry.second->last_sampled_ended_meter_values_timestamp, settings_->SampledDataTxEndedInterval.getValue());
+                add_reading_deadline(entry.second->last_clock_aligned_reading_timestamp, settings_->ClockAlignedDataInterval.getValue());
+                add_reading_deadline(entry.second->last_clock_aligned_ended_meter_values_timestamp, settings_->AlignedDataTxEndedInterval.getValue());
+            }
+
+            add_reading_deadline(last_non_transaction_meter_value_trigger_, settings_->ClockAlignedDataInterval.getValue());
+            return result;
+        }
+
         void runStep(ocpp2_0::OcppRemote& remote) override {
             auto const& metadata = station_->getConnectorMetadata();
 
@@ -371,6 +404,19 @@ namespace chargelab {
             }
         }
 
+        bool handlesRequest(ocpp2_0::ActionId const& action_id) const override {
+            switch (action_id) {
+                default:
+                    return false;
+
+                case ocpp2_0::ActionId::kGetTransactionStatus:
+                case ocpp2_0::ActionId::kRequestStartTransaction:
+                case ocpp2_0::ActionId::kRequestStopTransaction:
+                case ocpp2_0::ActionId::kTriggerMessage:
+                    return true;
+            }
+        }
+
         std::optional<ocpp2_0::ResponseToRequest<ocpp2_0::RequestStartTransactionResponse>> onRequestStartTransactionReq(
                 const ocpp2_0::RequestStartTransactionRequest &req
         ) override {
@@ -506,6 +552,11 @@ namespace chargelab {
             }
         }
 
+        bool observesResponses(ocpp2_0::ActionId const& action_id) const override {
+            // Note: the transaction events are sent by the pending messages module
+            return action_id == ocpp2_0::ActionId::kTransactionEvent;
+        }
+
         void onTransactionEventRsp(
                 const std::string &unique_id,
                 const std::variant<ocpp2_0::TransactionEventResponse, ocpp2_0::CallError> &rsp
@@ -1434,36 +1485,45 @@ namespace chargelab {
                 return;
             }
 
-            // TODO: It may be helpful to batch these while offline so that fewer requests are sent when the station
-            //  reconnects instead of persisting individual samples.
-            pending_messages_module_->sendRequest2_0(
-                    ocpp2_0::TransactionEventRequest {
-                            ocpp2_0::TransactionEventEnumType::kUpdated,
-                            now,
-                            trigger_reason,
-                            0,
-                            !isWebsocketConnected(),
-                            std::nullopt,
-                            std::nullopt,
-                            std::nullopt,
-                            ocpp2_0::TransactionType {
-                                    std::to_string(entry.transaction_id),
-                                    entry.last_charging_status = getChargingState(evse, entry)
-                            },
-                            std::nullopt,
-                            evse,
-                            getMeterValues(evse, context, measurands, now)
+            auto const connected = isWebsocketConnected();
+            ocpp2_0::TransactionEventRequest const request {
+                    ocpp2_0::TransactionEventEnumType::kUpdated,
+                    now,
+                    trigger_reason,
+                    0,
+                    !connected,
+                    std::nullopt,
+                    std::nullopt,
+                    std::nullopt,
+                    ocpp2_0::TransactionType {
+                            std::to_string(entry.transaction_id),
+                            entry.last_charging_status = getChargingState(evse, entry)
                     },
-                    PendingMessagePolicy {
-                            PendingMessageType::kTransactionEvent,
-                            entry.transaction_id,
-                            settings_->TransactionMessageAttempts.getValue(),
-                            settings_->TransactionMessageRetryInterval.getValue(),
-                            kPriorityMeterValue,
-                            false,
-                            true
-                    }
-            );
+                    std::nullopt,
+                    evse,
+                    getMeterValues(evse, context, measurands, now)
+            };
+            PendingMessagePolicy const policy {
+                    PendingMessageType::kTransactionEvent,
+                    entry.transaction_id,
+                    settings_->TransactionMessageAttempts.getValue(),
+                    settings_->TransactionMessageRetryInterval.getValue(),
+                    kPriorityMeterValue,
+                    false,
+                    true
+            };
+
+            // Samples taken while offline are merged so that fewer requests are sent when the station reconnects
+            if (connected) {
+                pending_messages_module_->sendRequest2_0(request, policy);
+            } else {
+                pending_messages_module_->sendBatchedRequest2_0(
+                        request,
+                        policy,
+                        (std::size_t)settings_->MeterValuesMaxPointsPerRequest.getValue(),
+                        (std::size_t)settings_->MeterValuesMaxBytesPerRequest.getValue()
+                );
+            }
         }
 
         void addEndedReading(
@@ -5,41 +5,85 @@
 #include "openocpp/helpers/json.h"
 #include "openocpp/common/logging.h"
 
+#include <array>
+#include <memory>
 #include <string>
-#include <utility>
-
-#include <ctime>
-#include <stdio.h>
-#include <chrono>
-
-#if defined (USE_HH_DATE)
-#include <date/date.h>
-#endif
+#include <string_view>
+#include <optional>
+#include <cstdint>
 
 namespace chargelab::common {
+    /**
+     * An RFC 3339 date and time, held as milliseconds since the epoch along with the offset and number of fraction
+     * digits it was written with; the text is rendered from those when it's written out. Text that can't be
+     * reproduced that way (unparseable values, sub-millisecond digits, lowercase separators) is kept verbatim.
+     */
     class DateTime {
         static constexpr int kMilliSecondSize = 3;
+        static constexpr std::uint8_t kBinaryNull = 0;
+        static constexpr std::uint8_t kBinaryTimestamp = 1;
+        static constexpr std::uint8_t kBinaryText = 2;
+
+        static constexpr std::int64_t kMillisPerMinute = 60*1000;
+        static constexpr std::int64_t kMillisPerDay = 24*60*kMillisPerMinute;
+
+        // Note: a sign, a year of up to 19 digits, "-MM-DDTHH:MM:SS", nine fraction digits and "+HH:MM"
+        static constexpr std::size_t kMaxTextLength = 1 + 19 + 15 + 10 + 6;
+
+        static constexpr std::uint8_t kHasTimestamp = 0x1;
+        static constexpr std::uint8_t kUtc = 0x2;
+
+        struct Fields {
+            std::int64_t timestamp;
+            std::int16_t offset_minutes;
+            std::uint8_t fraction_digits;
+            bool utc;
+            bool exact;
+        };
+
+    public:
+        using Text = std::array<char, kMaxTextLength>;
+
     public:
         DateTime() = default;
         DateTime(const DateTime& other) = default;
         DateTime& operator=(const DateTime& other) = default;
+        DateTime(DateTime&& other) noexcept = default;
+        DateTime& operator=(DateTime&& other) noexcept = default;
 
-        DateTime(SystemTimeMillis timestamp) : text_(timestampToText(timestamp)), timestamp_(timestamp) {
+        DateTime(SystemTimeMillis timestamp)
+            : timestamp_(static_cast<std::int64_t>(timestamp)),
+              flags_(kHasTimestamp | kUtc)
+        {
         }
-        DateTime(std::string text) : text_(text), timestamp_(textToTimestamp(text)) {
+
+        DateTime(std::string const& text) {
+            *this = fromText(text);
         }
 
         [[nodiscard]] std::optional<std::string> getText() const {
-            return text_;
+            if (text_ != nullptr)
+                return *text_;
+            if ((flags_ & kHasTimestamp) == 0)
+                return std::nullopt;
+
+            Text text;
+            return std::string {text.data(), render(text)};
         }
 
         [[nodiscard]] std::optional<SystemTimeMillis> getTimestamp() const {
-            return timestamp_;
+            if ((flags_ & kHasTimestamp) == 0)
+                return std::nullopt;
+
+            return static_cast<SystemTimeMillis>(timestamp_);
         }
 
         static void write_json(json::JsonWriter& writer, DateTime const& value) {
-            if (value.text_.has_value()) {
-                writer.String(value.text_.value());
+            if (value.text_ != nullptr) {
+                writer.String(*value.text_);
+            } else if ((value.flags_ & kHasTimestamp) != 0) {
+                Text text;
+                writer.String(text.data(), value.render(text));
             } else {
                 writer.Null();
             }
@@ -53,11 +97,62 @@ namespace chargelab::common {
                 return false;
 
             auto const& text = std::get<json::StringType>(token.value());
-            value.text_ = std::string{text.str, text.length};
-            value.timestamp_ = textToTimestamp(value.text_.value());
+            value = fromText(std::string_view {text.str, text.length});
             return true;
         }
 
+        // Note: times created from a timestamp (the common case) are stored as the timestamp alone
+        static void write_binary(binary::Writer& writer, DateTime const& value) {
+            if (value.text_ == nullptr && value.flags_ == (kHasTimestamp | kUtc) && value.fraction_digits_ == 0) {
+                writer.writeByte(kBinaryTimestamp);
+                writer.writeSignedVarint(value.timestamp_);
+            } else if (value.text_ != nullptr) {
+                writer.writeByte(kBinaryText);
+                writer.writeString(*value.text_);
+            } else if ((value.flags_ & kHasTimestamp) != 0) {
+                Text text;
+                writer.writeByte(kBinaryText);
+                writer.writeString(std::string_view {text.data(), value.render(text)});
+            } else {
+                writer.writeByte(kBinaryNull);
+            }
+        }
+
+        static bool read_binary(binary::Reader& reader, DateTime& value) {
+            std::uint8_t tag;
+            if (!reader.readByte(tag))
+                return false;
+
+            switch (tag) {
+                case kBinaryNull:
+                    value = DateTime {};
+                    return true;
+
+                case kBinaryTimestamp:
+                    {
+                        std::int64_t timestamp;
+                        if (!reader.readSignedVarint(timestamp))
+                            return false;
+
+                        value = DateTime {(SystemTimeMillis)timestamp};
+                        return true;
+                    }
+
+                case kBinaryText:
+                    {
+                        std::string text;
+                        if (!reader.readString(text))
+                            return false;
+
+                        value = fromText(text);
+                        return true;
+                    }
+
+                default:
+                    return false;
+            }
+        }
+
         bool operator==(DateTime const& rhs) const {
             return getTimestamp() == rhs.getTimestamp();
         }
@@ -67,257 +162,288 @@ namespace chargelab::common {
         }
 
         [[nodiscard]] bool isAfter(SystemTimeMillis ts, bool default_value) const {
-            if (!timestamp_.has_value())
+            if ((flags_ & kHasTimestamp) == 0)
                 return default_value;
 
-            return timestamp_.value() - ts > 0;
+            return timestamp_ - static_cast<std::int64_t>(ts) > 0;
         }
 
         [[nodiscard]] bool isBefore(SystemTimeMillis ts, bool default_value) const {
-            if (!timestamp_.has_value())
+            if ((flags_ & kHasTimestamp) == 0)
                 return default_value;
 
-            return timestamp_.value() - ts < 0;
+            return timestamp_ - static_cast<std::int64_t>(ts) < 0;
         }
 
-#if !defined(USE_HH_DATE)
-        static std::optional<std::string> timestampToText(SystemTimeMillis const& timestamp) {
-            time_t time = timestamp/1000;
-            int millisecond = timestamp%1000;
-            if (millisecond < 0) {  // adjust the minus value to be positive, borrow 1 second
-                time -= 1;
-                millisecond += 1000;
-            }
-
-            auto tm = gmtime(&time);
-            char buf[100]{};
-            sprintf(buf, "%04d-%02d-%02dT%02d:%02d:%02dZ", tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday,
-                    tm->tm_hour, tm->tm_min, tm->tm_sec);
-            return std::string(buf);
+        /**
+         * Writes the timestamp as UTC with whole seconds ("2024-03-01T10:15:00Z") into text, returning the number of
+         * characters used. The text isn't null terminated.
+         */
+        static std::size_t timestampToText(SystemTimeMillis const& timestamp, Text& text) {
+            return format(text, static_cast<std::int64_t>(timestamp), 0, 0, true);
         }
 
-        static std::optional<SystemTimeMillis> textToTimestamp(std::string const& text) {
-            auto text2 = removeExcessiveFractionDigits(text);
-            auto timezone_minutes = retrieveTimezoneMinutes(text2);
-            if (!timezone_minutes.has_value()) {
-                CHARGELAB_LOG_MESSAGE(error) << "wrong time zone format:" << text;
-                return std::nullopt;
-            }
-            // "2022-12-17T14:37:09.894Z"
-            auto tm = parseTm(text2);
-            if (tm) {
-                std::int64_t ret = timegm2(&tm.value());  // timegm() is not supported by ESP32
-                ret -= timezone_minutes.value() * 60;
-                return static_cast<SystemTimeMillis>(ret * 1000 + retrieveMillisecond(text2));
-            }
-            CHARGELAB_LOG_MESSAGE(error) << "wrong date time format:" << text;
-            return std::nullopt;
-        }
-#else
         static std::optional<std::string> timestampToText(SystemTimeMillis const& timestamp) {
-            date::sys_time<std::chrono::milliseconds> ts {std::chrono::milliseconds(timestamp)};
-
-            CHARGELAB_TRY {
-                std::ostringstream out;
+            Text text;
+            return std::string {text.data(), timestampToText(timestamp, text)};
+        }
 
-                // TODO: Need to confirm this *always* uses UTC timezone
-                out << date::format("%FT%TZ", ts);
-                if (!out.fail()) {
-                    return out.str();
-                }
-            } CHARGELAB_CATCH {
-                CHARGELAB_LOG_MESSAGE(error) << "Unexpected exception converting timestamp to date/time string: " << e.what();
+        static std::optional<SystemTimeMillis> textToTimestamp(std::string_view const& text) {
+            auto const fields = parse(text);
+            if (!fields.has_value()) {
+                CHARGELAB_LOG_MESSAGE(error) << "wrong date time format:" << text;
+                return std::nullopt;
             }
 
-            return std::nullopt;
+            return static_cast<SystemTimeMillis>(fields->timestamp);
         }
 
-        static std::optional<SystemTimeMillis> textToTimestamp(std::string const& text) {
-            auto text2 = removeExcessiveFractionDigits(text);
-
-            date::sys_time<std::chrono::milliseconds> ts;
-
-            CHARGELAB_TRY {
-                std::istringstream in{text2};
-                in >> date::parse("%FT%TZ", ts);
-                if (!in.fail()) {
-                    auto const millis = std::chrono::duration_cast<std::chrono::milliseconds>(ts.time_since_epoch()).count();
-                    return static_cast<SystemTimeMillis> (millis);
-                }
-            } CHARGELAB_CATCH {
-                CHARGELAB_LOG_MESSAGE(error) << "Unexpected exception converting date/time string to timestamp: " << e.what();
+    private:
+        static DateTime fromText(std::string_view const& text) {
+            DateTime result;
+            auto const fields = parse(text);
+            if (!fields.has_value()) {
+                CHARGELAB_LOG_MESSAGE(error) << "wrong date time format:" << text;
+                result.text_ = std::make_shared<std::string const>(text);
+                return result;
             }
 
-            CHARGELAB_TRY {
-                std::istringstream in{text2};
-                in >> date::parse("%FT%T%Ez", ts);
-                if (!in.fail()) {
-                    auto const millis = std::chrono::duration_cast<std::chrono::milliseconds>(ts.time_since_epoch()).count();
-                    return static_cast<SystemTimeMillis> (millis);
-                }
-            } CHARGELAB_CATCH {
-                CHARGELAB_LOG_MESSAGE(error) << "Unexpected exception converting date/time string to timestamp: " << e.what();
-            }
+            result.timestamp_ = fields->timestamp;
+            result.offset_minutes_ = fields->offset_minutes;
+            result.fraction_digits_ = fields->fraction_digits;
+            result.flags_ = kHasTimestamp | (fields->utc ? kUtc : 0);
+            if (!fields->exact)
+                result.text_ = std::make_shared<std::string const>(text);
 
-            return std::nullopt;
+            return result;
         }
-#endif
-    private:
-        static std::string removeExcessiveFractionDigits(std::string const& time_text) {
-            int pos = time_text.find('.');
-            if (pos == -1) return time_text;
-            int decimal_digit_count = 0;
-            unsigned int i = pos + 1;
-            while (i < time_text.length() && decimal_digit_count < kMilliSecondSize) {
-                if (!std::isdigit(time_text[i])) break;
-                ++decimal_digit_count;
-                ++i;
-            }
-            if (decimal_digit_count == kMilliSecondSize) {
-                auto start = i;
-                while (i < time_text.length()) {
-                    if (!std::isdigit(time_text[i])) break;
-                    ++i;
-                }
-                if (start != i) {
-                    return time_text.substr(0, start) + time_text.substr(i);
-                }
-            }
-            return time_text;
+
+        [[nodiscard]] std::size_t render(Text& text) const {
+            return format(text, timestamp_, offset_minutes_, fraction_digits_, (flags_ & kUtc) != 0);
         }
 
-        static int retrieveMillisecond(std::string const& timestamp) {
-            auto find = timestamp.find('.');
-            if (find == std::string::npos) {
-                return 0;
-            }
+        /**
+         * Parses "YYYY-MM-DDTHH:MM:SS[.fraction](Z|+HH:MM|-HH:MM)". Fraction digits past milliseconds are truncated.
+         * The result is exact if rendering it reproduces the text.
+         */
+        static std::optional<Fields> parse(std::string_view const& text) {
+            static constexpr std::size_t kZonePosition = 19;
+            if (text.size() < kZonePosition + 1)
+                return std::nullopt;
 
-            int milliseconds = 0;
-            unsigned int multiplier = 100;
-            for (unsigned int i = find+1; i < timestamp.length(); ++i) {
-                if (!std::isdigit(timestamp[i])) break;
-                milliseconds += (timestamp[i] - '0') * multiplier;
-                multiplier /= 10;
-            }
+            auto const* s = text.data();
+            auto const digit = [&](std::size_t index) -> unsigned {
+                return static_cast<unsigned>(static_cast<unsigned char>(s[index])) - '0';
+            };
 
-            return milliseconds;
-        }
+            // Note: the fixed width part is checked in one pass, without branching on each character
+            bool valid = (s[4] == '-') & (s[7] == '-') & ((s[10] == 'T') | (s[10] == 't')) & (s[13] == ':') & (s[16] == ':');
+            for (std::size_t index : {0, 1, 2, 3, 5, 6, 8, 9, 11, 12, 14, 15, 17, 18})
+                valid &= digit(index) < 10;
+            if (!valid)
+                return std::nullopt;
 
-        // timestamp: e.g. "2022-10-17T14:37:09.894+03:00" https://www.w3.org/TR/NOTE-datetime
-        static std::optional<int> retrieveTimezoneMinutes(std::string & timestamp) {
-            auto find = timestamp.find('Z');
-            if (find != std::string::npos) {
-                timestamp = timestamp.substr(0, find); // ignore anything after 'Z'
-                return 0;
-            }
+            auto const year = digit(0)*1000 + digit(1)*100 + digit(2)*10 + digit(3);
+            auto const month = digit(5)*10 + digit(6);
+            auto const day = digit(8)*10 + digit(9);
+            auto const hour = digit(11)*10 + digit(12);
+            auto const minute = digit(14)*10 + digit(15);
+            auto const second = digit(17)*10 + digit(18);
+            if (month - 1 >= 12 || day - 1 >= daysInMonth(year, month) || hour >= 24 || minute >= 60 || second >= 60)
+                return std::nullopt;
 
-            bool negative = false;
-            find = timestamp.find('+');
-            if (find == std::string::npos) {
-                find = timestamp.rfind('-');
-                negative = true;
-            }
-            if (find == std::string::npos) return std::nullopt;
+            Fields result {0, 0, 0, false, s[10] == 'T'};
+
+            // Fraction, keeping milliseconds
+            std::size_t position = kZonePosition;
+            std::int64_t milliseconds = 0;
+            if (s[position] == '.') {
+                auto const start = ++position;
+                while (position < text.size() && digit(position) < 10) {
+                    auto const index = position - start;
+                    if (index < kMilliSecondSize) {
+                        milliseconds = milliseconds*10 + digit(position);
+                    } else {
+                        result.exact &= s[position] == '0';
+                    }
+
+                    position++;
+                }
 
-            int hour = 0;
-            int minute = 0;
+                auto const count = position - start;
+                if (count == 0)
+                    return std::nullopt;
+                for (auto i=count; i < kMilliSecondSize; i++)
+                    milliseconds *= 10;
 
-            auto find2 = timestamp.find(':', find);
-            if (find2 == std::string::npos) {   // only have hours
-                if (sscanf(timestamp.c_str() + find + 1, "%2d", &hour) != 1) return std::nullopt;
-            } else {
-                if (sscanf(timestamp.c_str() + find + 1, "%2d:%2d", &hour, &minute) != 2) return std::nullopt;
+                result.exact &= count <= 9;
+                result.fraction_digits = static_cast<std::uint8_t>(std::min<std::size_t>(count, 9));
             }
 
-            timestamp = timestamp.substr(0, find);  // remove timezone from the timestamp for future process
-            return (hour*60 + minute)*(negative ? -1 : 1);
-        }
-
-        static std::optional<std::tm> parseTm(std::string const& timestamp) {
-            int year, month, day, hour, minute, second;
+            // Zone, either Z or a numeric offset
+            if (position >= text.size())
+                return std::nullopt;
 
-            if (sscanf(timestamp.c_str(), "%4d-%2d-%2dT%2d:%2d:%2d", &year, &month, &day, &hour, &minute, &second) != 6) {
+            auto const zone = s[position];
+            if (zone == 'Z' || zone == 'z') {
+                result.utc = true;
+                result.exact &= zone == 'Z';
+                position++;
+            } else if (zone == '+' || zone == '-') {
+                if (text.size() - position < 6 || s[position + 3] != ':')
+                    return std::nullopt;
+
+                auto const offset_valid = (digit(position + 1) < 10) & (digit(position + 2) < 10) &
+                                          (digit(position + 4) < 10) & (digit(position + 5) < 10);
+                auto const offset_hours = digit(position + 1)*10 + digit(position + 2);
+                auto const offset_minutes = digit(position + 4)*10 + digit(position + 5);
+                if (!offset_valid || offset_hours >= 24 || offset_minutes >= 60)
+                    return std::nullopt;
+
+                auto const offset = static_cast<std::int16_t>(offset_hours*60 + offset_minutes);
+                result.offset_minutes = zone == '-' ? -offset : offset;
+
+                // Note: -00:00 means the offset is unknown, and isn't distinguished from +00:00 when rendered
+                result.exact &= offset != 0 || zone == '+';
+                position += 6;
+            } else {
                 return std::nullopt;
             }
-            //
-            if (month < 1 || month > 12 || day < 1 || day > getDaysOfMonth(year, month) || hour < 0 || hour >= 24 ||
-                minute < 0 || minute >= 60 || second < 0 || second >= 60) { // no leap seconds supported
+
+            if (position != text.size())
                 return std::nullopt;
-            }
 
-            std::tm tm{};
+            auto const days = daysFromCivil(year, month, day);
+            auto const seconds = ((days*24 + hour)*60 + minute)*60 + second;
+            result.timestamp = seconds*1000 + milliseconds - result.offset_minutes*kMillisPerMinute;
+            return result;
+        }
 
-            tm.tm_sec = second;
-            tm.tm_min = minute;
-            tm.tm_hour = hour;
-            tm.tm_mday = day;
-            tm.tm_mon = month-1;
-            tm.tm_year = year-1900;
+        static std::size_t format(
+                Text& text,
+                std::int64_t timestamp,
+                std::int16_t offset_minutes,
+                std::uint8_t fraction_digits,
+                bool utc
+        ) {
+            auto const local = timestamp + offset_minutes*kMillisPerMinute;
+            auto days = local/kMillisPerDay;
+            auto millis_of_day = local%kMillisPerDay;
+            if (millis_of_day < 0) {
+                days--;
+                millis_of_day += kMillisPerDay;
+            }
 
-            return tm;
-        };
+            std::int64_t year;
+            unsigned month, day;
+            civilFromDays(days, year, month, day);
 
-        static std::time_t timegm2(std::tm const *tm) {
-            if (tm == nullptr) return -1;
-            if (tm->tm_mon >= 12 || tm->tm_hour >= 24 || tm->tm_min >= 60 || tm->tm_sec >= 61) {
-                return -1;
-            }
-            if (getDaysOfMonth(tm->tm_year + 1900, tm->tm_mon + 1) == -1) {
-                return -1;
-            }
+            auto const seconds_of_day = static_cast<unsigned>(millis_of_day/1000);
+            auto const milliseconds = static_cast<unsigned>(millis_of_day%1000);
 
-            // get the day to the tm date since 1900-01-01 00:00:00 +0000, UTC instead of the Epoch (1970-01-01 00:00:00 +0000, UTC)
-            std::int64_t total_days = 0; //
-            int year = tm->tm_year + 1900;
+            char* out = text.data();
+            auto const put2 = [&](unsigned value) {
+                out[0] = static_cast<char>('0' + value/10);
+                out[1] = static_cast<char>('0' + value%10);
+                out += 2;
+            };
 
-            auto const year_since_epch = year - 1970;
+            // Note: matches printf("%04d") for years outside of 0-9999
+            if (year >= 0 && year <= 9999) {
+                put2(static_cast<unsigned>(year/100));
+                put2(static_cast<unsigned>(year%100));
+            } else {
+                auto magnitude = static_cast<std::uint64_t>(year < 0 ? -year : year);
+                std::size_t width = 4;
+                if (year < 0) {
+                    *out++ = '-';
+                    width = 3;
+                }
 
-            int leap_years = totalLeapYears(year - 1) - totalLeapYears(1970);
+                char digits[20];
+                std::size_t count = 0;
+                do {
+                    digits[count++] = static_cast<char>('0' + magnitude%10);
+                    magnitude /= 10;
+                } while (magnitude > 0);
+                while (count < width)
+                    digits[count++] = '0';
+                while (count > 0)
+                    *out++ = digits[--count];
+            }
 
-            total_days = year_since_epch*365 + leap_years;
+            *out++ = '-';
+            put2(month);
+            *out++ = '-';
+            put2(day);
+            *out++ = 'T';
+            put2(seconds_of_day/3600);
+            *out++ = ':';
+            put2(seconds_of_day/60%60);
+            *out++ = ':';
+            put2(seconds_of_day%60);
+
+            if (fraction_digits > 0) {
+                char const fraction[] = {
+                        static_cast<char>('0' + milliseconds/100),
+                        static_cast<char>('0' + milliseconds/10%10),
+                        static_cast<char>('0' + milliseconds%10)
+                };
+
+                *out++ = '.';
+                for (std::uint8_t i=0; i < fraction_digits; i++)
+                    *out++ = i < kMilliSecondSize ? fraction[i] : '0';
+            }
 
-            for (int i = 0; i < tm->tm_mon; ++i) {
-                total_days += getDaysOfMonth(year, i+1);
+            if (utc) {
+                *out++ = 'Z';
+            } else {
+                *out++ = offset_minutes < 0 ? '-' : '+';
+                auto const offset = static_cast<unsigned>(offset_minutes < 0 ? -offset_minutes : offset_minutes);
+                put2(offset/60);
+                *out++ = ':';
+                put2(offset%60);
             }
-            total_days += tm->tm_mday - 1;  // tm_mday is 1-31
-            std::int64_t total_hours = total_days*24 + tm->tm_hour;
-            std::time_t total_seconds = (total_hours*60 + tm->tm_min)*60 + tm->tm_sec;
 
-            return total_seconds /*+ kSecondsFrom1990*/;
+            return static_cast<std::size_t>(out - text.data());
         }
 
-        static bool isLeapYear(unsigned int year) {
-            return (year%4 == 0) && (!(year%100 == 0) || (year%400 == 0));
+        // Days since 1970-01-01 in the proleptic Gregorian calendar; see http://howardhinnant.github.io/date_algorithms.html
+        static constexpr std::int64_t daysFromCivil(std::int64_t year, unsigned month, unsigned day) {
+            year -= month <= 2;
+            auto const era = (year >= 0 ? year : year - 399)/400;
+            auto const year_of_era = static_cast<unsigned>(year - era*400);
+            auto const day_of_year = (153*(month > 2 ? month - 3 : month + 9) + 2)/5 + day - 1;
+            auto const day_of_era = year_of_era*365 + year_of_era/4 - year_of_era/100 + day_of_year;
+            return era*146097 + static_cast<std::int64_t>(day_of_era) - 719468;
         }
-        // month: 1-based
-        static int getDaysOfMonth(unsigned int year, int month) {
-            switch (month) {
-                case 1:
-                case 3:
-                case 5:
-                case 7:
-                case 8:
-                case 10:
-                case 12:
-                    return 31;
-                case 4:
-                case 6:
-                case 9:
-                case 11:
-                    return 30;
-                case 2:
-                    return isLeapYear(year) ? 29 : 28;
-                default:
-                    return -1;
-            }
+
+        static constexpr void civilFromDays(std::int64_t days, std::int64_t& year, unsigned& month, unsigned& day) {
+            days += 719468;
+            auto const era = (days >= 0 ? days : days - 146096)/146097;
+            auto const day_of_era = static_cast<unsigned>(days - era*146097);
+            auto const year_of_era = (day_of_era - day_of_era/1460 + day_of_era/36524 - day_of_era/146096)/365;
+            auto const day_of_year = day_of_era - (365*year_of_era + year_of_era/4 - year_of_era/100);
+            auto const shifted_month = (5*day_of_year + 2)/153;
+            day = day_of_year - (153*shifted_month + 2)/5 + 1;
+            month = shifted_month < 10 ? shifted_month + 3 : shifted_month - 9;
+            year = static_cast<std::int64_t>(year_of_era) + era*400 + (month <= 2);
         }
 
-        static int totalLeapYears(int year) {
-            return year/4 - year/100 + year/400;
+        static constexpr unsigned daysInMonth(unsigned year, unsigned month) {
+            constexpr unsigned char kDays[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+            auto const leap = (year%4 == 0) && (year%100 != 0 || year%400 == 0);
+            return kDays[(month - 1)%12] + (month == 2 && leap);
         }
+
     private:
-        std::optional<std::string> text_ = std::nullopt;
-        std::optional<SystemTimeMillis> timestamp_ = std::nullopt;
+        std::int64_t timestamp_ = 0;
+        std::int16_t offset_minutes_ = 0;
+        std::uint8_t fraction_digits_ = 0;
+        std::uint8_t flags_ = 0;
+
+        // Note: only set for text that can't be rendered from the fields above
+        std::shared_ptr<std::string const> text_ = nullptr;
     };
 }
 
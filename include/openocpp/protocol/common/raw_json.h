@@ -37,7 +37,13 @@ namespace chargelab::common {
     private:
         using text_type = std::string;
         using lazy_type = std::shared_ptr<detail::RawJsonInterface>;
-        using data_type = std::variant<text_type, lazy_type>;
+
+        // Text already known to hold a single well-formed JSON value; written out verbatim
+        struct validated_type {
+            std::string text;
+        };
+
+        using data_type = std::variant<text_type, lazy_type, validated_type>;
 
     public:
         RawJson() = default;
@@ -55,70 +61,19 @@ namespace chargelab::common {
         std::string data() const {
             if (std::holds_alternative<text_type>(data_)) {
                 return std::get<text_type>(data_);
+            } else if (std::holds_alternative<validated_type>(data_)) {
+                return std::get<validated_type>(data_).text;
             } else {
                 return std::get<lazy_type>(data_)->data();
             }
         }
 
         static bool read_json(json::JsonReader& reader, RawJson& value) {
-            stream::StringWriter stream;
-            json::JsonWriter writer {stream};
-
-            int object_stack = 0;
-            int array_stack = 0;
-            do {
-                auto const& next = reader.nextToken();
-                if (!next.has_value())
-                    return false;
+            validated_type result;
+            if (!reader.readRawValue(result.text))
+                return false;
 
-                auto const& token = next.value();
-                if (std::holds_alternative<json::StartObjectType>(token)) {
-                    writer.StartObject();
-                    object_stack++;
-                } else if (std::holds_alternative<json::EndObjectType>(token)) {
-                    writer.EndObject();
-                    object_stack--;
-                } else if (std::holds_alternative<json::StartArrayType>(token)) {
-                    writer.StartArray();
-                    array_stack++;
-                } else if (std::holds_alternative<json::EndArrayType>(token)) {
-                    writer.EndArray();
-                    array_stack--;
-                } else if (std::holds_alternative<json::NullType>(token)) {
-                    writer.Null();
-                } else if (std::holds_alternative<json::BoolType>(token)) {
-                    auto const& x = std::get<json::BoolType>(token);
-                    writer.Bool(x.value);
-                } else if (std::holds_alternative<json::IntType>(token)) {
-                    auto const& x = std::get<json::IntType>(token);
-                    writer.Int(x.value);
-                } else if (std::holds_alternative<json::UintType>(token)) {
-                    auto const& x = std::get<json::UintType>(token);
-                    writer.Uint(x.value);
-                } else if (std::holds_alternative<json::Int64Type>(token)) {
-                    auto const& x = std::get<json::Int64Type>(token);
-                    writer.Int64(x.value);
-                } else if (std::holds_alternative<json::Uint64Type>(token)) {
-                    auto const& x = std::get<json::Uint64Type>(token);
-                    writer.Uint64(x.value);
-                } else if (std::holds_alternative<json::DoubleType>(token)) {
-                    auto const& x = std::get<json::DoubleType>(token);
-                    writer.Double(x.value);
-                } else if (std::holds_alternative<json::RawNumberType>(token)) {
-                    auto const& x = std::get<json::RawNumberType>(token);
-                    writer.RawNumber(x.str, x.length);
-                } else if (std::holds_alternative<json::StringType>(token)) {
-                    auto const& x = std::get<json::StringType>(token);
-                    writer.String(x.str, x.length);
-                } else if (std::holds_alternative<json::KeyType>(token)) {
-                    auto const& x = std::get<json::KeyType>(token);
-                    writer.Key(x.str, x.length);
-                } else {
-                    CHARGELAB_LOG_MESSAGE(error) << "Unexpected JSON token";
-                }
-            } while (object_stack > 0 || array_stack > 0);
-
-            value.data_ = stream.str();
+            value.data_ = std::move(result);
             return true;
         }
 
@@ -128,7 +83,19 @@ namespace chargelab::common {
                 return;
             }
 
-            stream::StringReader stream {std::get<text_type>(value.data_)};
+            if (std::holds_alternative<validated_type>(value.data_)) {
+                writer.RawValue(std::get<validated_type>(value.data_).text);
+                return;
+            }
+
+            auto const& text = std::get<text_type>(value.data_);
+            if (json::is_valid_json(text)) {
+                writer.RawValue(text);
+                return;
+            }
+
+            CHARGELAB_LOG_MESSAGE(warning) << "Malformed raw JSON - writing recoverable tokens: " << text;
+            stream::StringReader stream {text};
             json::JsonReader reader {stream};
             while (true) {
                 auto const& next = reader.nextToken();
@@ -181,16 +148,16 @@ namespace chargelab::common {
 
         template <typename T>
         static RawJson from_value(T const& value) {
-            RawJson result {};
-
-            stream::StringReader stream {write_json_to_string(value)};
-            json::JsonReader reader {stream};
-
-            if (!read_json(reader, result)) {
-                CHARGELAB_LOG_MESSAGE(error) << "Failed creating RawJson from record";
-                return RawJson {};
-            }
+            return from_validated(write_json_to_string(value));
+        }
 
+        /**
+         * Wraps text that is known to hold a single well-formed JSON value, such as the output of
+         * write_json_to_string, so that it is written out as-is without being validated or re-tokenized.
+         */
+        static RawJson from_validated(std::string text) {
+            RawJson result {};
+            result.data_ = validated_type {std::move(text)};
             return result;
         }
 
@@ -4,6 +4,8 @@
 #include "openocpp/common/logging.h"
 
 #include <string>
+#include <string_view>
+#include <cstring>
 #include <exception>
 
 namespace chargelab {
@@ -32,7 +34,10 @@ namespace chargelab {
             allocated_ = false;
         }
 
-        SmallString(std::string const& text) {
+        SmallString(std::string const& text) : SmallString(std::string_view{text}) {
+        }
+
+        explicit SmallString(std::string_view text) {
             size_ = text.size();
             allocated_ = true;
 
@@ -81,6 +81,22 @@ namespace chargelab {
             }
         }
 
+        static bool read_binary(binary::Reader& reader, this_type& value) {
+            data_type data;
+            if (!binary::ReadValue<data_type>::read_binary(reader, data))
+                return false;
+
+            value.supplier_ = std::move(data);
+            return true;
+        }
+
+        static void write_binary(binary::Writer& writer, this_type const& value) {
+            writer.writeVarint(value.size());
+            value.visit([&](auto const& element) {
+                binary::WriteValue<T>::write_binary(writer, element);
+            });
+        }
+
         static bool include_field(this_type const& value) {
             return !Optional || value.size() > 0;
         }
@@ -29,6 +29,7 @@
 #include "openocpp/protocol/ocpp1_6/messages/trigger_message.h"
 #include "openocpp/protocol/ocpp1_6/messages/unlock_connector.h"
 #include "openocpp/protocol/ocpp1_6/messages/update_firmware.h"
+#include "openocpp/protocol/ocpp1_6/types/action_id.h"
 #include "openocpp/protocol/ocpp1_6/types/call_result.h"
 #include "openocpp/protocol/ocpp1_6/handlers/ocpp_remote.h"
 
@@ -52,6 +53,14 @@ namespace chargelab::ocpp1_6 {
             (void)payload;
             return std::nullopt;
         }
+
+        /**
+         * Calls are only offered to the handlers that return true here for their action. Defaults to every action, so
+         * handlers that don't declare the requests they implement keep receiving all calls.
+         */
+        virtual bool handlesRequest(ocpp1_6::ActionId const&) const {
+            return true;
+        }
     };
 }
 
@@ -29,6 +29,7 @@
 #include "openocpp/protocol/ocpp1_6/messages/trigger_message.h"
 #include "openocpp/protocol/ocpp1_6/messages/unlock_connector.h"
 #include "openocpp/protocol/ocpp1_6/messages/update_firmware.h"
+#include "openocpp/protocol/ocpp1_6/types/action_id.h"
 #include "openocpp/protocol/ocpp1_6/types/call_result.h"
 
 #include <variant>
@@ -42,6 +43,14 @@ namespace chargelab::ocpp1_6 {
 #undef CHARGELAB_RESPONSE_HANDLER_TEMPLATE
 
         virtual void onCallRsp(std::string const&, ocpp1_6::ResponseMessage<common::RawJson> const&) {}
+
+        /**
+         * Responses are delivered to the module that sent the call; return true here to also receive responses to
+         * calls of this action sent by other modules.
+         */
+        virtual bool observesResponses(ocpp1_6::ActionId const&) const {
+            return false;
+        }
     };
 }
 
@@ -17,9 +17,12 @@
 #include "openocpp/helpers/string.h"
 #include "openocpp/common/settings.h"
 
+#include <array>
 #include <memory>
 #include <utility>
 #include <random>
+#include <vector>
+#include <algorithm>
 
 namespace chargelab::ocpp1_6 {
     namespace detail {
@@ -28,12 +31,18 @@ namespace chargelab::ocpp1_6 {
             ActionId action_id;
             SteadyPointMillis timestamp;
 
+            // Note: not serialized; the response handler of the module that sent the call, if it has one
+            AbstractResponseHandler* owner = nullptr;
+
             CHARGELAB_JSON_INTRUSIVE(PendingCall, unique_id, action_id, timestamp)
         };
     }
 
     class OcppMessageHandler {
     private:
+        template <typename T>
+        using ActionTable = std::array<std::vector<T*>, CHARGELAB_NUM_ARGS(CHARGELAB_OCPP_1_6_ACTION_IDS) + 1>;
+
         static constexpr const int kMaxMessageProcessedPerStep = 4;
 
     public:
@@ -84,23 +93,60 @@ namespace chargelab::ocpp1_6 {
                     registration_complete_,
                     [this](std::string const& unique_id, ActionId const& action) {
                         auto const now = system_->steadyClockNow();
-                        if (last_call_.has_value()) {
-                            auto const elapsed_seconds = (now - last_call_->timestamp)/1000;
-                            if (elapsed_seconds < settings_->DefaultMessageTimeout.getValue()) {
-                                CHARGELAB_LOG_MESSAGE(info) << "Call already in process - blocking call '" << action << "' waiting for: " << last_call_;
-                                return false;
-                            }
-
-                            CHARGELAB_LOG_MESSAGE(info) << "Call already in process but timeout elapsed - allowing call '" << action << "' waiting for: " << last_call_;
+                        pending_calls_.erase(
+                                std::remove_if(
+                                        pending_calls_.begin(),
+                                        pending_calls_.end(),
+                                        [&](detail::PendingCall const& call) {
+                                            auto const elapsed_seconds = (now - call.timestamp)/1000;
+                                            if (elapsed_seconds < settings_->DefaultMessageTimeout.getValue())
+                                                return false;
+
+                                            CHARGELAB_LOG_MESSAGE(info) << "Call timeout elapsed - no longer waiting for: " << call;
+                                            return true;
+                                        }
+                                ),
+                                pending_calls_.end()
+                        );
+
+                        auto const max_pending_calls = (std::size_t)std::max(settings_->MaxInFlightMessages.getValue(), 1);
+                        if (pending_calls_.size() >= max_pending_calls) {
+                            CHARGELAB_LOG_MESSAGE(info) << "Calls already in process - blocking call '" << action << "' waiting for: " << pending_calls_;
+                            return false;
                         }
 
-                        last_call_ = detail::PendingCall {unique_id, action, now};
+                        pending_calls_.push_back(detail::PendingCall {unique_id, action, now, sending_owner_});
                         return true;
                     }
             };
 
-            for (auto& x : services_)
-                x->runStep(remote);
+            for (std::size_t i=0; i < services_.size(); i++) {
+                sending_owner_ = service_owners_[i];
+                services_[i]->runStep(remote);
+            }
+
+            sending_owner_ = nullptr;
+        }
+
+        /**
+         * Returns the earliest time by which any module needs runStep() to be called again, or std::nullopt if none
+         * of the modules have timed work pending. Only the handler matching the websocket subprotocol reports a
+         * wakeup, since the modules are shared between handlers.
+         */
+        std::optional<SteadyPointMillis> nextWakeup(std::shared_ptr<WebsocketInterface> const& websocket) {
+            if (websocket == nullptr)
+                return std::nullopt;
+
+            auto const subprotocol = websocket->getSubprotocol();
+            if (!subprotocol.has_value() || !string::EqualsIgnoreCaseAscii(subprotocol.value(), "ocpp1.6"))
+                return std::nullopt;
+
+            auto const now = system_->steadyClockNow();
+            std::optional<SteadyPointMillis> result = std::nullopt;
+            for (auto& x : pure_services_)
+                chargelab::detail::EarliestWakeup(result, x->nextWakeup(now));
+
+            return result;
         }
 
         template <typename T, typename... Args>
@@ -130,16 +176,26 @@ namespace chargelab::ocpp1_6 {
     private:
         void updatePointers() {
             services_.clear();
-            request_handlers_.clear();
-            response_handlers_.clear();
+            service_owners_.clear();
             pure_services_.clear();
+            for (auto& x : request_handlers_)
+                x.clear();
+            for (auto& x : response_observers_)
+                x.clear();
 
             for (auto const& x : modules_) {
                 if (x != nullptr) {
                     auto implementations = x->getImplementations();
-                    addIfNotNull(services_, implementations.ocpp1_6.service);
-                    addIfNotNull(request_handlers_, implementations.ocpp1_6.request_handler);
-                    addIfNotNull(response_handlers_, implementations.ocpp1_6.response_handler);
+                    if (implementations.ocpp1_6.service != nullptr) {
+                        services_.push_back(implementations.ocpp1_6.service);
+                        service_owners_.push_back(implementations.ocpp1_6.response_handler);
+                    }
+                    addForActions(request_handlers_, implementations.ocpp1_6.request_handler, [](auto const& ptr, ActionId const& action_id) {
+                        return ptr->handlesRequest(action_id);
+                    });
+                    addForActions(response_observers_, implementations.ocpp1_6.response_handler, [](auto const& ptr, ActionId const& action_id) {
+                        return ptr->observesResponses(action_id);
+                    });
                     addIfNotNull(pure_services_, implementations.pure_service);
                 }
             }
@@ -189,8 +245,8 @@ namespace chargelab::ocpp1_6 {
         void onMessage(WebsocketInterface& websocket, std::string const& message) {
             CHARGELAB_LOG_MESSAGE(debug) << "Received OCPP message: " << message;
 
-            stream::StringReader stream {message};
-            json::JsonReader reader {stream};
+            // Note: parsed in place in a copy, so the received text stays intact for the diagnostics below
+            json::JsonReader reader {message, frame_buffer_};
             if (!json::expect_type<json::StartArrayType>(reader)) {
                 CHARGELAB_LOG_MESSAGE(warning) << "Bad message payload - expected array: " << message;
                 dispatchUnexpectedMessage(message);
@@ -211,8 +267,9 @@ namespace chargelab::ocpp1_6 {
 
                 case MessageType::kCall:
                     {
-                        std::string unique_id;
-                        if (!json::ReadValue<std::string>::read_json(reader, unique_id)) {
+                        // Note: borrowed from the frame buffer; only used while the call is dispatched
+                        std::string_view unique_id;
+                        if (!json::ReadValue<std::string_view>::read_json(reader, unique_id)) {
                             CHARGELAB_LOG_MESSAGE(warning) << "Bad message payload - missing or bad unique ID: " << message;
                             dispatchUnexpectedMessage(message);
                             return;
@@ -245,13 +302,13 @@ namespace chargelab::ocpp1_6 {
                                         websocket,                                                                                             \
                                         action_id,                                                                                             \
                                         unique_id,                                                                                             \
-                                        common::RawJson::from_value_lazy(parsed),                                                              \
+                                        [&]() {return common::RawJson::from_value_lazy(parsed);},                                              \
                                         [](                                                                                                    \
                                                 AbstractRequestHandler* handler,                                                               \
                                                 bool first,                                                                                    \
                                                 TYPE ## Req const& req,                                                                        \
                                                 WebsocketInterface& websocket,                                                                 \
-                                                std::string const& unique_id                                                                   \
+                                                std::string_view unique_id                                                                     \
                                         ) {                                                                                                    \
                                             auto const response = handler->on ## TYPE ## Req(req);                                             \
                                             if (response.has_value()) {                                                                        \
@@ -289,19 +346,15 @@ namespace chargelab::ocpp1_6 {
                             return;
                         }
 
-                        std::optional<ActionId> action_id;
-                        if (last_call_.has_value() && string::EqualsIgnoreCaseAscii(last_call_->unique_id, unique_id)) {
-                            action_id = last_call_->action_id;
-                            last_call_ = std::nullopt;
-                        }
+                        auto const call = takePendingCall(unique_id);
 
-                        if (!action_id.has_value()) {
+                        if (!call.has_value()) {
                             CHARGELAB_LOG_MESSAGE(warning) << "Response ID not found in pending call list - treating as unexpected message: " << unique_id;
                             dispatchUnexpectedMessage(message);
                             return;
                         }
 
-                        switch (action_id.value()) {
+                        switch (call->action_id) {
                             default:
                                 CHARGELAB_LOG_MESSAGE(warning) << "Bad message payload - bad action ID: " << message;
                                 dispatchUnexpectedMessage(message);
@@ -317,12 +370,12 @@ namespace chargelab::ocpp1_6 {
                                     return;                                                                                                 \
                                 }                                                                                                           \
                                                                                                                                             \
-                                for (auto& ptr : response_handlers_) {                                                                      \
-                                    if (ptr != nullptr) {                                                                                   \
-                                        ptr->on ## TYPE ## Rsp(unique_id, parsed);                                                          \
-                                        ptr->onCallRsp(unique_id, common::RawJson::from_value_lazy(parsed));                                \
-                                    }                                                                                                       \
-                                }                                                                                                           \
+                                ResponseMessage<common::RawJson> const payload {common::RawJson::from_value_lazy(parsed)};                  \
+                                ResponseMessage<TYPE ## Rsp> const response {std::move(parsed)};                                            \
+                                dispatchResponse(call.value(), [&](AbstractResponseHandler* ptr) {                                          \
+                                    ptr->on ## TYPE ## Rsp(unique_id, response);                                                            \
+                                    ptr->onCallRsp(unique_id, payload);                                                                     \
+                                });                                                                                                         \
                                 break;                                                                                                      \
                             }
                             CHARGELAB_PASTE(CHARGELAB_ON_CALL_RESPONSE_IMPL, CHARGELAB_OCPP_1_6_ACTION_IDS)
@@ -373,18 +426,14 @@ namespace chargelab::ocpp1_6 {
                         auto const error = CallError {error_code, description, details};
                         CHARGELAB_LOG_MESSAGE(debug) << "Received OCPP error: id=" << unique_id << ", error=" << error;
 
-                        std::optional<ActionId> action_id;
-                        if (last_call_.has_value() && string::EqualsIgnoreCaseAscii(last_call_->unique_id, unique_id)) {
-                            action_id = last_call_->action_id;
-                            last_call_ = std::nullopt;
-                        }
+                        auto const call = takePendingCall(unique_id);
 
-                        if (!action_id.has_value()) {
+                        if (!call.has_value()) {
                             dispatchUnexpectedMessage(message);
                             return;
                         }
 
-                        switch (action_id.value()) {
+                        switch (call->action_id) {
                             default:
                                 CHARGELAB_LOG_MESSAGE(warning) << "Bad message payload - bad action ID: " << message;
                                 dispatchUnexpectedMessage(message);
@@ -393,22 +442,20 @@ namespace chargelab::ocpp1_6 {
 #define CHARGELAB_ON_CALL_ERROR_IMPL(TYPE)                                                                                                  \
                             case ActionId::k ## TYPE:                                                                                       \
                             {                                                                                                               \
-                                for (auto& ptr : response_handlers_) {                                                                      \
-                                    if (ptr != nullptr) {                                                                                   \
-                                        ptr->on ## TYPE ## Rsp(unique_id, error);                                                           \
-                                    }                                                                                                       \
-                                }                                                                                                           \
+                                ResponseMessage<TYPE ## Rsp> const response {error};                                                        \
+                                dispatchResponse(call.value(), [&](AbstractResponseHandler* ptr) {                                          \
+                                    ptr->on ## TYPE ## Rsp(unique_id, response);                                                            \
+                                });                                                                                                         \
                                 break;                                                                                                      \
                             }
                             CHARGELAB_PASTE(CHARGELAB_ON_CALL_ERROR_IMPL, CHARGELAB_OCPP_1_6_ACTION_IDS)
 #undef CHARGELAB_ON_CALL_ERROR_IMPL
                         }
 
-                        for (auto& ptr : response_handlers_) {
-                            if (ptr != nullptr) {
-                                ptr->onCallRsp(unique_id, error);
-                            }
-                        }
+                        ResponseMessage<common::RawJson> const payload {error};
+                        dispatchResponse(call.value(), [&](AbstractResponseHandler* ptr) {
+                            ptr->onCallRsp(unique_id, payload);
+                        });
 
                         return;
                     }
@@ -416,7 +463,7 @@ namespace chargelab::ocpp1_6 {
         }
 
         template<typename T>
-        static void sendResponse(WebsocketInterface& websocket, std::string const& unique_id, ResponseToRequest<T> const& result) {
+        static void sendResponse(WebsocketInterface& websocket, std::string_view unique_id, ResponseToRequest<T> const& result) {
             if (std::holds_alternative<T>(result)) {
                 websocket.sendCustom([&](ByteWriterInterface& stream) {
                     json::JsonWriter writer {stream};
@@ -429,11 +476,11 @@ namespace chargelab::ocpp1_6 {
             } else if (std::holds_alternative<CallError>(result)) {
                 sendError(websocket, unique_id, std::get<CallError>(result));
             } else {
-                std::get<CustomResponse>(result)(websocket, unique_id);
+                std::get<CustomResponse>(result)(websocket, std::string {unique_id});
             }
         }
 
-        static void sendError(WebsocketInterface& websocket, std::string const& unique_id, CallError const& error) {
+        static void sendError(WebsocketInterface& websocket, std::string_view unique_id, CallError const& error) {
             websocket.sendCustom([&](ByteWriterInterface& stream) {
                 json::JsonWriter writer {stream};
                 writer.StartArray();
@@ -447,33 +494,48 @@ namespace chargelab::ocpp1_6 {
         }
 
 
-        template <typename F, typename... Args>
+        /**
+         * Offers the call to the handlers that implement its action, in module order, until one of them responds;
+         * for actions that allow fallthrough the remaining handlers are still notified. The generic payload is only
+         * built if a handler needs it.
+         */
+        template <typename P, typename F, typename... Args>
         void dispatchCall(
                 WebsocketInterface& websocket,
                 ActionId const& action_id,
-                std::string const& unique_id,
-                common::RawJson const& payload,
+                std::string_view unique_id,
+                P&& make_payload,
                 F&& function,
                 Args&&... args
         ) {
+            std::optional<common::RawJson> payload;
+            auto const get_payload = [&]() -> common::RawJson const& {
+                if (!payload.has_value())
+                    payload = make_payload();
+
+                return payload.value();
+            };
+
             bool responded = false;
-            for (auto& ptr : request_handlers_) {
-                if (ptr != nullptr) {
-                    if (!responded) {
-                        responded = function(ptr, true, std::forward<Args>(args)...);
-                    } else if (allowFallthrough(action_id)) {
-                        function(ptr, false, std::forward<Args>(args)...);
-                    }
+            auto const fallthrough = allowFallthrough(action_id);
+            for (auto const& ptr : request_handlers_[action_id]) {
+                if (responded && !fallthrough)
+                    break;
 
-                    if (!responded) {
-                        auto response = ptr->onCall(action_id, payload);
-                        if (response.has_value()) {
-                            sendResponse(websocket, unique_id, response.value());
-                            responded = true;
-                        }
-                    } else if (allowFallthrough(action_id)) {
-                        ptr->onCall(action_id, payload);
+                if (!responded) {
+                    responded = function(ptr, true, args...);
+                } else {
+                    function(ptr, false, args...);
+                }
+
+                if (!responded) {
+                    auto response = ptr->onCall(action_id, get_payload());
+                    if (response.has_value()) {
+                        sendResponse(websocket, unique_id, response.value());
+                        responded = true;
                     }
+                } else if (fallthrough) {
+                    ptr->onCall(action_id, get_payload());
                 }
             }
 
@@ -486,6 +548,35 @@ namespace chargelab::ocpp1_6 {
             }
         }
 
+        // Note: the pending list is bounded by MaxInFlightMessages (typically a single call), so a scan is cheaper
+        // than maintaining an index
+        std::optional<detail::PendingCall> takePendingCall(std::string const& unique_id) {
+            for (auto it = pending_calls_.begin(); it != pending_calls_.end(); ++it) {
+                if (string::EqualsIgnoreCaseAscii(it->unique_id, unique_id)) {
+                    auto call = std::move(*it);
+                    pending_calls_.erase(it);
+                    return call;
+                }
+            }
+
+            return std::nullopt;
+        }
+
+        /**
+         * Delivers a response to the module that sent the call, followed by the modules observing responses to that
+         * action.
+         */
+        template <typename F>
+        void dispatchResponse(detail::PendingCall const& call, F&& function) {
+            if (call.owner != nullptr)
+                function(call.owner);
+
+            for (auto const& ptr : response_observers_[call.action_id]) {
+                if (ptr != call.owner)
+                    function(ptr);
+            }
+        }
+
         bool allowFallthrough(ActionId const& action_id) {
             switch (action_id) {
                 default:
@@ -513,6 +604,17 @@ namespace chargelab::ocpp1_6 {
             }
         }
 
+        template <typename T, typename F>
+        static void addForActions(ActionTable<T>& table, T* x, F&& predicate) {
+            if (x == nullptr)
+                return;
+
+            for (std::size_t i=0; i < table.size(); i++) {
+                if (i != ActionId::kValueNotFoundInEnum && predicate(x, (ActionId::Value)i))
+                    table[i].push_back(x);
+            }
+        }
+
     private:
         std::shared_ptr<Settings> settings_;
         std::shared_ptr<SystemInterface> system_;
@@ -521,11 +623,18 @@ namespace chargelab::ocpp1_6 {
 
         std::vector<std::shared_ptr<void>> wrappers_;
         std::vector<AbstractService*> services_;
-        std::vector<AbstractRequestHandler*> request_handlers_;
-        std::vector<AbstractResponseHandler*> response_handlers_;
+        std::vector<AbstractResponseHandler*> service_owners_;
         std::vector<chargelab::detail::PureServiceInterface*> pure_services_;
 
-        std::optional<detail::PendingCall> last_call_ = std::nullopt;
+        // Note: indexed by action; the handlers that implement each request and the observers of each response
+        ActionTable<AbstractRequestHandler> request_handlers_;
+        ActionTable<AbstractResponseHandler> response_observers_;
+
+        std::vector<detail::PendingCall> pending_calls_;
+        AbstractResponseHandler* sending_owner_ = nullptr;
+
+        // Scratch space for parsing inbound frames; its capacity is kept between frames
+        std::string frame_buffer_;
     };
 }
 
@@ -74,7 +74,7 @@ namespace chargelab::ocpp1_6 {
             return executeCall(T::kActionId, req);
         }
 
-        bool sendCall(std::string const& unique_id, ActionId const& action, std::string const& payload) {
+        bool sendCall(std::string const& unique_id, ActionId const& action, common::RawJson const& payload) {
             if (!websocket_interface_.isConnected())
                 return false;
 
@@ -99,7 +99,7 @@ namespace chargelab::ocpp1_6 {
                 writer.Int((int)MessageType::kCall);
                 writer.String(unique_id);
                 writer.String(action.to_string()),
-                json::WriteValue<common::RawJson>::write_json(writer, {payload});
+                json::WriteValue<common::RawJson>::write_json(writer, payload);
                 writer.EndArray();
             });
             return true;
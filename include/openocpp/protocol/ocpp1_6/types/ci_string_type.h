@@ -18,6 +18,8 @@ namespace chargelab::ocpp1_6 {
         CaseInsensitiveString(std::string value) : value_(std::move(value)) {}
         CaseInsensitiveString(const this_type& other) = default;
         this_type& operator=(const this_type& other) = default;
+        CaseInsensitiveString(this_type&& other) noexcept = default;
+        this_type& operator=(this_type&& other) noexcept = default;
 
         [[nodiscard]] std::string const& value() const {
             return value_;
@@ -31,6 +33,14 @@ namespace chargelab::ocpp1_6 {
             json::WritePrimitive<std::string>::write_json(writer, value.value_);
         }
 
+        static bool read_binary(binary::Reader& reader, this_type& value) {
+            return reader.readString(value.value_);
+        }
+
+        static void write_binary(binary::Writer& writer, this_type const& value) {
+            writer.writeString(value.value_);
+        }
+
         bool operator==(this_type const& rhs) const {
             return string::EqualsIgnoreCaseAscii(value_, rhs.value_);
         }
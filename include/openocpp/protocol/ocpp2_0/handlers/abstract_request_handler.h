@@ -65,6 +65,7 @@
 #include "openocpp/protocol/ocpp2_0/messages/unlock_connector.h"
 #include "openocpp/protocol/ocpp2_0/messages/unpublish_firmware.h"
 #include "openocpp/protocol/ocpp2_0/messages/update_firmware.h"
+#include "openocpp/protocol/ocpp2_0/types/action_id.h"
 #include "openocpp/protocol/ocpp2_0/types/call_result.h"
 #include "openocpp/protocol/ocpp2_0/handlers/ocpp_remote.h"
 
@@ -88,6 +89,14 @@ namespace chargelab::ocpp2_0 {
             (void)payload;
             return std::nullopt;
         }
+
+        /**
+         * Calls are only offered to the handlers that return true here for their action. Defaults to every action, so
+         * handlers that don't declare the requests they implement keep receiving all calls.
+         */
+        virtual bool handlesRequest(ocpp2_0::ActionId const&) const {
+            return true;
+        }
     };
 }
 
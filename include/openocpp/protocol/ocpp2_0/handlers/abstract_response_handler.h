@@ -65,6 +65,7 @@
 #include "openocpp/protocol/ocpp2_0/messages/unlock_connector.h"
 #include "openocpp/protocol/ocpp2_0/messages/unpublish_firmware.h"
 #include "openocpp/protocol/ocpp2_0/messages/update_firmware.h"
+#include "openocpp/protocol/ocpp2_0/types/action_id.h"
 #include "openocpp/protocol/ocpp2_0/types/call_result.h"
 
 #include <variant>
@@ -78,6 +79,14 @@ namespace chargelab::ocpp2_0 {
 #undef CHARGELAB_RESPONSE_HANDLER_TEMPLATE
 
         virtual void onCallRsp(std::string const&, ocpp2_0::ResponseMessage<common::RawJson> const&) {}
+
+        /**
+         * Responses are delivered to the module that sent the call; return true here to also receive responses to
+         * calls of this action sent by other modules.
+         */
+        virtual bool observesResponses(ocpp2_0::ActionId const&) const {
+            return false;
+        }
     };
 }
 
@@ -110,7 +110,7 @@ namespace chargelab::ocpp2_0 {
             return executeCall(T::kActionId, req);
         }
 
-        bool sendCall(std::string const& unique_id, ActionId const& action, std::string const& payload) {
+        bool sendCall(std::string const& unique_id, ActionId const& action, common::RawJson const& payload) {
             if (!websocket_interface_.isConnected())
                 return false;
 
@@ -136,7 +136,7 @@ namespace chargelab::ocpp2_0 {
                 writer.Int(MessageType::kCall);
                 writer.String(unique_id);
                 writer.String(action.to_string());
-                json::WriteValue<common::RawJson>::write_json(writer,  common::RawJson{payload});
+                json::WriteValue<common::RawJson>::write_json(writer, payload);
                 writer.EndArray();
             });
             return true;
@@ -18,17 +18,19 @@ namespace chargelab::ocpp2_0 {
         IdentifierStringPrimitive() {}
         IdentifierStringPrimitive(const this_type& other) = default;
         this_type& operator=(const this_type& other) = default;
+        IdentifierStringPrimitive(this_type&& other) noexcept = default;
+        this_type& operator=(this_type&& other) noexcept = default;
 
         template <int N>
         IdentifierStringPrimitive(char const (&literal)[N]) : value_(literal) {}
         IdentifierStringPrimitive(std::string const& text) : value_(text) {}
 
         static bool read_json(json::JsonReader &reader, this_type &value) {
-            std::string text;
-            if (!json::ReadValue<std::string>::read_json(reader, text))
+            std::string_view text;
+            if (!json::ReadPrimitive<std::string_view>::read_transient(reader, text))
                 return false;
 
-            value.value_ = std::move(text);
+            value.value_ = SmallString {text};
             return true;
         }
 
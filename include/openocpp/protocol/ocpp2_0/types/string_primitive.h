@@ -17,17 +17,19 @@ namespace chargelab::ocpp2_0 {
         StringPrimitive() {}
         StringPrimitive(const this_type& other) = default;
         this_type& operator=(const this_type& other) = default;
+        StringPrimitive(this_type&& other) noexcept = default;
+        this_type& operator=(this_type&& other) noexcept = default;
 
         template <int N>
         StringPrimitive(char const (&literal)[N]) : value_(literal) {}
         StringPrimitive(std::string const& text) : value_(text) {}
 
         static bool read_json(json::JsonReader &reader, this_type &value) {
-            std::string text;
-            if (!json::ReadValue<std::string>::read_json(reader, text))
+            std::string_view text;
+            if (!json::ReadPrimitive<std::string_view>::read_transient(reader, text))
                 return false;
 
-            value.value_ = std::move(text);
+            value.value_ = SmallString {text};
             return true;
         }
 
@@ -35,6 +37,19 @@ namespace chargelab::ocpp2_0 {
             json::WritePrimitive<std::string>::write_json(writer, value.value_.value());
         }
 
+        static bool read_binary(binary::Reader& reader, this_type& value) {
+            std::string text;
+            if (!reader.readString(text))
+                return false;
+
+            value.value_ = std::move(text);
+            return true;
+        }
+
+        static void write_binary(binary::Writer& writer, this_type const& value) {
+            writer.writeString(value.value_.value());
+        }
+
         bool operator==(const this_type &rhs) const {
             return value_ == rhs.value_;
         }